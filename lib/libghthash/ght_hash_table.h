@@ -113,12 +113,16 @@ typedef uint32_t ght_uint32_t;
  * CF_GHT_DATA - Type of data
  */
 
-// Create funge space storage.
+// Create funge space storage. Keys are the top left corner of a tile.
 #define CF_GHT_VAR fspace
 #define CF_GHT_KEY fungeSpaceHashKey
-#define CF_GHT_DATA funge_cell
+#define CF_GHT_DATA fungeSpaceTile *
 
-#include "ght_hash_table_priv.h"
+#ifdef CFUN_OPEN_HASH
+#  include "ght_open_table_priv.h"
+#else
+#  include "ght_hash_table_priv.h"
+#endif
 
 #undef CF_GHT_VAR
 #undef CF_GHT_KEY
@@ -130,7 +134,11 @@ typedef uint32_t ght_uint32_t;
 #  define CF_GHT_KEY funge_cell
 #  define CF_GHT_DATA funge_unsigned_cell
 
-#  include "ght_hash_table_priv.h"
+#  ifdef CFUN_OPEN_HASH
+#    include "ght_open_table_priv.h"
+#  else
+#    include "ght_hash_table_priv.h"
+#  endif
 
 #  undef CF_GHT_VAR
 #  undef CF_GHT_KEY
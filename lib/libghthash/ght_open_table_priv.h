@@ -0,0 +1,171 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Declarations for the open addressing variant of the hash tables, used
+ * instead of ght_hash_table_priv.h when CFUN_OPEN_HASH is defined.
+ *
+ * The API is the same as for the chained tables, so funge-space.c doesn't
+ * need to care which one it gets. Differences:
+ *  - Lookups never write to the table.
+ *  - The table always grows when needed, set_rehash() is ignored.
+ *  - Growing is incremental: the old slots are kept next to the new ones and
+ *    each insert() moves a bounded number of entries over, so no single
+ *    insert() has to rehash the whole table.
+ *  - Pointers returned by get(), first() and next() are only valid until the
+ *    next insert() (which may move entries).
+ *  - remove() is allowed during iteration, insert() is not.
+ *
+ * Included once per variant, with CF_GHT_VAR, CF_GHT_KEY and CF_GHT_DATA set.
+ */
+
+/**
+ * One slot in the table.
+ */
+typedef struct CF_GHT_STRUCT(CF_GHT_VAR, hash_slot) {
+	CF_GHT_KEY key;
+	CF_GHT_DATA data;
+} CF_GHT_NAME(CF_GHT_VAR, hash_slot_t);
+
+/**
+ * The iterator, just a position in the slots (the old slots of an
+ * unfinished resize count as coming after the new ones).
+ */
+typedef struct {
+	struct CF_GHT_STRUCT(CF_GHT_VAR, hash_table) *p_ht;
+	size_t i_slot;
+} CF_GHT_NAME(CF_GHT_VAR, iterator_t);
+
+/**
+ * The hash table structure.
+ *
+ * Slots are grouped 16 at a time, each slot has a control byte telling if it
+ * is empty, deleted or, if used, 7 bits of the hash of its key. A lookup
+ * compares the control bytes of a whole group at once, and only looks at the
+ * keys of slots where those 7 bits match.
+ */
+typedef struct CF_GHT_STRUCT(CF_GHT_VAR, hash_table) {
+	size_t i_items;                    /**< The current number of items in the table */
+	size_t i_size;                     /**< The number of slots */
+	bool i_automatic_rehash;           /**< Ignored, the table always grows when needed */
+
+	/* private: */
+	size_t i_group_mask;               /* Number of groups - 1 */
+	size_t i_growth_left;              /* Empty slots that may be used before growing */
+	unsigned char *p_ctrl;             /* Control bytes, one per slot */
+	CF_GHT_NAME(CF_GHT_VAR, hash_slot_t) *p_slots;
+
+	/* Slots from before an unfinished resize, p_old_ctrl is NULL if there is
+	 * none. Entries in them are looked up after the ones in p_slots. */
+	size_t i_old_size;
+	size_t i_old_group_mask;
+	size_t i_migrated;                 /* Old slots before this one have been moved */
+	unsigned char *p_old_ctrl;
+	CF_GHT_NAME(CF_GHT_VAR, hash_slot_t) *p_old_slots;
+} CF_GHT_NAME(CF_GHT_VAR, hash_table_t);
+
+/**
+ * Create a new hash table.
+ * @param i_size The initial number of slots, rounded up to a power of two.
+ * @return A pointer to the table or NULL if allocation failed.
+ */
+FUNGE_ATTR_FAST
+CF_GHT_NAME(CF_GHT_VAR, hash_table_t) *CF_GHT_NAME(CF_GHT_VAR, create)(size_t i_size);
+
+/**
+ * Kept for compatibility with the chained tables, does nothing.
+ */
+FUNGE_ATTR_FAST
+void CF_GHT_NAME(CF_GHT_VAR, set_rehash)(CF_GHT_NAME(CF_GHT_VAR, hash_table_t) *p_ht,
+                                         bool b_rehash);
+
+/**
+ * Insert an entry into the hash table.
+ * @return 0 if the entry was inserted, -1 if the key was already there.
+ */
+FUNGE_ATTR_FAST
+int CF_GHT_NAME(CF_GHT_VAR, insert)(
+    CF_GHT_NAME(CF_GHT_VAR, hash_table_t) * restrict p_ht,
+    CF_GHT_DATA p_entry_data,
+    const CF_GHT_KEY * restrict p_key_data);
+
+/**
+ * Replace the data of an existing entry.
+ * @return The old data, or the variant's not found value if the key isn't
+ * in the table (nothing is inserted then).
+ */
+FUNGE_ATTR_FAST
+CF_GHT_DATA CF_GHT_NAME(CF_GHT_VAR, replace)(
+    CF_GHT_NAME(CF_GHT_VAR, hash_table_t) * restrict p_ht,
+    CF_GHT_DATA p_entry_data,
+    const CF_GHT_KEY * restrict p_key_data);
+
+/**
+ * Look up an entry.
+ * @return A pointer to the data of the entry, or NULL if there is none.
+ */
+FUNGE_ATTR_FAST
+CF_GHT_DATA *CF_GHT_NAME(CF_GHT_VAR, get)(CF_GHT_NAME(CF_GHT_VAR, hash_table_t) * restrict p_ht,
+        const CF_GHT_KEY * restrict p_key_data);
+
+/**
+ * Remove an entry.
+ * @return The data of the removed entry, or the variant's not found value.
+ */
+FUNGE_ATTR_FAST
+CF_GHT_DATA CF_GHT_NAME(CF_GHT_VAR, remove)(
+    CF_GHT_NAME(CF_GHT_VAR, hash_table_t) * restrict p_ht,
+    const CF_GHT_KEY * restrict p_key_data);
+
+/**
+ * Start iterating over the table (in no particular order).
+ * @return A pointer to the data of the first entry, or NULL if the table is
+ * empty. *pp_key is set to point to the key.
+ */
+FUNGE_ATTR_FAST
+void *CF_GHT_NAME(CF_GHT_VAR, first)(CF_GHT_NAME(CF_GHT_VAR, hash_table_t) *p_ht,
+                                     CF_GHT_NAME(CF_GHT_VAR, iterator_t) *p_iterator,
+                                     const CF_GHT_KEY **pp_key);
+
+/**
+ * Get the next entry of an iteration started with first().
+ * @return A pointer to the data, or NULL when there are no more entries.
+ */
+FUNGE_ATTR_FAST
+void *CF_GHT_NAME(CF_GHT_VAR, next)(
+    CF_GHT_NAME(CF_GHT_VAR, iterator_t) *p_iterator,
+    const CF_GHT_KEY **pp_key);
+
+/**
+ * Resize the table to at least i_size slots (and at least large enough to
+ * hold the current entries). Unlike the automatic growing this is done all
+ * at once.
+ */
+FUNGE_ATTR_FAST
+void CF_GHT_NAME(CF_GHT_VAR, rehash)(CF_GHT_NAME(CF_GHT_VAR, hash_table_t) *p_ht,
+                                     size_t i_size);
+
+/**
+ * Free the table. The data of the entries is not touched.
+ */
+FUNGE_ATTR_FAST
+void CF_GHT_NAME(CF_GHT_VAR, finalize)(CF_GHT_NAME(CF_GHT_VAR, hash_table_t) *p_ht);
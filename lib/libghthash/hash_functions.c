@@ -29,6 +29,9 @@
 #include <assert.h>
 #include "ght_hash_table.h"
 
+// The open addressing tables have their own hash functions.
+#ifndef CFUN_OPEN_HASH
+
 #if 1
 static const ght_uint32_t crc32_table[256] = {
 	0x00000000, 0x04c11db7, 0x09823b6e, 0x0d4326d9, 0x130476dc, 0x17c56b6b, 0x1a864db2, 0x1e475005,
@@ -83,3 +86,5 @@ static const ght_uint32_t crc32_table[256] = {
 
 # include "hash_functions_priv.h"
 #endif
+
+#endif /* CFUN_OPEN_HASH */
@@ -37,6 +37,8 @@
 #include "../../src/global.h"
 #include "../../src/diagnostic.h"
 
+#ifndef CFUN_OPEN_HASH
+
 #define CFUNGE_MEMPOOL_HASHLIB
 #include "../mempool/cfunge_mempool.h"
 
@@ -45,9 +47,13 @@
 #define FLAGS_NORMAL   0 /* Normal item. All user-inserted stuff is normal */
 #define FLAGS_INTERNAL 1 /* The item is internal to the hash table */
 
+/*
+ * CF_GHT_NOT_FOUND is what replace() returns if the key doesn't exist.
+ */
 #define CF_GHT_VAR fspace
 #define CF_GHT_KEY fungeSpaceHashKey
-#define CF_GHT_DATA funge_cell
+#define CF_GHT_DATA fungeSpaceTile *
+#define CF_GHT_NOT_FOUND NULL
 #define CF_GHT_COMPAREKEYS(m_a, m_b) (((m_a)->p_key.x == (m_b)->p_key.x) && ((m_a)->p_key.y == (m_b)->p_key.y))
 #define CF_GHT_COPYKEY(m_target, m_source) \
 	do { \
@@ -60,6 +66,7 @@
 #undef CF_GHT_VAR
 #undef CF_GHT_KEY
 #undef CF_GHT_DATA
+#undef CF_GHT_NOT_FOUND
 #undef CF_GHT_COMPAREKEYS
 #undef CF_GHT_COPYKEY
 
@@ -67,9 +74,47 @@
 #  define CF_GHT_VAR fspacecount
 #  define CF_GHT_KEY funge_cell
 #  define CF_GHT_DATA funge_unsigned_cell
+#  define CF_GHT_NOT_FOUND ((funge_unsigned_cell)-1)
 #  define CF_GHT_COMPAREKEYS(m_a, m_b) ((m_a)->p_key == (m_b)->p_key)
 #  define CF_GHT_COPYKEY(m_target, m_source) \
 	do { (m_target) = *(m_source); } while (0)
 
 #  include "hash_table_priv.h"
 #endif
+
+#else /* CFUN_OPEN_HASH */
+
+/*
+ * Open addressing variant, see open_table_priv.h.
+ * CF_GHT_HASHKEY is a multiplicative hash, the high bits are the good ones.
+ */
+#define CF_GHT_VAR fspace
+#define CF_GHT_KEY fungeSpaceHashKey
+#define CF_GHT_DATA fungeSpaceTile *
+#define CF_GHT_NOT_FOUND NULL
+#define CF_GHT_KEYEQ(m_a, m_b) (((m_a)->x == (m_b)->x) && ((m_a)->y == (m_b)->y))
+#define CF_GHT_HASHKEY(m_key) \
+	((uint64_t)(funge_unsigned_cell)(m_key)->x * GHT_HASH_MUL_X \
+	 + (uint64_t)(funge_unsigned_cell)(m_key)->y * GHT_HASH_MUL_Y)
+
+#include "open_table_priv.h"
+
+#undef CF_GHT_VAR
+#undef CF_GHT_KEY
+#undef CF_GHT_DATA
+#undef CF_GHT_NOT_FOUND
+#undef CF_GHT_KEYEQ
+#undef CF_GHT_HASHKEY
+
+#ifdef CFUN_EXACT_BOUNDS
+#  define CF_GHT_VAR fspacecount
+#  define CF_GHT_KEY funge_cell
+#  define CF_GHT_DATA funge_unsigned_cell
+#  define CF_GHT_NOT_FOUND ((funge_unsigned_cell)-1)
+#  define CF_GHT_KEYEQ(m_a, m_b) (*(m_a) == *(m_b))
+#  define CF_GHT_HASHKEY(m_key) ((uint64_t)(funge_unsigned_cell)*(m_key) * GHT_HASH_MUL_X)
+
+#  include "open_table_priv.h"
+#endif
+
+#endif /* CFUN_OPEN_HASH */
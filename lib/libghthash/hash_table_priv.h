@@ -487,7 +487,7 @@ CF_GHT_DATA CF_GHT_NAME(CF_GHT_VAR, replace)(
 	/* UNLOCK: p_ht->pp_entries[l_key] */
 
 	if (!p_e)
-		return -1;
+		return CF_GHT_NOT_FOUND;
 
 	p_old = p_e->p_data;
 	p_e->p_data = p_entry_data;
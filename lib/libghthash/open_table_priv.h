@@ -0,0 +1,512 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Implementation of the open addressing hash tables (CFUN_OPEN_HASH), see
+ * ght_open_table_priv.h for the API.
+ *
+ * Included from hash_table.c once per variant, with CF_GHT_VAR, CF_GHT_KEY,
+ * CF_GHT_DATA, CF_GHT_NOT_FOUND, CF_GHT_KEYEQ(a, b) (compares two keys given
+ * as pointers) and CF_GHT_HASHKEY(k) (64-bit hash of a key given as pointer)
+ * defined.
+ *
+ * Slots are split into groups of 16. The group to start looking in and a 7
+ * bit tag are both taken from the hash. A lookup compares the tag against the
+ * 16 control bytes of the group at once (with SSE2 when available) and checks
+ * the keys of matching slots. If the group has an empty slot the key isn't in
+ * the table, otherwise the next group is tried (triangular probing, which
+ * visits every group when the number of groups is a power of two).
+ *
+ * When the table has to grow, the old slots are kept and new ones allocated.
+ * Lookups check both, and each insert moves GHT_MIGRATE_SLOTS of the old
+ * slots over until they are all done. The new slots have room for at least
+ * 3/8 of their size more entries when a resize starts, more than enough for
+ * the inserts needed to move everything.
+ */
+
+#ifndef GHT_OPEN_TABLE_COMMON
+#define GHT_OPEN_TABLE_COMMON
+
+#if defined(CFUNGE_COMP_GCC_COMPAT) && defined(CFUNGE_ARCH_X86) \
+    && defined(__SSE2__) && !defined(CFUN_KLEE_TEST)
+#  define GHT_OPEN_SSE2
+#  include <emmintrin.h>
+#endif
+
+/// Slots per group, also the number of control bytes compared at once.
+#define GHT_GROUP_WIDTH 16
+/// Control byte of a slot that was never used.
+#define GHT_CTRL_EMPTY 0x80
+/// Control byte of a slot that was used, but the entry was removed.
+#define GHT_CTRL_DELETED 0xFE
+// Used slots have the tag, 0x00 to 0x7F.
+
+/// Old slots moved to the new ones by each insert during a resize.
+#define GHT_MIGRATE_SLOTS 64
+
+/// Mixing constants for the multiplicative hash.
+#define GHT_HASH_MUL_X UINT64_C(0x9E3779B97F4A7C15)
+#define GHT_HASH_MUL_Y UINT64_C(0xC2B2AE3D27D4EB4F)
+
+/// Bit i set if control byte i of the group is equal to tag.
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline uint32_t ght_group_match(const unsigned char *p_group, unsigned char tag)
+{
+#ifdef GHT_OPEN_SSE2
+	__m128i group = _mm_loadu_si128((const __m128i*)p_group);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char)tag)));
+#else
+	uint32_t mask = 0;
+	for (size_t i = 0; i < GHT_GROUP_WIDTH; i++)
+		if (p_group[i] == tag)
+			mask |= UINT32_C(1) << i;
+	return mask;
+#endif
+}
+
+/// Bit i set if slot i of the group is empty or deleted (high bit set).
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline uint32_t ght_group_match_free(const unsigned char *p_group)
+{
+#ifdef GHT_OPEN_SSE2
+	return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)p_group));
+#else
+	uint32_t mask = 0;
+	for (size_t i = 0; i < GHT_GROUP_WIDTH; i++)
+		if (p_group[i] & 0x80)
+			mask |= UINT32_C(1) << i;
+	return mask;
+#endif
+}
+
+/// Index of the lowest set bit, mask must not be 0.
+FUNGE_ATTR_FAST FUNGE_ATTR_CONST
+static inline size_t ght_lowest_bit(uint32_t mask)
+{
+#ifdef CFUNGE_COMP_GCC_COMPAT
+	return (size_t)__builtin_ctz(mask);
+#else
+	size_t i = 0;
+	while (!(mask & 1)) {
+		mask >>= 1;
+		i++;
+	}
+	return i;
+#endif
+}
+
+/// Group to start probing in.
+#define GHT_HASH_GROUP(m_hash, m_group_mask) ((size_t)((m_hash) ^ ((m_hash) >> 32)) & (m_group_mask))
+/// The 7 bit tag stored in the control byte.
+#define GHT_HASH_TAG(m_hash) ((unsigned char)((m_hash) >> 57))
+/// Returned by find_slot() if the key isn't there.
+#define GHT_NO_SLOT SIZE_MAX
+
+#endif /* GHT_OPEN_TABLE_COMMON */
+
+
+/* Find the slot of a key in one set of slots, returns GHT_NO_SLOT if it isn't there. */
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline size_t CF_GHT_NAME(CF_GHT_VAR, find_slot)(
+    const unsigned char * restrict p_ctrl,
+    const CF_GHT_NAME(CF_GHT_VAR, hash_slot_t) * restrict p_slots,
+    size_t i_group_mask,
+    const CF_GHT_KEY * restrict p_key,
+    uint64_t hash)
+{
+	size_t group = GHT_HASH_GROUP(hash, i_group_mask);
+	unsigned char tag = GHT_HASH_TAG(hash);
+
+	for (size_t step = 1; ; step++) {
+		const unsigned char *p_group = p_ctrl + group * GHT_GROUP_WIDTH;
+		uint32_t match = ght_group_match(p_group, tag);
+		while (match) {
+			size_t slot = group * GHT_GROUP_WIDTH + ght_lowest_bit(match);
+			if (FUNGE_LIKELY(CF_GHT_KEYEQ(&p_slots[slot].key, p_key)))
+				return slot;
+			match &= match - 1;
+		}
+		if (FUNGE_LIKELY(ght_group_match(p_group, GHT_CTRL_EMPTY)))
+			return GHT_NO_SLOT;
+		// Can't loop forever, there is always at least one empty slot.
+		group = (group + step) & i_group_mask;
+	}
+}
+
+/* Find the first empty or deleted slot in the probe sequence of a hash. */
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline size_t CF_GHT_NAME(CF_GHT_VAR, find_free_slot)(
+    const unsigned char *p_ctrl,
+    size_t i_group_mask,
+    uint64_t hash)
+{
+	size_t group = GHT_HASH_GROUP(hash, i_group_mask);
+
+	for (size_t step = 1; ; step++) {
+		uint32_t match = ght_group_match_free(p_ctrl + group * GHT_GROUP_WIDTH);
+		if (FUNGE_LIKELY(match))
+			return group * GHT_GROUP_WIDTH + ght_lowest_bit(match);
+		group = (group + step) & i_group_mask;
+	}
+}
+
+/* Find a key, first in the current slots and then in the old ones of an
+ * unfinished resize. Returns the slot or NULL, *pp_ctrl is set to its control
+ * byte and *p_group_ctrl to the control bytes of its group. */
+FUNGE_ATTR_FAST
+static inline CF_GHT_NAME(CF_GHT_VAR, hash_slot_t) *CF_GHT_NAME(CF_GHT_VAR, lookup)(
+    const CF_GHT_NAME(CF_GHT_VAR, hash_table_t) * restrict p_ht,
+    const CF_GHT_KEY * restrict p_key,
+    uint64_t hash,
+    unsigned char ** restrict pp_ctrl,
+    unsigned char ** restrict p_group_ctrl)
+{
+	size_t slot = CF_GHT_NAME(CF_GHT_VAR, find_slot)(p_ht->p_ctrl, p_ht->p_slots,
+	                                                  p_ht->i_group_mask, p_key, hash);
+	if (FUNGE_LIKELY(slot != GHT_NO_SLOT)) {
+		*pp_ctrl = p_ht->p_ctrl + slot;
+		*p_group_ctrl = p_ht->p_ctrl + (slot & ~(size_t)(GHT_GROUP_WIDTH - 1));
+		return p_ht->p_slots + slot;
+	}
+	if (FUNGE_LIKELY(!p_ht->p_old_ctrl))
+		return NULL;
+	slot = CF_GHT_NAME(CF_GHT_VAR, find_slot)(p_ht->p_old_ctrl, p_ht->p_old_slots,
+	                                           p_ht->i_old_group_mask, p_key, hash);
+	if (slot == GHT_NO_SLOT)
+		return NULL;
+	*pp_ctrl = p_ht->p_old_ctrl + slot;
+	// Nothing is inserted into the old slots, so this doesn't matter for them.
+	*p_group_ctrl = NULL;
+	return p_ht->p_old_slots + slot;
+}
+
+/* Move up to i_count of the old slots of an unfinished resize over to the
+ * current ones, and free the old slots once they are all done. */
+FUNGE_ATTR_FAST
+static void CF_GHT_NAME(CF_GHT_VAR, migrate)(
+    CF_GHT_NAME(CF_GHT_VAR, hash_table_t) *p_ht,
+    size_t i_count)
+{
+	size_t end = p_ht->i_migrated + i_count;
+
+	if (end > p_ht->i_old_size)
+		end = p_ht->i_old_size;
+	// Keys are known to be unique, so no need to look for them first.
+	for (size_t i = p_ht->i_migrated; i < end; i++) {
+		if (!(p_ht->p_old_ctrl[i] & 0x80)) {
+			uint64_t hash = CF_GHT_HASHKEY(&p_ht->p_old_slots[i].key);
+			size_t slot = CF_GHT_NAME(CF_GHT_VAR, find_free_slot)(p_ht->p_ctrl, p_ht->i_group_mask, hash);
+			p_ht->p_ctrl[slot] = GHT_HASH_TAG(hash);
+			p_ht->p_slots[slot] = p_ht->p_old_slots[i];
+			p_ht->i_growth_left--;
+			// Lookups must not find it in both places.
+			p_ht->p_old_ctrl[i] = GHT_CTRL_DELETED;
+		}
+	}
+	p_ht->i_migrated = end;
+
+	if (end == p_ht->i_old_size) {
+		free(p_ht->p_old_ctrl);
+		free(p_ht->p_old_slots);
+		p_ht->p_old_ctrl = NULL;
+		p_ht->p_old_slots = NULL;
+		p_ht->i_old_size = 0;
+	}
+}
+
+/* Allocate empty storage for i_size slots (a power of two, at least one
+ * group). Returns false if out of memory, p_ht is unchanged then. */
+FUNGE_ATTR_FAST
+static bool CF_GHT_NAME(CF_GHT_VAR, alloc_slots)(
+    CF_GHT_NAME(CF_GHT_VAR, hash_table_t) *p_ht,
+    size_t i_size)
+{
+	unsigned char *p_ctrl = malloc(i_size);
+	CF_GHT_NAME(CF_GHT_VAR, hash_slot_t) *p_slots =
+	    malloc(i_size * sizeof(CF_GHT_NAME(CF_GHT_VAR, hash_slot_t)));
+
+	if (!p_ctrl || !p_slots) {
+		free(p_ctrl);
+		free(p_slots);
+		return false;
+	}
+	memset(p_ctrl, GHT_CTRL_EMPTY, i_size);
+
+	p_ht->i_size = i_size;
+	p_ht->i_group_mask = i_size / GHT_GROUP_WIDTH - 1;
+	// Keep the load factor at most 7/8.
+	p_ht->i_growth_left = i_size - i_size / 8;
+	p_ht->p_ctrl = p_ctrl;
+	p_ht->p_slots = p_slots;
+	return true;
+}
+
+/* Smallest valid table size that is at least i_size. */
+FUNGE_ATTR_FAST FUNGE_ATTR_CONST
+static inline size_t CF_GHT_NAME(CF_GHT_VAR, round_size)(size_t i_size)
+{
+	size_t size = GHT_GROUP_WIDTH;
+	while (size < i_size)
+		size <<= 1;
+	return size;
+}
+
+/* Start moving all entries to i_size new slots. Finishes any unfinished
+ * resize first. */
+FUNGE_ATTR_FAST
+static void CF_GHT_NAME(CF_GHT_VAR, start_resize)(
+    CF_GHT_NAME(CF_GHT_VAR, hash_table_t) *p_ht,
+    size_t i_size)
+{
+	if (p_ht->p_old_ctrl)
+		CF_GHT_NAME(CF_GHT_VAR, migrate)(p_ht, p_ht->i_old_size);
+
+	p_ht->p_old_ctrl = p_ht->p_ctrl;
+	p_ht->p_old_slots = p_ht->p_slots;
+	p_ht->i_old_size = p_ht->i_size;
+	p_ht->i_old_group_mask = p_ht->i_group_mask;
+	p_ht->i_migrated = 0;
+
+	if (!CF_GHT_NAME(CF_GHT_VAR, alloc_slots)(p_ht, CF_GHT_NAME(CF_GHT_VAR, round_size)(i_size)))
+		DIAG_OOM("Out of memory when rehashing");
+}
+
+
+/* --- Exported methods --- */
+/* Create a new hash table */
+FUNGE_ATTR_FAST CF_GHT_NAME(CF_GHT_VAR, hash_table_t) *CF_GHT_NAME(CF_GHT_VAR, create)(size_t i_size)
+{
+	CF_GHT_NAME(CF_GHT_VAR, hash_table_t) *p_ht;
+
+	if (!(p_ht = malloc(sizeof(CF_GHT_NAME(CF_GHT_VAR, hash_table_t))))) {
+		perror("malloc");
+		return NULL;
+	}
+	p_ht->i_items = 0;
+	p_ht->i_automatic_rehash = true;
+	p_ht->i_old_size = 0;
+	p_ht->i_old_group_mask = 0;
+	p_ht->i_migrated = 0;
+	p_ht->p_old_ctrl = NULL;
+	p_ht->p_old_slots = NULL;
+
+	if (!CF_GHT_NAME(CF_GHT_VAR, alloc_slots)(p_ht, CF_GHT_NAME(CF_GHT_VAR, round_size)(i_size))) {
+		perror("malloc");
+		free(p_ht);
+		return NULL;
+	}
+	return p_ht;
+}
+
+/* The table always grows when needed. */
+FUNGE_ATTR_FAST void CF_GHT_NAME(CF_GHT_VAR, set_rehash)(
+    CF_GHT_NAME(CF_GHT_VAR, hash_table_t) *p_ht,
+    bool b_rehash)
+{
+	p_ht->i_automatic_rehash = b_rehash;
+}
+
+/* Insert an entry into the hash table */
+FUNGE_ATTR_FAST
+int CF_GHT_NAME(CF_GHT_VAR, insert)(
+    CF_GHT_NAME(CF_GHT_VAR, hash_table_t) * restrict p_ht,
+    CF_GHT_DATA p_entry_data,
+    const CF_GHT_KEY * restrict p_key_data)
+{
+	unsigned char *p_ctrl, *p_group_ctrl;
+	uint64_t hash;
+	size_t slot;
+
+	assert(p_ht != NULL);
+
+	hash = CF_GHT_HASHKEY(p_key_data);
+	if (CF_GHT_NAME(CF_GHT_VAR, lookup)(p_ht, p_key_data, hash, &p_ctrl, &p_group_ctrl))
+		return -1;
+
+	if (FUNGE_UNLIKELY(p_ht->p_old_ctrl != NULL))
+		CF_GHT_NAME(CF_GHT_VAR, migrate)(p_ht, GHT_MIGRATE_SLOTS);
+
+	slot = CF_GHT_NAME(CF_GHT_VAR, find_free_slot)(p_ht->p_ctrl, p_ht->i_group_mask, hash);
+	if (p_ht->p_ctrl[slot] == GHT_CTRL_EMPTY) {
+		if (FUNGE_UNLIKELY(p_ht->i_growth_left == 0)) {
+			// Grow if at least half full, otherwise just get rid of the
+			// deleted slots.
+			size_t i_size = p_ht->i_size;
+			if (p_ht->i_items >= i_size / 2)
+				i_size *= 2;
+			CF_GHT_NAME(CF_GHT_VAR, start_resize)(p_ht, i_size);
+			CF_GHT_NAME(CF_GHT_VAR, migrate)(p_ht, GHT_MIGRATE_SLOTS);
+			slot = CF_GHT_NAME(CF_GHT_VAR, find_free_slot)(p_ht->p_ctrl, p_ht->i_group_mask, hash);
+		}
+		p_ht->i_growth_left--;
+	}
+
+	p_ht->p_ctrl[slot] = GHT_HASH_TAG(hash);
+	p_ht->p_slots[slot].key = *p_key_data;
+	p_ht->p_slots[slot].data = p_entry_data;
+	p_ht->i_items++;
+
+	return 0;
+}
+
+/* Get an entry from the hash table. The entry is returned, or NULL if it wasn't found */
+FUNGE_ATTR_FAST
+CF_GHT_DATA *CF_GHT_NAME(CF_GHT_VAR, get)(
+    CF_GHT_NAME(CF_GHT_VAR, hash_table_t) * restrict p_ht,
+    const CF_GHT_KEY * restrict p_key_data)
+{
+	unsigned char *p_ctrl, *p_group_ctrl;
+	CF_GHT_NAME(CF_GHT_VAR, hash_slot_t) *p_slot;
+
+	assert(p_ht != NULL);
+
+	p_slot = CF_GHT_NAME(CF_GHT_VAR, lookup)(p_ht, p_key_data, CF_GHT_HASHKEY(p_key_data),
+	                                          &p_ctrl, &p_group_ctrl);
+	return p_slot ? &p_slot->data : NULL;
+}
+
+/* Replace an entry from the hash table. The old data is returned, or CF_GHT_NOT_FOUND */
+FUNGE_ATTR_FAST
+CF_GHT_DATA CF_GHT_NAME(CF_GHT_VAR, replace)(
+    CF_GHT_NAME(CF_GHT_VAR, hash_table_t) * restrict p_ht,
+    CF_GHT_DATA p_entry_data,
+    const CF_GHT_KEY * restrict p_key_data)
+{
+	CF_GHT_DATA *p_data = CF_GHT_NAME(CF_GHT_VAR, get)(p_ht, p_key_data);
+	CF_GHT_DATA p_old;
+
+	if (!p_data)
+		return CF_GHT_NOT_FOUND;
+	p_old = *p_data;
+	*p_data = p_entry_data;
+	return p_old;
+}
+
+/* Remove an entry from the hash table. The data of the removed entry, or
+   CF_GHT_NOT_FOUND, is returned. */
+FUNGE_ATTR_FAST
+CF_GHT_DATA CF_GHT_NAME(CF_GHT_VAR, remove)(
+    CF_GHT_NAME(CF_GHT_VAR, hash_table_t) * restrict p_ht,
+    const CF_GHT_KEY * restrict p_key_data)
+{
+	unsigned char *p_ctrl, *p_group_ctrl;
+	CF_GHT_NAME(CF_GHT_VAR, hash_slot_t) *p_slot;
+
+	assert(p_ht != NULL);
+
+	p_slot = CF_GHT_NAME(CF_GHT_VAR, lookup)(p_ht, p_key_data, CF_GHT_HASHKEY(p_key_data),
+	                                          &p_ctrl, &p_group_ctrl);
+	if (!p_slot)
+		return CF_GHT_NOT_FOUND;
+
+	// If the group still has an empty slot no probe sequence went past this
+	// group while it was full, so the slot can become empty again.
+	if (p_group_ctrl && ght_group_match(p_group_ctrl, GHT_CTRL_EMPTY)) {
+		*p_ctrl = GHT_CTRL_EMPTY;
+		p_ht->i_growth_left++;
+	} else {
+		*p_ctrl = GHT_CTRL_DELETED;
+	}
+	p_ht->i_items--;
+
+	return p_slot->data;
+}
+
+/* Find the first used slot at or after i_slot, fill in the iterator. */
+FUNGE_ATTR_FAST
+static inline void *CF_GHT_NAME(CF_GHT_VAR, iterate_from)(
+    CF_GHT_NAME(CF_GHT_VAR, iterator_t) *p_iterator,
+    size_t i_slot,
+    const CF_GHT_KEY **pp_key)
+{
+	const CF_GHT_NAME(CF_GHT_VAR, hash_table_t) *p_ht = p_iterator->p_ht;
+
+	for (; i_slot < p_ht->i_size; i_slot++) {
+		if (!(p_ht->p_ctrl[i_slot] & 0x80)) {
+			p_iterator->i_slot = i_slot;
+			*pp_key = &p_ht->p_slots[i_slot].key;
+			return &p_ht->p_slots[i_slot].data;
+		}
+	}
+	for (; i_slot < p_ht->i_size + p_ht->i_old_size; i_slot++) {
+		size_t old = i_slot - p_ht->i_size;
+		if (!(p_ht->p_old_ctrl[old] & 0x80)) {
+			p_iterator->i_slot = i_slot;
+			*pp_key = &p_ht->p_old_slots[old].key;
+			return &p_ht->p_old_slots[old].data;
+		}
+	}
+	p_iterator->i_slot = i_slot;
+	*pp_key = NULL;
+	return NULL;
+}
+
+/* Get the first entry in an iteration */
+FUNGE_ATTR_FAST
+void *CF_GHT_NAME(CF_GHT_VAR, first)(CF_GHT_NAME(CF_GHT_VAR, hash_table_t) *p_ht,
+                                     CF_GHT_NAME(CF_GHT_VAR, iterator_t) *p_iterator,
+                                     const CF_GHT_KEY **pp_key)
+{
+	assert(p_ht && p_iterator);
+
+	p_iterator->p_ht = p_ht;
+	return CF_GHT_NAME(CF_GHT_VAR, iterate_from)(p_iterator, 0, pp_key);
+}
+
+/* Get the next entry in an iteration. You have to call CF_GHT_NAME(CF_GHT_VAR, first)
+   once initially before you use this function */
+FUNGE_ATTR_FAST
+void *CF_GHT_NAME(CF_GHT_VAR, next)(
+    CF_GHT_NAME(CF_GHT_VAR, iterator_t) *p_iterator,
+    const CF_GHT_KEY **pp_key)
+{
+	assert(p_iterator != NULL);
+
+	return CF_GHT_NAME(CF_GHT_VAR, iterate_from)(p_iterator, p_iterator->i_slot + 1, pp_key);
+}
+
+/* Finalize (free) a hash table */
+FUNGE_ATTR_FAST void CF_GHT_NAME(CF_GHT_VAR, finalize)(CF_GHT_NAME(CF_GHT_VAR, hash_table_t) *p_ht)
+{
+	assert(p_ht != NULL);
+
+	free(p_ht->p_ctrl);
+	free(p_ht->p_slots);
+	free(p_ht->p_old_ctrl);
+	free(p_ht->p_old_slots);
+	free(p_ht);
+}
+
+/* Rehash the hash table into one with (at least) i_size slots, all at once.
+ * Also gets rid of deleted slots.
+ */
+FUNGE_ATTR_FAST void CF_GHT_NAME(CF_GHT_VAR, rehash)(
+    CF_GHT_NAME(CF_GHT_VAR, hash_table_t) *p_ht,
+    size_t i_size)
+{
+	assert(p_ht != NULL);
+
+	// Make sure everything fits at the 7/8 load factor.
+	while (i_size - i_size / 8 <= p_ht->i_items)
+		i_size *= 2;
+	CF_GHT_NAME(CF_GHT_VAR, start_resize)(p_ht, i_size);
+	CF_GHT_NAME(CF_GHT_VAR, migrate)(p_ht, p_ht->i_old_size);
+}
@@ -69,17 +69,19 @@ Notes:
 #define CF_MEMPOOL_FUNC(m_funcname, m_variant) \
 	CF_MEMPOOL_FUNC_INTERN(m_funcname, m_variant)
 
-#define CF_MEMPOOL_VARIANT  fspace
-#define CF_MEMPOOL_DATATYPE struct s_fspace_hash_entry
-#include "cfunge_mempool_priv.h"
+#ifndef CFUN_OPEN_HASH
+#  define CF_MEMPOOL_VARIANT  fspace
+#  define CF_MEMPOOL_DATATYPE struct s_fspace_hash_entry
+#  include "cfunge_mempool_priv.h"
 
-#undef CF_MEMPOOL_VARIANT
-#undef CF_MEMPOOL_DATATYPE
+#  undef CF_MEMPOOL_VARIANT
+#  undef CF_MEMPOOL_DATATYPE
 
-#ifdef CFUN_EXACT_BOUNDS
-#  define CF_MEMPOOL_VARIANT  fspacecount
-#  define CF_MEMPOOL_DATATYPE struct s_fspacecount_hash_entry
-#  include "cfunge_mempool_priv.h"
+#  ifdef CFUN_EXACT_BOUNDS
+#    define CF_MEMPOOL_VARIANT  fspacecount
+#    define CF_MEMPOOL_DATATYPE struct s_fspacecount_hash_entry
+#    include "cfunge_mempool_priv.h"
+#  endif
 #endif
 
 #undef CF_MEMPOOL_VARIANT
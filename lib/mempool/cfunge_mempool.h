@@ -103,7 +103,8 @@ void cf_mempool_<name>_free(memorypool_data *ptr);
 #endif
 
 // Actual function prototypes.
-#ifdef CFUNGE_MEMPOOL_HASHLIB
+// The open addressing hash tables store entries inline, no pools needed.
+#if defined(CFUNGE_MEMPOOL_HASHLIB) && !defined(CFUN_OPEN_HASH)
 CF_MEMPOOL_DECLARE_FUNCS(fspace, struct s_fspace_hash_entry)
 #  ifdef CFUN_EXACT_BOUNDS
 CF_MEMPOOL_DECLARE_FUNCS(fspacecount, struct s_fspacecount_hash_entry)
@@ -0,0 +1,702 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global.h"
+#include "checkpoint.h"
+
+#include "diagnostic.h"
+#include "prng.h"
+#include "settings.h"
+#include "stack.h"
+
+#include "fingerprints/manager.h"
+#include "funge-space/funge-space.h"
+
+#include <errno.h>
+#include <fcntl.h> /* open */
+#include <stdint.h>
+#include <stdlib.h> /* free, realloc */
+#include <string.h> /* memcmp, memcpy */
+#include <unistd.h> /* close */
+#include <sys/mman.h> /* mmap, munmap */
+#include <sys/stat.h> /* fstat */
+
+/*
+ * The format is binary, in the byte order and cell size of the machine that
+ * wrote it:
+ *
+ *   header   "CFUNCKPT", version (u32), cell size in bytes (u32),
+ *            standard (u32, see standardVersion), reserved (u32)
+ *   "BNDS"   top left and bottom right corner of the bounds (4 cells)
+ *   "CELL"   runs of non-space cells: x, y (cells), n (u32), n packed cells;
+ *            ended by a run with n = 0
+ *   "RAND"   size (u32) and state of the PRNG, size is 0 if it can't be saved
+ *   "IPS "   highest ID given out (cell), number of IPs (u64), then for each
+ *            IP, in the order they run in:
+ *              ID (cell), position, delta, storage offset (2 cells each),
+ *              mode, need move, last was space, SUBR relative (u8 each),
+ *              number of stacks (u64), then for each stack from the
+ *              bottom of the stack-stack: number of items (u64) and the
+ *              items from the bottom, packed;
+ *              for each instruction A to Z: number of entries on its opcode
+ *              stack (u64), then for each entry from the bottom the
+ *              fingerprint (cell) and instruction (u8) it came from, or a
+ *              fingerprint of 0 for an entry that reflects.
+ *   "END "
+ *
+ * Packed cells are written in blocks of up to CKPT_BLOCK cells, each starting
+ * with the number of bytes per cell in it (u8: 1, 2, 4 or 8), enough for the
+ * largest value in the block. Most cells hold characters, so that is usually
+ * one byte.
+ *
+ * Everything is written in one pass, so it can be streamed to disk without
+ * holding a copy in memory. It is read back with mmap().
+ */
+
+/// Current version of the format.
+#define CHECKPOINT_VERSION 1
+/// Number of cells per block of packed cells.
+#define CKPT_BLOCK 256
+
+/**********
+ * Writer *
+ **********/
+
+/// Keeps track of errors, so they only have to be checked at the end.
+typedef struct checkpointWriter {
+	FILE * f;
+	bool   ok;
+} checkpointWriter;
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void ckpt_put(checkpointWriter * restrict w, const void * restrict data, size_t size)
+{
+	if (w->ok && size > 0 && fwrite(data, size, 1, w->f) != 1)
+		w->ok = false;
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void ckpt_put_tag(checkpointWriter * restrict w, const char * restrict tag)
+{
+	ckpt_put(w, tag, 4);
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void ckpt_put_u8(checkpointWriter * restrict w, uint8_t value)
+{
+	ckpt_put(w, &value, sizeof(value));
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void ckpt_put_u32(checkpointWriter * restrict w, uint32_t value)
+{
+	ckpt_put(w, &value, sizeof(value));
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void ckpt_put_u64(checkpointWriter * restrict w, uint64_t value)
+{
+	ckpt_put(w, &value, sizeof(value));
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void ckpt_put_cell(checkpointWriter * restrict w, funge_cell value)
+{
+	ckpt_put(w, &value, sizeof(value));
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void ckpt_put_vector(checkpointWriter * restrict w, const funge_vector * restrict v)
+{
+	ckpt_put_cell(w, v->x);
+	ckpt_put_cell(w, v->y);
+}
+
+/// Bytes needed to store value in packed cells.
+FUNGE_ATTR_FAST FUNGE_ATTR_CONST
+static inline uint8_t ckpt_width(funge_cell value)
+{
+	if (value >= INT8_MIN && value <= INT8_MAX)
+		return 1;
+	if (value >= INT16_MIN && value <= INT16_MAX)
+		return 2;
+#ifdef USE64
+	if (value >= INT32_MIN && value <= INT32_MAX)
+		return 4;
+#endif
+	return (uint8_t)sizeof(funge_cell);
+}
+
+/// Write n cells, packed.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void ckpt_put_cells(checkpointWriter * restrict w, const funge_cell * restrict cells, size_t n)
+{
+	union {
+		int8_t  b[CKPT_BLOCK];
+		int16_t h[CKPT_BLOCK];
+		int32_t l[CKPT_BLOCK];
+	} buf;
+
+	while (n > 0) {
+		size_t k = (n < CKPT_BLOCK) ? n : CKPT_BLOCK;
+		uint8_t width = 1;
+		for (size_t i = 0; i < k; i++) {
+			uint8_t cw = ckpt_width(cells[i]);
+			if (cw > width)
+				width = cw;
+		}
+		ckpt_put_u8(w, width);
+		switch (width) {
+			case 1:
+				for (size_t i = 0; i < k; i++)
+					buf.b[i] = (int8_t)cells[i];
+				ckpt_put(w, buf.b, k);
+				break;
+			case 2:
+				for (size_t i = 0; i < k; i++)
+					buf.h[i] = (int16_t)cells[i];
+				ckpt_put(w, buf.h, k * 2);
+				break;
+			default:
+				if (width == sizeof(funge_cell)) {
+					ckpt_put(w, cells, k * sizeof(funge_cell));
+				} else {
+					for (size_t i = 0; i < k; i++)
+						buf.l[i] = (int32_t)cells[i];
+					ckpt_put(w, buf.l, k * 4);
+				}
+				break;
+		}
+		cells += k;
+		n -= k;
+	}
+}
+
+/// Callback for fungespace_for_each_run().
+FUNGE_ATTR_FAST
+static bool ckpt_put_run(const funge_vector * restrict start,
+                         const funge_cell * restrict cells,
+                         size_t n, void * data)
+{
+	checkpointWriter *w = data;
+	ckpt_put_vector(w, start);
+	ckpt_put_u32(w, (uint32_t)n);
+	ckpt_put_cells(w, cells, n);
+	return w->ok;
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void ckpt_put_fungespace(checkpointWriter * restrict w)
+{
+	fungeRect bounds;
+	funge_vector end = { 0, 0 };
+
+	fungespace_get_bounds_rect(&bounds);
+	ckpt_put_tag(w, "BNDS");
+	ckpt_put_cell(w, bounds.x);
+	ckpt_put_cell(w, bounds.y);
+	ckpt_put_cell(w, bounds.x + bounds.w);
+	ckpt_put_cell(w, bounds.y + bounds.h);
+
+	ckpt_put_tag(w, "CELL");
+	if (!fungespace_for_each_run(&ckpt_put_run, w))
+		return;
+	ckpt_put_vector(w, &end);
+	ckpt_put_u32(w, 0);
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void ckpt_put_prng(checkpointWriter * restrict w)
+{
+	const void *state;
+	size_t size = prng_get_state(&state);
+
+	ckpt_put_tag(w, "RAND");
+	ckpt_put_u32(w, (uint32_t)size);
+	if (size > 0)
+		ckpt_put(w, state, size);
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void ckpt_put_opcodes(checkpointWriter * restrict w, const instructionPointer * restrict ip)
+{
+	for (int i = 0; i < FINGEROPCODECOUNT; i++) {
+		const fungeOpcodeStack *stack = &ip->fingerOpcodes[i];
+		// The opcode stacks aren't set up at all with -F.
+		size_t top = setting_disable_fingerprints ? 0 : stack->top;
+		ckpt_put_u64(w, (uint64_t)top);
+		for (size_t j = 0; j < top; j++) {
+			ckpt_put_cell(w, stack->origins[j].fingerprint);
+			ckpt_put_u8(w, stack->origins[j].opcode);
+		}
+	}
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void ckpt_put_ip(checkpointWriter * restrict w, const instructionPointer * restrict ip)
+{
+	const funge_stackstack *stackstack = ip->stackstack;
+
+	ckpt_put_cell(w, ip->ID);
+	ckpt_put_vector(w, &ip->position);
+	ckpt_put_vector(w, &ip->delta);
+	ckpt_put_vector(w, &ip->storageOffset);
+	ckpt_put_u8(w, (uint8_t)ip->mode);
+	ckpt_put_u8(w, ip->needMove);
+	ckpt_put_u8(w, ip->stringLastWasSpace);
+	ckpt_put_u8(w, ip->fingerSUBRisRelative);
+	ckpt_put_u64(w, (uint64_t)stackstack->current + 1);
+	for (size_t i = 0; i <= stackstack->current; i++) {
+		const funge_stack *stack = stackstack->stacks[i];
+		ckpt_put_u64(w, (uint64_t)stack->top);
+		ckpt_put_cells(w, stack->entries, stack->top);
+	}
+	ckpt_put_opcodes(w, ip);
+}
+
+#ifdef CONCURRENT_FUNGE
+FUNGE_ATTR_FAST bool checkpoint_write(FILE * restrict f, const ipList * restrict ips)
+#else
+FUNGE_ATTR_FAST bool checkpoint_write(FILE * restrict f, const instructionPointer * restrict ip)
+#endif
+{
+	checkpointWriter w = { f, true };
+
+	ckpt_put(&w, "CFUNCKPT", 8);
+	ckpt_put_u32(&w, CHECKPOINT_VERSION);
+	ckpt_put_u32(&w, sizeof(funge_cell));
+	ckpt_put_u32(&w, (uint32_t)setting_current_standard);
+	ckpt_put_u32(&w, 0);
+
+	ckpt_put_fungespace(&w);
+	ckpt_put_prng(&w);
+
+	ckpt_put_tag(&w, "IPS ");
+#ifdef CONCURRENT_FUNGE
+	ckpt_put_cell(&w, (funge_cell)ips->highestID);
+	ckpt_put_u64(&w, (uint64_t)ips->top + 1);
+	for (size_t i = 0; i <= ips->top; i++) {
+#  ifdef LARGE_IPLIST
+		ckpt_put_ip(&w, ips->ips[i]);
+#  else
+		ckpt_put_ip(&w, &ips->ips[i]);
+#  endif
+	}
+#else
+	ckpt_put_cell(&w, ip->ID);
+	ckpt_put_u64(&w, 1);
+	ckpt_put_ip(&w, ip);
+#endif
+	ckpt_put_tag(&w, "END ");
+	return w.ok;
+}
+
+/**********
+ * Reader *
+ **********/
+
+/// Where we are in the mapped file. Once something is wrong ok is false and
+/// everything read after that is 0.
+typedef struct checkpointReader {
+	const unsigned char * p;
+	const unsigned char * end;
+	bool                  ok;
+} checkpointReader;
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void ckpt_get(checkpointReader * restrict r, void * restrict data, size_t size)
+{
+	if (!r->ok || (size_t)(r->end - r->p) < size) {
+		r->ok = false;
+		memset(data, 0, size);
+		return;
+	}
+	memcpy(data, r->p, size);
+	r->p += size;
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void ckpt_get_tag(checkpointReader * restrict r, const char * restrict tag)
+{
+	char got[4];
+	ckpt_get(r, got, sizeof(got));
+	if (memcmp(got, tag, sizeof(got)) != 0)
+		r->ok = false;
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline uint8_t ckpt_get_u8(checkpointReader * restrict r)
+{
+	uint8_t value;
+	ckpt_get(r, &value, sizeof(value));
+	return value;
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline uint32_t ckpt_get_u32(checkpointReader * restrict r)
+{
+	uint32_t value;
+	ckpt_get(r, &value, sizeof(value));
+	return value;
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline uint64_t ckpt_get_u64(checkpointReader * restrict r)
+{
+	uint64_t value;
+	ckpt_get(r, &value, sizeof(value));
+	return value;
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline funge_cell ckpt_get_cell(checkpointReader * restrict r)
+{
+	funge_cell value;
+	ckpt_get(r, &value, sizeof(value));
+	return value;
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void ckpt_get_vector(checkpointReader * restrict r, funge_vector * restrict v)
+{
+	v->x = ckpt_get_cell(r);
+	v->y = ckpt_get_cell(r);
+}
+
+/**
+ * Check that n items of at least size bytes each fit in what is left, so a
+ * broken count can't make us allocate lots of memory.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline bool ckpt_check_count(checkpointReader * restrict r, uint64_t n, size_t size)
+{
+	if (r->ok && n > (uint64_t)(r->end - r->p) / size)
+		r->ok = false;
+	return r->ok;
+}
+
+/// Read n packed cells.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void ckpt_get_cells(checkpointReader * restrict r, funge_cell * restrict cells, size_t n)
+{
+	while (n > 0) {
+		size_t k = (n < CKPT_BLOCK) ? n : CKPT_BLOCK;
+		uint8_t width = ckpt_get_u8(r);
+		if (width == 0)
+			r->ok = false;
+		if (!ckpt_check_count(r, k, width))
+			return;
+		switch (width) {
+			case 1:
+				for (size_t i = 0; i < k; i++)
+					cells[i] = (int8_t)r->p[i];
+				break;
+			case 2:
+				for (size_t i = 0; i < k; i++) {
+					int16_t value;
+					memcpy(&value, r->p + i * 2, 2);
+					cells[i] = value;
+				}
+				break;
+			case 4:
+				for (size_t i = 0; i < k; i++) {
+					int32_t value;
+					memcpy(&value, r->p + i * 4, 4);
+					cells[i] = value;
+				}
+				break;
+			default:
+				if (width != sizeof(funge_cell)) {
+					r->ok = false;
+					return;
+				}
+				memcpy(cells, r->p, k * sizeof(funge_cell));
+				break;
+		}
+		r->p += k * width;
+		cells += k;
+		n -= k;
+	}
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void ckpt_get_fungespace(checkpointReader * restrict r)
+{
+	fungeRect bounds;
+	funge_cell buf[CKPT_BLOCK];
+
+	ckpt_get_tag(r, "BNDS");
+	bounds.x = ckpt_get_cell(r);
+	bounds.y = ckpt_get_cell(r);
+	bounds.w = ckpt_get_cell(r) - bounds.x;
+	bounds.h = ckpt_get_cell(r) - bounds.y;
+	if (!r->ok)
+		return;
+	fungespace_restore_begin(&bounds);
+
+	ckpt_get_tag(r, "CELL");
+	while (r->ok) {
+		funge_vector start;
+		uint32_t n;
+		ckpt_get_vector(r, &start);
+		n = ckpt_get_u32(r);
+		if (n == 0)
+			return;
+		// Blocks of packed cells are at most CKPT_BLOCK long.
+		while (n > 0 && r->ok) {
+			size_t k = (n < CKPT_BLOCK) ? n : CKPT_BLOCK;
+			ckpt_get_cells(r, buf, k);
+			if (!r->ok)
+				return;
+			fungespace_restore_run(&start, buf, k);
+			start.x = (funge_cell)((funge_unsigned_cell)start.x + k);
+			n -= (uint32_t)k;
+		}
+	}
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void ckpt_get_prng(checkpointReader * restrict r)
+{
+	uint32_t size;
+
+	ckpt_get_tag(r, "RAND");
+	size = ckpt_get_u32(r);
+	if (!ckpt_check_count(r, size, 1))
+		return;
+	// If it doesn't fit (other PRNG) the program just gets a new seed.
+	if (size > 0)
+		prng_set_state(r->p, size);
+	r->p += size;
+}
+
+/// A fingerprint loaded on the IP being restored, and what it provides.
+typedef struct ckptFingerprint {
+	funge_cell        fingerprint;
+	bool              loaded;
+	fingerprintOpcode funcs[FINGEROPCODECOUNT];
+} ckptFingerprint;
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void ckpt_get_opcodes(checkpointReader * restrict r, instructionPointer * restrict ip)
+{
+	ckptFingerprint *seen = NULL;
+	size_t nseen = 0;
+
+	for (int i = 0; i < FINGEROPCODECOUNT && r->ok; i++) {
+		uint64_t n = ckpt_get_u64(r);
+		if (!ckpt_check_count(r, n, sizeof(funge_cell) + 1))
+			break;
+		for (uint64_t j = 0; j < n; j++) {
+			funge_cell fingerprint = ckpt_get_cell(r);
+			uint8_t opcode = ckpt_get_u8(r);
+			fingerprintOpcode func = NULL;
+			fingerprintOrigin origin = { fingerprint, opcode };
+			size_t k;
+
+			if (setting_disable_fingerprints)
+				continue;
+			if (fingerprint != 0 && opcode >= 'A' && opcode <= 'Z') {
+				// Load each fingerprint once, and on this IP: some of them
+				// set up per-IP data.
+				for (k = 0; k < nseen; k++)
+					if (seen[k].fingerprint == fingerprint)
+						break;
+				if (k == nseen) {
+					ckptFingerprint *tmp = realloc(seen, (nseen + 1) * sizeof(ckptFingerprint));
+					if (FUNGE_UNLIKELY(!tmp))
+						DIAG_OOM("Couldn't allocate memory while restoring fingerprints");
+					seen = tmp;
+					seen[k].fingerprint = fingerprint;
+					seen[k].loaded = manager_load_opcodes(ip, fingerprint, seen[k].funcs);
+					nseen++;
+				}
+				// If it can't be loaded any more (sandbox?) the instruction
+				// reflects.
+				if (seen[k].loaded)
+					func = seen[k].funcs[opcode - 'A'];
+			}
+			if (FUNGE_UNLIKELY(!opcode_stack_push_origin(ip, (unsigned char)('A' + i), func, origin)))
+				DIAG_OOM("Couldn't allocate memory while restoring fingerprints");
+		}
+	}
+	free(seen);
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void ckpt_get_ip(checkpointReader * restrict r, instructionPointer * restrict ip)
+{
+	uint64_t nstacks;
+
+	ip->ID = ckpt_get_cell(r);
+	ckpt_get_vector(r, &ip->position);
+	ckpt_get_vector(r, &ip->delta);
+	ckpt_get_vector(r, &ip->storageOffset);
+	ip->mode = ckpt_get_u8(r);
+	ip->needMove = ckpt_get_u8(r) != 0;
+	ip->stringLastWasSpace = ckpt_get_u8(r) != 0;
+	ip->fingerSUBRisRelative = ckpt_get_u8(r) != 0;
+	if (ip->mode != ipmCODE && ip->mode != ipmSTRING)
+		r->ok = false;
+
+	nstacks = ckpt_get_u64(r);
+	if (nstacks == 0 || !ckpt_check_count(r, nstacks, sizeof(uint64_t)))
+		r->ok = false;
+	for (uint64_t i = 0; i < nstacks && r->ok; i++) {
+		funge_stack *stack;
+		uint64_t n;
+		if (i == 0) {
+			stack = ip->stackstack->stacks[0];
+		} else {
+			stack = stackstack_push_stack(&ip->stackstack);
+			if (FUNGE_UNLIKELY(!stack))
+				DIAG_OOM("Couldn't allocate stack while restoring");
+		}
+		n = ckpt_get_u64(r);
+		if (!ckpt_check_count(r, n, 1))
+			break;
+		if (n > 0)
+			ckpt_get_cells(r, stack_push_space(stack, (size_t)n), (size_t)n);
+	}
+	ip->stack = ip->stackstack->stacks[ip->stackstack->current];
+	ckpt_get_opcodes(r, ip);
+}
+
+#ifdef CONCURRENT_FUNGE
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static ipList * ckpt_get_all(checkpointReader * restrict r)
+#else
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static instructionPointer * ckpt_get_all(checkpointReader * restrict r)
+#endif
+{
+	char magic[8];
+	uint32_t standard;
+	funge_cell highestID;
+	uint64_t count;
+#ifdef CONCURRENT_FUNGE
+	ipList *ips;
+#else
+	instructionPointer *ip;
+#endif
+
+	ckpt_get(r, magic, sizeof(magic));
+	if (memcmp(magic, "CFUNCKPT", sizeof(magic)) != 0
+	    || ckpt_get_u32(r) != CHECKPOINT_VERSION
+	    || ckpt_get_u32(r) != sizeof(funge_cell))
+		return NULL;
+	standard = ckpt_get_u32(r);
+	ckpt_get_u32(r);
+	if (standard > stdver109)
+		return NULL;
+	// The program keeps running with the standard it was started with.
+	setting_current_standard = (standardVersion)standard;
+
+	ckpt_get_fungespace(r);
+	ckpt_get_prng(r);
+
+	ckpt_get_tag(r, "IPS ");
+	highestID = ckpt_get_cell(r);
+	count = ckpt_get_u64(r);
+	if (count == 0 || !ckpt_check_count(r, count, 1))
+		return NULL;
+#ifdef CONCURRENT_FUNGE
+	ips = iplist_create();
+	if (FUNGE_UNLIKELY(!ips))
+		DIAG_OOM("Couldn't create instruction pointer list");
+	for (uint64_t i = 1; i < count; i++)
+		if (FUNGE_UNLIKELY(iplist_duplicate_ip(&ips, ips->top) == -1))
+			DIAG_OOM("Couldn't create instruction pointer");
+	for (size_t i = 0; i <= ips->top; i++) {
+#  ifdef LARGE_IPLIST
+		ckpt_get_ip(r, ips->ips[i]);
+#  else
+		ckpt_get_ip(r, &ips->ips[i]);
+#  endif
+	}
+	ips->highestID = (size_t)highestID;
+#else
+	// Snapshots of several IPs need a concurrent build.
+	if (count != 1)
+		return NULL;
+	ip = ip_create();
+	if (FUNGE_UNLIKELY(!ip))
+		DIAG_OOM("Couldn't create instruction pointer");
+	ckpt_get_ip(r, ip);
+	(void)highestID;
+#endif
+	ckpt_get_tag(r, "END ");
+	if (!r->ok)
+		return NULL;
+#ifdef CONCURRENT_FUNGE
+	return ips;
+#else
+	return ip;
+#endif
+}
+
+#ifdef CONCURRENT_FUNGE
+FUNGE_ATTR_FAST ipList * checkpoint_restore(const char * restrict filename)
+#else
+FUNGE_ATTR_FAST instructionPointer * checkpoint_restore(const char * restrict filename)
+#endif
+{
+	checkpointReader r;
+	struct stat st;
+	void *addr;
+	int fd;
+#ifdef CONCURRENT_FUNGE
+	ipList *result;
+#else
+	instructionPointer *result;
+#endif
+
+	fd = open(filename, O_RDONLY);
+	if (fd == -1)
+		return NULL;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return NULL;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		errno = EINVAL;
+		return NULL;
+	}
+	addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (addr == MAP_FAILED) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return NULL;
+	}
+	// It is read front to back once.
+	posix_madvise(addr, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+	r.p = addr;
+	r.end = r.p + st.st_size;
+	r.ok = true;
+	result = ckpt_get_all(&r);
+	munmap(addr, (size_t)st.st_size);
+	close(fd);
+	if (!result)
+		errno = EINVAL;
+	return result;
+}
@@ -0,0 +1,68 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Writing the state of a running program to a file and reading it back:
+ * Funge-Space, the IPs with their stacks and loaded fingerprints, and the
+ * PRNG. The format is described in checkpoint.c.
+ */
+
+#ifndef FUNGE_HAD_SRC_CHECKPOINT_H
+#define FUNGE_HAD_SRC_CHECKPOINT_H
+
+#include "global.h"
+#include "ip.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * Write the state of the program. Must be called between instructions.
+ * @param f File to write to, in binary mode.
+ * @return False if writing failed (see errno).
+ */
+#ifdef CONCURRENT_FUNGE
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+bool checkpoint_write(FILE * restrict f, const ipList * restrict ips);
+#else
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+bool checkpoint_write(FILE * restrict f, const instructionPointer * restrict ip);
+#endif
+
+/**
+ * Restore the state of a program from a file written by checkpoint_write().
+ * Funge-Space must be empty. Also sets setting_current_standard.
+ * Data of fingerprints (open files, HRTI marks, ...) isn't saved, so
+ * fingerprints start over from a clean state.
+ * @param filename File to read.
+ * @return The IPs, or NULL with errno set if the file couldn't be read (EINVAL
+ * if it isn't a valid checkpoint). Funge-Space may be partly restored then.
+ */
+#ifdef CONCURRENT_FUNGE
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+ipList * checkpoint_restore(const char * restrict filename);
+#else
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+instructionPointer * checkpoint_restore(const char * restrict filename);
+#endif
+
+#endif
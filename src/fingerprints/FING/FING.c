@@ -49,19 +49,20 @@ static void finger_FING_swap(instructionPointer * ip)
 	if (first == 0 || second == 0) {
 		ip_reverse(ip);
 	} else {
-		fingerprintOpcode op1 = opcode_stack_pop(ip, first);
-		fingerprintOpcode op2 = opcode_stack_pop(ip, second);
+		fingerprintOrigin origin1, origin2;
+		fingerprintOpcode op1 = opcode_stack_pop_origin(ip, first, &origin1);
+		fingerprintOpcode op2 = opcode_stack_pop_origin(ip, second, &origin2);
 		// Push reflect if there wasn't anything on the stack.
 		if (!op1)
 			op1 = &do_reflect;
 		if (!op2)
 			op2 = &do_reflect;
-		if (!opcode_stack_push(ip, second, op1))
+		if (!opcode_stack_push_origin(ip, second, op1, origin1))
 		{
 			ip_reverse(ip);
 			return;
 		}
-		if (!opcode_stack_push(ip, first, op2))
+		if (!opcode_stack_push_origin(ip, first, op2, origin2))
 		{
 			ip_reverse(ip);
 			return;
@@ -88,16 +89,17 @@ static void finger_FING_push(instructionPointer * ip)
 	if (src == 0 || dst == 0) {
 		ip_reverse(ip);
 	} else {
-		fingerprintOpcode op = opcode_stack_pop(ip, src);
+		fingerprintOrigin origin;
+		fingerprintOpcode op = opcode_stack_pop_origin(ip, src, &origin);
 		if (op == NULL) {
 			op = &do_reflect;
 		} else {
-			if (!opcode_stack_push(ip, src, op)) {
+			if (!opcode_stack_push_origin(ip, src, op, origin)) {
 				ip_reverse(ip);
 				return;
 			}
 		}
-		if (!opcode_stack_push(ip, dst, op))
+		if (!opcode_stack_push_origin(ip, dst, op, origin))
 			ip_reverse(ip);
 	}
 }
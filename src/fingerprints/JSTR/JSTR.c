@@ -40,12 +40,12 @@ static void finger_JSTR_push_n(instructionPointer * ip)
 	}
 
 	stack_push(ip->stack, 0);
-
-	while (n--) {
-		stack_push(ip->stack, fungespace_get(&pos));
-		pos.x += delta.x;
-		pos.y += delta.y;
-	}
+	// The last cell goes on top, so push the line backwards from it.
+	pos.x = (funge_cell)((funge_unsigned_cell)pos.x + (funge_unsigned_cell)(n - 1) * (funge_unsigned_cell)delta.x);
+	pos.y = (funge_cell)((funge_unsigned_cell)pos.y + (funge_unsigned_cell)(n - 1) * (funge_unsigned_cell)delta.y);
+	delta.x = (funge_cell)(0 - (funge_unsigned_cell)delta.x);
+	delta.y = (funge_cell)(0 - (funge_unsigned_cell)delta.y);
+	fungespace_push_line(ip->stack, &pos, &delta, (size_t)n);
 }
 
 /// P - Write with delta
@@ -65,11 +65,7 @@ static void finger_JSTR_pop_n(instructionPointer * ip)
 		return;
 	}
 
-	while (n--) {
-		fungespace_set(stack_pop(ip->stack), &pos);
-		pos.x += delta.x;
-		pos.y += delta.y;
-	}
+	fungespace_pop_line(ip->stack, &pos, &delta, (size_t)n);
 }
 
 bool finger_JSTR_load(instructionPointer * ip)
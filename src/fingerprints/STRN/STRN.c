@@ -141,9 +141,6 @@ static void finger_STRN_search(instructionPointer * ip)
 static void finger_STRN_get(instructionPointer * ip)
 {
 	fungeRect bounds;
-	StringBuffer *sb;
-	size_t len;
-	funge_cell *s;
 	funge_vector pos;
 
 	fungespace_get_bounds_rect(&bounds);
@@ -154,33 +151,11 @@ static void finger_STRN_get(instructionPointer * ip)
 		ip_reverse(ip);
 		return;
 	}
-
-	sb = stringbuffer_new();
-	if (FUNGE_UNLIKELY(!sb)) {
-		ip_reverse(ip);
-		return;
-	}
-
-	while (true) {
-		funge_cell val;
-		val = fungespace_get(&pos);
-		if (val == 0) break;
-		stringbuffer_append_cell(sb, val);
-		if (pos.x < bounds.x || pos.x > bounds.x + bounds.w) {
-			stringbuffer_destroy(sb);
-			ip_reverse(ip);
-			return;
-		}
-		pos.x += 1;
-	}
-	s = stringbuffer_finish_multibyte(sb, &len);
-	if (FUNGE_UNLIKELY(!s)) {
-		stringbuffer_destroy(sb);
+	// Everything outside the bounds is space, so the 0 has to be inside them.
+	if (pos.x < bounds.x || pos.x > bounds.x + bounds.w
+	    || !fungespace_push_string(ip->stack, &pos,
+	                               (funge_unsigned_cell)(bounds.x + bounds.w) - (funge_unsigned_cell)pos.x + 1))
 		ip_reverse(ip);
-		return;
-	}
-	stack_push_string_multibyte(ip->stack, s, len);
-	free(s);
 }
 
 /// I - Input a string
@@ -258,7 +233,6 @@ static void finger_STRN_length(instructionPointer * ip)
 /// P - Put string at specified position
 static void finger_STRN_put(instructionPointer * ip)
 {
-	funge_cell value;
 	funge_vector pos;
 
 	pos = stack_pop_vector(ip->stack);
@@ -266,11 +240,8 @@ static void finger_STRN_put(instructionPointer * ip)
 	pos.y += ip->storageOffset.y;
 
 	// This doesn't cast to char, but is faster and uses less memory.
-	do {
-		value = stack_pop(ip->stack);
-		fungespace_set(value, &pos);
-		pos.x += 1;
-	} while (value != 0);
+	// The terminating 0 is written too.
+	fungespace_pop_line(ip->stack, &pos, vector_create_ref(1, 0), stack_strlen(ip->stack) + 1);
 }
 
 /// R - Rightmost n characters of string
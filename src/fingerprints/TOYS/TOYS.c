@@ -65,10 +65,61 @@ static void finger_TOYS_pair_of_shoes(instructionPointer * ip)
 
 }
 
-/// C - bracelet (Low order copy)
-static void finger_TOYS_bracelet(instructionPointer * ip)
+/**
+ * Would copying cell by cell from o to t in increasing (low order) or
+ * decreasing position order read a cell after writing it? Only then is the
+ * result different from fungespace_copy_rect().
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_PURE
+static bool toys_copy_overlaps(const funge_vector * restrict o,
+                               const funge_vector * restrict t,
+                               const funge_vector * restrict d,
+                               bool loworder)
+{
+	funge_cell dx = (funge_cell)((funge_unsigned_cell)t->x - (funge_unsigned_cell)o->x);
+	funge_cell dy = (funge_cell)((funge_unsigned_cell)t->y - (funge_unsigned_cell)o->y);
+	bool after = (dy > 0) || (dy == 0 && dx > 0);
+
+	if (dx <= -d->x || dx >= d->x || dy <= -d->y || dy >= d->y)
+		return false;
+	return loworder ? after : !after;
+}
+
+/**
+ * Copy (or move) cell by cell, in increasing or decreasing position order.
+ * Used for the overlapping cases where that matters.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void toys_copy_cells(const funge_vector * restrict o,
+                            const funge_vector * restrict t,
+                            const funge_vector * restrict d,
+                            bool loworder, bool move)
+{
+	if (loworder) {
+		for (funge_cell y = 0; y < d->y; ++y)
+			for (funge_cell x = 0; x < d->x; ++x) {
+				fungespace_set_offset(fungespace_get_offset(vector_create_ref(x, y), o),
+				                      vector_create_ref(x, y), t);
+				if (move)
+					fungespace_set_offset(' ', vector_create_ref(x, y), o);
+			}
+	} else {
+		for (funge_cell y = d->y; y-- > 0;)
+			for (funge_cell x = d->x; x-- > 0;) {
+				fungespace_set_offset(fungespace_get_offset(vector_create_ref(x, y), o),
+				                      vector_create_ref(x, y), t);
+				if (move)
+					fungespace_set_offset(' ', vector_create_ref(x, y), o);
+			}
+	}
+}
+
+/// C, K, M and V: copy or move an area.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void toys_copy(instructionPointer * ip, bool loworder, bool move)
 {
 	funge_vector t, d, o;
+	fungeRect area;
 	t = stack_pop_vector(ip->stack);
 	d = stack_pop_vector(ip->stack);
 	o = stack_pop_vector(ip->stack);
@@ -81,10 +132,25 @@ static void finger_TOYS_bracelet(instructionPointer * ip)
 		return;
 	}
 
-	for (funge_cell y = 0; y < d.y; ++y)
-		for (funge_cell x = 0; x < d.x; ++x)
-			fungespace_set_offset(fungespace_get_offset(vector_create_ref(x, y), &o),
-			                      vector_create_ref(x, y), &t);
+	// Moving onto itself clears it, cell by cell.
+	if (toys_copy_overlaps(&o, &t, &d, loworder) || (move && o.x == t.x && o.y == t.y)) {
+		toys_copy_cells(&o, &t, &d, loworder, move);
+		return;
+	}
+	area.x = o.x;
+	area.y = o.y;
+	area.w = d.x;
+	area.h = d.y;
+	if (move)
+		fungespace_move_rect(&area, &t);
+	else
+		fungespace_copy_rect(&area, &t);
+}
+
+/// C - bracelet (Low order copy)
+static void finger_TOYS_bracelet(instructionPointer * ip)
+{
+	toys_copy(ip, true, false);
 }
 
 /// D - toilet seat (Decrement top of stack)
@@ -108,6 +174,7 @@ static void finger_TOYS_calipers(instructionPointer * ip)
 {
 	funge_vector t;
 	funge_cell i, j;
+	fungeRect area;
 
 	t = stack_pop_vector(ip->stack);
 
@@ -115,9 +182,11 @@ static void finger_TOYS_calipers(instructionPointer * ip)
 	j = stack_pop(ip->stack);
 	i = stack_pop(ip->stack);
 
-	for (funge_cell y = t.y; y < t.y + j; ++y)
-		for (funge_cell x = t.x; x < t.x + i; ++x)
-			fungespace_set(stack_pop(ip->stack), vector_create_ref(x, y));
+	area.x = t.x;
+	area.y = t.y;
+	area.w = i;
+	area.h = j;
+	fungespace_pop_rect(ip->stack, &area);
 }
 
 /// G - counterclockwise (Read matrix from funge space onto stack)
@@ -125,6 +194,7 @@ static void finger_TOYS_counterclockwise(instructionPointer * ip)
 {
 	funge_vector o;
 	funge_cell i, j;
+	fungeRect area;
 
 	o = stack_pop_vector(ip->stack);
 
@@ -132,9 +202,11 @@ static void finger_TOYS_counterclockwise(instructionPointer * ip)
 	j = stack_pop(ip->stack);
 	i = stack_pop(ip->stack);
 
-	for (funge_cell y = o.y + j; y-- > o.y;)
-		for (funge_cell x = o.x + i; x-- > o.x;)
-			stack_push(ip->stack, fungespace_get(vector_create_ref(x, y)));
+	area.x = o.x;
+	area.y = o.y;
+	area.w = i;
+	area.h = j;
+	fungespace_push_rect(ip->stack, &area);
 }
 
 /// H - pair of stilts (Bitshift)
@@ -160,42 +232,24 @@ static void finger_TOYS_doric_column(instructionPointer * ip)
 /// J - fishhook (Translate current funge space column)
 static void finger_TOYS_fishhook(instructionPointer * ip)
 {
-	fungeRect bounds;
+	fungeRect bounds, area;
 	funge_cell n = stack_pop(ip->stack);
 
 	fungespace_get_bounds_rect(&bounds);
 
 	if (!n)
 		return;
-	if (n < 0) {
-		for (funge_cell y = bounds.y; y <= (bounds.y + bounds.h); ++y)
-			fungespace_set(fungespace_get(vector_create_ref(ip->position.x, y)), vector_create_ref(ip->position.x, y + n));
-	} else if (n > 0) {
-		for (funge_cell y = (bounds.y + bounds.h); y >= bounds.y; --y)
-			fungespace_set(fungespace_get(vector_create_ref(ip->position.x, y)), vector_create_ref(ip->position.x, y + n));
-	}
+	area.x = ip->position.x;
+	area.y = bounds.y;
+	area.w = 1;
+	area.h = bounds.h + 1;
+	fungespace_copy_rect(&area, vector_create_ref(ip->position.x, bounds.y + n));
 }
 
 /// K - scissors (High order copy)
 static void finger_TOYS_scissors(instructionPointer * ip)
 {
-	funge_vector t, d, o;
-	t = stack_pop_vector(ip->stack);
-	d = stack_pop_vector(ip->stack);
-	o = stack_pop_vector(ip->stack);
-
-	if (!d.x || !d.y)
-		return;
-
-	if (d.x < 0 || d.y < 0) {
-		ip_reverse(ip);
-		return;
-	}
-
-	for (funge_cell y = d.y; y-- > 0;)
-		for (funge_cell x = d.x; x-- > 0;)
-			fungespace_set_offset(fungespace_get_offset(vector_create_ref(x, y), &o),
-			                      vector_create_ref(x, y), &t);
+	toys_copy(ip, false, false);
 }
 
 /// L - corner (Like ' but picks up cell to left and doesn't skip)
@@ -211,25 +265,7 @@ static void finger_TOYS_corner(instructionPointer * ip)
 /// M - kittycat (Low order move)
 static void finger_TOYS_kittycat(instructionPointer * ip)
 {
-	funge_vector t, d, o;
-	t = stack_pop_vector(ip->stack);
-	d = stack_pop_vector(ip->stack);
-	o = stack_pop_vector(ip->stack);
-
-	if (!d.x || !d.y)
-		return;
-
-	if (d.x < 0 || d.y < 0) {
-		ip_reverse(ip);
-		return;
-	}
-
-	for (funge_cell y = 0; y < d.y; ++y)
-		for (funge_cell x = 0; x < d.x; ++x) {
-			fungespace_set_offset(fungespace_get_offset(vector_create_ref(x, y), &o),
-			                      vector_create_ref(x, y), &t);
-			fungespace_set_offset(' ', vector_create_ref(x, y), &o);
-		}
+	toys_copy(ip, true, true);
 }
 
 /// N - lightning bolt (Negate top of stack)
@@ -241,20 +277,18 @@ static void finger_TOYS_lightning_bolt(instructionPointer * ip)
 /// O - boulder (Translate current funge space row)
 static void finger_TOYS_boulder(instructionPointer * ip)
 {
-	fungeRect bounds;
+	fungeRect bounds, area;
 	funge_cell n = stack_pop(ip->stack);
 
 	fungespace_get_bounds_rect(&bounds);
 
 	if (!n)
 		return;
-	if (n < 0) {
-		for (funge_cell x = bounds.x; x <= (bounds.x + bounds.w); ++x)
-			fungespace_set(fungespace_get(vector_create_ref(x, ip->position.y)), vector_create_ref(x + n, ip->position.y));
-	} else if (n > 0) {
-		for (funge_cell x = (bounds.x + bounds.w); x >= bounds.x; --x)
-			fungespace_set(fungespace_get(vector_create_ref(x, ip->position.y)), vector_create_ref(x + n, ip->position.y));
-	}
+	area.x = bounds.x;
+	area.y = ip->position.y;
+	area.w = bounds.w + 1;
+	area.h = 1;
+	fungespace_copy_rect(&area, vector_create_ref(bounds.x + n, ip->position.y));
 }
 
 /// P - mailbox (Replace stack with product of all items on stack)
@@ -292,6 +326,7 @@ static void finger_TOYS_chicane(instructionPointer * ip)
 {
 	funge_vector d, o;
 	funge_cell c;
+	fungeRect area;
 	o = stack_pop_vector(ip->stack);
 	d = stack_pop_vector(ip->stack);
 	c = stack_pop(ip->stack);
@@ -304,9 +339,11 @@ static void finger_TOYS_chicane(instructionPointer * ip)
 		return;
 	}
 
-	for (funge_cell y = o.y; y < o.y + d.y; ++y)
-		for (funge_cell x = o.x; x < o.x + d.x; ++x)
-			fungespace_set(c, vector_create_ref(x, y));
+	area.x = o.x;
+	area.y = o.y;
+	area.w = d.x;
+	area.h = d.y;
+	fungespace_fill_rect(c, &area);
 }
 
 /// T - barstool (Act like _ or | depending on popped number)
@@ -334,25 +371,7 @@ static void finger_TOYS_tumbler(instructionPointer * ip)
 /// V - dixiecup (High order move)
 static void finger_TOYS_dixiecup(instructionPointer * ip)
 {
-	funge_vector t, d, o;
-	t = stack_pop_vector(ip->stack);
-	d = stack_pop_vector(ip->stack);
-	o = stack_pop_vector(ip->stack);
-
-	if (!d.x || !d.y)
-		return;
-
-	if (d.x < 0 || d.y < 0) {
-		ip_reverse(ip);
-		return;
-	}
-
-	for (funge_cell y = d.y; y-- > 0;)
-		for (funge_cell x = d.x; x-- > 0;) {
-			fungespace_set_offset(fungespace_get_offset(vector_create_ref(x, y), &o),
-			                      vector_create_ref(x, y), &t);
-			fungespace_set_offset(' ', vector_create_ref(x, y), &o);
-		}
+	toys_copy(ip, false, true);
 }
 
 /// W - television antenna (Atomic g/wait and try again/reverse)
@@ -55,54 +55,83 @@ static inline void opcode_stack_duplicate(const fungeOpcodeStack * restrict old,
 {
 	if (old->top) {
 		new->entries = (fingerprintOpcode*)malloc((old->top + 1) * sizeof(fingerprintOpcode));
-		if (FUNGE_UNLIKELY(!new->entries)) {
+		new->origins = (fingerprintOrigin*)malloc((old->top + 1) * sizeof(fingerprintOrigin));
+		if (FUNGE_UNLIKELY(!new->entries || !new->origins)) {
 			DIAG_OOM("Couldn't allocate for fingerprint stack");
 		}
 		new->size = old->top + 1;
 		new->top = old->top;
 		// Copy the pointers.
 		memcpy(new->entries, old->entries, new->top * sizeof(fingerprintOpcode));
+		memcpy(new->origins, old->origins, new->top * sizeof(fingerprintOrigin));
 	} else {
 		new->entries = NULL;
+		new->origins = NULL;
 		new->top = 0;
 		new->size = 0;
 	}
 }
 #endif
 
+/// Fingerprint whose loader is running, recorded as the origin of what it pushes.
+static funge_cell loading_fingerprint = 0;
+
 /// Add an entry to an opcode stack.
-FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
-bool opcode_stack_push(instructionPointer * restrict ip, unsigned char opcode, fingerprintOpcode func)
+FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+bool opcode_stack_push_origin(instructionPointer * restrict ip, unsigned char opcode,
+                              fingerprintOpcode func, fingerprintOrigin origin)
 {
 	fungeOpcodeStack * stack = &ip->fingerOpcodes[opcode - 'A'];
 	// Check if we need to realloc. It may also be that stack->entries is NULL
 	// (both stack->top and stack->size are 0 then.
 	if (stack->top == stack->size) {
 		fingerprintOpcode* newstack = realloc(stack->entries, (stack->size + ALLOCCHUNKSIZE) * sizeof(fingerprintOpcode));
+		fingerprintOrigin* neworigins;
 		if (FUNGE_UNLIKELY(!newstack))
 			return false;
 		stack->entries = newstack;
-		stack->entries[stack->top] = func;
-		stack->top++;
+		neworigins = realloc(stack->origins, (stack->size + ALLOCCHUNKSIZE) * sizeof(fingerprintOrigin));
+		if (FUNGE_UNLIKELY(!neworigins))
+			return false;
+		stack->origins = neworigins;
 		stack->size += ALLOCCHUNKSIZE;
-	} else {
-		stack->entries[stack->top] = func;
-		stack->top++;
 	}
+	stack->entries[stack->top] = func;
+	stack->origins[stack->top] = origin;
+	stack->top++;
 	return true;
 }
 
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+bool opcode_stack_push(instructionPointer * restrict ip, unsigned char opcode, fingerprintOpcode func)
+{
+	fingerprintOrigin origin = { loading_fingerprint, opcode };
+	return opcode_stack_push_origin(ip, opcode, func, origin);
+}
+
 FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
-fingerprintOpcode opcode_stack_pop(instructionPointer * restrict ip, unsigned char opcode)
+fingerprintOpcode opcode_stack_pop_origin(instructionPointer * restrict ip, unsigned char opcode,
+                                          fingerprintOrigin * restrict origin)
 {
 	fungeOpcodeStack * stack = &ip->fingerOpcodes[opcode - 'A'];
 	if (stack->top == 0) {
+		origin->fingerprint = 0;
+		origin->opcode = opcode;
 		return NULL;
 	} else {
-		return stack->entries[--stack->top];
+		--stack->top;
+		*origin = stack->origins[stack->top];
+		return stack->entries[stack->top];
 	}
 }
 
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+fingerprintOpcode opcode_stack_pop(instructionPointer * restrict ip, unsigned char opcode)
+{
+	fingerprintOrigin origin;
+	return opcode_stack_pop_origin(ip, opcode, &origin);
+}
+
 /**
  * Pop a function pointer from an opcode stack, discarding it.
  */
@@ -127,6 +156,7 @@ FUNGE_ATTR_FAST void manager_free(instructionPointer * restrict ip)
 		return;
 	for (int i = 0; i < FINGEROPCODECOUNT; i++) {
 		free(ip->fingerOpcodes[i].entries);
+		free(ip->fingerOpcodes[i].origins);
 	}
 }
 
@@ -172,7 +202,10 @@ FUNGE_ATTR_FAST bool manager_load(instructionPointer * restrict ip, funge_cell f
 	if (index == FPRINT_NOTFOUND) {
 		return false;
 	} else {
-		bool gotLoaded = ImplementedFingerprints[index].loader(ip);
+		bool gotLoaded;
+		loading_fingerprint = fingerprint;
+		gotLoaded = ImplementedFingerprints[index].loader(ip);
+		loading_fingerprint = 0;
 		if (FUNGE_LIKELY(gotLoaded)) {
 			stack_push(ip->stack, fingerprint);
 			stack_push(ip->stack, 1);
@@ -196,6 +229,29 @@ FUNGE_ATTR_FAST bool manager_unload(instructionPointer * restrict ip, funge_cell
 	return true;
 }
 
+FUNGE_ATTR_FAST bool manager_load_opcodes(instructionPointer * restrict ip,
+                                          funge_cell fingerprint,
+                                          fingerprintOpcode * restrict funcs)
+{
+	ssize_t index = find_fingerprint(fingerprint);
+	size_t tops[FINGEROPCODECOUNT];
+	bool gotLoaded;
+
+	if (index == FPRINT_NOTFOUND)
+		return false;
+	for (int i = 0; i < FINGEROPCODECOUNT; i++)
+		tops[i] = ip->fingerOpcodes[i].top;
+	loading_fingerprint = fingerprint;
+	gotLoaded = ImplementedFingerprints[index].loader(ip);
+	loading_fingerprint = 0;
+	for (int i = 0; i < FINGEROPCODECOUNT; i++) {
+		fungeOpcodeStack *stack = &ip->fingerOpcodes[i];
+		funcs[i] = (stack->top > tops[i]) ? stack->entries[stack->top - 1] : NULL;
+		stack->top = tops[i];
+	}
+	return gotLoaded;
+}
+
 #if CHAR_BIT != 8
 #  error "CHAR_BIT != 8, please make sure the function below the location of this error works on your system."
 #endif
@@ -39,6 +39,15 @@ struct s_instructionPointer;
 /// Function prototype for a fingerprint instruction.
 typedef void (*fingerprintOpcode)(struct s_instructionPointer * ip);
 
+/// Where a function on an opcode stack came from, saved in checkpoints.
+typedef struct s_fingerprintOrigin {
+	/// Fingerprint that provided it, 0 if none (such as the reflect FING
+	/// pushes for an empty stack).
+	funge_cell    fingerprint;
+	/// Instruction the fingerprint provided it for ('A' to 'Z').
+	unsigned char opcode;
+} fingerprintOrigin;
+
 /**
  * An opcode stack.
  * @warning
@@ -54,6 +63,8 @@ typedef struct s_fungeOpcodeStack {
 	/// be NULL before any fingerprint has been loaded that uses this opcode.
 	/// In that case, both size and top are 0.
 	fingerprintOpcode *entries;
+	/// Where each entry came from, allocated along with entries.
+	fingerprintOrigin *origins;
 } fungeOpcodeStack;
 
 /**
@@ -72,9 +83,21 @@ typedef bool (*fingerprintLoader)(struct s_instructionPointer * ip);
  * @param ip IP to add this opcode to.
  * @param opcode What opcode to add.
  * @param func Function pointer to routine implementing the instruction.
+ * @note The origin recorded is the fingerprint being loaded, if any.
  */
 FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
 bool opcode_stack_push(struct s_instructionPointer * restrict ip, unsigned char opcode, fingerprintOpcode func);
+/**
+ * Add func to the correct opcode (instruction) in ip, with where it came from.
+ * Used when moving functions between instructions.
+ * @param ip IP to add this opcode to.
+ * @param opcode What opcode to add.
+ * @param func Function pointer to routine implementing the instruction, may be NULL.
+ * @param origin Where func came from.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR((nonnull(1))) FUNGE_ATTR_WARN_UNUSED
+bool opcode_stack_push_origin(struct s_instructionPointer * restrict ip, unsigned char opcode,
+                              fingerprintOpcode func, fingerprintOrigin origin);
 /**
  * Pop an opcode from an stack returning it.
  * @param ip IP to pop opcode for.
@@ -83,6 +106,17 @@ bool opcode_stack_push(struct s_instructionPointer * restrict ip, unsigned char
  */
 FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
 fingerprintOpcode opcode_stack_pop(struct s_instructionPointer * restrict ip, unsigned char opcode);
+/**
+ * Pop an opcode from an stack returning it and where it came from.
+ * @param ip IP to pop opcode for.
+ * @param opcode What opcode to pop.
+ * @param origin Out parameter, set to where it came from (fingerprint 0 if
+ * the stack was empty).
+ * @return A function pointer.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+fingerprintOpcode opcode_stack_pop_origin(struct s_instructionPointer * restrict ip, unsigned char opcode,
+                                          fingerprintOrigin * restrict origin);
 
 /**
  * Free opcode stacks for IP
@@ -125,6 +159,22 @@ bool manager_load(struct s_instructionPointer * restrict ip, funge_cell fingerpr
 FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
 bool manager_unload(struct s_instructionPointer * restrict ip, funge_cell fingerprint);
 
+/**
+ * Find out what functions a fingerprint provides, by running its loader on
+ * ip and then putting the opcode stacks of ip back as they were. Any other
+ * setup the loader does is kept. Used when restoring checkpoints.
+ * @warning Don't call this directly from fingerprints.
+ * @param ip IP to load it on.
+ * @param fingerprint Fingerprint to load.
+ * @param funcs Out parameter, array of FINGEROPCODECOUNT. Entry i is set to
+ * what the fingerprint provides for instruction 'A' + i, or NULL.
+ * @return False if the fingerprint couldn't be loaded.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+bool manager_load_opcodes(struct s_instructionPointer * restrict ip,
+                          funge_cell fingerprint,
+                          fingerprintOpcode * restrict funcs);
+
 /**
  * Print out list of supported fingerprints
  */
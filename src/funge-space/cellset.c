@@ -0,0 +1,208 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../global.h"
+#include "cellset.h"
+#include "../diagnostic.h"
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Values are turned into unsigned keys that sort the same way (by flipping
+ * the sign bit). Each level of the tree handles 6 bits of the key, the
+ * bottom level nodes hold the bitmaps of 64 keys each instead of children.
+ */
+
+/// Bits of the key handled by each level.
+#define CELLSET_BITS 6
+/// Number of levels, the top one handles fewer bits if they don't add up.
+#define CELLSET_LEVELS ((sizeof(funge_cell) * 8 + CELLSET_BITS - 1) / CELLSET_BITS)
+/// The digit of a key for a given level.
+#define CELLSET_DIGIT(m_key, m_level) \
+	((unsigned int)((m_key) >> ((m_level) * CELLSET_BITS)) & 63)
+/// Flips the sign bit.
+#define CELLSET_KEY_FLIP ((funge_unsigned_cell)1 << (sizeof(funge_cell) * 8 - 1))
+
+typedef struct cellSetNode {
+	/// Bit i set if child i (or bitmap i, for level 1) is non-empty.
+	uint64_t mask;
+	union {
+		/// Used above level 1.
+		struct cellSetNode *children[64];
+		/// Used at level 1, bit i of bits[j] set if key j*64+i is in the set.
+		uint64_t bits[64];
+	} u;
+} cellSetNode;
+
+struct fungeCellSet {
+	/// Top level node, always there.
+	cellSetNode root;
+};
+
+FUNGE_ATTR_FAST FUNGE_ATTR_CONST
+static inline unsigned int lowest_bit(uint64_t mask)
+{
+#ifdef CFUNGE_COMP_GCC_COMPAT
+	return (unsigned int)__builtin_ctzll(mask);
+#else
+	unsigned int i = 0;
+	while (!(mask & 1)) {
+		mask >>= 1;
+		i++;
+	}
+	return i;
+#endif
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_CONST
+static inline unsigned int highest_bit(uint64_t mask)
+{
+#ifdef CFUNGE_COMP_GCC_COMPAT
+	return 63 - (unsigned int)__builtin_clzll(mask);
+#else
+	unsigned int i = 63;
+	while (!(mask & UINT64_C(0x8000000000000000))) {
+		mask <<= 1;
+		i--;
+	}
+	return i;
+#endif
+}
+
+FUNGE_ATTR_FAST fungeCellSet *cellset_create(void)
+{
+	return calloc(1, sizeof(fungeCellSet));
+}
+
+/// Free the children of a node at level.
+FUNGE_ATTR_FAST
+static void cellset_free_children(cellSetNode *node, size_t level)
+{
+	if (level <= 1)
+		return;
+	for (unsigned int i = 0; i < 64; i++) {
+		if (node->mask & (UINT64_C(1) << i)) {
+			cellset_free_children(node->u.children[i], level - 1);
+			free(node->u.children[i]);
+		}
+	}
+}
+
+FUNGE_ATTR_FAST void cellset_free(fungeCellSet *set)
+{
+	if (!set)
+		return;
+	cellset_free_children(&set->root, CELLSET_LEVELS - 1);
+	free(set);
+}
+
+FUNGE_ATTR_FAST void cellset_add(fungeCellSet * restrict set, funge_cell value)
+{
+	funge_unsigned_cell key = (funge_unsigned_cell)value ^ CELLSET_KEY_FLIP;
+	cellSetNode *node = &set->root;
+	unsigned int digit;
+
+	for (size_t level = CELLSET_LEVELS - 1; level > 1; level--) {
+		digit = CELLSET_DIGIT(key, level);
+		if (!(node->mask & (UINT64_C(1) << digit))) {
+			cellSetNode *child = calloc(1, sizeof(cellSetNode));
+			if (FUNGE_UNLIKELY(!child))
+				DIAG_OOM("Could not allocate memory for Funge-Space bounds");
+			node->u.children[digit] = child;
+			node->mask |= UINT64_C(1) << digit;
+		}
+		node = node->u.children[digit];
+	}
+	digit = CELLSET_DIGIT(key, 1);
+	node->u.bits[digit] |= UINT64_C(1) << CELLSET_DIGIT(key, 0);
+	node->mask |= UINT64_C(1) << digit;
+}
+
+FUNGE_ATTR_FAST void cellset_remove(fungeCellSet * restrict set, funge_cell value)
+{
+	funge_unsigned_cell key = (funge_unsigned_cell)value ^ CELLSET_KEY_FLIP;
+	cellSetNode *path[CELLSET_LEVELS];
+	cellSetNode *node = &set->root;
+	unsigned int digit;
+	size_t level;
+
+	for (level = CELLSET_LEVELS - 1; level > 1; level--) {
+		digit = CELLSET_DIGIT(key, level);
+		if (!(node->mask & (UINT64_C(1) << digit)))
+			return;
+		path[level] = node;
+		node = node->u.children[digit];
+	}
+	digit = CELLSET_DIGIT(key, 1);
+	node->u.bits[digit] &= ~(UINT64_C(1) << CELLSET_DIGIT(key, 0));
+	if (node->u.bits[digit] != 0)
+		return;
+	node->mask &= ~(UINT64_C(1) << digit);
+	// Free nodes that became empty, up to (but not including) the root.
+	for (level = 2; level < CELLSET_LEVELS && node->mask == 0; level++) {
+		digit = CELLSET_DIGIT(key, level);
+		free(node);
+		node = path[level];
+		node->mask &= ~(UINT64_C(1) << digit);
+	}
+}
+
+FUNGE_ATTR_FAST bool cellset_min(const fungeCellSet * restrict set, funge_cell * restrict min)
+{
+	const cellSetNode *node = &set->root;
+	funge_unsigned_cell key = 0;
+	unsigned int digit;
+
+	if (!node->mask)
+		return false;
+	for (size_t level = CELLSET_LEVELS - 1; level > 1; level--) {
+		digit = lowest_bit(node->mask);
+		key |= (funge_unsigned_cell)digit << (level * CELLSET_BITS);
+		node = node->u.children[digit];
+	}
+	digit = lowest_bit(node->mask);
+	key |= (funge_unsigned_cell)digit << CELLSET_BITS;
+	key |= lowest_bit(node->u.bits[digit]);
+	*min = (funge_cell)(key ^ CELLSET_KEY_FLIP);
+	return true;
+}
+
+FUNGE_ATTR_FAST bool cellset_max(const fungeCellSet * restrict set, funge_cell * restrict max)
+{
+	const cellSetNode *node = &set->root;
+	funge_unsigned_cell key = 0;
+	unsigned int digit;
+
+	if (!node->mask)
+		return false;
+	for (size_t level = CELLSET_LEVELS - 1; level > 1; level--) {
+		digit = highest_bit(node->mask);
+		key |= (funge_unsigned_cell)digit << (level * CELLSET_BITS);
+		node = node->u.children[digit];
+	}
+	digit = highest_bit(node->mask);
+	key |= (funge_unsigned_cell)digit << CELLSET_BITS;
+	key |= highest_bit(node->u.bits[digit]);
+	*max = (funge_cell)(key ^ CELLSET_KEY_FLIP);
+	return true;
+}
@@ -0,0 +1,81 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * An ordered set of cell values, used to track which rows and columns of
+ * Funge-Space are in use so that exact bounds can be found quickly.
+ *
+ * It is a hierarchical bitmap: a tree where each node has 64 children, and a
+ * 64 bit mask telling which of them are non-empty. The lowest and highest
+ * values are found by following the lowest or highest set bit of each mask.
+ * Finding them, adding and removing all take a fixed number of steps (11 with
+ * 64-bit cells, 6 with 32-bit cells).
+ */
+
+#ifndef FUNGE_HAD_SRC_FUNGE_SPACE_CELLSET_H
+#define FUNGE_HAD_SRC_FUNGE_SPACE_CELLSET_H
+
+#include "../global.h"
+#include <stdbool.h>
+
+/// Opaque set type.
+typedef struct fungeCellSet fungeCellSet;
+
+/**
+ * Create an empty set.
+ * @return The set, or NULL if out of memory.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+fungeCellSet *cellset_create(void);
+/**
+ * Free a set.
+ * @param set Set to free, may be NULL.
+ */
+FUNGE_ATTR_FAST
+void cellset_free(fungeCellSet *set);
+/**
+ * Add a value to a set, does nothing if it is already there.
+ * Exits with an error if out of memory.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void cellset_add(fungeCellSet * restrict set, funge_cell value);
+/**
+ * Remove a value from a set, does nothing if it isn't there.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void cellset_remove(fungeCellSet * restrict set, funge_cell value);
+/**
+ * Get the lowest value in a set.
+ * @param min Out parameter for the value, untouched if the set is empty.
+ * @return False if the set is empty.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+bool cellset_min(const fungeCellSet * restrict set, funge_cell * restrict min);
+/**
+ * Get the highest value in a set.
+ * @param max Out parameter for the value, untouched if the set is empty.
+ * @return False if the set is empty.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+bool cellset_max(const fungeCellSet * restrict set, funge_cell * restrict max);
+
+#endif
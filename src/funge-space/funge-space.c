@@ -22,23 +22,30 @@
 /*
  * How it works:
  * * We use a static array for the commonly used funge space near (0,0).
+ *   It is sized and placed to fit the initially loaded program (or set by -w).
  * * The array is slightly offset to include a bit of the negative funge space
  *   too.
- * * Outside this array we use a hash library.
+ * * Outside this array we use a hash library, mapping the top left corner of
+ *   fixed size tiles to a plain array of cells. A tile is allocated the first
+ *   time a non-space cell is written to it and freed when the last non-space
+ *   cell in it is cleared again.
  */
 
 
 #include "../global.h"
 #include "funge-space.h"
+#include "cellset.h"
 #include "../diagnostic.h"
+#include "../settings.h"
 #include "../../lib/libghthash/ght_hash_table.h"
 #define CFUNGE_MEMPOOL_HASHLIB
 #include "../../lib/mempool/cfunge_mempool.h"
 
 #include <assert.h>
+#include <inttypes.h>  /* PRIuFAST64 */
 #include <errno.h>
 #include <stdio.h>     /* fclose, fileno, fopen, fputs, fwrite, ... */
-#include <stdlib.h>
+#include <stdlib.h>    /* getenv, malloc, strtol, ... */
 #include <string.h>    /* strerror */
 
 #include <unistd.h>    /* _POSIX_MAPPED_FILES, close, fstat */
@@ -46,33 +53,91 @@
 #include <sys/types.h> /* fstat, open */
 #include <sys/stat.h>  /* fstat, open */
 #include <fcntl.h>     /* open, posix_fallocate */
+#include <time.h>      /* time */
 
 #if !defined(_POSIX_MAPPED_FILES) || (_POSIX_MAPPED_FILES < 1)
 #  error "cfunge needs a working mmap(), which this system claims it lacks."
 #endif
 
 #include <sys/mman.h>  /* mmap, munmap, posix_madvise */
+// Rows of the static array aren't contiguous then, load with one thread.
+#ifdef CFUN_TILED_STATIC
+#  undef CFUN_PARALLEL_LOAD
+#endif
+#ifdef CFUN_PARALLEL_LOAD
+#  include <pthread.h>
+#endif
 
-/// Initial size for hash table (main)
-#define FUNGESPACE_INITIAL_SIZE 0x40000
+/// Initial size for hash table (main). Each entry is a whole tile.
+#define FUNGESPACE_INITIAL_SIZE 0x1000
 /// Initial size for hash table (column count)
 #define FUNGECOUNT_COL_INITIAL_SIZE 0x20000
 /// Initial size for hash table (row count)
 #define FUNGECOUNT_ROW_INITIAL_SIZE 0x20000
 
+/// log2 of the width and height of a tile.
+#define FUNGESPACE_TILE_BITS 5
+/// Width and height of a tile. At 32x32 a tile of 32-bit cells is one page.
+#define FUNGESPACE_TILE_SIZE (1 << FUNGESPACE_TILE_BITS)
+#define FUNGESPACE_TILE_MASK ((funge_unsigned_cell)(FUNGESPACE_TILE_SIZE - 1))
+
+/// Coordinate of the top left corner of the tile containing m_c (x or y).
+#define TILE_ORIGIN(m_c) \
+	((funge_cell)((funge_unsigned_cell)(m_c) & ~FUNGESPACE_TILE_MASK))
+/// Index of the cell m_x,m_y in the tile containing it.
+#define TILE_COORD(m_x, m_y) \
+	(((funge_unsigned_cell)(m_x) & FUNGESPACE_TILE_MASK) \
+	 + (((funge_unsigned_cell)(m_y) & FUNGESPACE_TILE_MASK) << FUNGESPACE_TILE_BITS))
+
+struct fungeSpaceTile {
+	/// Row-major cells, encoded with FSPACE_ENCODE().
+	funge_cell    cells[FUNGESPACE_TILE_SIZE * FUNGESPACE_TILE_SIZE];
+	/// Number of non-space cells, the tile is freed when this drops to 0.
+	uint_fast32_t used;
+};
+
+/// Counters shown with -P, some are also used by the adaptive static array.
+typedef struct fungeSpaceStats {
+	uint_fast64_t outside;     ///< Accesses outside the static array.
+	uint_fast64_t lookups;     ///< Hash table lookups (cache misses).
+	size_t        tiles;       ///< Tiles currently allocated.
+	size_t        tiles_peak;  ///< Most tiles allocated at once.
+	uint_fast64_t relocations; ///< Times the static array was moved.
+	uint_fast64_t moved;       ///< Cells moved between tiles and static array.
+	uint_fast64_t skiphits;    ///< Skips over spaces or ;; found in the skip cache.
+	uint_fast64_t loadhits;    ///< Files loaded with i from the load cache.
+	bool          image;       ///< The program was mapped from a cached image.
+} fungeSpaceStats;
+
 typedef struct fungeSpace {
 	/// These two form a rectangle for the program size
 	funge_vector                  topLeftCorner;
 	funge_vector                  bottomRightCorner;
-	/// And this is the main hash table.
+	/// And this is the main hash table, mapping tile origin to tile.
 	ght_fspace_hash_table_t      * restrict entries;
+	/// Bumped each time a tile is allocated or freed, see fungeSpaceCache.
+	uint_fast64_t                 tilegeneration;
+	/// Lookup cache for g, p and other accesses not done by the main loop.
+	fungeSpaceCache               cache;
+#ifdef CFUN_COMPACT_CELLS
+	/// Lookup cache for escaped cells in the static array.
+	fungeSpaceCache               overflowcache;
+#endif
+	/// Statistics.
+	fungeSpaceStats               stats;
 #ifdef CFUN_EXACT_BOUNDS
 	/// Hash tables for cell count in columns.
 	ght_fspacecount_hash_table_t * restrict col_count;
 	/// Hash tables for cell count in rows.
 	ght_fspacecount_hash_table_t * restrict row_count;
+	/// Columns with at least one non-space cell, wherever their count is.
+	fungeCellSet                 * restrict used_cols;
+	/// Rows with at least one non-space cell.
+	fungeCellSet                 * restrict used_rows;
 	/// Are the bounds stored currently exact already?
 	bool                          boundsexact;
+	/// Are the counts above kept up to date? Not until bounds may shrink.
+	bool                          countsvalid;
 #endif
 	/// Used during loading to handle 0,0 not being least point.
 	bool                          boundsvalid;
@@ -83,55 +148,100 @@ static fungeSpace fspace = {
 	.topLeftCorner     = {0, 0},
 	.bottomRightCorner = {0, 0},
 	.entries           = NULL,
+	.tilegeneration    = 1,
+	.cache             = { {0, 0}, NULL, 0 },
+#ifdef CFUN_COMPACT_CELLS
+	.overflowcache     = { {0, 0}, NULL, 0 },
+#endif
+	.stats             = { 0, 0, 0, 0, 0, 0 },
 #ifdef CFUN_EXACT_BOUNDS
 	.col_count         = NULL,
 	.row_count         = NULL,
+	.used_cols         = NULL,
+	.used_rows         = NULL,
 	.boundsexact       = true,
+	.countsvalid       = false,
 #endif
 	.boundsvalid       = false
 };
 
 
-#define FUNGESPACE_STATIC_OFFSET_X 64
-#define FUNGESPACE_STATIC_OFFSET_Y 64
-// Note that this must be true to not break code below:
-//  (FUNGESPACE_STATIC_X * FUNGESPACE_STATIC_Y * sizeof(funge_cell)) % 128 == 0
-// Further cfun_static_space must be aligned on 16 byte boundary.
-#define FUNGESPACE_STATIC_X 512
-#define FUNGESPACE_STATIC_Y 1024
+/*
+ * The static array covers the area of Funge-Space most programs use. Its size
+ * and position are decided when the initial program is loaded (see
+ * fungespace_static_create()). Until then it is empty and every cell is stored
+ * in tiles, which works, just slower.
+ */
+
+/// Empty margin around the loaded program in the static array.
+#define FUNGESPACE_STATIC_MARGIN 64
+/// Width and height are rounded up to a multiple of this. Must be a multiple
+/// of 16, since the SSE code below fills 16 bytes at a time, and of the block
+/// size with CFUN_TILED_STATIC.
+#define FUNGESPACE_STATIC_ALIGN 64
+/// Smallest width or height decided from the program.
+#define FUNGESPACE_STATIC_MIN 256
+/// Largest width or height decided from the program.
+#define FUNGESPACE_STATIC_MAX 8192
+/// Largest number of cells decided from the program (32 MB with 64-bit cells).
+#define FUNGESPACE_STATIC_MAX_CELLS (1 << 22)
 
 #define FUNGESPACE_RANGE_CHECK(rx, ry) \
-	(((rx) < FUNGESPACE_STATIC_X) && ((ry) < FUNGESPACE_STATIC_Y))
-#define STATIC_COORD(rx, ry) ((rx)+(ry)*FUNGESPACE_STATIC_X)
+	(((rx) < cfun_static_x) && ((ry) < cfun_static_y))
+#ifdef CFUN_TILED_STATIC
+/*
+ * The static array is stored as square blocks, each block row-major and the
+ * blocks in row-major order. Then an IP moving vertically stays in the same
+ * block (one cache line with one byte cells) for several steps, instead of
+ * touching a new cache line each step.
+ */
+/// log2 of the width and height of a block in the static array.
+#  define FUNGESPACE_BLOCK_BITS 3
+#  define FUNGESPACE_BLOCK_MASK ((funge_unsigned_cell)((1 << FUNGESPACE_BLOCK_BITS) - 1))
+#  define STATIC_COORD(rx, ry) \
+	((((ry) & ~FUNGESPACE_BLOCK_MASK) * cfun_static_x) \
+	 + (((rx) & ~FUNGESPACE_BLOCK_MASK) << FUNGESPACE_BLOCK_BITS) \
+	 + (((ry) & FUNGESPACE_BLOCK_MASK) << FUNGESPACE_BLOCK_BITS) \
+	 + ((rx) & FUNGESPACE_BLOCK_MASK))
+#else
+#  define STATIC_COORD(rx, ry) ((rx)+(ry)*cfun_static_x)
+#endif
 
-/**
- * Static array for core Funge Space.
- *
- * We need to give it an asm name here, or the non-PIC inline asm below won't
- * work properly in some cases.
+/*
+ * With CFUN_COMPACT_CELLS the static array has one byte per cell, which is
+ * enough for code and ASCII data and means up to 8 times less memory (and
+ * cache) than full cells. Values that don't fit are stored as
+ * FSPACE_STATIC_ESCAPE in the array, with the real value in the tile for that
+ * position. Such tiles are created on demand by fungespace_static_write(), and
+ * are never looked at for positions inside the static array otherwise.
+ * Only access the array through fungespace_static_read() and
+ * fungespace_static_write().
  */
-static funge_cell cfun_static_space[FUNGESPACE_STATIC_X * FUNGESPACE_STATIC_Y]
-#ifdef CFUNGE_COMP_GCC_COMPAT
-__asm__("cfun_static_space")
+#ifdef CFUN_COMPACT_CELLS
+/// Can m_v be stored in the static array itself?
+#  define FSPACE_STATIC_FITS(m_v) \
+	((funge_unsigned_cell)FSPACE_ENCODE(m_v) < FSPACE_STATIC_ESCAPE)
 #endif
-FUNGE_ATTR_ALIGNED(16);
+
+/// Static array for core Funge Space, row-major. NULL until allocated.
+static fungeStaticCell *cfun_static_space = NULL;
+/// Width of static array, 0 until allocated.
+static funge_unsigned_cell cfun_static_x = 0;
+/// Height of static array, 0 until allocated.
+static funge_unsigned_cell cfun_static_y = 0;
+/// Added to x to get the column in the static array (x of its left edge negated).
+static funge_unsigned_cell cfun_static_offset_x = 0;
+/// Added to y to get the row in the static array (y of its top edge negated).
+static funge_unsigned_cell cfun_static_offset_y = 0;
+
+// Starts at 1, so a zeroed cursor is never valid.
+uint_fast64_t fungespace_cursor_generation = 1;
 
 #ifdef CFUN_EXACT_BOUNDS
 /// Non-Space counts for each column.
-static funge_unsigned_cell cfun_static_use_count_col[FUNGESPACE_STATIC_X];
+static funge_unsigned_cell *cfun_static_use_count_col = NULL;
 /// Non-Space counts for each row.
-static funge_unsigned_cell cfun_static_use_count_row[FUNGESPACE_STATIC_Y];
-/** If difference is larger than this we switch to a different bounds minimising
- * algorithm
- */
-#  define SIMPLEBOUNDS_MAX 0x10000
-/**
- * Decide if difference is too large or not, m_dim is either x or y.
- * Used in wrapping code to decide if we should minimise the bounds.
- * Check fspace.boundsexact first!
- */
-#  define BOUNDS_TOO_LARGE(m_dim) \
-	((fspace.bottomRightCorner.m_dim - fspace.topLeftCorner.m_dim) > SIMPLEBOUNDS_MAX)
+static funge_unsigned_cell *cfun_static_use_count_row = NULL;
 #endif
 
 /*
@@ -148,6 +258,14 @@ static funge_unsigned_cell cfun_static_use_count_row[FUNGESPACE_STATIC_Y];
 #ifdef CFUN_KLEE_TEST
 #  define CFUN_NO_SSE
 #endif
+// Nothing to fill with the zero-means-space encoding.
+#ifdef CFUN_ZERO_SPACE
+#  define CFUN_NO_SSE
+#endif
+// The plain loop becomes a memset() for bytes.
+#ifdef CFUN_COMPACT_CELLS
+#  define CFUN_NO_SSE
+#endif
 
 // We don't want SSE if testing with klee.
 #if defined(CFUNGE_COMP_GCC_COMPAT) && defined(CFUNGE_ARCH_X86) \
@@ -163,6 +281,27 @@ static funge_unsigned_cell cfun_static_use_count_row[FUNGESPACE_STATIC_Y];
 #  include <xmmintrin.h>
 #endif
 
+/*
+ * Loading files looks for newlines and spaces a vector at a time:
+ *
+ * FSPACE_LOAD_SSE2       - 16 bytes at a time, SSE2 intrinsics.
+ * FSPACE_LOAD_AVX2       - 32 bytes at a time, AVX2 intrinsics.
+ *
+ * Without them it is done a byte at a time.
+ */
+#undef FSPACE_LOAD_SSE2
+#undef FSPACE_LOAD_AVX2
+
+#if defined(CFUNGE_COMP_GCC_COMPAT) && defined(CFUNGE_ARCH_X86) \
+    && defined(__SSE2__) && !defined(CFUN_KLEE_TEST)
+#  define FSPACE_LOAD_SSE2 1
+#  include <emmintrin.h>
+#  ifdef __AVX2__
+#    define FSPACE_LOAD_AVX2 1
+#    include <immintrin.h>
+#  endif
+#endif
+
 #ifdef FSPACE_CREATE_SSE
 typedef int32_t v4si __attribute__((vector_size(16)));
 #  ifdef USE32
@@ -183,6 +322,99 @@ static const v4si fspace_vector_init = {0x20, 0x0, 0x20, 0x0};
 
 bool fungespace_create(void)
 {
+	fspace.entries = ght_fspace_create(FUNGESPACE_INITIAL_SIZE);
+	if (FUNGE_UNLIKELY(!fspace.entries))
+		return false;
+	ght_fspace_set_rehash(fspace.entries, true);
+#ifdef CFUN_EXACT_BOUNDS
+	fspace.col_count = ght_fspacecount_create(FUNGECOUNT_COL_INITIAL_SIZE);
+	fspace.row_count = ght_fspacecount_create(FUNGECOUNT_ROW_INITIAL_SIZE);
+	fspace.used_cols = cellset_create();
+	fspace.used_rows = cellset_create();
+	if (FUNGE_UNLIKELY(!fspace.col_count || !fspace.row_count
+	                   || !fspace.used_cols || !fspace.used_rows))
+		return false;
+	ght_fspacecount_set_rehash(fspace.col_count, true);
+	ght_fspacecount_set_rehash(fspace.row_count, true);
+#endif
+#ifdef CFUN_OPEN_HASH
+	return true;
+#else
+	// Set up mempool for hash library.
+#  ifdef CFUN_EXACT_BOUNDS
+	if (FUNGE_UNLIKELY(!cf_mempool_fspacecount_setup()))
+		return false;
+#  endif
+	return cf_mempool_fspace_setup();
+#endif
+}
+
+/**
+ * Get zero filled memory straight from the kernel, pages aren't touched until
+ * they are used.
+ * @param size Number of bytes.
+ * @return Page aligned memory to be freed with munmap(), or NULL.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+static void *fungespace_map_zero(size_t size)
+{
+	void *addr;
+	// MAP_ANONYMOUS isn't in POSIX (yet), fall back to /dev/zero without it.
+#if defined(MAP_ANONYMOUS) || defined(MAP_ANON)
+#  ifndef MAP_ANONYMOUS
+#    define MAP_ANONYMOUS MAP_ANON
+#  endif
+	addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#else
+	int fd = open("/dev/zero", O_RDWR);
+	if (FUNGE_UNLIKELY(fd == -1))
+		return NULL;
+	addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+#endif
+	return (addr == MAP_FAILED) ? NULL : addr;
+}
+
+/**
+ * Allocate the static array and fill it with spaces.
+ * Must be called before anything is stored in Funge-Space, since cells already
+ * in tiles inside the new area would be hidden by it.
+ * @param x Left edge of the static array.
+ * @param y Top edge of the static array.
+ * @param w Width, must be a multiple of FUNGESPACE_STATIC_ALIGN.
+ * @param h Height, must be a multiple of FUNGESPACE_STATIC_ALIGN.
+ * @return True if successful, otherwise false (and everything stays in tiles).
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+static bool fungespace_static_create(funge_cell x, funge_cell y,
+                                     funge_unsigned_cell w, funge_unsigned_cell h)
+{
+	size_t cells = (size_t)w * (size_t)h;
+	void *addr;
+
+	assert(cfun_static_space == NULL);
+	assert((w % FUNGESPACE_STATIC_ALIGN) == 0 && (h % FUNGESPACE_STATIC_ALIGN) == 0);
+
+	if (FUNGE_UNLIKELY(h != 0 && cells / h != w)
+	    || FUNGE_UNLIKELY(cells > SIZE_MAX / sizeof(fungeStaticCell)))
+		return false;
+	addr = fungespace_map_zero(cells * sizeof(fungeStaticCell));
+	if (FUNGE_UNLIKELY(!addr))
+		return false;
+#ifdef CFUN_EXACT_BOUNDS
+	cfun_static_use_count_col = calloc((size_t)w, sizeof(funge_unsigned_cell));
+	cfun_static_use_count_row = calloc((size_t)h, sizeof(funge_unsigned_cell));
+	if (FUNGE_UNLIKELY(!cfun_static_use_count_col || !cfun_static_use_count_row)) {
+		free(cfun_static_use_count_col);
+		free(cfun_static_use_count_row);
+		cfun_static_use_count_col = cfun_static_use_count_row = NULL;
+		munmap(addr, cells * sizeof(fungeStaticCell));
+		return false;
+	}
+#endif
+	cfun_static_space = addr;
+
+#ifndef CFUN_ZERO_SPACE
 	// Fill static array with spaces.
 	// When possible use movntps, which reduces cache pollution (because it acts
 	// as if the memory was write combining).
@@ -200,9 +432,9 @@ bool fungespace_create(void)
 #    ifdef CFUNGE_COMP_GCC4_6_COMPAT
 #      pragma GCC diagnostic ignored "-Wstrict-aliasing"
 #    endif
-	for (size_t i = 0; i < (sizeof(cfun_static_space) / 16); i++) {
+	for (size_t i = 0; i < (cells * sizeof(fungeStaticCell) / 16); i++) {
 		// Cast to void to shut up warning about strict-aliasing rules.
-		_mm_stream_ps(((float*)(void*)&cfun_static_space) + i * 4,
+		_mm_stream_ps(((float*)(void*)cfun_static_space) + i * 4,
 		              *((const __m128*)(const void*)&fspace_vector_init));
 	}
 #    ifdef CFUNGE_COMP_GCC4_6_COMPAT
@@ -211,231 +443,384 @@ bool fungespace_create(void)
 	_mm_sfence();
 #  endif
 #else
-	for (size_t i = 0; i < sizeof(cfun_static_space) / sizeof(funge_cell); i++)
+	for (size_t i = 0; i < cells; i++)
 		cfun_static_space[i] = ' ';
 #endif
-	fspace.entries = ght_fspace_create(FUNGESPACE_INITIAL_SIZE);
-	if (FUNGE_UNLIKELY(!fspace.entries))
-		return false;
-	ght_fspace_set_rehash(fspace.entries, true);
-#ifdef CFUN_EXACT_BOUNDS
-	fspace.col_count = ght_fspacecount_create(FUNGECOUNT_COL_INITIAL_SIZE);
-	fspace.row_count = ght_fspacecount_create(FUNGECOUNT_ROW_INITIAL_SIZE);
-	if (FUNGE_UNLIKELY(!fspace.col_count || !fspace.row_count))
-		return false;
-	ght_fspacecount_set_rehash(fspace.col_count, true);
-	ght_fspacecount_set_rehash(fspace.row_count, true);
-	// Set up mempool for hash library.
-	if (FUNGE_UNLIKELY(!cf_mempool_fspacecount_setup()))
-		return false;
-#endif
-	return cf_mempool_fspace_setup();
+#endif /* CFUN_ZERO_SPACE */
+	// Set these last, so nothing is looked up in the array before it is ready.
+	cfun_static_offset_x = -(funge_unsigned_cell)x;
+	cfun_static_offset_y = -(funge_unsigned_cell)y;
+	cfun_static_x = w;
+	cfun_static_y = h;
+	fungespace_cursor_generation++;
+	return true;
 }
 
+/**
+ * Pick width or height of the static array from the extent of the program in
+ * that dimension.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_CONST FUNGE_ATTR_WARN_UNUSED
+static inline funge_unsigned_cell fungespace_static_pick_size(funge_unsigned_cell extent)
+{
+	funge_unsigned_cell size;
+	if (extent > FUNGESPACE_STATIC_MAX)
+		return FUNGESPACE_STATIC_MAX;
+	// Leave some room for the program to grow.
+	size = extent + extent / 2 + 2 * FUNGESPACE_STATIC_MARGIN;
+	size = (size + FUNGESPACE_STATIC_ALIGN - 1) & ~(funge_unsigned_cell)(FUNGESPACE_STATIC_ALIGN - 1);
+	if (size < FUNGESPACE_STATIC_MIN)
+		return FUNGESPACE_STATIC_MIN;
+	if (size > FUNGESPACE_STATIC_MAX)
+		return FUNGESPACE_STATIC_MAX;
+	return size;
+}
 
-void fungespace_free(void)
+/**
+ * Set up the static array for a program with the given bounds, unless the
+ * user gave a size on the command line.
+ * @param bounds Bounding rectangle of the program (w and h are inclusive, as
+ * for fungespace_get_bounds_rect()).
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void fungespace_static_setup(const fungeRect * restrict bounds)
 {
-	if (fspace.entries)
-		ght_fspace_finalize(fspace.entries);
-#ifdef CFUN_EXACT_BOUNDS
-	if (fspace.col_count)
-		ght_fspacecount_finalize(fspace.col_count);
-	if (fspace.row_count)
-		ght_fspacecount_finalize(fspace.row_count);
-	cf_mempool_fspacecount_teardown();
-#endif
-	cf_mempool_fspace_teardown();
+	funge_unsigned_cell w, h;
+	if (setting_static_width != 0) {
+		w = setting_static_width;
+		h = setting_static_height;
+	} else {
+		w = fungespace_static_pick_size((funge_unsigned_cell)bounds->w + 1);
+		h = fungespace_static_pick_size((funge_unsigned_cell)bounds->h + 1);
+		while ((w * h) > FUNGESPACE_STATIC_MAX_CELLS) {
+			if (w > h)
+				w /= 2;
+			else
+				h /= 2;
+		}
+	}
+	w = (w + FUNGESPACE_STATIC_ALIGN - 1) & ~(funge_unsigned_cell)(FUNGESPACE_STATIC_ALIGN - 1);
+	h = (h + FUNGESPACE_STATIC_ALIGN - 1) & ~(funge_unsigned_cell)(FUNGESPACE_STATIC_ALIGN - 1);
+	if (FUNGE_UNLIKELY(!fungespace_static_create(bounds->x - FUNGESPACE_STATIC_MARGIN,
+	                                             bounds->y - FUNGESPACE_STATIC_MARGIN,
+	                                             w, h)))
+		diag_warn("Could not allocate static Funge-Space array, things will be slow.");
 }
 
-/*****************************************************************
- * This section of the code handles tracking exact bounds for y. *
- *****************************************************************/
+/*
+ * Programs that load the same file with i over and over keep what it loads
+ * in memory: the non-space runs of each line and the size i pushes for it.
+ * Loading it again then just merges those runs at the new offset, without
+ * reading or scanning the file. A file is only stored the second time it is
+ * loaded. Entries are keyed by path, device, inode, size and modification
+ * and change times, so files that changed are read again. The least
+ * recently used entries are dropped to stay under the limits below.
+ *
+ * File times may only have whole seconds (or coarser), so a file changed
+ * just after it was read can keep its times. Files changed in the last
+ * LOADCACHE_MIN_AGE seconds are therefore not stored.
+ */
+/// Most memory used by the cache of files loaded with i.
+#define LOADCACHE_MAX_MEMORY (64 << 20)
+/// Most files remembered by the cache, stored or not.
+#define LOADCACHE_MAX_ENTRIES 256
+/// Seconds since a file last changed before it is stored.
+#define LOADCACHE_MIN_AGE 2
 
-#ifdef CFUN_EXACT_BOUNDS
+/// A run of bytes from a file, starting and ending with a non-space.
+typedef struct loadCacheRun {
+	/// Position relative to where the file is loaded.
+	funge_cell          x;
+	funge_cell          y;
+	funge_unsigned_cell n;
+	/// Where the bytes are in loadCacheEntry.bytes.
+	size_t              start;
+} loadCacheRun;
+
+/// A file in the cache.
+typedef struct loadCacheEntry {
+	struct loadCacheEntry *next;
+	char                  *path;
+	dev_t                  dev;
+	ino_t                  ino;
+	off_t                  length;
+	time_t                 mtime;
+	time_t                 ctime;
+	bool                   binary;
+	/// If the runs are stored, false the first time the file is loaded.
+	bool                   stored;
+	/// Size pushed by i, for text files.
+	funge_vector           size;
+	loadCacheRun          *runs;
+	size_t                 nruns;
+	unsigned char         *bytes;
+	/// Memory used by the entry.
+	size_t                 memory;
+} loadCacheEntry;
+
+static struct {
+	/// Most recently used first.
+	loadCacheEntry *entries;
+	size_t          count;
+	size_t          memory;
+} fspace_loadcache = { NULL, 0, 0 };
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void loadcache_entry_free(loadCacheEntry * restrict entry)
+{
+	fspace_loadcache.memory -= entry->memory;
+	fspace_loadcache.count--;
+	free(entry->path);
+	free(entry->runs);
+	free(entry->bytes);
+	free(entry);
+}
+
+/**
+ * Drop the least recently used entries until there are at most count of
+ * them, using at most memory bytes.
+ */
 FUNGE_ATTR_FAST
-static inline funge_unsigned_cell get_count_col(funge_cell x)
+static void loadcache_trim(size_t count, size_t memory)
 {
-	funge_unsigned_cell sx = (funge_unsigned_cell)x + FUNGESPACE_STATIC_OFFSET_X;
-	if (sx < FUNGESPACE_STATIC_X) {
-		return cfun_static_use_count_col[sx];
-	} else {
-		funge_unsigned_cell *tmp = ght_fspacecount_get(fspace.col_count, &x);
-		if (!tmp)
-			return 0;
-		return *tmp;
+	while (fspace_loadcache.entries
+	       && (fspace_loadcache.count > count || fspace_loadcache.memory > memory)) {
+		loadCacheEntry **last = &fspace_loadcache.entries;
+		while ((*last)->next)
+			last = &(*last)->next;
+		loadcache_entry_free(*last);
+		*last = NULL;
 	}
 }
 
-FUNGE_ATTR_FAST
-static inline funge_unsigned_cell get_count_row(funge_cell y)
+/**
+ * Find the entry for a file and make it the most recently used one. An entry
+ * for an older version of the file is dropped.
+ * @param sb Status of the file.
+ * @return The entry, or NULL if there is none.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static loadCacheEntry *loadcache_find(const char * restrict filename,
+                                      const struct stat * restrict sb, bool binary)
 {
-	funge_unsigned_cell sy = (funge_unsigned_cell)y + FUNGESPACE_STATIC_OFFSET_Y;
-	if (sy < FUNGESPACE_STATIC_Y) {
-		return cfun_static_use_count_row[sy];
-	} else {
-		funge_unsigned_cell *tmp = ght_fspacecount_get(fspace.row_count, &y);
-		if (!tmp)
-			return 0;
-		return *tmp;
+	for (loadCacheEntry **p = &fspace_loadcache.entries; *p; p = &(*p)->next) {
+		loadCacheEntry *entry = *p;
+		if (entry->binary != binary || strcmp(entry->path, filename) != 0)
+			continue;
+		*p = entry->next;
+		if (entry->dev != sb->st_dev || entry->ino != sb->st_ino
+		    || entry->length != sb->st_size
+		    || entry->mtime != sb->st_mtime || entry->ctime != sb->st_ctime) {
+			loadcache_entry_free(entry);
+			return NULL;
+		}
+		entry->next = fspace_loadcache.entries;
+		fspace_loadcache.entries = entry;
+		return entry;
+	}
+	return NULL;
+}
+
+/**
+ * Add an entry, without any runs, for a file as the most recently used one.
+ * Nothing is added if out of memory.
+ * @param sb Status of the file.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void loadcache_add(const char * restrict filename,
+                          const struct stat * restrict sb, bool binary)
+{
+	size_t len = strlen(filename) + 1;
+	loadCacheEntry *entry = calloc(1, sizeof(loadCacheEntry));
+
+	if (FUNGE_UNLIKELY(!entry))
+		return;
+	entry->path = malloc(len);
+	if (FUNGE_UNLIKELY(!entry->path)) {
+		free(entry);
+		return;
 	}
+	memcpy(entry->path, filename, len);
+	entry->dev = sb->st_dev;
+	entry->ino = sb->st_ino;
+	entry->length = sb->st_size;
+	entry->mtime = sb->st_mtime;
+	entry->ctime = sb->st_ctime;
+	entry->binary = binary;
+	entry->memory = sizeof(loadCacheEntry) + len;
+	loadcache_trim(LOADCACHE_MAX_ENTRIES - 1, LOADCACHE_MAX_MEMORY - entry->memory);
+	entry->next = fspace_loadcache.entries;
+	fspace_loadcache.entries = entry;
+	fspace_loadcache.count++;
+	fspace_loadcache.memory += entry->memory;
 }
 
 
-FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL static inline void
-largemodel_minimise(funge_cell * restrict max, funge_cell * restrict min,
-                    ght_fspacecount_hash_table_t* restrict hashtable,
-                    const funge_unsigned_cell* restrict sarray,
-                    const size_t sarray_len, const size_t sarray_off)
+void fungespace_free(void)
 {
-	// Sparse scan over hash array.
-	funge_cell min_h = 0;
-	funge_cell max_h = 0;
-	bool isfirst = true;
-	ght_fspacecount_iterator_t iterator;
-	const funge_cell *p_key;
-	funge_unsigned_cell *p;
-	for (p = ght_fspacecount_first(hashtable, &iterator, &p_key);
-	     p; p = ght_fspacecount_next(&iterator, &p_key)) {
-		funge_cell value = *p_key;
-		if (FUNGE_UNLIKELY(isfirst)) {
-			max_h = min_h = value;
-			isfirst = false;
-		} else {
-			if (max_h < value) max_h = value;
-			if (min_h > value) min_h = value;
-		}
+	if (fspace.entries) {
+		ght_fspace_iterator_t iterator;
+		const funge_vector *p_key;
+		fungeSpaceTile **p;
+		for (p = ght_fspace_first(fspace.entries, &iterator, &p_key);
+		     p; p = ght_fspace_next(&iterator, &p_key))
+			free(*p);
+		ght_fspace_finalize(fspace.entries);
 	}
-	// Now scan static array.
-	for (size_t i = 0; i < sarray_len; i++)
-		if (sarray[i] > 0) {
-			funge_cell value = (funge_cell)(i - sarray_off);
-			if (max_h < value) max_h = value;
-			if (min_h > value) min_h = value;
-		}
-	*min = min_h;
-	*max = max_h;
+#ifdef CFUN_EXACT_BOUNDS
+	if (fspace.col_count)
+		ght_fspacecount_finalize(fspace.col_count);
+	if (fspace.row_count)
+		ght_fspacecount_finalize(fspace.row_count);
+	cellset_free(fspace.used_cols);
+	cellset_free(fspace.used_rows);
+#endif
+#ifndef CFUN_OPEN_HASH
+#  ifdef CFUN_EXACT_BOUNDS
+	cf_mempool_fspacecount_teardown();
+#  endif
+	cf_mempool_fspace_teardown();
+#endif
+	if (cfun_static_space) {
+		munmap(cfun_static_space, (size_t)cfun_static_x * (size_t)cfun_static_y * sizeof(fungeStaticCell));
+		cfun_static_space = NULL;
+		cfun_static_x = cfun_static_y = 0;
+		fungespace_cursor_generation++;
+	}
+#ifdef CFUN_EXACT_BOUNDS
+	free(cfun_static_use_count_col);
+	free(cfun_static_use_count_row);
+	cfun_static_use_count_col = cfun_static_use_count_row = NULL;
+#endif
+	loadcache_trim(0, 0);
 }
 
+/*****************************************************************
+ * This section of the code handles tracking exact bounds for y. *
+ *****************************************************************/
+
+#ifdef CFUN_EXACT_BOUNDS
+/**
+ * Shrink the bounds to the used rows and columns, if they may be too large.
+ */
 static inline void fungespace_minimize_bounds(void)
 {
-	funge_cell minx, miny, maxx, maxy;
 	if (fspace.boundsexact)
 		return;
 
-	minx = fspace.topLeftCorner.x;
-	miny = fspace.topLeftCorner.y;
-	maxx = fspace.bottomRightCorner.x;
-	maxy = fspace.bottomRightCorner.y;
-
-	/* Time for scanning.
-	 * * If difference is huge, (over 2^16 atm, see the define SIMPLEBOUNDS_MAX):
-	 *   * First try to do a sparse scan by iterating over all entries in the hash array.
-	 *   * Then scan static space and grow the previously calculated bounds if needed.
-	 * * If the difference is smaller:
-	 *   * Scan inwards from each edge until we a non-zero count in a column.
-	 *   * If we hit the other bound we stop, lets lock up in an infinite loop
-	 *     in the wrapping code instead of here!
-	 */
-	if (FUNGE_UNLIKELY((maxx - minx) > SIMPLEBOUNDS_MAX)) {
-		largemodel_minimise(&maxx, &minx, fspace.col_count,
-		                    cfun_static_use_count_col,
-		                    FUNGESPACE_STATIC_X, FUNGESPACE_STATIC_OFFSET_X);
-	} else {
-		for (; minx < maxx; minx++) {
-			if (get_count_col(minx) != 0)
-				break;
-		}
-		for (; maxx > minx; maxx--) {
-			if (get_count_col(maxx) != 0)
-				break;
-		}
-	}
-	if (FUNGE_UNLIKELY((maxy - miny) > SIMPLEBOUNDS_MAX)) {
-		largemodel_minimise(&maxy, &miny, fspace.row_count,
-		                    cfun_static_use_count_row,
-		                    FUNGESPACE_STATIC_Y, FUNGESPACE_STATIC_OFFSET_Y);
-	} else {
-		for (; miny < maxy; miny++) {
-			if (get_count_row(miny) != 0)
-				break;
-		}
-		for (; maxy > miny; maxy--) {
-			if (get_count_row(maxy) != 0)
-				break;
-		}
-	}
-	fspace.topLeftCorner.x = minx;
-	fspace.topLeftCorner.y = miny;
-	fspace.bottomRightCorner.x = maxx;
-	fspace.bottomRightCorner.y = maxy;
+	/* If nothing is left we end up with the bottom right corner, and will
+	 * lock up in an infinite loop in the wrapping code instead of here. */
+	if (!cellset_min(fspace.used_cols, &fspace.topLeftCorner.x)
+	    || !cellset_max(fspace.used_cols, &fspace.bottomRightCorner.x))
+		fspace.topLeftCorner.x = fspace.bottomRightCorner.x;
+	if (!cellset_min(fspace.used_rows, &fspace.topLeftCorner.y)
+	    || !cellset_max(fspace.used_rows, &fspace.bottomRightCorner.y))
+		fspace.topLeftCorner.y = fspace.bottomRightCorner.y;
 	fspace.boundsexact = true;
 }
 
 /**
- * Clear the boundsexact flag if needed.
+ * Is the position on the edge of the bounds?
  */
-FUNGE_ATTR_FAST
-static inline void fungespace_check_pos(const funge_cell x, const funge_cell y)
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline bool fungespace_on_bounds(const funge_cell x, const funge_cell y)
 {
-	if (x == fspace.bottomRightCorner.x)
-		fspace.boundsexact = false;
-	else if (y == fspace.bottomRightCorner.y)
-		fspace.boundsexact = false;
-	else if (x == fspace.topLeftCorner.x)
-		fspace.boundsexact = false;
-	else if (y == fspace.topLeftCorner.y)
-		fspace.boundsexact = false;
+	return x == fspace.bottomRightCorner.x || y == fspace.bottomRightCorner.y
+	       || x == fspace.topLeftCorner.x || y == fspace.topLeftCorner.y;
 }
 
 
-#define FSPACE_COUNT_OP_OR_NEW(m_var, m_op, m_a, m_key, m_val) \
+#define FSPACE_COUNT_OP_OR_NEW(m_var, m_op, m_a, m_set, m_key, m_val) \
 	do { \
 		if (m_var) { \
 			(*(m_var)) m_op; \
-			if (*(m_var) == 0) \
+			if (*(m_var) == 0) { \
 				ght_fspacecount_remove((m_a), &m_key); \
-		} \
-		else if (ght_fspacecount_insert((m_a), m_val, &m_key) == -1) { \
-			ght_fspacecount_replace((m_a), m_val, &m_key); \
+				cellset_remove((m_set), m_key); \
+			} \
+		} else { \
+			if (ght_fspacecount_insert((m_a), m_val, &m_key) == -1) \
+				ght_fspacecount_replace((m_a), m_val, &m_key); \
+			if (m_val) \
+				cellset_add((m_set), m_key); \
 		} \
 	} while(0)
 
 /**
- * Update column/row counts.
+ * Update column/row counts for a single cell.
  */
 FUNGE_ATTR_FAST
-static inline void fungespace_count(bool isset, const funge_vector * restrict position)
+static inline void fungespace_count_cell(bool isset, funge_cell x, funge_cell y)
 {
-	funge_cell x = position->x;
-	funge_cell y = position->y;
-	funge_unsigned_cell sx = (funge_unsigned_cell)x + FUNGESPACE_STATIC_OFFSET_X;
-	funge_unsigned_cell sy = (funge_unsigned_cell)y + FUNGESPACE_STATIC_OFFSET_Y;
-	if (sx < FUNGESPACE_STATIC_X) {
-		if (isset)
-			cfun_static_use_count_col[sx]++;
-		else
-			cfun_static_use_count_col[sx]--;
+	funge_unsigned_cell sx = (funge_unsigned_cell)x + cfun_static_offset_x;
+	funge_unsigned_cell sy = (funge_unsigned_cell)y + cfun_static_offset_y;
+	if (sx < cfun_static_x) {
+		if (isset) {
+			if (cfun_static_use_count_col[sx]++ == 0)
+				cellset_add(fspace.used_cols, x);
+		} else if (--cfun_static_use_count_col[sx] == 0) {
+			cellset_remove(fspace.used_cols, x);
+		}
 	} else {
 		funge_unsigned_cell *prevcol = ght_fspacecount_get(fspace.col_count, &x);
 		if (isset)
-			FSPACE_COUNT_OP_OR_NEW(prevcol, ++, fspace.col_count, x, 1);
+			FSPACE_COUNT_OP_OR_NEW(prevcol, ++, fspace.col_count, fspace.used_cols, x, 1);
 		else
-			FSPACE_COUNT_OP_OR_NEW(prevcol, --, fspace.col_count, x, 0);
+			FSPACE_COUNT_OP_OR_NEW(prevcol, --, fspace.col_count, fspace.used_cols, x, 0);
 	}
-	if (sy < FUNGESPACE_STATIC_Y) {
-		if (isset)
-			cfun_static_use_count_row[sy]++;
-		else
-			cfun_static_use_count_row[sy]--;
+	if (sy < cfun_static_y) {
+		if (isset) {
+			if (cfun_static_use_count_row[sy]++ == 0)
+				cellset_add(fspace.used_rows, y);
+		} else if (--cfun_static_use_count_row[sy] == 0) {
+			cellset_remove(fspace.used_rows, y);
+		}
 	} else {
 		funge_unsigned_cell *prevrow = ght_fspacecount_get(fspace.row_count, &y);
 		if (isset)
-			FSPACE_COUNT_OP_OR_NEW(prevrow, ++, fspace.row_count, y, 1);
+			FSPACE_COUNT_OP_OR_NEW(prevrow, ++, fspace.row_count, fspace.used_rows, y, 1);
 		else
-			FSPACE_COUNT_OP_OR_NEW(prevrow, --, fspace.row_count, y, 0);
+			FSPACE_COUNT_OP_OR_NEW(prevrow, --, fspace.row_count, fspace.used_rows, y, 0);
+	}
+}
+
+/**
+ * Add delta to the count for a whole column or row, used when many cells in
+ * it changed at once. The count must not go below 0.
+ * @param row Is line a row rather than a column?
+ */
+FUNGE_ATTR_FAST
+static void fungespace_count_line(bool row, funge_cell line, funge_cell delta)
+{
+	funge_unsigned_cell s = (funge_unsigned_cell)line + (row ? cfun_static_offset_y : cfun_static_offset_x);
+	fungeCellSet *set = row ? fspace.used_rows : fspace.used_cols;
+	ght_fspacecount_hash_table_t *table;
+	funge_unsigned_cell *count;
+
+	if (s < (row ? cfun_static_y : cfun_static_x)) {
+		funge_unsigned_cell prev;
+		count = row ? &cfun_static_use_count_row[s] : &cfun_static_use_count_col[s];
+		prev = *count;
+		*count += (funge_unsigned_cell)delta;
+		if (prev == 0 && *count != 0)
+			cellset_add(set, line);
+		else if (prev != 0 && *count == 0)
+			cellset_remove(set, line);
+		return;
+	}
+	table = row ? fspace.row_count : fspace.col_count;
+	count = ght_fspacecount_get(table, &line);
+	if (count) {
+		*count += (funge_unsigned_cell)delta;
+		if (*count == 0) {
+			ght_fspacecount_remove(table, &line);
+			cellset_remove(set, line);
+		}
+	} else if (delta != 0) {
+		if (ght_fspacecount_insert(table, (funge_unsigned_cell)delta, &line) == -1)
+			ght_fspacecount_replace(table, (funge_unsigned_cell)delta, &line);
+		cellset_add(set, line);
 	}
-	if (!isset)
-		fungespace_check_pos(x, y);
 }
 #endif
 
@@ -471,361 +856,3621 @@ static inline bool fungespace_in_range(const funge_vector * restrict position)
 }
 
 
-/************************
- * Funge space get code *
- ************************/
+/**************
+ * Tile store *
+ **************/
 
-FUNGE_ATTR_FAST funge_cell
-fungespace_get(const funge_vector * restrict position)
+/**
+ * Find the tile containing position.
+ * @return The tile or NULL if there is no tile (all spaces) there.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static inline fungeSpaceTile *fungespace_tile_find(const funge_vector * restrict position)
 {
-	// Offsets for static.
-	funge_unsigned_cell x = (funge_unsigned_cell)position->x + FUNGESPACE_STATIC_OFFSET_X;
-	funge_unsigned_cell y = (funge_unsigned_cell)position->y + FUNGESPACE_STATIC_OFFSET_Y;
+	funge_vector key = { TILE_ORIGIN(position->x), TILE_ORIGIN(position->y) };
+	fungeSpaceTile **tile = ght_fspace_get(fspace.entries, &key);
+	return tile ? *tile : NULL;
+}
 
-	if (FUNGESPACE_RANGE_CHECK(x, y)) {
-		return cfun_static_space[STATIC_COORD(x, y)];
-	} else {
-		funge_cell *tmp = (funge_cell*)ght_fspace_get(fspace.entries, position);
-		if (!tmp)
-			return (funge_cell)' ';
-		else
-			return *tmp;
+/**
+ * Allocate a tile filled with spaces, without inserting it.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_MALLOC FUNGE_ATTR_WARN_UNUSED
+static fungeSpaceTile *fungespace_tile_alloc(void)
+{
+#ifdef CFUN_ZERO_SPACE
+	fungeSpaceTile *tile = calloc(1, sizeof(fungeSpaceTile));
+	if (FUNGE_UNLIKELY(!tile)) {
+		DIAG_OOM("Could not allocate Funge-Space tile.");
+	}
+#else
+	fungeSpaceTile *tile = malloc(sizeof(fungeSpaceTile));
+	if (FUNGE_UNLIKELY(!tile)) {
+		DIAG_OOM("Could not allocate Funge-Space tile.");
 	}
+	for (size_t i = 0; i < sizeof(tile->cells) / sizeof(funge_cell); i++)
+		tile->cells[i] = ' ';
+	tile->used = 0;
+#endif
+	return tile;
 }
 
-FUNGE_ATTR_FAST funge_cell
-fungespace_get_offset(const funge_vector * restrict position,
-                      const funge_vector * restrict offset)
+/**
+ * Insert a tile for position, there must not be one already.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void fungespace_tile_insert(fungeSpaceTile * restrict tile,
+                                   const funge_vector * restrict position)
 {
-	funge_vector tmp;
-	funge_cell *result;
-	// Offsets for static.
-	funge_unsigned_cell x, y;
-
-	assert(position != NULL);
-	assert(offset != NULL);
+	funge_vector key = { TILE_ORIGIN(position->x), TILE_ORIGIN(position->y) };
 
-	tmp.x = position->x + offset->x;
-	tmp.y = position->y + offset->y;
-
-	x = (funge_unsigned_cell)tmp.x + FUNGESPACE_STATIC_OFFSET_X;
-	y = (funge_unsigned_cell)tmp.y + FUNGESPACE_STATIC_OFFSET_Y;
-
-	if (FUNGESPACE_RANGE_CHECK(x, y)) {
-		return cfun_static_space[STATIC_COORD(x, y)];
-	} else {
-		result = (funge_cell*)ght_fspace_get(fspace.entries, &tmp);
-		if (!result)
-			return (funge_cell)' ';
-		else
-			return *result;
+	if (FUNGE_UNLIKELY(ght_fspace_insert(fspace.entries, tile, &key) == -1)) {
+		DIAG_FATAL_LOC("Internal error: insert in hash table failed when value known not to exist.");
 	}
+	fspace.tilegeneration++;
+	if (++fspace.stats.tiles > fspace.stats.tiles_peak)
+		fspace.stats.tiles_peak = fspace.stats.tiles;
 }
 
+/**
+ * Allocate a tile filled with spaces for position and insert it.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static fungeSpaceTile *fungespace_tile_create(const funge_vector * restrict position)
+{
+	fungeSpaceTile *tile = fungespace_tile_alloc();
+	fungespace_tile_insert(tile, position);
+	return tile;
+}
 
-/************************
- * Funge space set code *
- ************************/
-
-FUNGE_ATTR_FAST static inline void
-fungespace_set_no_bounds_update(funge_cell value,
-                                const funge_vector * restrict position)
+/**
+ * Remove a tile that no longer contains any non-space cells.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void fungespace_tile_destroy(const funge_vector * restrict position)
 {
-	// Offsets for static.
-	funge_unsigned_cell x = (funge_unsigned_cell)position->x + FUNGESPACE_STATIC_OFFSET_X;
-	funge_unsigned_cell y = (funge_unsigned_cell)position->y + FUNGESPACE_STATIC_OFFSET_Y;
+	funge_vector key = { TILE_ORIGIN(position->x), TILE_ORIGIN(position->y) };
+	free(ght_fspace_remove(fspace.entries, &key));
+	fspace.tilegeneration++;
+	fspace.stats.tiles--;
+}
 
-	if (FUNGESPACE_RANGE_CHECK(x, y)) {
-#ifdef CFUN_EXACT_BOUNDS
-		funge_cell prev = cfun_static_space[STATIC_COORD(x, y)];
+/**
+ * Store a value in a tile, for moving cells out of the static array.
+ * Must NOT be called with a space, or for a cell that isn't a space already.
+ * Doesn't update counts or bounds.
+ */
+FUNGE_ATTR_FAST
+static void fungespace_tile_put(funge_cell x, funge_cell y, funge_cell value)
+{
+	funge_vector pos = { x, y };
+	fungeSpaceTile *tile = fungespace_tile_find(&pos);
+	if (!tile)
+		tile = fungespace_tile_create(&pos);
+	tile->cells[TILE_COORD(x, y)] = FSPACE_ENCODE(value);
+	tile->used++;
+}
+
+
+/************************
+ * Static array access  *
+ ************************/
+
+#ifdef CFUN_COMPACT_CELLS
+/**
+ * Find the tile holding the value of an escaped cell in the static array.
+ * Programs tend to keep their large values in a few variables, so the last
+ * tile is cached (separately from the caches used outside the static array).
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+static inline fungeSpaceTile *fungespace_overflow_tile(funge_cell x, funge_cell y)
+{
+	fungeSpaceCache *cache = &fspace.overflowcache;
+	funge_cell ox = TILE_ORIGIN(x);
+	funge_cell oy = TILE_ORIGIN(y);
+	if (FUNGE_UNLIKELY(cache->generation != fspace.tilegeneration
+	                   || cache->origin.x != ox || cache->origin.y != oy)) {
+		cache->tile       = fungespace_tile_find(vector_create_ref(x, y));
+		cache->origin.x   = ox;
+		cache->origin.y   = oy;
+		cache->generation = fspace.tilegeneration;
+	}
+	assert(cache->tile != NULL);
+	return cache->tile;
+}
+
+/**
+ * Get the value of an escaped cell in the static array from its tile.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NOINLINE FUNGE_ATTR_WARN_UNUSED
+static funge_cell fungespace_overflow_get(funge_cell x, funge_cell y)
+{
+	return FSPACE_DECODE(fungespace_overflow_tile(x, y)->cells[TILE_COORD(x, y)]);
+}
+
+/**
+ * Replace the value of a cell in the static array that is already escaped.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NOINLINE
+static void fungespace_overflow_replace(funge_cell x, funge_cell y, funge_cell value)
+{
+	fungespace_overflow_tile(x, y)->cells[TILE_COORD(x, y)] = FSPACE_ENCODE(value);
+}
+
+/**
+ * Drop the tile value of a cell in the static array that is no longer escaped.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NOINLINE
+static void fungespace_overflow_clear(funge_cell x, funge_cell y)
+{
+	funge_vector pos = { x, y };
+	fungeSpaceTile *tile = fungespace_overflow_tile(x, y);
+	tile->cells[TILE_COORD(x, y)] = FSPACE_ENCODE(' ');
+	if (--tile->used == 0)
+		fungespace_tile_destroy(&pos);
+}
 #endif
-		cfun_static_space[STATIC_COORD(x, y)] = value;
-#ifdef CFUN_EXACT_BOUNDS
-		if (value != prev) {
-			if ((prev == ' ') || (value == ' '))
-				fungespace_count((value != ' '), position);
+
+/**
+ * Read a cell in the static array.
+ * @param sx Column in the static array, must be in range.
+ * @param sy Row in the static array, must be in range.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+static inline funge_cell fungespace_static_read(funge_unsigned_cell sx,
+                                                funge_unsigned_cell sy)
+{
+#ifdef CFUN_COMPACT_CELLS
+	fungeStaticCell stored = cfun_static_space[STATIC_COORD(sx, sy)];
+	if (FUNGE_LIKELY(stored != FSPACE_STATIC_ESCAPE))
+		return FSPACE_DECODE((funge_cell)stored);
+	return fungespace_overflow_get((funge_cell)(sx - cfun_static_offset_x),
+	                               (funge_cell)(sy - cfun_static_offset_y));
+#else
+	return FSPACE_DECODE(cfun_static_space[STATIC_COORD(sx, sy)]);
+#endif
+}
+
+/**
+ * Write a cell in the static array. Doesn't update counts or bounds.
+ * @param sx Column in the static array, must be in range.
+ * @param sy Row in the static array, must be in range.
+ * @param value Value to store.
+ * @return The previous value of the cell.
+ */
+FUNGE_ATTR_FAST
+static inline funge_cell fungespace_static_write(funge_unsigned_cell sx,
+                                                 funge_unsigned_cell sy,
+                                                 funge_cell value)
+{
+	fungeStaticCell *cell = &cfun_static_space[STATIC_COORD(sx, sy)];
+#ifdef CFUN_COMPACT_CELLS
+	funge_cell x = (funge_cell)(sx - cfun_static_offset_x);
+	funge_cell y = (funge_cell)(sy - cfun_static_offset_y);
+	funge_cell prev;
+	if (FUNGE_LIKELY(*cell != FSPACE_STATIC_ESCAPE)) {
+		prev = FSPACE_DECODE((funge_cell)*cell);
+		if (FUNGE_LIKELY(FSPACE_STATIC_FITS(value))) {
+			*cell = (fungeStaticCell)FSPACE_ENCODE(value);
+		} else {
+			*cell = FSPACE_STATIC_ESCAPE;
+			fungespace_tile_put(x, y, value);
 		}
+		return prev;
+	}
+	prev = fungespace_overflow_get(x, y);
+	if (FSPACE_STATIC_FITS(value)) {
+		fungespace_overflow_clear(x, y);
+		*cell = (fungeStaticCell)FSPACE_ENCODE(value);
+	} else {
+		fungespace_overflow_replace(x, y, value);
+	}
+	return prev;
+#else
+	funge_cell prev = FSPACE_DECODE(*cell);
+	*cell = FSPACE_ENCODE(value);
+	return prev;
 #endif
+}
+
+
+/***************************
+ * Adaptive static array   *
+ ***************************/
+
+/*
+ * With -a hash lookups (that is, accesses outside the static array that the
+ * lookup caches couldn't handle) are sampled into a few candidate regions,
+ * using the Misra-Gries heavy hitters algorithm. Every ADAPTIVE_PERIOD ticks
+ * the main loop calls fungespace_adaptive_tick(), which moves the static array
+ * to be centred on the area most lookups went to, if it got a large share of
+ * them. A move that didn't reduce the number of lookups in the period after it
+ * is undone, and then no move is tried for a while (doubling each time).
+ */
+
+/// log2 of the width and height of a sampled region.
+#define ADAPTIVE_REGION_BITS 6
+/// Number of candidate regions tracked.
+#define ADAPTIVE_CANDIDATES 8
+/// Ticks between decisions.
+#define ADAPTIVE_PERIOD 0x10000
+/// Don't bother moving with fewer lookups than this in a period.
+#define ADAPTIVE_MIN_LOOKUPS (ADAPTIVE_PERIOD / 64)
+/// Upper limit for periods to wait after an undone move.
+#define ADAPTIVE_BACKOFF_MAX 0x100
+
+typedef struct adaptiveCandidate {
+	funge_cell    x;     ///< Top left corner of region.
+	funge_cell    y;     ///< Top left corner of region.
+	uint_fast32_t count; ///< 0 means the slot is free.
+} adaptiveCandidate;
+
+static struct {
+	adaptiveCandidate candidates[ADAPTIVE_CANDIDATES];
+	uint_fast32_t     samples;      ///< Samples this period.
+	uint_fast64_t     last_lookups; ///< fspace.stats.lookups at start of period.
+	uint_fast64_t     before;       ///< Lookups in the period before last move.
+	funge_vector      previous;     ///< Where the static array was before last move.
+	bool              moved;        ///< Did we move at the end of last period?
+	uint_fast32_t     backoff;      ///< Periods to wait after next undone move.
+	uint_fast32_t     wait;         ///< Periods left to wait.
+} fspace_adaptive = { .samples = 0, .moved = false, .backoff = 1, .wait = 0 };
+
+uint_fast32_t fungespace_adaptive_countdown = ADAPTIVE_PERIOD;
+
+/**
+ * Record a hash lookup for the tile at x,y.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NOINLINE
+static void fungespace_adaptive_sample(funge_cell x, funge_cell y)
+{
+	adaptiveCandidate *free_slot = NULL;
+	const funge_unsigned_cell mask = ~(((funge_unsigned_cell)1 << ADAPTIVE_REGION_BITS) - 1);
+	funge_cell rx = (funge_cell)((funge_unsigned_cell)x & mask);
+	funge_cell ry = (funge_cell)((funge_unsigned_cell)y & mask);
+
+	fspace_adaptive.samples++;
+	for (size_t i = 0; i < ADAPTIVE_CANDIDATES; i++) {
+		adaptiveCandidate *c = &fspace_adaptive.candidates[i];
+		if (c->count == 0) {
+			if (!free_slot)
+				free_slot = c;
+		} else if (c->x == rx && c->y == ry) {
+			c->count++;
+			return;
+		}
+	}
+	if (free_slot) {
+		free_slot->x = rx;
+		free_slot->y = ry;
+		free_slot->count = 1;
 	} else {
+		for (size_t i = 0; i < ADAPTIVE_CANDIDATES; i++)
+			fspace_adaptive.candidates[i].count--;
+	}
+}
+
 #ifdef CFUN_EXACT_BOUNDS
-		funge_cell* prev = ght_fspace_get(fspace.entries, position);
-		if (!prev) {
-			if (value == ' ')
-				return;
-			if (FUNGE_UNLIKELY(ght_fspace_insert(fspace.entries, value, position) == -1)) {
-				DIAG_FATAL_LOC("Internal error: insert in hash table failed when value known not to exist.");
-			}
-			fungespace_count(true, position);
+/**
+ * Build the count array for a static array starting at start, and move counts
+ * between the hash table and the arrays. Helper for fungespace_static_move().
+ * @param hashtable Column or row count hash table.
+ * @param oldarray Current count array.
+ * @param newarray Zeroed array of size elements to fill in.
+ * @param oldstart First column/row in current static array.
+ * @param newstart First column/row in new static array.
+ * @param size Number of columns/rows in the static array.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void fungespace_move_counts(ght_fspacecount_hash_table_t * restrict hashtable,
+                                   const funge_unsigned_cell * restrict oldarray,
+                                   funge_unsigned_cell * restrict newarray,
+                                   funge_cell oldstart, funge_cell newstart,
+                                   funge_unsigned_cell size)
+{
+	for (funge_unsigned_cell i = 0; i < size; i++) {
+		funge_cell key = (funge_cell)((funge_unsigned_cell)newstart + i);
+		funge_unsigned_cell oldindex = (funge_unsigned_cell)key - (funge_unsigned_cell)oldstart;
+		if (oldindex < size) {
+			newarray[i] = oldarray[oldindex];
 		} else {
-			if (value == ' ') {
-				ght_fspace_remove(fspace.entries, position);
-				fungespace_count(false, position);
-			} else {
-				*prev = value;
+			funge_unsigned_cell *count = ght_fspacecount_get(hashtable, &key);
+			if (count) {
+				newarray[i] = *count;
+				ght_fspacecount_remove(hashtable, &key);
+			}
+		}
+	}
+	for (funge_unsigned_cell i = 0; i < size; i++) {
+		funge_cell key = (funge_cell)((funge_unsigned_cell)oldstart + i);
+		if (oldarray[i] != 0 && ((funge_unsigned_cell)key - (funge_unsigned_cell)newstart) >= size) {
+			if (FUNGE_UNLIKELY(ght_fspacecount_insert(hashtable, oldarray[i], &key) == -1)) {
+				DIAG_FATAL_LOC("Internal error: insert in hash table failed when value known not to exist.");
 			}
 		}
+	}
+}
+#endif
+
+/**
+ * Move the static array so its top left corner is at nx,ny, moving cells
+ * between it and the tiles as needed.
+ */
+FUNGE_ATTR_FAST
+static void fungespace_static_move(funge_cell nx, funge_cell ny)
+{
+	const funge_unsigned_cell w = cfun_static_x;
+	const funge_unsigned_cell h = cfun_static_y;
+	const funge_cell ox = (funge_cell)(0 - cfun_static_offset_x);
+	const funge_cell oy = (funge_cell)(0 - cfun_static_offset_y);
+	const size_t cells = (size_t)w * (size_t)h;
+	fungeStaticCell *old = cfun_static_space;
+	fungeStaticCell *new;
+#ifdef CFUN_EXACT_BOUNDS
+	funge_unsigned_cell *newcol, *newrow;
+#endif
+
+	if (nx == ox && ny == oy)
+		return;
+	new = fungespace_map_zero(cells * sizeof(fungeStaticCell));
+	if (FUNGE_UNLIKELY(!new))
+		return;
+#ifdef CFUN_EXACT_BOUNDS
+	newcol = calloc((size_t)w, sizeof(funge_unsigned_cell));
+	newrow = calloc((size_t)h, sizeof(funge_unsigned_cell));
+	if (FUNGE_UNLIKELY(!newcol || !newrow)) {
+		free(newcol);
+		free(newrow);
+		munmap(new, cells * sizeof(fungeStaticCell));
+		return;
+	}
+#endif
+#ifndef CFUN_ZERO_SPACE
+	for (size_t i = 0; i < cells; i++)
+		new[i] = ' ';
+#endif
+
+	// Cells in tiles inside the new area go into the new array.
+	for (funge_unsigned_cell dy = 0; dy < h + FUNGESPACE_TILE_SIZE; dy += FUNGESPACE_TILE_SIZE) {
+		for (funge_unsigned_cell dx = 0; dx < w + FUNGESPACE_TILE_SIZE; dx += FUNGESPACE_TILE_SIZE) {
+			funge_vector pos = { TILE_ORIGIN((funge_unsigned_cell)nx + dx),
+			                     TILE_ORIGIN((funge_unsigned_cell)ny + dy) };
+			fungeSpaceTile *tile = fungespace_tile_find(&pos);
+			if (!tile)
+				continue;
+			for (funge_cell ty = 0; ty < FUNGESPACE_TILE_SIZE; ty++) {
+				funge_unsigned_cell sy = (funge_unsigned_cell)pos.y + (funge_unsigned_cell)ty - (funge_unsigned_cell)ny;
+				if (sy >= h)
+					continue;
+				for (funge_cell tx = 0; tx < FUNGESPACE_TILE_SIZE; tx++) {
+					funge_unsigned_cell sx = (funge_unsigned_cell)pos.x + (funge_unsigned_cell)tx - (funge_unsigned_cell)nx;
+					funge_cell *cell = &tile->cells[TILE_COORD(tx, ty)];
+					if (sx >= w || FSPACE_DECODE(*cell) == ' ')
+						continue;
+#ifdef CFUN_COMPACT_CELLS
+					if (!FSPACE_STATIC_FITS(FSPACE_DECODE(*cell))) {
+						// Stays in the tile.
+						new[STATIC_COORD(sx, sy)] = FSPACE_STATIC_ESCAPE;
+						continue;
+					}
+					new[STATIC_COORD(sx, sy)] = (fungeStaticCell)*cell;
 #else
-		if (value == ' ') {
-			ght_fspace_remove(fspace.entries, position);
-		} else {
-			// Reuse cell if it exists
-			funge_cell *tmp;
-			if ((tmp = (funge_cell*)ght_fspace_get(fspace.entries, position)) != NULL) {
-				*tmp = value;
-			} else {
-				if (FUNGE_UNLIKELY(ght_fspace_insert(fspace.entries, value, position) == -1)) {
-					DIAG_FATAL_LOC("Internal error: insert in hash table failed when value known not to exist.");
+					new[STATIC_COORD(sx, sy)] = *cell;
+#endif
+					*cell = FSPACE_ENCODE(' ');
+					tile->used--;
+					fspace.stats.moved++;
 				}
 			}
+			if (tile->used == 0)
+				fungespace_tile_destroy(&pos);
 		}
+	}
+	// Cells in the old array go into the new array or tiles.
+	for (funge_unsigned_cell sy = 0; sy < h; sy++) {
+		funge_cell y = (funge_cell)((funge_unsigned_cell)oy + sy);
+		funge_unsigned_cell ny_index = (funge_unsigned_cell)y - (funge_unsigned_cell)ny;
+#ifdef CFUN_EXACT_BOUNDS
+		if (fspace.countsvalid && cfun_static_use_count_row[sy] == 0)
+			continue;
 #endif
+		for (funge_unsigned_cell sx = 0; sx < w; sx++) {
+			funge_cell x = (funge_cell)((funge_unsigned_cell)ox + sx);
+			funge_unsigned_cell nx_index = (funge_unsigned_cell)x - (funge_unsigned_cell)nx;
+			funge_cell value;
+#ifdef CFUN_COMPACT_CELLS
+			// Already in a tile, and escaped in the new array above if inside it.
+			if (old[STATIC_COORD(sx, sy)] == FSPACE_STATIC_ESCAPE)
+				continue;
+#endif
+			value = FSPACE_DECODE((funge_cell)old[STATIC_COORD(sx, sy)]);
+			if (value == ' ')
+				continue;
+			if (nx_index < w && ny_index < h) {
+				new[STATIC_COORD(nx_index, ny_index)] = old[STATIC_COORD(sx, sy)];
+			} else {
+				fungespace_tile_put(x, y, value);
+				fspace.stats.moved++;
+			}
+		}
+	}
+#ifdef CFUN_EXACT_BOUNDS
+	if (fspace.countsvalid) {
+		fungespace_move_counts(fspace.col_count, cfun_static_use_count_col, newcol, ox, nx, w);
+		fungespace_move_counts(fspace.row_count, cfun_static_use_count_row, newrow, oy, ny, h);
 	}
+	free(cfun_static_use_count_col);
+	free(cfun_static_use_count_row);
+	cfun_static_use_count_col = newcol;
+	cfun_static_use_count_row = newrow;
+#endif
+	cfun_static_space = new;
+	cfun_static_offset_x = -(funge_unsigned_cell)nx;
+	cfun_static_offset_y = -(funge_unsigned_cell)ny;
+	munmap(old, cells * sizeof(fungeStaticCell));
+	// Cached lookups may refer to what is now in the array.
+	fspace.tilegeneration++;
+	fungespace_cursor_generation++;
+	fspace.stats.relocations++;
 }
 
+/**
+ * Find where to move the static array, if anywhere.
+ * @param pos Out parameter for the new top left corner.
+ * @return True if it should be moved.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static bool fungespace_adaptive_pick(funge_vector * restrict pos)
+{
+	const adaptiveCandidate *best = NULL;
+	uint_fast64_t total = 0;
+	int_fast64_t sum_x = 0, sum_y = 0;
+	funge_unsigned_cell half = (funge_unsigned_cell)1 << (ADAPTIVE_REGION_BITS - 1);
+	funge_unsigned_cell cx, cy;
+
+	for (size_t i = 0; i < ADAPTIVE_CANDIDATES; i++) {
+		const adaptiveCandidate *c = &fspace_adaptive.candidates[i];
+		if (c->count != 0 && (!best || c->count > best->count))
+			best = c;
+	}
+	if (!best)
+		return false;
+	// Take the regions near the best one into account too, they would fit
+	// in the static array together with it.
+	for (size_t i = 0; i < ADAPTIVE_CANDIDATES; i++) {
+		const adaptiveCandidate *c = &fspace_adaptive.candidates[i];
+		funge_cell dx = (funge_cell)((funge_unsigned_cell)c->x - (funge_unsigned_cell)best->x);
+		funge_cell dy = (funge_cell)((funge_unsigned_cell)c->y - (funge_unsigned_cell)best->y);
+		if (c->count == 0
+		    || (funge_unsigned_cell)ABS(dx) >= cfun_static_x / 2
+		    || (funge_unsigned_cell)ABS(dy) >= cfun_static_y / 2)
+			continue;
+		total += c->count;
+		sum_x += (int_fast64_t)dx * (int_fast64_t)c->count;
+		sum_y += (int_fast64_t)dy * (int_fast64_t)c->count;
+	}
+	// Only move for an area that got a large share of the lookups. The
+	// counts are underestimates by at most samples / (ADAPTIVE_CANDIDATES + 1).
+	if (total < fspace_adaptive.samples / 3)
+		return false;
+	cx = (funge_unsigned_cell)best->x + half + (funge_unsigned_cell)(funge_cell)(sum_x / (int_fast64_t)total);
+	cy = (funge_unsigned_cell)best->y + half + (funge_unsigned_cell)(funge_cell)(sum_y / (int_fast64_t)total);
+	pos->x = TILE_ORIGIN(cx - cfun_static_x / 2);
+	pos->y = TILE_ORIGIN(cy - cfun_static_y / 2);
+	return true;
+}
 
 FUNGE_ATTR_FAST void
-fungespace_set(funge_cell value, const funge_vector * restrict position)
+fungespace_adaptive_tick(void)
 {
-	assert(position != NULL);
-	if (value != ' ') {
-		// It is faster to not use else if here, because this way the code
-		// translates into conditional moves (on x86 at least).
-		if (fspace.bottomRightCorner.y < position->y)
-			fspace.bottomRightCorner.y = position->y;
-		if (fspace.topLeftCorner.y > position->y)
-			fspace.topLeftCorner.y = position->y;
-		if (fspace.bottomRightCorner.x < position->x)
-			fspace.bottomRightCorner.x = position->x;
-		if (fspace.topLeftCorner.x > position->x)
-			fspace.topLeftCorner.x = position->x;
+	uint_fast64_t lookups = fspace.stats.lookups - fspace_adaptive.last_lookups;
+	funge_vector pos;
+
+	if (!setting_adaptive_static || !cfun_static_space) {
+		fungespace_adaptive_countdown = UINT_FAST32_MAX;
+		return;
 	}
-	fungespace_set_no_bounds_update(value, position);
+	fungespace_adaptive_countdown = ADAPTIVE_PERIOD;
+	fspace_adaptive.last_lookups = fspace.stats.lookups;
+
+	if (fspace_adaptive.moved) {
+		fspace_adaptive.moved = false;
+		if (lookups >= fspace_adaptive.before) {
+			// Didn't help, go back and leave it alone for a while.
+			fungespace_static_move(fspace_adaptive.previous.x, fspace_adaptive.previous.y);
+			fspace_adaptive.wait = fspace_adaptive.backoff;
+			if (fspace_adaptive.backoff < ADAPTIVE_BACKOFF_MAX)
+				fspace_adaptive.backoff *= 2;
+			goto reset;
+		}
+	}
+	if (fspace_adaptive.wait > 0) {
+		fspace_adaptive.wait--;
+		goto reset;
+	}
+	if (lookups >= ADAPTIVE_MIN_LOOKUPS && fungespace_adaptive_pick(&pos)) {
+		fspace_adaptive.previous.x = (funge_cell)(0 - cfun_static_offset_x);
+		fspace_adaptive.previous.y = (funge_cell)(0 - cfun_static_offset_y);
+		fspace_adaptive.before = lookups;
+		fspace_adaptive.moved = true;
+		fungespace_static_move(pos.x, pos.y);
+	}
+reset:
+	memset(fspace_adaptive.candidates, 0, sizeof(fspace_adaptive.candidates));
+	fspace_adaptive.samples = 0;
 }
 
+void fungespace_print_stats(void)
+{
+	fprintf(stderr, "Funge-Space statistics:\n");
+	if (cfun_static_space) {
+		fprintf(stderr, "  Static array:       %" FUNGECELLPRI "x%" FUNGECELLPRI
+		        " at (%" FUNGECELLPRI ",%" FUNGECELLPRI ")\n",
+		        (funge_cell)cfun_static_x, (funge_cell)cfun_static_y,
+		        (funge_cell)(0 - cfun_static_offset_x),
+		        (funge_cell)(0 - cfun_static_offset_y));
+	} else {
+		fprintf(stderr, "  Static array:       none\n");
+	}
+	fprintf(stderr, "  Accesses outside:   %" PRIuFAST64 "\n", fspace.stats.outside);
+	fprintf(stderr, "  Hash lookups:       %" PRIuFAST64 "\n", fspace.stats.lookups);
+	fprintf(stderr, "  Tiles:              %zu (peak %zu)\n",
+	        fspace.stats.tiles, fspace.stats.tiles_peak);
+	fprintf(stderr, "  Relocations:        %" PRIuFAST64 " (%" PRIuFAST64 " cells moved)\n",
+	        fspace.stats.relocations, fspace.stats.moved);
+	fprintf(stderr, "  Skip cache hits:    %" PRIuFAST64 "\n", fspace.stats.skiphits);
+	fprintf(stderr, "  Load cache hits:    %" PRIuFAST64 "\n", fspace.stats.loadhits);
+	fprintf(stderr, "  Program image:      %s\n", fspace.stats.image ? "mapped" : "not used");
+#ifdef CFUN_EXACT_BOUNDS
+	fprintf(stderr, "  Row/column counts:  %s\n", fspace.countsvalid ? "kept" : "not needed");
+#endif
+}
 
 /**
- * Special variant of fungespace_set() to deal with initial load.
- * Needed to handle the initial bounding box properly.
- * Must NOT be called with a space for value.
+ * Find the tile containing position, trying cache before the hash table.
+ * @return The tile or NULL if there is no tile (all spaces) there.
  */
-FUNGE_ATTR_FAST static inline void
-fungespace_set_initial(funge_cell value, const funge_vector * restrict position)
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static inline fungeSpaceTile *fungespace_tile_find_cached(const funge_vector * restrict position,
+                                                          fungeSpaceCache * restrict cache)
 {
-	if (FUNGE_LIKELY(fspace.boundsvalid)) {
-		// It is faster to not use else if here, because this way the code
-		// translates into conditional moves (on x86 at least).
-		if (fspace.bottomRightCorner.y < position->y)
-			fspace.bottomRightCorner.y = position->y;
-		if (fspace.topLeftCorner.y > position->y)
-			fspace.topLeftCorner.y = position->y;
-		if (fspace.bottomRightCorner.x < position->x)
-			fspace.bottomRightCorner.x = position->x;
-		if (fspace.topLeftCorner.x > position->x)
-			fspace.topLeftCorner.x = position->x;
+	funge_cell ox = TILE_ORIGIN(position->x);
+	funge_cell oy = TILE_ORIGIN(position->y);
+	if (FUNGE_LIKELY(cache->generation == fspace.tilegeneration
+	                 && cache->origin.x == ox && cache->origin.y == oy))
+		return cache->tile;
+	fspace.stats.lookups++;
+	if (FUNGE_UNLIKELY(setting_adaptive_static))
+		fungespace_adaptive_sample(ox, oy);
+	cache->tile       = fungespace_tile_find(position);
+	cache->origin.x   = ox;
+	cache->origin.y   = oy;
+	cache->generation = fspace.tilegeneration;
+	return cache->tile;
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static inline funge_cell fungespace_tile_get(const funge_vector * restrict position,
+                                             fungeSpaceCache * restrict cache)
+{
+	fungeSpaceTile *tile;
+	fspace.stats.outside++;
+	tile = fungespace_tile_find_cached(position, cache);
+	if (!tile)
+		return (funge_cell)' ';
+	return FSPACE_DECODE(tile->cells[TILE_COORD(position->x, position->y)]);
+}
+
+
+/************************
+ * Funge space get code *
+ ************************/
+
+FUNGE_ATTR_FAST funge_cell
+fungespace_get(const funge_vector * restrict position)
+{
+	// Offsets for static.
+	funge_unsigned_cell x = (funge_unsigned_cell)position->x + cfun_static_offset_x;
+	funge_unsigned_cell y = (funge_unsigned_cell)position->y + cfun_static_offset_y;
+
+	if (FUNGESPACE_RANGE_CHECK(x, y)) {
+		return fungespace_static_read(x, y);
 	} else {
-		fspace.topLeftCorner.y = fspace.bottomRightCorner.y = position->y;
-		fspace.topLeftCorner.x = fspace.bottomRightCorner.x = position->x;
-		fspace.boundsvalid = true;
+		return fungespace_tile_get(position, &fspace.cache);
 	}
-	fungespace_set_no_bounds_update(value, position);
 }
 
+FUNGE_ATTR_FAST funge_cell
+fungespace_get_cached(const funge_vector * restrict position,
+                      fungeSpaceCache * restrict cache)
+{
+	// Offsets for static.
+	funge_unsigned_cell x = (funge_unsigned_cell)position->x + cfun_static_offset_x;
+	funge_unsigned_cell y = (funge_unsigned_cell)position->y + cfun_static_offset_y;
 
-FUNGE_ATTR_FAST void
-fungespace_set_offset(funge_cell value,
-                      const funge_vector * restrict position,
+	if (FUNGESPACE_RANGE_CHECK(x, y)) {
+		return fungespace_static_read(x, y);
+	} else {
+		return fungespace_tile_get(position, cache);
+	}
+}
+
+FUNGE_ATTR_FAST funge_cell
+fungespace_get_offset(const funge_vector * restrict position,
                       const funge_vector * restrict offset)
 {
+	funge_vector tmp;
+	// Offsets for static.
+	funge_unsigned_cell x, y;
+
 	assert(position != NULL);
 	assert(offset != NULL);
 
-	fungespace_set(value, vector_create_ref(position->x + offset->x, position->y + offset->y));
-}
-
+	tmp.x = position->x + offset->x;
+	tmp.y = position->y + offset->y;
 
-/*****************
- * Wrapping code *
- *****************/
+	x = (funge_unsigned_cell)tmp.x + cfun_static_offset_x;
+	y = (funge_unsigned_cell)tmp.y + cfun_static_offset_y;
 
-/// Duplicated from vector.c for speed reasons (inlining).
-FUNGE_ATTR_PURE FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
-static inline bool fspace_vector_is_cardinal(const funge_vector * restrict v)
-{
-	// Due to unsigned this can't overflow in the addition below.
-	funge_unsigned_cell x = (funge_unsigned_cell)ABS(v->x);
-	funge_unsigned_cell y = (funge_unsigned_cell)ABS(v->y);
-	if ((x + y) != 1)
-		return false;
-	if (x && y)
-		return false;
-	return true;
+	if (FUNGESPACE_RANGE_CHECK(x, y)) {
+		return fungespace_static_read(x, y);
+	} else {
+		return fungespace_tile_get(&tmp, &fspace.cache);
+	}
 }
 
-/* Thanks to Elliott Hird for the algorithm in the following wrapping code. */
-FUNGE_ATTR_CONST FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
-static inline funge_cell wrap_frac(funge_cell n, funge_cell d)
+/**
+ * How many steps of d from a (at s in the static array of the given size)
+ * stay inside both the static array and min..max. For fungespace_cursor_setup().
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_CONST
+static inline funge_unsigned_cell cursor_steps(funge_unsigned_cell s, funge_unsigned_cell size,
+                                               funge_cell a, funge_cell min, funge_cell max,
+                                               funge_cell d)
 {
-	return (n % d == 0) ? (n / d) : ((n + d) / d);
+	funge_unsigned_cell room;
+	if (d > 0) {
+		room = size - 1 - s;
+		if ((funge_unsigned_cell)(max - a) < room)
+			room = (funge_unsigned_cell)(max - a);
+		return room / (funge_unsigned_cell)d;
+	} else if (d < 0) {
+		room = s;
+		if ((funge_unsigned_cell)(a - min) < room)
+			room = (funge_unsigned_cell)(a - min);
+		return room / (0 - (funge_unsigned_cell)d);
+	}
+	return size;
 }
 
-// a  = value in x or y
-// r  = min in x or y
-// s  = max in x or y
-// da = delta in x or y
-FUNGE_ATTR_CONST FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
-static inline funge_cell wrap_frac_dir(funge_cell a, funge_cell r,
-                                       funge_cell s, funge_cell da)
+FUNGE_ATTR_FAST funge_cell
+fungespace_cursor_setup(fungeSpaceCursor * restrict cursor,
+                        const funge_vector * restrict position,
+                        const funge_vector * restrict delta,
+                        fungeSpaceCache * restrict cache)
 {
-	return (da > 0) ? wrap_frac(a - r, da) : wrap_frac(a - s, da);
-}
+	funge_unsigned_cell x = (funge_unsigned_cell)position->x + cfun_static_offset_x;
+	funge_unsigned_cell y = (funge_unsigned_cell)position->y + cfun_static_offset_y;
 
+	cursor->position   = *position;
+	cursor->delta      = *delta;
+	cursor->generation = fungespace_cursor_generation;
+	cursor->steps      = 0;
+	if (!FUNGESPACE_RANGE_CHECK(x, y)) {
+		cursor->cell = NULL;
+		return fungespace_tile_get(position, cache);
+	}
+	cursor->cell = &cfun_static_space[STATIC_COORD(x, y)];
+#ifndef CFUN_TILED_STATIC
+	// With blocks there is no fixed stride, those just use the cell pointer.
+	// Bounds that aren't exact may shrink, so don't trust them.
+#  ifdef CFUN_EXACT_BOUNDS
+	if (fspace.boundsexact && fungespace_in_range(position)) {
+#  else
+	if (fungespace_in_range(position)) {
+#  endif
+		funge_unsigned_cell sx = cursor_steps(x, cfun_static_x, position->x,
+		                                      fspace.topLeftCorner.x, fspace.bottomRightCorner.x,
+		                                      delta->x);
+		funge_unsigned_cell sy = cursor_steps(y, cfun_static_y, position->y,
+		                                      fspace.topLeftCorner.y, fspace.bottomRightCorner.y,
+		                                      delta->y);
+		cursor->steps  = (sx < sy) ? sx : sy;
+		cursor->stride = (ptrdiff_t)delta->x + (ptrdiff_t)delta->y * (ptrdiff_t)cfun_static_x;
+	}
+#endif
+	return fungespace_static_read(x, y);
+}
+
+#ifdef CFUN_EXACT_BOUNDS
+/**
+ * Start keeping counts, by counting everything currently in Funge-Space.
+ * Only done once, most programs never get here.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NOINLINE
+static void fungespace_build_counts(void)
+{
+	ght_fspace_iterator_t iterator;
+	const funge_vector *p_key;
+	fungeSpaceTile **p;
+
+	for (funge_unsigned_cell sy = 0; sy < cfun_static_y; sy++) {
+		funge_cell y = (funge_cell)(sy - cfun_static_offset_y);
+		for (funge_unsigned_cell sx = 0; sx < cfun_static_x; sx++) {
+			if (fungespace_static_read(sx, sy) != ' ')
+				fungespace_count_cell(true, (funge_cell)(sx - cfun_static_offset_x), y);
+		}
+	}
+	for (p = ght_fspace_first(fspace.entries, &iterator, &p_key);
+	     p; p = ght_fspace_next(&iterator, &p_key)) {
+		for (funge_cell ty = 0; ty < FUNGESPACE_TILE_SIZE; ty++)
+			for (funge_cell tx = 0; tx < FUNGESPACE_TILE_SIZE; tx++) {
+				funge_cell x = p_key->x + tx;
+				funge_cell y = p_key->y + ty;
+				// Values for escaped static cells were counted above.
+				if (FUNGESPACE_RANGE_CHECK((funge_unsigned_cell)x + cfun_static_offset_x,
+				                           (funge_unsigned_cell)y + cfun_static_offset_y))
+					continue;
+				if (FSPACE_DECODE((*p)->cells[TILE_COORD(tx, ty)]) != ' ')
+					fungespace_count_cell(true, x, y);
+			}
+	}
+	fspace.countsvalid = true;
+}
+
+/**
+ * A cell on the edge of the bounds was cleared, so they may be too large now.
+ */
+FUNGE_ATTR_FAST
+static inline void fungespace_bounds_cleared(void)
+{
+	if (FUNGE_UNLIKELY(!fspace.countsvalid))
+		fungespace_build_counts();
+	fspace.boundsexact = false;
+	// Cursors may go past the new bounds.
+	fungespace_cursor_generation++;
+}
+
+/**
+ * Update column/row counts after a cell at position changed between space
+ * and non-space (the new value is already stored).
+ *
+ * Bounds only grow until a cell on the edge of them is cleared, and until
+ * then nothing is counted. The counts are built from what is in Funge-Space
+ * the first time that happens.
+ */
+FUNGE_ATTR_FAST
+static inline void fungespace_count(bool isset, const funge_vector * restrict position)
+{
+	if (FUNGE_LIKELY(fspace.countsvalid))
+		fungespace_count_cell(isset, position->x, position->y);
+	if (!isset && fungespace_on_bounds(position->x, position->y))
+		fungespace_bounds_cleared();
+}
+#endif
+
+/**************
+ * Skip cache *
+ **************/
+
+/*
+ * Remembers where skipping over spaces or a ;; comment from a given cell with
+ * a given cardinal delta ended up. The path of such a skip is a single row or
+ * column (wrapping doesn't leave it), so an entry stays valid until a cell in
+ * that row or column changes to or from a space or ';'. Rows and columns are
+ * hashed into SKIPCACHE_LINES generation counters, which are bumped on such
+ * changes. Other changes don't move where a skip ends, but may change the
+ * instruction there, so that is read again on every hit.
+ */
+/// Entries in the skip cache, must be a power of two.
+#define SKIPCACHE_SIZE 256
+/// Generation counters for rows and for columns, must be a power of two.
+#define SKIPCACHE_LINES 256
+
+typedef struct skipCacheEntry {
+	funge_vector  from;       ///< Where the skip started.
+	funge_vector  to;         ///< Where it ended. Only where, the value there may change.
+	uint_fast64_t generation; ///< Generation of the row or column when filled in.
+	/// Direction and kind of skip, see skipcache_key(). 0 means unused.
+	uint_fast8_t  key;
+} skipCacheEntry;
+
+static struct {
+	skipCacheEntry entries[SKIPCACHE_SIZE];
+	uint_fast64_t  rows[SKIPCACHE_LINES];
+	uint_fast64_t  cols[SKIPCACHE_LINES];
+} fspace_skipcache;
+
+/**
+ * Note that the cell at x,y changed from prev to value (which differ).
+ */
+FUNGE_ATTR_FAST
+static inline void skipcache_update(funge_cell x, funge_cell y,
+                                    funge_cell prev, funge_cell value)
+{
+	if (prev == ' ' || value == ' ' || prev == ';' || value == ';') {
+		fspace_skipcache.rows[(funge_unsigned_cell)y & (SKIPCACHE_LINES - 1)]++;
+		fspace_skipcache.cols[(funge_unsigned_cell)x & (SKIPCACHE_LINES - 1)]++;
+	}
+}
+
+/****************
+ * Write epochs *
+ ****************/
+
+/*
+ * Funge-Space is split into regions of the same size as tiles (wherever the
+ * cells are stored), and every change of a cell stores a new epoch for its
+ * region. Regions are mapped onto an EPOCH_REGIONS x EPOCH_REGIONS torus, so
+ * a program spanning up to 2048x2048 cells never has two regions sharing a
+ * slot. Sharing one only makes fungespace_changed_since() answer true more
+ * often, never false when it shouldn't.
+ */
+/// Slots along each axis, must be a power of two.
+#define EPOCH_REGIONS 64
+
+static struct {
+	/// Last epoch handed out.
+	uint_fast64_t now;
+	/// Epoch of the last change in each region.
+	uint_fast64_t regions[EPOCH_REGIONS * EPOCH_REGIONS];
+} fspace_epochs;
+
+/// Slot for the region containing x,y.
+#define EPOCH_SLOT(m_x, m_y) \
+	((((funge_unsigned_cell)(m_x) >> FUNGESPACE_TILE_BITS) & (EPOCH_REGIONS - 1)) \
+	 + ((((funge_unsigned_cell)(m_y) >> FUNGESPACE_TILE_BITS) & (EPOCH_REGIONS - 1)) * EPOCH_REGIONS))
+
+/*
+ * Watched cells have a second set of region epochs, that only changes to
+ * them update. There is one watch bit per cell of a WATCH_SIDE x WATCH_SIDE
+ * torus, so for programs that fit in it a change to a cell next to a watched
+ * one doesn't count. Bits are never cleared.
+ *
+ * The last few changes to watched cells are also logged, for callers that
+ * can tell if a particular cell matters to them.
+ */
+/// Cells along each axis of the watch bits, must be a power of two.
+#define WATCH_SIDE 1024
+/// Changes kept in the log, must be a power of two.
+#define WATCH_LOG 64
+
+static struct {
+	/// Epoch of the last change to a watched cell.
+	uint_fast64_t last;
+	/// Changes up to this epoch may be missing from the log (areas written).
+	uint_fast64_t unlogged;
+	/// Number of changes logged so far.
+	size_t logged;
+	/// The last changes, logged % WATCH_LOG is the next one to replace.
+	struct {
+		funge_vector  position;
+		uint_fast64_t epoch;
+	} log[WATCH_LOG];
+	/// Epoch of the last change to a watched cell in each region.
+	uint_fast64_t regions[EPOCH_REGIONS * EPOCH_REGIONS];
+	/// One bit per cell.
+	uint64_t bits[WATCH_SIDE * WATCH_SIDE / 64];
+} fspace_watch;
+
+/// Index of the watch bit for x,y.
+#define WATCH_BIT(m_x, m_y) \
+	(((funge_unsigned_cell)(m_x) & (WATCH_SIDE - 1)) \
+	 + ((funge_unsigned_cell)(m_y) & (WATCH_SIDE - 1)) * WATCH_SIDE)
+
+/**
+ * Note that the cell at x,y changed.
+ */
+FUNGE_ATTR_FAST
+static inline void epoch_touch(funge_cell x, funge_cell y)
+{
+	size_t slot = EPOCH_SLOT(x, y);
+	size_t bit = WATCH_BIT(x, y);
+	uint_fast64_t epoch = ++fspace_epochs.now;
+
+	fspace_epochs.regions[slot] = epoch;
+	if (FUNGE_UNLIKELY(fspace_watch.bits[bit / 64] & (UINT64_C(1) << (bit % 64)))) {
+		size_t entry = fspace_watch.logged++ % WATCH_LOG;
+		fspace_watch.log[entry].position = (funge_vector) { x, y };
+		fspace_watch.log[entry].epoch = epoch;
+		fspace_watch.regions[slot] = epoch;
+		fspace_watch.last = epoch;
+	}
+}
+
+FUNGE_ATTR_FAST uint_fast64_t fungespace_epoch(void)
+{
+	return fspace_epochs.now;
+}
+
+FUNGE_ATTR_FAST void fungespace_watch(const funge_vector * restrict position)
+{
+	size_t bit = WATCH_BIT(position->x, position->y);
+
+	assert(position != NULL);
+	fspace_watch.bits[bit / 64] |= UINT64_C(1) << (bit % 64);
+}
+
+FUNGE_ATTR_FAST uint_fast64_t fungespace_watched_epoch(void)
+{
+	return fspace_watch.last;
+}
+
+FUNGE_ATTR_FAST ssize_t
+fungespace_watched_changes(uint_fast64_t epoch, funge_vector * restrict cells, size_t max)
+{
+	size_t count = 0;
+
+	assert(cells != NULL);
+	if (epoch < fspace_watch.unlogged)
+		return -1;
+	while (count < fspace_watch.logged) {
+		size_t entry = (fspace_watch.logged - 1 - count) % WATCH_LOG;
+		if (fspace_watch.log[entry].epoch <= epoch)
+			return (ssize_t)count;
+		if (count == max || count == WATCH_LOG)
+			return -1;
+		cells[count++] = fspace_watch.log[entry].position;
+	}
+	return (ssize_t)count;
+}
+
+/**
+ * Number of region slots along one axis from a to a+length-1.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_CONST
+static inline funge_unsigned_cell epoch_span(funge_cell a, funge_cell length)
+{
+	funge_unsigned_cell first = (funge_unsigned_cell)a >> FUNGESPACE_TILE_BITS;
+	funge_unsigned_cell last = ((funge_unsigned_cell)a + (funge_unsigned_cell)length - 1) >> FUNGESPACE_TILE_BITS;
+	// Wrapping around the cell range gives a huge count as well.
+	if (last - first >= EPOCH_REGIONS)
+		return EPOCH_REGIONS;
+	return last - first + 1;
+}
+
+/**
+ * Check if any of the region epochs for an area is newer than epoch.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_PURE
+static bool epoch_regions_since(const uint_fast64_t * restrict regions,
+                                const fungeRect * restrict rect, uint_fast64_t epoch)
+{
+	funge_unsigned_cell w, h, sx, sy;
+
+	if (rect->w <= 0 || rect->h <= 0)
+		return false;
+	w = epoch_span(rect->x, rect->w);
+	h = epoch_span(rect->y, rect->h);
+	sx = (funge_unsigned_cell)rect->x >> FUNGESPACE_TILE_BITS;
+	sy = (funge_unsigned_cell)rect->y >> FUNGESPACE_TILE_BITS;
+	for (funge_unsigned_cell j = 0; j < h; j++) {
+		const uint_fast64_t *row =
+		    &regions[((sy + j) & (EPOCH_REGIONS - 1)) * EPOCH_REGIONS];
+		for (funge_unsigned_cell i = 0; i < w; i++)
+			if (row[(sx + i) & (EPOCH_REGIONS - 1)] > epoch)
+				return true;
+	}
+	return false;
+}
+
+FUNGE_ATTR_FAST bool
+fungespace_changed_since(const fungeRect * restrict rect, uint_fast64_t epoch)
+{
+	assert(rect != NULL);
+	if (epoch >= fspace_epochs.now)
+		return false;
+	return epoch_regions_since(fspace_epochs.regions, rect, epoch);
+}
+
+FUNGE_ATTR_FAST bool
+fungespace_watched_changed_since(const fungeRect * restrict rect, uint_fast64_t epoch)
+{
+	assert(rect != NULL);
+	if (epoch >= fspace_watch.last)
+		return false;
+	return epoch_regions_since(fspace_watch.regions, rect, epoch);
+}
+
+/************************
+ * Funge space set code *
+ ************************/
+
+FUNGE_ATTR_FAST static inline void
+fungespace_set_no_bounds_update(funge_cell value,
+                                const funge_vector * restrict position)
+{
+	// Offsets for static.
+	funge_unsigned_cell x = (funge_unsigned_cell)position->x + cfun_static_offset_x;
+	funge_unsigned_cell y = (funge_unsigned_cell)position->y + cfun_static_offset_y;
+
+	if (FUNGESPACE_RANGE_CHECK(x, y)) {
+		funge_cell prev = fungespace_static_write(x, y, value);
+		if (value == prev)
+			return;
+		epoch_touch(position->x, position->y);
+		skipcache_update(position->x, position->y, prev, value);
+#ifdef CFUN_EXACT_BOUNDS
+		if ((prev == ' ') || (value == ' '))
+			fungespace_count((value != ' '), position);
+#endif
+	} else {
+		fungeSpaceTile *tile;
+		funge_cell *cell;
+		funge_cell prev;
+		fspace.stats.outside++;
+		tile = fungespace_tile_find_cached(position, &fspace.cache);
+		if (!tile) {
+			if (value == ' ')
+				return;
+			tile = fungespace_tile_create(position);
+		}
+		cell = &tile->cells[TILE_COORD(position->x, position->y)];
+		prev = FSPACE_DECODE(*cell);
+		if (value == prev)
+			return;
+		*cell = FSPACE_ENCODE(value);
+		epoch_touch(position->x, position->y);
+		skipcache_update(position->x, position->y, prev, value);
+		if ((prev == ' ') == (value == ' '))
+			return;
+#ifdef CFUN_EXACT_BOUNDS
+		fungespace_count((value != ' '), position);
+#endif
+		if (value != ' ') {
+			tile->used++;
+		} else if (--tile->used == 0) {
+			fungespace_tile_destroy(position);
+		}
+	}
+}
+
+
+FUNGE_ATTR_FAST void
+fungespace_set(funge_cell value, const funge_vector * restrict position)
+{
+	assert(position != NULL);
+	if (value != ' ') {
+		// It is faster to not use else if here, because this way the code
+		// translates into conditional moves (on x86 at least).
+		if (fspace.bottomRightCorner.y < position->y)
+			fspace.bottomRightCorner.y = position->y;
+		if (fspace.topLeftCorner.y > position->y)
+			fspace.topLeftCorner.y = position->y;
+		if (fspace.bottomRightCorner.x < position->x)
+			fspace.bottomRightCorner.x = position->x;
+		if (fspace.topLeftCorner.x > position->x)
+			fspace.topLeftCorner.x = position->x;
+	}
+	fungespace_set_no_bounds_update(value, position);
+}
+
+
+/**
+ * Special variant of fungespace_set() to deal with initial load.
+ * Needed to handle the initial bounding box properly.
+ * Must NOT be called with a space for value.
+ */
+FUNGE_ATTR_FAST static inline void
+fungespace_set_initial(funge_cell value, const funge_vector * restrict position)
+{
+	if (FUNGE_LIKELY(fspace.boundsvalid)) {
+		// It is faster to not use else if here, because this way the code
+		// translates into conditional moves (on x86 at least).
+		if (fspace.bottomRightCorner.y < position->y)
+			fspace.bottomRightCorner.y = position->y;
+		if (fspace.topLeftCorner.y > position->y)
+			fspace.topLeftCorner.y = position->y;
+		if (fspace.bottomRightCorner.x < position->x)
+			fspace.bottomRightCorner.x = position->x;
+		if (fspace.topLeftCorner.x > position->x)
+			fspace.topLeftCorner.x = position->x;
+	} else {
+		fspace.topLeftCorner.y = fspace.bottomRightCorner.y = position->y;
+		fspace.topLeftCorner.x = fspace.bottomRightCorner.x = position->x;
+		fspace.boundsvalid = true;
+	}
+	fungespace_set_no_bounds_update(value, position);
+}
+
+
+FUNGE_ATTR_FAST void
+fungespace_set_offset(funge_cell value,
+                      const funge_vector * restrict position,
+                      const funge_vector * restrict offset)
+{
+	assert(position != NULL);
+	assert(offset != NULL);
+
+	fungespace_set(value, vector_create_ref(position->x + offset->x, position->y + offset->y));
+}
+
+
+/*************************
+ * Rectangle operations  *
+ *************************/
+
+/*
+ * Copying and filling areas a row at a time, in runs that are either in the
+ * static array or in a single tile. Runs in the static array are copied or
+ * filled directly (memmove()), runs in tiles a tile row at a time, and what
+ * is left (escaped cells, the tiled static layout) one cell at a time.
+ * The bounds are extended once at the end, from the non-space cells written.
+ */
+
+/// Most cells moved through a buffer at a time.
+#define RECT_CHUNK 256
+/// Widest area for which column count changes in tiles are saved up.
+#define RECT_BATCH_MAX 0x10000
+
+/// What a rectangle operation has done so far.
+typedef struct rectState {
+	/// Bounding box of the non-space cells written.
+	funge_vector          min;
+	funge_vector          max;
+	bool                  any;
+#ifdef CFUN_EXACT_BOUNDS
+	/// Leftmost column written.
+	funge_cell            colx;
+	/// Number of columns written.
+	funge_unsigned_cell   ncols;
+	/// Changes to column counts not applied yet, allocated when needed.
+	funge_cell          * cols;
+#endif
+} rectState;
+
+/// Where the cells of a run are.
+typedef enum rectRunKind {
+	RECT_STATIC, ///< In the static array.
+	RECT_TILE,   ///< In a single tile, outside the static array.
+	RECT_CELLS   ///< Anywhere, access one cell at a time.
+} rectRunKind;
+
+/**
+ * Start a rectangle operation writing to columns x..x+w-1.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void rect_begin(rectState * restrict state, funge_cell x, funge_cell w)
+{
+	state->any = false;
+#ifdef CFUN_EXACT_BOUNDS
+	state->colx = x;
+	state->ncols = (funge_unsigned_cell)w;
+	state->cols = NULL;
+#else
+	(void)x; (void)w;
+#endif
+}
+
+/**
+ * Add the cells x0..x1 on row y to the bounding box of what was written.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void rect_extent_add(rectState * restrict state,
+                                   funge_cell x0, funge_cell x1, funge_cell y)
+{
+	if (!state->any) {
+		state->min.x = x0;
+		state->max.x = x1;
+		state->min.y = state->max.y = y;
+		state->any = true;
+		return;
+	}
+	if (state->min.x > x0)
+		state->min.x = x0;
+	if (state->max.x < x1)
+		state->max.x = x1;
+	if (state->min.y > y)
+		state->min.y = y;
+	if (state->max.y < y)
+		state->max.y = y;
+}
+
+/**
+ * Finish a rectangle operation: apply saved up counts and extend the bounds.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void rect_end(rectState * restrict state)
+{
+#ifdef CFUN_EXACT_BOUNDS
+	if (state->cols) {
+		for (funge_unsigned_cell i = 0; i < state->ncols; i++)
+			if (state->cols[i] != 0)
+				fungespace_count_line(false, (funge_cell)((funge_unsigned_cell)state->colx + i),
+				                      state->cols[i]);
+		free(state->cols);
+	}
+#endif
+	if (!state->any)
+		return;
+	if (fspace.bottomRightCorner.y < state->max.y)
+		fspace.bottomRightCorner.y = state->max.y;
+	if (fspace.topLeftCorner.y > state->min.y)
+		fspace.topLeftCorner.y = state->min.y;
+	if (fspace.bottomRightCorner.x < state->max.x)
+		fspace.bottomRightCorner.x = state->max.x;
+	if (fspace.topLeftCorner.x > state->min.x)
+		fspace.topLeftCorner.x = state->min.x;
+}
+
+/**
+ * Note that cells x..x+n-1 on row y may have changed, for the write epochs
+ * and the skip cache.
+ */
+FUNGE_ATTR_FAST
+static void rect_touch_run(funge_cell x, funge_cell y, funge_unsigned_cell n)
+{
+	funge_unsigned_cell first = (funge_unsigned_cell)x >> FUNGESPACE_TILE_BITS;
+	funge_unsigned_cell regions = (((funge_unsigned_cell)x + n - 1) >> FUNGESPACE_TILE_BITS) - first + 1;
+	uint_fast64_t epoch = ++fspace_epochs.now;
+	uint_fast64_t *row = &fspace_epochs.regions[EPOCH_SLOT(0, y)];
+	uint_fast64_t *watched = &fspace_watch.regions[EPOCH_SLOT(0, y)];
+
+	if (regions > EPOCH_REGIONS)
+		regions = EPOCH_REGIONS;
+	// Not worth checking the watch bits of each cell.
+	for (funge_unsigned_cell i = 0; i < regions; i++) {
+		row[(first + i) & (EPOCH_REGIONS - 1)] = epoch;
+		watched[(first + i) & (EPOCH_REGIONS - 1)] = epoch;
+	}
+	fspace_watch.last = epoch;
+	fspace_watch.unlogged = epoch;
+
+	fspace_skipcache.rows[(funge_unsigned_cell)y & (SKIPCACHE_LINES - 1)]++;
+	if (n > SKIPCACHE_LINES)
+		n = SKIPCACHE_LINES;
+	for (funge_unsigned_cell i = 0; i < n; i++)
+		fspace_skipcache.cols[((funge_unsigned_cell)x + i) & (SKIPCACHE_LINES - 1)]++;
+}
+
+/**
+ * Find the longest run, at most n cells, starting at x,y and going right (or
+ * left if backwards) that is all in the static array or all in one tile.
+ * @param kind Out parameter for where the run is.
+ * @return Length of the run.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline funge_unsigned_cell rect_run(funge_cell x, funge_cell y,
+                                           funge_unsigned_cell n, bool backwards,
+                                           rectRunKind * restrict kind)
+{
+	funge_unsigned_cell sx = (funge_unsigned_cell)x + cfun_static_offset_x;
+	funge_unsigned_cell sy = (funge_unsigned_cell)y + cfun_static_offset_y;
+	funge_unsigned_cell span, end;
+
+	if (FUNGESPACE_RANGE_CHECK(sx, sy)) {
+#ifdef CFUN_TILED_STATIC
+		// Rows aren't contiguous.
+		*kind = RECT_CELLS;
+		return (n < RECT_CHUNK) ? n : RECT_CHUNK;
+#else
+		span = backwards ? sx + 1 : cfun_static_x - sx;
+		if (span > n)
+			span = n;
+		// The bounding box of a run is found from its ends, so it must not
+		// wrap around the edge of the cell range.
+		end = backwards ? (funge_unsigned_cell)x - (span - 1) : (funge_unsigned_cell)x + (span - 1);
+		if (backwards ? (funge_cell)end > x : (funge_cell)end < x) {
+			*kind = RECT_CELLS;
+			return 1;
+		}
+		*kind = RECT_STATIC;
+		return span;
+#endif
+	}
+	span = backwards ? ((funge_unsigned_cell)x & FUNGESPACE_TILE_MASK) + 1
+	                 : FUNGESPACE_TILE_SIZE - ((funge_unsigned_cell)x & FUNGESPACE_TILE_MASK);
+	if (span > n)
+		span = n;
+	end = backwards ? (funge_unsigned_cell)x - (span - 1) : (funge_unsigned_cell)x + (span - 1);
+	// The static array is wider than a tile, so checking the ends is enough.
+	if (FUNGESPACE_RANGE_CHECK(end + cfun_static_offset_x, sy)) {
+		*kind = RECT_CELLS;
+		return 1;
+	}
+	*kind = RECT_TILE;
+	return span;
+}
+
+/**
+ * Pointer to the cell x,y in the static array, which must be in it.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline fungeStaticCell *rect_static_cell(funge_cell x, funge_cell y)
+{
+	return &cfun_static_space[STATIC_COORD((funge_unsigned_cell)x + cfun_static_offset_x,
+	                                       (funge_unsigned_cell)y + cfun_static_offset_y)];
+}
+
+#ifdef CFUN_COMPACT_CELLS
+/**
+ * Are there no escaped cells among the n cells? Those can't be copied or
+ * overwritten directly.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline bool rect_static_plain(const fungeStaticCell * restrict cells, funge_unsigned_cell n)
+{
+	return memchr(cells, FSPACE_STATIC_ESCAPE, n) == NULL;
+}
+#else
+#  define rect_static_plain(m_cells, m_n) true
+#endif
+
+#ifdef CFUN_EXACT_BOUNDS
+/**
+ * Do what fungespace_count() does for each of n cells in a row of the static
+ * array, which are about to be overwritten.
+ * @param dest The cells, as stored. The first one is at x,y.
+ * @param src New values, as stored.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void rect_static_count(const fungeStaticCell * dest,
+                              const fungeStaticCell * src,
+                              funge_cell x, funge_cell y, funge_unsigned_cell n)
+{
+	const fungeStaticCell space = (fungeStaticCell)FSPACE_ENCODE(' ');
+	funge_unsigned_cell i;
+	bool cleared = false;
+
+	// Is a cell on the edge of the bounds cleared?
+	if (y == fspace.topLeftCorner.y || y == fspace.bottomRightCorner.y) {
+		for (i = 0; i < n && !cleared; i++)
+			cleared = dest[i] != space && src[i] == space;
+	} else {
+		i = (funge_unsigned_cell)fspace.topLeftCorner.x - (funge_unsigned_cell)x;
+		if (i < n && dest[i] != space && src[i] == space)
+			cleared = true;
+		i = (funge_unsigned_cell)fspace.bottomRightCorner.x - (funge_unsigned_cell)x;
+		if (i < n && dest[i] != space && src[i] == space)
+			cleared = true;
+	}
+	// Nothing is overwritten yet, so counts can be built here if needed.
+	if (cleared)
+		fungespace_bounds_cleared();
+	if (!fspace.countsvalid)
+		return;
+	for (i = 0; i < n; i++) {
+		bool isset = src[i] != space;
+		if ((dest[i] != space) != isset)
+			fungespace_count_cell(isset, (funge_cell)((funge_unsigned_cell)x + i), y);
+	}
+}
+#endif
+
+/**
+ * Write n cells (as stored) to x,y and to the right of it in the static
+ * array. Overlap is fine, there must be no escaped cells among them.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void rect_static_write(funge_cell x, funge_cell y, funge_unsigned_cell n,
+                              const fungeStaticCell * src,
+                              rectState * restrict state)
+{
+	const fungeStaticCell space = (fungeStaticCell)FSPACE_ENCODE(' ');
+	fungeStaticCell *dest = rect_static_cell(x, y);
+	funge_unsigned_cell first = 0, last = n;
+
+#ifdef CFUN_EXACT_BOUNDS
+	rect_static_count(dest, src, x, y, n);
+#endif
+	while (first < n && src[first] == space)
+		first++;
+	if (first < n) {
+		while (src[last - 1] == space)
+			last--;
+		rect_extent_add(state, (funge_cell)((funge_unsigned_cell)x + first),
+		                (funge_cell)((funge_unsigned_cell)x + last - 1), y);
+	}
+	memmove(dest, src, (size_t)n * sizeof(fungeStaticCell));
+	rect_touch_run(x, y, n);
+}
+
+/**
+ * Read n cells (as stored) from x,y and to the right of it, all in one tile
+ * outside the static array.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void rect_tile_read(funge_cell x, funge_cell y, funge_unsigned_cell n,
+                           funge_cell * restrict cells,
+                           fungeSpaceCache * restrict readcache)
+{
+	fungeSpaceTile *tile = fungespace_tile_find_cached(vector_create_ref(x, y), readcache);
+
+	if (!tile) {
+		for (funge_unsigned_cell i = 0; i < n; i++)
+			cells[i] = FSPACE_ENCODE(' ');
+		return;
+	}
+	memcpy(cells, &tile->cells[TILE_COORD(x, y)], (size_t)n * sizeof(funge_cell));
+}
+
+/**
+ * Write n cells (as stored) to x,y and to the right of it, all in one tile
+ * outside the static array.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void rect_tile_write(funge_cell x, funge_cell y, funge_unsigned_cell n,
+                            const funge_cell * restrict cells,
+                            rectState * restrict state)
+{
+	const funge_cell space = FSPACE_ENCODE(' ');
+	funge_vector pos = { x, y };
+	fungeSpaceTile *tile = fungespace_tile_find_cached(&pos, &fspace.cache);
+	funge_cell *dest;
+#ifdef CFUN_EXACT_BOUNDS
+	funge_cell rowdelta = 0;
+#endif
+
+	if (!tile) {
+		funge_unsigned_cell i = 0;
+		while (i < n && cells[i] == space)
+			i++;
+		if (i == n)
+			return;
+		tile = fungespace_tile_create(&pos);
+	}
+	dest = &tile->cells[TILE_COORD(x, y)];
+	for (funge_unsigned_cell i = 0; i < n; i++) {
+		bool isset = cells[i] != space;
+		bool changed = (dest[i] != space) != isset;
+		dest[i] = cells[i];
+		if (isset)
+			rect_extent_add(state, pos.x, pos.x, y);
+		if (changed) {
+			if (isset)
+				tile->used++;
+			else
+				tile->used--;
+#ifdef CFUN_EXACT_BOUNDS
+			// Save up changes to the counts, it is mostly the same columns
+			// again on the next row.
+			if (fspace.countsvalid && state->ncols <= RECT_BATCH_MAX) {
+				if (!state->cols) {
+					state->cols = calloc((size_t)state->ncols, sizeof(funge_cell));
+					if (FUNGE_UNLIKELY(!state->cols))
+						DIAG_OOM("Could not allocate memory for Funge-Space bounds");
+				}
+				state->cols[(funge_unsigned_cell)pos.x - (funge_unsigned_cell)state->colx] += isset ? 1 : -1;
+				rowdelta += isset ? 1 : -1;
+			} else if (fspace.countsvalid) {
+				fungespace_count_cell(isset, pos.x, y);
+			}
+			if (!isset && fungespace_on_bounds(pos.x, y))
+				fungespace_bounds_cleared();
+#endif
+		}
+		pos.x = (funge_cell)((funge_unsigned_cell)pos.x + 1);
+	}
+#ifdef CFUN_EXACT_BOUNDS
+	if (rowdelta != 0)
+		fungespace_count_line(true, y, rowdelta);
+#endif
+	if (tile->used == 0)
+		fungespace_tile_destroy(vector_create_ref(x, y));
+	rect_touch_run(x, y, n);
+}
+
+/**
+ * Read n cells (as stored) from x,y and to the right of it, a run as found
+ * by rect_run().
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void rect_read_run(funge_cell x, funge_cell y, rectRunKind kind,
+                          funge_unsigned_cell n, funge_cell * restrict cells,
+                          fungeSpaceCache * restrict readcache)
+{
+	funge_vector pos;
+
+	assert(n <= RECT_CHUNK);
+	if (kind == RECT_TILE) {
+		rect_tile_read(x, y, n, cells, readcache);
+	} else if (kind == RECT_STATIC) {
+		funge_unsigned_cell sx = (funge_unsigned_cell)x + cfun_static_offset_x;
+		funge_unsigned_cell sy = (funge_unsigned_cell)y + cfun_static_offset_y;
+		for (funge_unsigned_cell i = 0; i < n; i++)
+			cells[i] = FSPACE_ENCODE(fungespace_static_read(sx + i, sy));
+	} else {
+		pos.y = y;
+		for (funge_unsigned_cell i = 0; i < n; i++) {
+			pos.x = (funge_cell)((funge_unsigned_cell)x + i);
+			cells[i] = FSPACE_ENCODE(fungespace_get_cached(&pos, readcache));
+		}
+	}
+}
+
+/**
+ * Write n cells (as stored) to x,y and to the right of it, a run as found
+ * by rect_run().
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void rect_write_run(funge_cell x, funge_cell y, rectRunKind kind,
+                           funge_unsigned_cell n, const funge_cell * restrict cells,
+                           rectState * restrict state)
+{
+	funge_vector pos;
+
+	assert(n <= RECT_CHUNK);
+	if (kind == RECT_TILE) {
+		rect_tile_write(x, y, n, cells, state);
+		return;
+	}
+	if (kind == RECT_STATIC && rect_static_plain(rect_static_cell(x, y), n)) {
+#ifdef CFUN_COMPACT_CELLS
+		fungeStaticCell stored[RECT_CHUNK];
+		funge_unsigned_cell i;
+		for (i = 0; i < n && (funge_unsigned_cell)cells[i] < FSPACE_STATIC_ESCAPE; i++)
+			stored[i] = (fungeStaticCell)cells[i];
+		if (i == n) {
+			rect_static_write(x, y, n, stored, state);
+			return;
+		}
+#else
+		rect_static_write(x, y, n, cells, state);
+		return;
+#endif
+	}
+	pos.y = y;
+	for (funge_unsigned_cell i = 0; i < n; i++) {
+		funge_cell value = FSPACE_DECODE(cells[i]);
+		pos.x = (funge_cell)((funge_unsigned_cell)x + i);
+		if (value != ' ')
+			rect_extent_add(state, pos.x, pos.x, y);
+		fungespace_set_no_bounds_update(value, &pos);
+	}
+}
+
+/**
+ * Copy n cells, from sx,sy to dx,dy and to the right of them (overlap is
+ * fine). Each side must be a run as found by rect_run().
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void rect_copy_run(funge_cell sx, funge_cell sy, rectRunKind srckind,
+                          funge_cell dx, funge_cell dy, rectRunKind destkind,
+                          funge_unsigned_cell n,
+                          fungeSpaceCache * restrict readcache,
+                          rectState * restrict state)
+{
+	// As stored.
+	funge_cell buf[RECT_CHUNK];
+
+	if (srckind == RECT_STATIC && destkind == RECT_STATIC) {
+		const fungeStaticCell *src = rect_static_cell(sx, sy);
+		if (rect_static_plain(src, n) && rect_static_plain(rect_static_cell(dx, dy), n)) {
+			rect_static_write(dx, dy, n, src, state);
+			return;
+		}
+	}
+	rect_read_run(sx, sy, srckind, n, buf, readcache);
+	rect_write_run(dx, dy, destkind, n, buf, state);
+}
+
+/**
+ * Copy n cells of a row, from sx,sy to dx,dy. If backwards, start from the
+ * right end, needed when the row is copied onto itself further right.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void fungespace_copy_row(funge_cell sx, funge_cell sy, funge_cell dx, funge_cell dy,
+                                funge_unsigned_cell n, bool backwards,
+                                fungeSpaceCache * restrict readcache,
+                                rectState * restrict state)
+{
+	funge_unsigned_cell done = 0;
+
+	while (done < n) {
+		funge_unsigned_cell left = n - done;
+		// Column of the cell the run starts from (its right end if
+		// backwards) and of its leftmost cell.
+		funge_unsigned_cell at = backwards ? left - 1 : done;
+		funge_unsigned_cell k, destspan, lo;
+		rectRunKind srckind, destkind;
+
+		k = rect_run((funge_cell)((funge_unsigned_cell)sx + at), sy, left, backwards, &srckind);
+		destspan = rect_run((funge_cell)((funge_unsigned_cell)dx + at), dy, left, backwards, &destkind);
+		if (destspan < k)
+			k = destspan;
+		lo = backwards ? at - (k - 1) : at;
+		// Only static to static runs without escaped cells are done without
+		// a buffer.
+		if (k > RECT_CHUNK
+		    && (srckind != RECT_STATIC || destkind != RECT_STATIC
+		        || !rect_static_plain(rect_static_cell((funge_cell)((funge_unsigned_cell)sx + lo), sy), k)
+		        || !rect_static_plain(rect_static_cell((funge_cell)((funge_unsigned_cell)dx + lo), dy), k))) {
+			k = RECT_CHUNK;
+			lo = backwards ? at - (k - 1) : at;
+		}
+		rect_copy_run((funge_cell)((funge_unsigned_cell)sx + lo), sy, srckind,
+		              (funge_cell)((funge_unsigned_cell)dx + lo), dy, destkind,
+		              k, readcache, state);
+		done += k;
+	}
+}
+
+FUNGE_ATTR_FAST void
+fungespace_copy_rect(const fungeRect * restrict area, const funge_vector * restrict dest)
+{
+	fungeSpaceCache readcache = { {0, 0}, NULL, 0 };
+	rectState state;
+	funge_cell ddx, ddy;
+	bool up, backwards;
+
+	assert(area != NULL);
+	assert(dest != NULL);
+	if (area->w <= 0 || area->h <= 0)
+		return;
+	ddx = (funge_cell)((funge_unsigned_cell)dest->x - (funge_unsigned_cell)area->x);
+	ddy = (funge_cell)((funge_unsigned_cell)dest->y - (funge_unsigned_cell)area->y);
+	if (ddx == 0 && ddy == 0)
+		return;
+	rect_begin(&state, dest->x, area->w);
+	// Go the way that never writes a cell before it has been read: from the
+	// bottom when copying downwards, from the right when copying rightwards
+	// within the same rows.
+	up = ddy > 0;
+	backwards = ddy == 0 && ddx > 0;
+	for (funge_unsigned_cell j = 0; j < (funge_unsigned_cell)area->h; j++) {
+		funge_unsigned_cell row = up ? (funge_unsigned_cell)area->h - 1 - j : j;
+		fungespace_copy_row(area->x, (funge_cell)((funge_unsigned_cell)area->y + row),
+		                    dest->x, (funge_cell)((funge_unsigned_cell)dest->y + row),
+		                    (funge_unsigned_cell)area->w, backwards, &readcache, &state);
+	}
+	rect_end(&state);
+}
+
+FUNGE_ATTR_FAST void
+fungespace_fill_rect(funge_cell value, const fungeRect * restrict area)
+{
+	funge_cell buf[RECT_CHUNK];
+#ifdef CFUN_COMPACT_CELLS
+	fungeStaticCell cells[RECT_CHUNK];
+	const bool fits = FSPACE_STATIC_FITS(value);
+#else
+	funge_cell *cells = buf;
+	const bool fits = true;
+#endif
+	rectState state;
+	funge_vector pos;
+
+	assert(area != NULL);
+	if (area->w <= 0 || area->h <= 0)
+		return;
+	for (size_t i = 0; i < RECT_CHUNK; i++) {
+		buf[i] = FSPACE_ENCODE(value);
+#ifdef CFUN_COMPACT_CELLS
+		cells[i] = (fungeStaticCell)FSPACE_ENCODE(value);
+#endif
+	}
+	rect_begin(&state, area->x, area->w);
+	for (funge_unsigned_cell j = 0; j < (funge_unsigned_cell)area->h; j++) {
+		funge_unsigned_cell done = 0;
+		pos.y = (funge_cell)((funge_unsigned_cell)area->y + j);
+		while (done < (funge_unsigned_cell)area->w) {
+			funge_unsigned_cell left = (funge_unsigned_cell)area->w - done;
+			rectRunKind kind;
+			funge_unsigned_cell k;
+			pos.x = (funge_cell)((funge_unsigned_cell)area->x + done);
+			k = rect_run(pos.x, pos.y, left, false, &kind);
+			if (k > RECT_CHUNK)
+				k = RECT_CHUNK;
+			if (kind == RECT_STATIC && fits && rect_static_plain(rect_static_cell(pos.x, pos.y), k)) {
+				rect_static_write(pos.x, pos.y, k, cells, &state);
+			} else if (kind == RECT_TILE) {
+				rect_tile_write(pos.x, pos.y, k, buf, &state);
+			} else {
+				for (funge_unsigned_cell i = 0; i < k; i++) {
+					if (value != ' ')
+						rect_extent_add(&state, pos.x, pos.x, pos.y);
+					fungespace_set_no_bounds_update(value, &pos);
+					pos.x = (funge_cell)((funge_unsigned_cell)pos.x + 1);
+				}
+			}
+			done += k;
+		}
+	}
+	rect_end(&state);
+}
+
+FUNGE_ATTR_FAST void
+fungespace_move_rect(const fungeRect * restrict area, const funge_vector * restrict dest)
+{
+	funge_cell ddx, ddy;
+	fungeRect part;
+
+	assert(area != NULL);
+	assert(dest != NULL);
+	if (area->w <= 0 || area->h <= 0)
+		return;
+	fungespace_copy_rect(area, dest);
+
+	// Clear what is left of the source area, in up to two parts.
+	ddx = (funge_cell)((funge_unsigned_cell)dest->x - (funge_unsigned_cell)area->x);
+	ddy = (funge_cell)((funge_unsigned_cell)dest->y - (funge_unsigned_cell)area->y);
+	if (ddx <= -area->w || ddx >= area->w || ddy <= -area->h || ddy >= area->h) {
+		fungespace_fill_rect(' ', area);
+		return;
+	}
+	// Rows above or below the destination.
+	part.x = area->x;
+	part.w = area->w;
+	part.h = (ddy < 0) ? -ddy : ddy;
+	part.y = (ddy > 0) ? area->y : (funge_cell)((funge_unsigned_cell)area->y + (funge_unsigned_cell)(area->h + ddy));
+	fungespace_fill_rect(' ', &part);
+	// Columns left or right of it, in the other rows.
+	part.y = (ddy > 0) ? (funge_cell)((funge_unsigned_cell)area->y + (funge_unsigned_cell)ddy) : area->y;
+	part.h = area->h - part.h;
+	part.w = (ddx < 0) ? -ddx : ddx;
+	part.x = (ddx > 0) ? area->x : (funge_cell)((funge_unsigned_cell)area->x + (funge_unsigned_cell)(area->w + ddx));
+	fungespace_fill_rect(' ', &part);
+}
+
+
+/*
+ * Moving cells between Funge-Space and a stack. Items are read and written
+ * directly in the stack, and rows go through the same runs as above.
+ */
+
+/**
+ * Read n cells of a row, starting at x,y, to out[i * stride].
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void rect_read_row(funge_cell x, funge_cell y, funge_unsigned_cell n,
+                          funge_cell * restrict out, ptrdiff_t stride,
+                          fungeSpaceCache * restrict readcache)
+{
+	funge_cell buf[RECT_CHUNK];
+	funge_unsigned_cell done = 0;
+
+	while (done < n) {
+		funge_cell at = (funge_cell)((funge_unsigned_cell)x + done);
+		rectRunKind kind;
+		funge_unsigned_cell k = rect_run(at, y, n - done, false, &kind);
+		if (k > RECT_CHUNK)
+			k = RECT_CHUNK;
+		rect_read_run(at, y, kind, k, buf, readcache);
+		for (funge_unsigned_cell i = 0; i < k; i++)
+			out[(ptrdiff_t)(done + i) * stride] = FSPACE_DECODE(buf[i]);
+		done += k;
+	}
+}
+
+/**
+ * Write n cells of a row, starting at x,y, from in[i * stride].
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void rect_write_row(funge_cell x, funge_cell y, funge_unsigned_cell n,
+                           const funge_cell * restrict in, ptrdiff_t stride,
+                           rectState * restrict state)
+{
+	funge_cell buf[RECT_CHUNK];
+	funge_unsigned_cell done = 0;
+
+	while (done < n) {
+		funge_cell at = (funge_cell)((funge_unsigned_cell)x + done);
+		rectRunKind kind;
+		funge_unsigned_cell k = rect_run(at, y, n - done, false, &kind);
+		if (k > RECT_CHUNK)
+			k = RECT_CHUNK;
+		for (funge_unsigned_cell i = 0; i < k; i++)
+			buf[i] = FSPACE_ENCODE(in[(ptrdiff_t)(done + i) * stride]);
+		rect_write_run(at, y, kind, k, buf, state);
+		done += k;
+	}
+}
+
+/**
+ * Fill n cells of a row, starting at x,y, with 0 (what popping an empty
+ * stack gives).
+ */
+FUNGE_ATTR_FAST
+static inline void rect_zero_row(funge_cell x, funge_cell y, funge_unsigned_cell n)
+{
+	fungeRect area = { x, y, (funge_cell)n, 1 };
+	fungespace_fill_rect(0, &area);
+}
+
+FUNGE_ATTR_FAST void
+fungespace_push_line(funge_stack * restrict stack, const funge_vector * restrict start,
+                     const funge_vector * restrict delta, size_t n)
+{
+	fungeSpaceCache readcache = { {0, 0}, NULL, 0 };
+	funge_cell *items;
+
+	assert(stack != NULL);
+	assert(start != NULL);
+	assert(delta != NULL);
+	if (n == 0)
+		return;
+	// The cell at start goes on top.
+	items = stack_push_space(stack, n);
+	if (delta->y == 0 && delta->x == 1) {
+		rect_read_row(start->x, start->y, (funge_unsigned_cell)n, items + n - 1, -1, &readcache);
+	} else if (delta->y == 0 && delta->x == -1) {
+		rect_read_row((funge_cell)((funge_unsigned_cell)start->x - (funge_unsigned_cell)(n - 1)),
+		              start->y, (funge_unsigned_cell)n, items, 1, &readcache);
+	} else {
+		funge_vector pos = *start;
+		for (size_t i = n; i-- > 0;) {
+			items[i] = fungespace_get_cached(&pos, &readcache);
+			pos.x = (funge_cell)((funge_unsigned_cell)pos.x + (funge_unsigned_cell)delta->x);
+			pos.y = (funge_cell)((funge_unsigned_cell)pos.y + (funge_unsigned_cell)delta->y);
+		}
+	}
+}
+
+FUNGE_ATTR_FAST void
+fungespace_pop_line(funge_stack * restrict stack, const funge_vector * restrict start,
+                    const funge_vector * restrict delta, size_t n)
+{
+	rectState state;
+	// Number of cells that get an item from the stack, the rest get 0.
+	size_t m;
+
+	assert(stack != NULL);
+	assert(start != NULL);
+	assert(delta != NULL);
+	m = (n < stack->top) ? n : stack->top;
+	if (delta->y == 0 && delta->x == 1) {
+		rect_begin(&state, start->x, (funge_cell)n);
+		if (m > 0)
+			rect_write_row(start->x, start->y, (funge_unsigned_cell)m,
+			               stack->entries + stack->top - 1, -1, &state);
+		rect_end(&state);
+		if (n > m)
+			rect_zero_row((funge_cell)((funge_unsigned_cell)start->x + (funge_unsigned_cell)m),
+			              start->y, (funge_unsigned_cell)(n - m));
+	} else if (delta->y == 0 && delta->x == -1) {
+		funge_cell left = (funge_cell)((funge_unsigned_cell)start->x - (funge_unsigned_cell)(n - 1));
+		rect_begin(&state, left, (funge_cell)n);
+		if (m > 0)
+			rect_write_row((funge_cell)((funge_unsigned_cell)left + (funge_unsigned_cell)(n - m)),
+			               start->y, (funge_unsigned_cell)m,
+			               stack->entries + stack->top - m, 1, &state);
+		rect_end(&state);
+		if (n > m)
+			rect_zero_row(left, start->y, (funge_unsigned_cell)(n - m));
+	} else {
+		funge_vector pos = *start;
+		// Later cells win if the line crosses itself.
+		for (size_t i = 0; i < n; i++) {
+			fungespace_set((i < m) ? stack->entries[stack->top - 1 - i] : 0, &pos);
+			pos.x = (funge_cell)((funge_unsigned_cell)pos.x + (funge_unsigned_cell)delta->x);
+			pos.y = (funge_cell)((funge_unsigned_cell)pos.y + (funge_unsigned_cell)delta->y);
+		}
+	}
+	stack_discard(stack, m);
+}
+
+FUNGE_ATTR_FAST void
+fungespace_push_rect(funge_stack * restrict stack, const fungeRect * restrict area)
+{
+	fungeSpaceCache readcache = { {0, 0}, NULL, 0 };
+	funge_cell *items;
+	size_t n;
+
+	assert(stack != NULL);
+	assert(area != NULL);
+	if (area->w <= 0 || area->h <= 0)
+		return;
+	// Too large for memory, let stack_push_space() say so.
+	if ((size_t)area->w > SIZE_MAX / (size_t)area->h)
+		n = SIZE_MAX;
+	else
+		n = (size_t)area->w * (size_t)area->h;
+	// The top left cell goes on top, then the rest of the top row, and so on.
+	items = stack_push_space(stack, n);
+	for (size_t j = 0; j < (size_t)area->h; j++)
+		rect_read_row(area->x, (funge_cell)((funge_unsigned_cell)area->y + j),
+		              (funge_unsigned_cell)area->w, items + n - 1 - j * (size_t)area->w, -1,
+		              &readcache);
+}
+
+FUNGE_ATTR_FAST void
+fungespace_pop_rect(funge_stack * restrict stack, const fungeRect * restrict area)
+{
+	rectState state;
+	// Items left to pop.
+	size_t avail;
+	funge_unsigned_cell j;
+
+	assert(stack != NULL);
+	assert(area != NULL);
+	if (area->w <= 0 || area->h <= 0)
+		return;
+	avail = stack->top;
+	rect_begin(&state, area->x, area->w);
+	for (j = 0; j < (funge_unsigned_cell)area->h && avail > 0; j++) {
+		funge_cell y = (funge_cell)((funge_unsigned_cell)area->y + j);
+		size_t m = ((size_t)area->w < avail) ? (size_t)area->w : avail;
+		rect_write_row(area->x, y, (funge_unsigned_cell)m, stack->entries + avail - 1, -1, &state);
+		avail -= m;
+		if (m < (size_t)area->w)
+			rect_zero_row((funge_cell)((funge_unsigned_cell)area->x + m), y,
+			              (funge_unsigned_cell)area->w - m);
+	}
+	rect_end(&state);
+	// The stack ran out, the rest is 0.
+	if (j < (funge_unsigned_cell)area->h) {
+		fungeRect rest = { area->x, (funge_cell)((funge_unsigned_cell)area->y + j),
+		                   area->w, (funge_cell)((funge_unsigned_cell)area->h - j) };
+		fungespace_fill_rect(0, &rest);
+	}
+	stack->top = avail;
+}
+
+FUNGE_ATTR_FAST bool
+fungespace_push_string(funge_stack * restrict stack, const funge_vector * restrict start,
+                       funge_unsigned_cell maxlen)
+{
+	fungeSpaceCache readcache = { {0, 0}, NULL, 0 };
+	funge_cell buf[RECT_CHUNK];
+	funge_unsigned_cell len = 0;
+
+	assert(stack != NULL);
+	assert(start != NULL);
+	// Find the 0 first, so the string can be pushed in one go.
+	while (len < maxlen) {
+		funge_cell at = (funge_cell)((funge_unsigned_cell)start->x + len);
+		rectRunKind kind;
+		funge_unsigned_cell k = rect_run(at, start->y, maxlen - len, false, &kind);
+		funge_unsigned_cell i;
+		if (k > RECT_CHUNK)
+			k = RECT_CHUNK;
+		rect_read_run(at, start->y, kind, k, buf, &readcache);
+		for (i = 0; i < k && buf[i] != FSPACE_ENCODE(0); i++)
+			;
+		len += i;
+		if (i < k)
+			break;
+	}
+	if (len == maxlen)
+		return false;
+	stack_push(stack, 0);
+	fungespace_push_line(stack, start, vector_create_ref(1, 0), len);
+	return true;
+}
+
+/*
+ * Going through all non-space cells, for writing out the whole of
+ * Funge-Space.
+ */
+
+/// Collects cells into runs for fungespace_for_each_run().
+typedef struct runCollector {
+	funge_vector      start;
+	size_t            n;
+	funge_cell        cells[RECT_CHUNK];
+	fungeSpaceRunFunc func;
+	void            * data;
+} runCollector;
+
+/**
+ * Pass on the collected run, if any.
+ * @return False if the callback said to stop.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline bool run_flush(runCollector * restrict run)
+{
+	size_t n = run->n;
+	if (n == 0)
+		return true;
+	run->n = 0;
+	return run->func(&run->start, run->cells, n, run->data);
+}
+
+/**
+ * Add a cell to the collected run, it must be right of the last one if the
+ * run isn't empty.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline bool run_add(runCollector * restrict run, funge_cell x, funge_cell y, funge_cell value)
+{
+	if (run->n == 0) {
+		run->start.x = x;
+		run->start.y = y;
+	}
+	run->cells[run->n++] = value;
+	return run->n < RECT_CHUNK || run_flush(run);
+}
+
+FUNGE_ATTR_FAST bool
+fungespace_for_each_run(fungeSpaceRunFunc func, void *data)
+{
+	ght_fspace_iterator_t iterator;
+	const funge_vector *p_key;
+	fungeSpaceTile **p;
+	runCollector run;
+
+	assert(func != NULL);
+	run.n = 0;
+	run.func = func;
+	run.data = data;
+	for (funge_unsigned_cell sy = 0; sy < cfun_static_y; sy++) {
+		funge_cell y = (funge_cell)(sy - cfun_static_offset_y);
+		for (funge_unsigned_cell sx = 0; sx < cfun_static_x; sx++) {
+			funge_cell value = fungespace_static_read(sx, sy);
+			if (value == ' ') {
+				if (!run_flush(&run))
+					return false;
+			} else if (!run_add(&run, (funge_cell)(sx - cfun_static_offset_x), y, value)) {
+				return false;
+			}
+		}
+		if (!run_flush(&run))
+			return false;
+	}
+	for (p = ght_fspace_first(fspace.entries, &iterator, &p_key);
+	     p; p = ght_fspace_next(&iterator, &p_key)) {
+		for (funge_cell ty = 0; ty < FUNGESPACE_TILE_SIZE; ty++) {
+			funge_cell y = (funge_cell)((funge_unsigned_cell)p_key->y + (funge_unsigned_cell)ty);
+			for (funge_cell tx = 0; tx < FUNGESPACE_TILE_SIZE; tx++) {
+				funge_cell x = (funge_cell)((funge_unsigned_cell)p_key->x + (funge_unsigned_cell)tx);
+				funge_cell value = FSPACE_DECODE((*p)->cells[TILE_COORD(tx, ty)]);
+				// Values for escaped static cells were passed on above.
+				if (value == ' ' || FUNGESPACE_RANGE_CHECK((funge_unsigned_cell)x + cfun_static_offset_x,
+				                                           (funge_unsigned_cell)y + cfun_static_offset_y)) {
+					if (!run_flush(&run))
+						return false;
+				} else if (!run_add(&run, x, y, value)) {
+					return false;
+				}
+			}
+			if (!run_flush(&run))
+				return false;
+		}
+	}
+	return true;
+}
+
+FUNGE_ATTR_FAST void
+fungespace_restore_begin(const fungeRect * restrict bounds)
+{
+	assert(bounds != NULL);
+	if (!cfun_static_space && ght_size(fspace.entries) == 0)
+		fungespace_static_setup(bounds);
+	fspace.topLeftCorner.x = bounds->x;
+	fspace.topLeftCorner.y = bounds->y;
+	fspace.bottomRightCorner.x = bounds->x + bounds->w;
+	fspace.bottomRightCorner.y = bounds->y + bounds->h;
+	fspace.boundsvalid = true;
+}
+
+FUNGE_ATTR_FAST void
+fungespace_restore_run(const funge_vector * restrict start,
+                       const funge_cell * restrict cells, size_t n)
+{
+	rectState state;
+
+	assert(start != NULL);
+	assert(cells != NULL);
+	rect_begin(&state, start->x, (funge_cell)n);
+	rect_write_row(start->x, start->y, (funge_unsigned_cell)n, cells, 1, &state);
+	rect_end(&state);
+}
+
+/**********
+ * Images *
+ **********/
+
+/*
+ * An image is Funge-Space as it is in memory right after loading a program:
+ * a header, the tiles, and then the static array, page aligned so that it can
+ * be mapped straight from the file. Only builds with the same layout (see
+ * fungespace_image_layout()) can use an image.
+ */
+
+/// Identifies an image file.
+#define FUNGESPACE_IMAGE_MAGIC "CFUNIMG"
+/// Bumped when the format changes in ways the layout doesn't cover.
+#define FUNGESPACE_IMAGE_VERSION 1
+
+typedef struct fungeImageHeader {
+	char                magic[8];
+	uint32_t            version;
+	uint32_t            layout;
+	uint64_t            source_size;
+	uint64_t            source_hash;
+	/// Bounds, only valid if boundsvalid is set.
+	funge_vector        topleft;
+	funge_vector        bottomright;
+	uint32_t            boundsvalid;
+	uint32_t            reserved;
+	/// Top left corner and size of the static array, size 0 if there is none.
+	funge_vector        staticpos;
+	funge_unsigned_cell staticw;
+	funge_unsigned_cell statich;
+	/// Where the static array is in the file, page aligned.
+	uint64_t            staticoffset;
+	/// Number of tiles, they follow right after the header.
+	uint64_t            tiles;
+	/// image_header_check() of the rest of the header.
+	uint64_t            check;
+} fungeImageHeader;
+
+/// A tile in an image.
+typedef struct fungeImageTile {
+	funge_vector   origin;
+	fungeSpaceTile tile;
+} fungeImageTile;
+
+FUNGE_ATTR_FAST FUNGE_ATTR_CONST uint32_t fungespace_image_layout(void)
+{
+	uint32_t layout = (uint32_t)sizeof(funge_cell)
+	                  | (uint32_t)FUNGESPACE_TILE_BITS << 8;
+#ifdef CFUN_ZERO_SPACE
+	layout |= UINT32_C(1) << 16;
+#endif
+#ifdef CFUN_COMPACT_CELLS
+	layout |= UINT32_C(1) << 17;
+#endif
+#ifdef CFUN_TILED_STATIC
+	layout |= UINT32_C(1) << 18;
+#endif
+	return layout;
+}
+
+/**
+ * FNV-1a of the header (except the check field), so that a damaged header is
+ * noticed rather than giving a program with the wrong bounds.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_PURE
+static uint64_t image_header_check(const fungeImageHeader * restrict header)
+{
+	const unsigned char *p = (const unsigned char *)header;
+	uint64_t h = UINT64_C(0xcbf29ce484222325);
+	for (size_t i = 0; i < offsetof(fungeImageHeader, check); i++)
+		h = (h ^ p[i]) * UINT64_C(0x100000001b3);
+	return h;
+}
+
+/// pwrite() all of buf, or fail.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static bool image_pwrite(int fd, const void * restrict buf, size_t len, uint64_t offset)
+{
+	const char *p = buf;
+	while (len > 0) {
+		ssize_t n = pwrite(fd, p, len, (off_t)offset);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		p += n;
+		len -= (size_t)n;
+		offset += (uint64_t)n;
+	}
+	return true;
+}
+
+/// pread() all of buf, or fail (also at end of file).
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static bool image_pread(int fd, void * restrict buf, size_t len, uint64_t offset)
+{
+	char *p = buf;
+	while (len > 0) {
+		ssize_t n = pread(fd, p, len, (off_t)offset);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		p += n;
+		len -= (size_t)n;
+		offset += (uint64_t)n;
+	}
+	return true;
+}
+
+/// Size of the static array in bytes.
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline size_t image_static_bytes(void)
+{
+	return (size_t)cfun_static_x * (size_t)cfun_static_y * sizeof(fungeStaticCell);
+}
+
+FUNGE_ATTR_FAST bool
+fungespace_image_write(int fd, uint64_t source_size, uint64_t source_hash)
+{
+	fungeImageHeader header;
+	fungeImageTile *record;
+	ght_fspace_iterator_t iterator;
+	const funge_vector *p_key;
+	fungeSpaceTile **p;
+	uint64_t offset;
+	long pagesize = sysconf(_SC_PAGESIZE);
+
+	if (pagesize <= 0)
+		pagesize = 4096;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, FUNGESPACE_IMAGE_MAGIC, sizeof(header.magic));
+	header.version = FUNGESPACE_IMAGE_VERSION;
+	header.layout = fungespace_image_layout();
+	header.source_size = source_size;
+	header.source_hash = source_hash;
+	header.topleft = fspace.topLeftCorner;
+	header.bottomright = fspace.bottomRightCorner;
+	header.boundsvalid = fspace.boundsvalid;
+	if (cfun_static_space) {
+		header.staticpos.x = (funge_cell)(0 - cfun_static_offset_x);
+		header.staticpos.y = (funge_cell)(0 - cfun_static_offset_y);
+		header.staticw = cfun_static_x;
+		header.statich = cfun_static_y;
+	}
+	header.tiles = ght_size(fspace.entries);
+
+	record = malloc(sizeof(fungeImageTile));
+	if (FUNGE_UNLIKELY(!record))
+		return false;
+	offset = sizeof(header);
+	for (p = ght_fspace_first(fspace.entries, &iterator, &p_key);
+	     p; p = ght_fspace_next(&iterator, &p_key)) {
+		// Copied so padding in the record is zero rather than junk.
+		memset(record, 0, sizeof(fungeImageTile));
+		record->origin = *p_key;
+		memcpy(record->tile.cells, (*p)->cells, sizeof(record->tile.cells));
+		record->tile.used = (*p)->used;
+		if (!image_pwrite(fd, record, sizeof(fungeImageTile), offset)) {
+			free(record);
+			return false;
+		}
+		offset += sizeof(fungeImageTile);
+	}
+	free(record);
+
+	header.staticoffset = (offset + (uint64_t)pagesize - 1) & ~((uint64_t)pagesize - 1);
+	if (cfun_static_space) {
+		const unsigned char *cells = (const unsigned char *)cfun_static_space;
+		size_t bytes = image_static_bytes();
+		for (size_t i = 0; i < bytes; i += (size_t)pagesize) {
+			size_t len = bytes - i < (size_t)pagesize ? bytes - i : (size_t)pagesize;
+#ifdef CFUN_ZERO_SPACE
+			// Leave holes for pages of spaces, the ftruncate() below fills
+			// them in with zeros.
+			if (cells[i] == 0 && memcmp(cells + i, cells + i + 1, len - 1) == 0)
+				continue;
+#endif
+			if (!image_pwrite(fd, cells + i, len, header.staticoffset + i))
+				return false;
+		}
+	}
+	if (ftruncate(fd, (off_t)(header.staticoffset + image_static_bytes())) != 0)
+		return false;
+	header.check = image_header_check(&header);
+	// Header last, so a partial image is never valid.
+	return image_pwrite(fd, &header, sizeof(header), 0);
+}
+
+FUNGE_ATTR_FAST bool
+fungespace_image_map(int fd, uint64_t source_size, uint64_t source_hash)
+{
+	fungeImageHeader header;
+	fungeImageTile *records = NULL;
+	fungeStaticCell *cells = NULL;
+	struct stat sb;
+	size_t bytes = 0;
+	uint64_t tilebytes;
+	long pagesize = sysconf(_SC_PAGESIZE);
+
+	if (cfun_static_space || ght_size(fspace.entries) != 0)
+		return false;
+	if (!image_pread(fd, &header, sizeof(header), 0) || fstat(fd, &sb) != 0)
+		return false;
+	if (memcmp(header.magic, FUNGESPACE_IMAGE_MAGIC, sizeof(header.magic)) != 0
+	    || header.version != FUNGESPACE_IMAGE_VERSION
+	    || header.layout != fungespace_image_layout()
+	    || header.source_size != source_size
+	    || header.source_hash != source_hash
+	    || header.check != image_header_check(&header))
+		return false;
+	// The rest should be fine if the header is, but don't trust it blindly.
+	if (pagesize <= 0 || header.staticoffset % (uint64_t)pagesize != 0
+	    || header.staticoffset < sizeof(header)
+	    || header.tiles > (header.staticoffset - sizeof(header)) / sizeof(fungeImageTile)
+	    || header.staticoffset > (uint64_t)sb.st_size)
+		return false;
+	if (header.staticw != 0) {
+		if (header.staticw % FUNGESPACE_STATIC_ALIGN != 0
+		    || header.statich % FUNGESPACE_STATIC_ALIGN != 0
+		    || header.statich == 0
+		    || header.staticw > ((uint64_t)sb.st_size - header.staticoffset) / header.statich / sizeof(fungeStaticCell))
+			return false;
+		bytes = (size_t)header.staticw * (size_t)header.statich * sizeof(fungeStaticCell);
+	}
+
+	tilebytes = header.tiles * sizeof(fungeImageTile);
+	if (tilebytes != 0) {
+		records = malloc((size_t)tilebytes);
+		if (FUNGE_UNLIKELY(!records))
+			return false;
+		if (!image_pread(fd, records, (size_t)tilebytes, sizeof(header)))
+			goto error;
+		for (uint64_t i = 0; i < header.tiles; i++) {
+			const fungeImageTile *record = &records[i];
+			if (record->origin.x != TILE_ORIGIN(record->origin.x)
+			    || record->origin.y != TILE_ORIGIN(record->origin.y)
+			    || record->tile.used == 0
+			    || record->tile.used > FUNGESPACE_TILE_SIZE * FUNGESPACE_TILE_SIZE)
+				goto error;
+		}
+	}
+	if (bytes != 0) {
+		// Private, so changes aren't written back to the image. Pages are only
+		// read in once they are used.
+		cells = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, (off_t)header.staticoffset);
+		if (cells == MAP_FAILED) {
+			cells = NULL;
+			goto error;
+		}
+#ifdef CFUN_EXACT_BOUNDS
+		cfun_static_use_count_col = calloc((size_t)header.staticw, sizeof(funge_unsigned_cell));
+		cfun_static_use_count_row = calloc((size_t)header.statich, sizeof(funge_unsigned_cell));
+		if (FUNGE_UNLIKELY(!cfun_static_use_count_col || !cfun_static_use_count_row))
+			goto error;
+#endif
+	}
+
+	for (uint64_t i = 0; i < header.tiles; i++) {
+		fungeSpaceTile *tile;
+		if (fungespace_tile_find(&records[i].origin))
+			goto error;
+		tile = fungespace_tile_create(&records[i].origin);
+		memcpy(tile->cells, records[i].tile.cells, sizeof(tile->cells));
+		tile->used = records[i].tile.used;
+	}
+	free(records);
+
+	if (cells) {
+		cfun_static_space = cells;
+		cfun_static_offset_x = -(funge_unsigned_cell)header.staticpos.x;
+		cfun_static_offset_y = -(funge_unsigned_cell)header.staticpos.y;
+		cfun_static_x = header.staticw;
+		cfun_static_y = header.statich;
+	}
+	fspace.topLeftCorner = header.topleft;
+	fspace.bottomRightCorner = header.bottomright;
+	fspace.boundsvalid = header.boundsvalid != 0;
+	fungespace_cursor_generation++;
+	fspace.stats.image = true;
+	return true;
+
+error:
+	// Undo what was done, leaving Funge-Space empty again.
+	if (records) {
+		for (uint64_t i = 0; i < header.tiles; i++) {
+			if (fungespace_tile_find(&records[i].origin))
+				fungespace_tile_destroy(&records[i].origin);
+		}
+		free(records);
+	}
+	if (cells)
+		munmap(cells, bytes);
+#ifdef CFUN_EXACT_BOUNDS
+	free(cfun_static_use_count_col);
+	free(cfun_static_use_count_row);
+	cfun_static_use_count_col = cfun_static_use_count_row = NULL;
+#endif
+	return false;
+}
+
+/*****************
+ * Wrapping code *
+ *****************/
+
+/// Duplicated from vector.c for speed reasons (inlining).
+FUNGE_ATTR_PURE FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+static inline bool fspace_vector_is_cardinal(const funge_vector * restrict v)
+{
+	// Due to unsigned this can't overflow in the addition below.
+	funge_unsigned_cell x = (funge_unsigned_cell)ABS(v->x);
+	funge_unsigned_cell y = (funge_unsigned_cell)ABS(v->y);
+	if ((x + y) != 1)
+		return false;
+	if (x && y)
+		return false;
+	return true;
+}
+
+/* Thanks to Elliott Hird for the algorithm in the following wrapping code. */
+FUNGE_ATTR_CONST FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+static inline funge_cell wrap_frac(funge_cell n, funge_cell d)
+{
+	return (n % d == 0) ? (n / d) : ((n + d) / d);
+}
+
+// a  = value in x or y
+// r  = min in x or y
+// s  = max in x or y
+// da = delta in x or y
+FUNGE_ATTR_CONST FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+static inline funge_cell wrap_frac_dir(funge_cell a, funge_cell r,
+                                       funge_cell s, funge_cell da)
+{
+	return (da > 0) ? wrap_frac(a - r, da) : wrap_frac(a - s, da);
+}
+
+FUNGE_ATTR_FAST
+static inline void wrap(funge_vector * restrict pos,
+                        const funge_vector * restrict delta)
+{
+	funge_cell m;
+#define FUNGESPACE_FY wrap_frac_dir(pos->y, fspace.topLeftCorner.y, fspace.bottomRightCorner.y, delta->y)
+#define FUNGESPACE_FX wrap_frac_dir(pos->x, fspace.topLeftCorner.x, fspace.bottomRightCorner.x, delta->x)
+	if (delta->x == 0  && delta->y == 0)
+		return; // Shouldn't happen, zero delta and outside the border.
+	else if (delta->x == 0)
+		m = FUNGESPACE_FY;
+	else if (delta->y == 0)
+		m = FUNGESPACE_FX;
+	else {
+		funge_cell fx = FUNGESPACE_FX;
+		funge_cell fy = FUNGESPACE_FY;
+		m = (fx < fy) ? fx : fy;
+	}
+
+	pos->x = pos->x - (m * delta->x);
+	pos->y = pos->y - (m * delta->y);
+#undef FUNGESPACE_FY
+#undef FUNGESPACE_FX
+}
+/* End of algorithm contributed by Elliott Hird. */
+
+FUNGE_ATTR_FAST void
+fungespace_wrap(funge_vector * restrict position,
+                const funge_vector * restrict delta)
+{
+#ifdef CFUN_EXACT_BOUNDS
+	// Cheap enough to always do, and makes wrapping skip less empty space.
+	if (FUNGE_UNLIKELY(!fspace.boundsexact))
+		fungespace_minimize_bounds();
+#endif
+	if (!fungespace_in_range(position)) {
+		// Quick and dirty if cardinal.
+		if (FUNGE_LIKELY(fspace_vector_is_cardinal(delta))) {
+			// FIXME, HACK: Why are the +1/-1 needed?
+			if (position->x < fspace.topLeftCorner.x)
+				position->x = fspace.bottomRightCorner.x + 1;
+			else if (position->x > fspace.bottomRightCorner.x)
+				position->x = fspace.topLeftCorner.x - 1;
+
+			if (position->y < fspace.topLeftCorner.y)
+				position->y = fspace.bottomRightCorner.y + 1;
+			else if (position->y > fspace.bottomRightCorner.y)
+				position->y = fspace.topLeftCorner.y - 1;
+		} else {
+#ifdef SLOW_WRAP
+			do {
+				position->x -= delta->x;
+				position->y -= delta->y;
+			} while (fungespace_in_range(position));
+			position->x += delta->x;
+			position->y += delta->y;
+#else
+			wrap(position, delta);
+#endif
+		}
+	}
+}
+
+/**
+ * Key for a skip cache entry.
+ * @param delta Must be cardinal.
+ * @param comment Skipping to the end of a ;; comment rather than over spaces?
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline uint_fast8_t skipcache_key(const funge_vector * restrict delta, bool comment)
+{
+	uint_fast8_t dir = (delta->x > 0) ? 0 : (delta->x < 0) ? 1 : (delta->y > 0) ? 2 : 3;
+	return (uint_fast8_t)(1 + dir * 2 + comment);
+}
+
+/**
+ * Generation counter for the row or column a skip along delta from position
+ * stays in.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline uint_fast64_t skipcache_generation(const funge_vector * restrict position,
+                                                 const funge_vector * restrict delta)
+{
+	if (delta->y == 0)
+		return fspace_skipcache.rows[(funge_unsigned_cell)position->y & (SKIPCACHE_LINES - 1)];
+	return fspace_skipcache.cols[(funge_unsigned_cell)position->x & (SKIPCACHE_LINES - 1)];
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline skipCacheEntry *skipcache_entry(const funge_vector * restrict position,
+                                              uint_fast8_t key)
+{
+	uint64_t h = (uint64_t)(funge_unsigned_cell)position->x * UINT64_C(0x9E3779B97F4A7C15)
+	             ^ (uint64_t)(funge_unsigned_cell)position->y * UINT64_C(0xC2B2AE3D27D4EB4F)
+	             ^ key;
+	return &fspace_skipcache.entries[(h >> 32) & (SKIPCACHE_SIZE - 1)];
+}
+
+/**
+ * Step along delta until a cell that ends the skip. With a cardinal delta the
+ * rest of a missing tile is passed in one go, those are all spaces.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static funge_cell fungespace_skip_scan(funge_vector * restrict position,
+                                       const funge_vector * restrict delta,
+                                       fungeSpaceCache * restrict cache,
+                                       bool comment)
+{
+	const bool cardinal = fspace_vector_is_cardinal(delta);
+	funge_cell value;
+#ifdef AFL_FUZZ_TESTING
+	long iterations = 500;
+#endif
+	do {
+		funge_unsigned_cell sx, sy;
+		fungeSpaceTile *tile;
+#ifdef AFL_FUZZ_TESTING
+		if (!iterations--)
+			exit(123);
+#endif
+		position->x += delta->x;
+		position->y += delta->y;
+		fungespace_wrap(position, delta);
+		sx = (funge_unsigned_cell)position->x + cfun_static_offset_x;
+		sy = (funge_unsigned_cell)position->y + cfun_static_offset_y;
+		if (FUNGESPACE_RANGE_CHECK(sx, sy)) {
+			value = fungespace_static_read(sx, sy);
+			continue;
+		}
+		fspace.stats.outside++;
+		tile = fungespace_tile_find_cached(position, cache);
+		if (tile) {
+			value = FSPACE_DECODE(tile->cells[TILE_COORD(position->x, position->y)]);
+			continue;
+		}
+		value = ' ';
+		if (!cardinal)
+			continue;
+		// Go to the last cell of the tile, without leaving the bounds or
+		// entering the static array.
+		if (delta->x > 0) {
+			funge_cell end = TILE_ORIGIN(position->x) + (FUNGESPACE_TILE_SIZE - 1);
+			funge_cell edge = (funge_cell)(0 - cfun_static_offset_x);
+			if (end > fspace.bottomRightCorner.x)
+				end = fspace.bottomRightCorner.x;
+			if (sy < cfun_static_y && position->x < edge && end >= edge)
+				end = edge - 1;
+			position->x = end;
+		} else if (delta->x < 0) {
+			funge_cell end = TILE_ORIGIN(position->x);
+			funge_cell edge = (funge_cell)(cfun_static_x - cfun_static_offset_x);
+			if (end < fspace.topLeftCorner.x)
+				end = fspace.topLeftCorner.x;
+			if (sy < cfun_static_y && position->x >= edge && end < edge)
+				end = edge;
+			position->x = end;
+		} else if (delta->y > 0) {
+			funge_cell end = TILE_ORIGIN(position->y) + (FUNGESPACE_TILE_SIZE - 1);
+			funge_cell edge = (funge_cell)(0 - cfun_static_offset_y);
+			if (end > fspace.bottomRightCorner.y)
+				end = fspace.bottomRightCorner.y;
+			if (sx < cfun_static_x && position->y < edge && end >= edge)
+				end = edge - 1;
+			position->y = end;
+		} else {
+			funge_cell end = TILE_ORIGIN(position->y);
+			funge_cell edge = (funge_cell)(cfun_static_y - cfun_static_offset_y);
+			if (end < fspace.topLeftCorner.y)
+				end = fspace.topLeftCorner.y;
+			if (sx < cfun_static_x && position->y >= edge && end < edge)
+				end = edge;
+			position->y = end;
+		}
+	} while (comment ? (value != ';') : (value == ' '));
+	return value;
+}
+
+/**
+ * Shared code for fungespace_skip_spaces() and fungespace_skip_comment().
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline funge_cell fungespace_skip(funge_vector * restrict position,
+                                         const funge_vector * restrict delta,
+                                         fungeSpaceCache * restrict cache,
+                                         bool comment)
+{
+	funge_vector from = *position;
+	skipCacheEntry *entry;
+	uint_fast8_t key;
+	funge_cell value;
+
+	// Most skips are short, check the next cell before bothering with the cache.
+	position->x += delta->x;
+	position->y += delta->y;
+	fungespace_wrap(position, delta);
+	value = fungespace_get_cached(position, cache);
+	if (comment ? (value == ';') : (value != ' '))
+		return value;
+	if (FUNGE_UNLIKELY(!fspace_vector_is_cardinal(delta)))
+		return fungespace_skip_scan(position, delta, cache, comment);
+
+	key = skipcache_key(delta, comment);
+	entry = skipcache_entry(&from, key);
+	if (entry->key == key && entry->from.x == from.x && entry->from.y == from.y
+	    && entry->generation == skipcache_generation(&from, delta)) {
+		fspace.stats.skiphits++;
+		*position = entry->to;
+		return fungespace_get_cached(position, cache);
+	}
+	value = fungespace_skip_scan(position, delta, cache, comment);
+	entry->from       = from;
+	entry->to         = *position;
+	entry->generation = skipcache_generation(&from, delta);
+	entry->key        = key;
+	return value;
+}
+
+FUNGE_ATTR_FAST funge_cell
+fungespace_skip_spaces(funge_vector * restrict position,
+                       const funge_vector * restrict delta,
+                       fungeSpaceCache * restrict cache)
+{
+	return fungespace_skip(position, delta, cache, false);
+}
+
+FUNGE_ATTR_FAST funge_cell
+fungespace_skip_comment(funge_vector * restrict position,
+                        const funge_vector * restrict delta,
+                        fungeSpaceCache * restrict cache)
+{
+	return fungespace_skip(position, delta, cache, true);
+}
+
+
+/******************
+ * Load/save code *
+ ******************/
+
+// Returns fd, addr and length.
+/**
+ * mmap() a file.
+ * @param filename Filename to mmap().
+ * @param maddr Pointer to a char* where the mapping's address will be placed.
+ * @param length Pointer to a size_t where the size of the mapping will be placed.
+ * @return
+ * Returns the file descriptor, or -1 in case of error, or -2 in case of
+ * empty file.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+static inline int do_mmap(const char * restrict filename,
+                          unsigned char **maddr,
+                          size_t * restrict length)
+{
+	char *addr = NULL;
+	struct stat sb;
+	int fd;
+	size_t len = 0;
+
+	fd = open(filename, O_RDONLY);
+	if (FUNGE_UNLIKELY(fd == -1))
+		return -1;
+
+	if (FUNGE_UNLIKELY(fstat(fd, &sb) == -1)) {
+		diag_error_format("fstat() on file \"%s\" failed: %s", filename, strerror(errno));
+		goto error;
+	}
+
+	len = (size_t)sb.st_size;
+	*length = len;
+	// An empty file isn't an error, but we can't mmap it.
+	if (len == 0) {
+		close(fd);
+		return -2;
+	}
+	// mmap() it.
+	addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (FUNGE_UNLIKELY(addr == MAP_FAILED)) {
+		diag_error_format("mmap() on file \"%s\" failed: %s", filename, strerror(errno));
+		goto error;
+	}
+#if defined(_POSIX_ADVISORY_INFO) && (_POSIX_ADVISORY_INFO > 0)
+	posix_madvise(addr, len, POSIX_MADV_SEQUENTIAL);
+#endif
+	*maddr = (unsigned char*)addr;
+	return fd;
+error:
+	if (addr != NULL) {
+		munmap(addr, len);
+	}
+	if (fd != -1) {
+		close(fd);
+	}
+	return -1;
+}
+
+/**
+ * Clean up a mapping created with do_mmap().
+ * @param fd is the file descriptor to close.
+ * @param addr is the address to the mmap()ed area.
+ * @param length is the length of the mmap()ed area.
+ */
 FUNGE_ATTR_FAST
-static inline void wrap(funge_vector * restrict pos,
-                        const funge_vector * restrict delta)
+static inline void do_mmap_cleanup(int fd, unsigned char *addr, size_t length)
 {
-	funge_cell m;
-#define FUNGESPACE_FY wrap_frac_dir(pos->y, fspace.topLeftCorner.y, fspace.bottomRightCorner.y, delta->y)
-#define FUNGESPACE_FX wrap_frac_dir(pos->x, fspace.topLeftCorner.x, fspace.bottomRightCorner.x, delta->x)
-	if (delta->x == 0  && delta->y == 0)
-		return; // Shouldn't happen, zero delta and outside the border.
-	else if (delta->x == 0)
-		m = FUNGESPACE_FY;
-	else if (delta->y == 0)
-		m = FUNGESPACE_FX;
-	else {
-		funge_cell fx = FUNGESPACE_FX;
-		funge_cell fy = FUNGESPACE_FY;
-		m = (fx < fy) ? fx : fy;
+	if (FUNGE_LIKELY(addr != NULL)) {
+		munmap((char*)addr, length);
+	}
+	if (FUNGE_LIKELY(fd != -1)) {
+		close(fd);
 	}
+}
 
-	pos->x = pos->x - (m * delta->x);
-	pos->y = pos->y - (m * delta->y);
-#undef FUNGESPACE_FY
-#undef FUNGESPACE_FX
+/*
+ * Loading files goes through them a run of ordinary characters (instructions
+ * and spaces) at a time, looking for the next newline, form feed, space or
+ * non-space 16 bytes at a time (32 with AVX2). The non-space parts of a run
+ * are merged into Funge-Space a row chunk at a time, like rectangle writes.
+ */
+
+#ifdef FSPACE_LOAD_SSE2
+#  ifdef FSPACE_LOAD_AVX2
+#    define LOAD_VECTOR 32
+#  else
+#    define LOAD_VECTOR 16
+#  endif
+
+/// Bit i set if byte i of the LOAD_VECTOR at p is '\n', '\r' or '\f'.
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline uint32_t load_match_newline(const unsigned char * restrict p)
+{
+#  ifdef FSPACE_LOAD_AVX2
+	__m256i v = _mm256_loadu_si256((const __m256i *)(const void *)p);
+	__m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+	                            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')),
+	                                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\f'))));
+	return (uint32_t)_mm256_movemask_epi8(m);
+#  else
+	__m128i v = _mm_loadu_si128((const __m128i *)(const void *)p);
+	__m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+	                         _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+	                                      _mm_cmpeq_epi8(v, _mm_set1_epi8('\f'))));
+	return (uint32_t)_mm_movemask_epi8(m);
+#  endif
+}
+
+/// Bit i set if byte i of the LOAD_VECTOR at p is a space.
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline uint32_t load_match_space(const unsigned char * restrict p)
+{
+#  ifdef FSPACE_LOAD_AVX2
+	__m256i v = _mm256_loadu_si256((const __m256i *)(const void *)p);
+	return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+#  else
+	__m128i v = _mm_loadu_si128((const __m128i *)(const void *)p);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+#  endif
+}
+
+/// All bits of a load_match_*() mask.
+#  if LOAD_VECTOR == 32
+#    define LOAD_MASK_ALL UINT32_C(0xFFFFFFFF)
+#  else
+#    define LOAD_MASK_ALL UINT32_C(0xFFFF)
+#  endif
+#endif /* FSPACE_LOAD_SSE2 */
+
+/**
+ * Find the first '\n', '\r' or '\f' from p, or end if there is none.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE FUNGE_ATTR_NONNULL
+static inline const unsigned char *load_find_newline(const unsigned char * restrict p,
+                                                     const unsigned char * restrict end)
+{
+#ifdef FSPACE_LOAD_SSE2
+	for (; end - p >= LOAD_VECTOR; p += LOAD_VECTOR) {
+		uint32_t mask = load_match_newline(p);
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+#endif
+	for (; p < end; p++)
+		if (*p == '\n' || *p == '\r' || *p == '\f')
+			break;
+	return p;
+}
+
+/**
+ * Find the first byte from p that isn't a space, or end if there is none.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE FUNGE_ATTR_NONNULL
+static inline const unsigned char *load_skip_spaces(const unsigned char * restrict p,
+                                                    const unsigned char * restrict end)
+{
+#ifdef FSPACE_LOAD_SSE2
+	for (; end - p >= LOAD_VECTOR; p += LOAD_VECTOR) {
+		uint32_t mask = load_match_space(p) ^ LOAD_MASK_ALL;
+		if (mask)
+			return p + __builtin_ctz(mask);
+	}
+#endif
+	while (p < end && *p == ' ')
+		p++;
+	return p;
+}
+
+/**
+ * Find the end of the last byte before end that isn't a space, or start if
+ * they are all spaces.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE FUNGE_ATTR_NONNULL
+static inline const unsigned char *load_trim_spaces(const unsigned char * restrict start,
+                                                    const unsigned char * restrict end)
+{
+#ifdef FSPACE_LOAD_SSE2
+	for (; end - start >= LOAD_VECTOR; end -= LOAD_VECTOR) {
+		uint32_t mask = load_match_space(end - LOAD_VECTOR) ^ LOAD_MASK_ALL;
+		if (mask)
+			return end - LOAD_VECTOR + 32 - __builtin_clz(mask);
+	}
+#endif
+	while (end > start && end[-1] == ' ')
+		end--;
+	return end;
+}
+
+#ifdef CFUN_COMPACT_CELLS
+/**
+ * Merge n bytes from a file into cells of the static array: spaces leave the
+ * cell as it was, other bytes replace it.
+ * @param stored Out parameter for the merged cells, as stored.
+ * @param dest The cells in the static array, there must be no escaped ones.
+ * @param src The bytes.
+ * @return False if a byte doesn't fit in the static array, stored is
+ * incomplete then.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static inline bool load_merge_static(fungeStaticCell * restrict stored,
+                                     const fungeStaticCell * restrict dest,
+                                     const unsigned char * restrict src,
+                                     funge_unsigned_cell n)
+{
+	const unsigned char encode = (unsigned char)FSPACE_ENCODE(0);
+	funge_unsigned_cell i = 0;
+
+#  ifdef FSPACE_LOAD_SSE2
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i escape = _mm_set1_epi8((char)FSPACE_STATIC_ESCAPE);
+	const __m128i enc = _mm_set1_epi8((char)encode);
+	for (; n - i >= 16; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(const void *)(src + i));
+		__m128i keep = _mm_cmpeq_epi8(v, space);
+		__m128i e = _mm_xor_si128(v, enc);
+		__m128i old = _mm_loadu_si128((const __m128i *)(const void *)(dest + i));
+		if (_mm_movemask_epi8(_mm_andnot_si128(keep, _mm_cmpeq_epi8(e, escape))))
+			return false;
+		_mm_storeu_si128((__m128i *)(void *)(stored + i),
+		                 _mm_or_si128(_mm_and_si128(keep, old), _mm_andnot_si128(keep, e)));
+	}
+#  endif
+	for (; i < n; i++) {
+		if (src[i] == ' ') {
+			stored[i] = dest[i];
+		} else {
+			stored[i] = (fungeStaticCell)(src[i] ^ encode);
+			if (stored[i] == FSPACE_STATIC_ESCAPE)
+				return false;
+		}
+	}
+	return true;
+}
+#endif
+
+#ifdef FSPACE_LOAD_SSE2
+/**
+ * Blend cells: lanes of e (encoded new values) where m is all zeros, the
+ * cells already there where m is all ones. Both have one lane per cell.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void load_blend_cells(funge_cell * restrict cells, __m128i e, __m128i m)
+{
+	__m128i old = _mm_loadu_si128((const __m128i *)(void *)cells);
+	_mm_storeu_si128((__m128i *)(void *)cells,
+	                 _mm_or_si128(_mm_and_si128(m, old), _mm_andnot_si128(m, e)));
+}
+
+/// load_blend_cells() for 4 cells, from 32-bit lanes.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void load_blend_cells32(funge_cell * restrict cells, __m128i e, __m128i m)
+{
+#  ifdef USE64
+	const __m128i zero = _mm_setzero_si128();
+	load_blend_cells(cells, _mm_unpacklo_epi32(e, zero), _mm_unpacklo_epi32(m, m));
+	load_blend_cells(cells + 2, _mm_unpackhi_epi32(e, zero), _mm_unpackhi_epi32(m, m));
+#  else
+	load_blend_cells(cells, e, m);
+#  endif
+}
+
+/// load_blend_cells() for 8 cells, from 16-bit lanes.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void load_blend_cells16(funge_cell * restrict cells, __m128i e, __m128i m)
+{
+	const __m128i zero = _mm_setzero_si128();
+	load_blend_cells32(cells, _mm_unpacklo_epi16(e, zero), _mm_unpacklo_epi16(m, m));
+	load_blend_cells32(cells + 4, _mm_unpackhi_epi16(e, zero), _mm_unpackhi_epi16(m, m));
+}
+#endif
+
+/**
+ * Merge n bytes from a file into cells: spaces leave the cell as it was,
+ * other bytes replace it.
+ * @param cells The cells, as stored.
+ * @param src The bytes.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void load_merge_cells(funge_cell * restrict cells,
+                                    const unsigned char * restrict src,
+                                    funge_unsigned_cell n)
+{
+	funge_unsigned_cell i = 0;
+
+#ifdef FSPACE_LOAD_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i enc = _mm_set1_epi8((char)FSPACE_ENCODE(0));
+	// Widen the bytes (and the mask of which are spaces) to cells.
+	for (; n - i >= 16; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(const void *)(src + i));
+		__m128i keep = _mm_cmpeq_epi8(v, space);
+		__m128i e = _mm_xor_si128(v, enc);
+		load_blend_cells16(cells + i, _mm_unpacklo_epi8(e, zero), _mm_unpacklo_epi8(keep, keep));
+		load_blend_cells16(cells + i + 8, _mm_unpackhi_epi8(e, zero), _mm_unpackhi_epi8(keep, keep));
+	}
+#endif
+	for (; i < n; i++)
+		if (src[i] != ' ')
+			cells[i] = FSPACE_ENCODE((funge_cell)src[i]);
+}
+
+/**
+ * Merge n bytes from a file into Funge-Space at x,y and to the right of it,
+ * a run as found by rect_run(). Spaces leave the cell as it was.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void load_run(funge_cell x, funge_cell y, rectRunKind kind,
+                     funge_unsigned_cell n, const unsigned char * restrict src,
+                     rectState * restrict state, fungeSpaceCache * restrict readcache)
+{
+	funge_cell cells[RECT_CHUNK];
+
+	assert(n <= RECT_CHUNK);
+#ifdef CFUN_COMPACT_CELLS
+	if (kind == RECT_STATIC) {
+		fungeStaticCell stored[RECT_CHUNK];
+		const fungeStaticCell *dest = rect_static_cell(x, y);
+		if (rect_static_plain(dest, n) && load_merge_static(stored, dest, src, n)) {
+			rect_static_write(x, y, n, stored, state);
+			return;
+		}
+	}
+#endif
+	rect_read_run(x, y, kind, n, cells, readcache);
+	load_merge_cells(cells, src, n);
+	rect_write_run(x, y, kind, n, cells, state);
+}
+
+/**
+ * Merge a run of n bytes (no newlines) from a file into row y of Funge-Space,
+ * starting at column x. Spaces leave the cell as it was.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void load_row(funge_cell x, funge_cell y, const unsigned char * restrict src,
+                     size_t n, rectState * restrict state)
+{
+	const unsigned char *p = src, *end = src + n;
+	fungeSpaceCache readcache = { {0, 0}, NULL, 0 };
+
+	while ((p = load_skip_spaces(p, end)) < end) {
+		funge_cell cx = (funge_cell)((funge_unsigned_cell)x + (funge_unsigned_cell)(p - src));
+		size_t left = (size_t)(end - p);
+		rectRunKind kind;
+		funge_unsigned_cell len = rect_run(cx, y, left < RECT_CHUNK ? (funge_unsigned_cell)left : RECT_CHUNK,
+		                                   false, &kind);
+		// Starts with a non-space, so this doesn't trim all of it.
+		len = (funge_unsigned_cell)(load_trim_spaces(p, p + len) - p);
+		load_run(cx, y, kind, len, p, state, &readcache);
+		p += len;
+	}
+}
+
+/// Where a loader is in the file it is going through.
+typedef struct loadScanner {
+	const unsigned char *p;
+	const unsigned char *end;
+	/// Position in the file of the next ordinary character.
+	funge_cell           x;
+	funge_cell           y;
+	/// Longest line so far.
+	funge_cell           width;
+	bool                 last_was_cr;
+} loadScanner;
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void load_newline(loadScanner * restrict s)
+{
+	if (s->x > s->width)
+		s->width = s->x;
+	s->x = 0;
+	s->y++;
+}
+
+/**
+ * Find the next run of ordinary characters in the file, handling the
+ * newlines before it. It starts at s->x,s->y, the caller must add its length
+ * to s->x.
+ *
+ * A \\r followed by \\n is a single newline, as is either on its own. Form
+ * feeds are ignored, also between a \\r and what follows it.
+ * @param start Out parameter for the run.
+ * @return Length of the run, 0 at the end of the file.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static size_t load_next_run(loadScanner * restrict s, const unsigned char ** start)
+{
+	while (s->p < s->end) {
+		const unsigned char *stop = load_find_newline(s->p, s->end);
+		if (stop != s->p) {
+			if (s->last_was_cr) {
+				s->last_was_cr = false;
+				load_newline(s);
+			}
+			*start = s->p;
+			s->p = stop;
+			return (size_t)(stop - *start);
+		}
+		switch (*s->p++) {
+			case '\r':
+				if (s->last_was_cr)
+					load_newline(s);
+				s->last_was_cr = true;
+				break;
+			case '\n':
+				s->last_was_cr = false;
+				load_newline(s);
+				break;
+			// Ignore form feed. Treat it as newline is treated in Unefunge.
+			default:
+				break;
+		}
+	}
+	return 0;
+}
+
+/**
+ * Load a text file into Funge-Space. Spaces in the file leave the cells
+ * there as they are.
+ * @param program The file.
+ * @param length Length of the file.
+ * @param offset Where 0,0 of the file goes.
+ * @param initial If the bounds should be set from the file, rather than only
+ * extended, when nothing was stored before.
+ * @param size Out parameter for the width and height of the file, as for the
+ * i instruction.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void load_text(const unsigned char * restrict program, size_t length,
+                      const funge_vector * restrict offset, bool initial,
+                      funge_vector * restrict size)
+{
+	loadScanner s = { program, program + length, 0, 0, 0, false };
+	const unsigned char *run;
+	size_t n;
+
+	while ((n = load_next_run(&s, &run)) != 0) {
+		funge_cell x = (funge_cell)((funge_unsigned_cell)offset->x + (funge_unsigned_cell)s.x);
+		funge_cell y = (funge_cell)((funge_unsigned_cell)offset->y + (funge_unsigned_cell)s.y);
+		rectState state;
+		rect_begin(&state, x, (funge_cell)n);
+		load_row(x, y, run, n, &state);
+		if (initial && !fspace.boundsvalid && state.any) {
+			fspace.topLeftCorner = state.min;
+			fspace.bottomRightCorner = state.max;
+			fspace.boundsvalid = true;
+		}
+		rect_end(&state);
+		s.x += (funge_cell)n;
+	}
+	if (s.last_was_cr)
+		s.y++;
+	size->x = (s.x > s.width) ? s.x : s.width;
+	size->y = s.y;
+}
+
+#ifdef CFUN_PARALLEL_LOAD
+/*
+ * Files of FSPACE_LOAD_PARALLEL_MIN bytes or more are loaded by several
+ * threads. The file is split into chunks after newlines (anywhere for binary
+ * i), so each chunk has rows of its own. Each thread first scans its chunk to
+ * count the lines in it, which gives the row each chunk starts at. Then each
+ * thread merges its chunk straight into its rows of the static array, and
+ * into tiles of its own outside it. What can't be done that way (escaped
+ * cells, the edge of the cell range) is left for afterwards, when the tiles
+ * are inserted and the bounds and caches are updated.
+ *
+ * Nothing shared is written by the threads, and spaces are never written, so
+ * the result is the same as for load_text() whatever order that happens in.
+ */
+/// Smallest file loaded with several threads.
+#define FSPACE_LOAD_PARALLEL_MIN (4 << 20)
+/// Smallest chunk for a thread.
+#define FSPACE_LOAD_CHUNK_MIN (1 << 20)
+/// Most threads used.
+#define FSPACE_LOAD_THREADS_MAX 16
+
+/// A run a loader thread left for afterwards.
+typedef struct loadDeferred {
+	const unsigned char *src;
+	funge_unsigned_cell  n;
+	funge_cell           x;
+	funge_cell           y;
+} loadDeferred;
+
+/// A tile built by a loader thread.
+typedef struct loadTile {
+	funge_vector    origin;
+	fungeSpaceTile *tile;
+} loadTile;
+
+/// A chunk of the file and what the thread for it has done.
+typedef struct loadChunk {
+	const unsigned char *start;
+	const unsigned char *end;
+	/// Where the first byte of the chunk goes.
+	funge_vector         origin;
+	/// Scan the chunk (instead of loading it).
+	bool                 scanning;
+	/// Find the bounding box of the chunk while scanning.
+	bool                 scanbounds;
+	bool                 binary;
+	/// Where the scan ended, with rows counted from the start of the chunk.
+	loadScanner          scan;
+	/// Bounding box of the non-space bytes, rows as for scan.
+	rectState            scanned;
+	/// Bounding box of what was written.
+	rectState            written;
+	/// Open addressing hash table of the tiles built.
+	loadTile            *tiles;
+	size_t               tilemask;
+	size_t               ntiles;
+	loadDeferred        *deferred;
+	size_t               ndeferred;
+	size_t               deferredsize;
+} loadChunk;
+
+/**
+ * Hash of a tile origin, for the tables of the loader threads.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_PURE
+static inline size_t load_tile_hash(const funge_vector * restrict origin)
+{
+	uint64_t h = ((uint64_t)((funge_unsigned_cell)origin->x >> FUNGESPACE_TILE_BITS) * UINT64_C(0x9E3779B97F4A7C15))
+	             ^ (uint64_t)((funge_unsigned_cell)origin->y >> FUNGESPACE_TILE_BITS);
+	return (size_t)((h * UINT64_C(0xC2B2AE3D27D4EB4F)) >> 32);
+}
+
+/**
+ * Get the tile of the chunk for x,y, create it if it doesn't exist yet.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static fungeSpaceTile *load_chunk_tile(loadChunk * restrict chunk, funge_cell x, funge_cell y)
+{
+	funge_vector origin = { TILE_ORIGIN(x), TILE_ORIGIN(y) };
+	size_t i;
+
+	if (chunk->ntiles * 2 >= chunk->tilemask) {
+		loadTile *old = chunk->tiles;
+		size_t oldsize = old ? chunk->tilemask + 1 : 0;
+		size_t size = old ? oldsize * 2 : 64;
+		chunk->tiles = calloc(size, sizeof(loadTile));
+		if (FUNGE_UNLIKELY(!chunk->tiles))
+			DIAG_OOM("Could not allocate memory for loading file");
+		chunk->tilemask = size - 1;
+		chunk->ntiles = 0;
+		for (size_t j = 0; j < oldsize; j++)
+			if (old[j].tile) {
+				i = load_tile_hash(&old[j].origin) & chunk->tilemask;
+				while (chunk->tiles[i].tile)
+					i = (i + 1) & chunk->tilemask;
+				chunk->tiles[i] = old[j];
+				chunk->ntiles++;
+			}
+		free(old);
+	}
+	i = load_tile_hash(&origin) & chunk->tilemask;
+	while (chunk->tiles[i].tile) {
+		if (chunk->tiles[i].origin.x == origin.x && chunk->tiles[i].origin.y == origin.y)
+			return chunk->tiles[i].tile;
+		i = (i + 1) & chunk->tilemask;
+	}
+	chunk->tiles[i].origin = origin;
+	chunk->tiles[i].tile = fungespace_tile_alloc();
+	chunk->ntiles++;
+	return chunk->tiles[i].tile;
+}
+
+/**
+ * Merge n bytes into the static array at x,y and to the right of it, a run as
+ * found by rect_run().
+ * @return False if there are escaped cells or bytes that don't fit, nothing
+ * was written then.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static inline bool load_chunk_static(funge_cell x, funge_cell y, funge_unsigned_cell n,
+                                     const unsigned char * restrict src)
+{
+	fungeStaticCell *dest = rect_static_cell(x, y);
+#ifdef CFUN_COMPACT_CELLS
+	fungeStaticCell stored[RECT_CHUNK];
+
+	if (!rect_static_plain(dest, n) || !load_merge_static(stored, dest, src, n))
+		return false;
+	memcpy(dest, stored, (size_t)n * sizeof(fungeStaticCell));
+#else
+	load_merge_cells(dest, src, n);
+#endif
+	return true;
+}
+
+/**
+ * Load a row of the chunk, like load_row() but only writing to the static
+ * array and the tiles of the chunk.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void load_chunk_row(loadChunk * restrict chunk, funge_cell x, funge_cell y,
+                           const unsigned char * restrict src, size_t n)
+{
+	const unsigned char *p = src, *end = src + n;
+
+	while ((p = load_skip_spaces(p, end)) < end) {
+		funge_cell cx = (funge_cell)((funge_unsigned_cell)x + (funge_unsigned_cell)(p - src));
+		size_t left = (size_t)(end - p);
+		rectRunKind kind;
+		funge_unsigned_cell len = rect_run(cx, y, left < RECT_CHUNK ? (funge_unsigned_cell)left : RECT_CHUNK,
+		                                   false, &kind);
+		// Starts and ends with a non-space after this.
+		len = (funge_unsigned_cell)(load_trim_spaces(p, p + len) - p);
+		if (kind == RECT_TILE) {
+			fungeSpaceTile *tile = load_chunk_tile(chunk, cx, y);
+			load_merge_cells(&tile->cells[TILE_COORD(cx, y)], p, len);
+		} else if (kind != RECT_STATIC || !load_chunk_static(cx, y, len, p)) {
+			if (chunk->ndeferred == chunk->deferredsize) {
+				chunk->deferredsize = chunk->deferredsize ? chunk->deferredsize * 2 : 64;
+				chunk->deferred = realloc(chunk->deferred, chunk->deferredsize * sizeof(loadDeferred));
+				if (FUNGE_UNLIKELY(!chunk->deferred))
+					DIAG_OOM("Could not allocate memory for loading file");
+			}
+			chunk->deferred[chunk->ndeferred++] = (loadDeferred){ p, len, cx, y };
+			p += len;
+			continue;
+		}
+		rect_extent_add(&chunk->written, cx, (funge_cell)((funge_unsigned_cell)cx + len - 1), y);
+		p += len;
+	}
+}
+
+/**
+ * Scan or load a chunk, run by the loader threads.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void *load_chunk(void *arg)
+{
+	loadChunk *chunk = arg;
+	loadScanner s = { chunk->start, chunk->end, 0, 0, 0, false };
+	const unsigned char *run;
+	size_t n;
+
+	if (chunk->binary) {
+		load_chunk_row(chunk, chunk->origin.x, chunk->origin.y,
+		               chunk->start, (size_t)(chunk->end - chunk->start));
+		return NULL;
+	}
+	while ((n = load_next_run(&s, &run)) != 0) {
+		if (!chunk->scanning) {
+			load_chunk_row(chunk, (funge_cell)((funge_unsigned_cell)chunk->origin.x + (funge_unsigned_cell)s.x),
+			               (funge_cell)((funge_unsigned_cell)chunk->origin.y + (funge_unsigned_cell)s.y),
+			               run, n);
+		} else if (chunk->scanbounds) {
+			const unsigned char *first = load_skip_spaces(run, run + n);
+			if (first != run + n)
+				rect_extent_add(&chunk->scanned, s.x + (funge_cell)(first - run),
+				                s.x + (funge_cell)(load_trim_spaces(first, run + n) - run) - 1, s.y);
+		}
+		s.x += (funge_cell)n;
+	}
+	chunk->scan = s;
+	return NULL;
+}
+
+/**
+ * Run load_chunk() for each chunk, each in its own thread. The first one,
+ * and any that a thread couldn't be started for, are done by this thread.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void load_chunks(loadChunk * restrict chunks, size_t count)
+{
+	pthread_t threads[FSPACE_LOAD_THREADS_MAX];
+	bool started[FSPACE_LOAD_THREADS_MAX];
+
+	for (size_t i = 1; i < count; i++)
+		started[i] = pthread_create(&threads[i], NULL, &load_chunk, &chunks[i]) == 0;
+	load_chunk(&chunks[0]);
+	for (size_t i = 1; i < count; i++) {
+		if (started[i])
+			pthread_join(threads[i], NULL);
+		else
+			load_chunk(&chunks[i]);
+	}
+}
+
+/**
+ * Split a file into chunks for the loader threads.
+ * @return Number of chunks, at most count.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static size_t load_split(loadChunk * restrict chunks, size_t count,
+                         const unsigned char * restrict program, size_t length,
+                         bool binary)
+{
+	const unsigned char *start = program, *end = program + length;
+	size_t n = 0;
+
+	for (size_t i = 1; i <= count && start < end; i++) {
+		const unsigned char *stop = (i == count) ? end : program + length / count * i;
+		if (stop <= start)
+			continue;
+		if (!binary && stop < end) {
+			stop = memchr(stop, '\n', (size_t)(end - stop));
+			stop = stop ? stop + 1 : end;
+		}
+		memset(&chunks[n], 0, sizeof(loadChunk));
+		chunks[n].start = start;
+		chunks[n].end = stop;
+		chunks[n].binary = binary;
+		n++;
+		start = stop;
+	}
+	return n;
+}
+
+/**
+ * Number of threads to load a file of length bytes with. The number of CPUs
+ * can be overridden with CFUNGE_LOAD_THREADS in the environment, so the tests
+ * use threads on any machine.
+ */
+FUNGE_ATTR_FAST
+static size_t load_thread_count(size_t length)
+{
+	const char *threads = getenv("CFUNGE_LOAD_THREADS");
+	long cpus = 1;
+	size_t n = length / FSPACE_LOAD_CHUNK_MIN;
+
+#ifdef _SC_NPROCESSORS_ONLN
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (threads && *threads)
+		cpus = strtol(threads, NULL, 10);
+	if (length < FSPACE_LOAD_PARALLEL_MIN || cpus < 2)
+		return 1;
+	if (n > (size_t)cpus)
+		n = (size_t)cpus;
+	if (n > FSPACE_LOAD_THREADS_MAX)
+		n = FSPACE_LOAD_THREADS_MAX;
+	return n;
 }
-/* End of algorithm contributed by Elliott Hird. */
 
-FUNGE_ATTR_FAST void
-fungespace_wrap(funge_vector * restrict position,
-                const funge_vector * restrict delta)
+/**
+ * Insert the tiles a loader thread built, merging them into any that are
+ * already there.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void load_merge_tiles(loadChunk * restrict chunk)
 {
-#ifdef CFUN_EXACT_BOUNDS
-	if (FUNGE_UNLIKELY(!fspace.boundsexact
-	                   && (BOUNDS_TOO_LARGE(x) || BOUNDS_TOO_LARGE(y))))
-		fungespace_minimize_bounds();
-#endif
-	if (!fungespace_in_range(position)) {
-		// Quick and dirty if cardinal.
-		if (FUNGE_LIKELY(fspace_vector_is_cardinal(delta))) {
-			// FIXME, HACK: Why are the +1/-1 needed?
-			if (position->x < fspace.topLeftCorner.x)
-				position->x = fspace.bottomRightCorner.x + 1;
-			else if (position->x > fspace.bottomRightCorner.x)
-				position->x = fspace.topLeftCorner.x - 1;
+	const funge_cell space = FSPACE_ENCODE(' ');
 
-			if (position->y < fspace.topLeftCorner.y)
-				position->y = fspace.bottomRightCorner.y + 1;
-			else if (position->y > fspace.bottomRightCorner.y)
-				position->y = fspace.topLeftCorner.y - 1;
-		} else {
-#ifdef SLOW_WRAP
-			do {
-				position->x -= delta->x;
-				position->y -= delta->y;
-			} while (fungespace_in_range(position));
-			position->x += delta->x;
-			position->y += delta->y;
-#else
-			wrap(position, delta);
-#endif
+	for (size_t i = 0; chunk->tiles && i <= chunk->tilemask; i++) {
+		fungeSpaceTile *local = chunk->tiles[i].tile, *tile;
+		if (!local)
+			continue;
+		tile = fungespace_tile_find(&chunk->tiles[i].origin);
+		if (!tile) {
+			local->used = 0;
+			for (size_t j = 0; j < FUNGESPACE_TILE_SIZE * FUNGESPACE_TILE_SIZE; j++)
+				if (local->cells[j] != space)
+					local->used++;
+			fungespace_tile_insert(local, &chunk->tiles[i].origin);
+			continue;
+		}
+		for (size_t j = 0; j < FUNGESPACE_TILE_SIZE * FUNGESPACE_TILE_SIZE; j++) {
+			if (local->cells[j] == space)
+				continue;
+			if (tile->cells[j] == space)
+				tile->used++;
+			tile->cells[j] = local->cells[j];
 		}
+		free(local);
 	}
+	free(chunk->tiles);
 }
 
+/**
+ * Note that anything may have changed, for the write epochs and the skip
+ * cache.
+ */
+FUNGE_ATTR_FAST
+static void load_touch_all(void)
+{
+	uint_fast64_t epoch = ++fspace_epochs.now;
 
-/******************
- * Load/save code *
- ******************/
+	for (size_t i = 0; i < EPOCH_REGIONS * EPOCH_REGIONS; i++) {
+		fspace_epochs.regions[i] = epoch;
+		fspace_watch.regions[i] = epoch;
+	}
+	fspace_watch.last = epoch;
+	fspace_watch.unlogged = epoch;
+	for (size_t i = 0; i < SKIPCACHE_LINES; i++) {
+		fspace_skipcache.rows[i]++;
+		fspace_skipcache.cols[i]++;
+	}
+}
 
-// Returns fd, addr and length.
 /**
- * mmap() a file.
- * @param filename Filename to mmap().
- * @param maddr Pointer to a char* where the mapping's address will be placed.
- * @param length Pointer to a size_t where the size of the mapping will be placed.
- * @return
- * Returns the file descriptor, or -1 in case of error, or -2 in case of
- * empty file.
+ * Extend the bounds with what was written, or set them from it if this is
+ * the initial load and nothing has been stored yet.
  */
-FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
-static inline int do_mmap(const char * restrict filename,
-                          unsigned char **maddr,
-                          size_t * restrict length)
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void load_bounds(rectState * restrict state, bool initial)
 {
-	char *addr = NULL;
-	struct stat sb;
-	int fd;
-	size_t len = 0;
+	if (initial && !fspace.boundsvalid && state->any) {
+		fspace.topLeftCorner = state->min;
+		fspace.bottomRightCorner = state->max;
+		fspace.boundsvalid = true;
+	}
+	rect_end(state);
+}
 
-	fd = open(filename, O_RDONLY);
-	if (FUNGE_UNLIKELY(fd == -1))
-		return -1;
+/**
+ * Load a file into Funge-Space with several threads, see above. Takes the
+ * same arguments as load_text(), and places the static array like
+ * fungespace_load_string() if initial is set.
+ * @param binary Load it as a single row (for binary i), size isn't set then.
+ * @return False if the file wasn't loaded because it is too small for this.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static bool load_parallel(const unsigned char * restrict program, size_t length,
+                          const funge_vector * restrict offset, bool initial,
+                          bool binary, funge_vector * restrict size)
+{
+	loadChunk chunks[FSPACE_LOAD_THREADS_MAX];
+	size_t count = load_thread_count(length);
+	bool setup = initial && !cfun_static_space && ght_size(fspace.entries) == 0;
 
-	if (FUNGE_UNLIKELY(fstat(fd, &sb) == -1)) {
-		diag_error_format("fstat() on file \"%s\" failed: %s", filename, strerror(errno));
-		goto error;
-	}
+#ifdef CFUN_EXACT_BOUNDS
+	// Counts have to be kept a cell at a time.
+	if (fspace.countsvalid)
+		return false;
+#endif
+	if (count < 2)
+		return false;
+	count = load_split(chunks, count, program, length, binary);
+	if (count < 2)
+		return false;
 
-	len = (size_t)sb.st_size;
-	*length = len;
-	// An empty file isn't an error, but we can't mmap it.
-	if (len == 0) {
-		close(fd);
-		return -2;
-	}
-	// mmap() it.
-	addr = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
-	if (FUNGE_UNLIKELY(addr == MAP_FAILED)) {
-		diag_error_format("mmap() on file \"%s\" failed: %s", filename, strerror(errno));
-		goto error;
+	if (binary) {
+		for (size_t i = 0; i < count; i++) {
+			chunks[i].origin.x = (funge_cell)((funge_unsigned_cell)offset->x
+			                                  + (funge_unsigned_cell)(chunks[i].start - program));
+			chunks[i].origin.y = offset->y;
+		}
+	} else {
+		funge_unsigned_cell y = 0;
+		funge_cell width = 0;
+		fungeRect bounds = { 0, 0, 0, 0 };
+		rectState extent = { .any = false };
+		const loadScanner *last = &chunks[count - 1].scan;
+
+		for (size_t i = 0; i < count; i++) {
+			chunks[i].scanning = true;
+			chunks[i].scanbounds = setup;
+		}
+		load_chunks(chunks, count);
+		// Rows of the scan results are from the start of each chunk.
+		for (size_t i = 0; i < count; i++) {
+			chunks[i].origin.x = offset->x;
+			chunks[i].origin.y = (funge_cell)((funge_unsigned_cell)offset->y + y);
+			if (chunks[i].scanned.any) {
+				rect_extent_add(&extent, chunks[i].scanned.min.x, chunks[i].scanned.max.x,
+				                (funge_cell)(y + (funge_unsigned_cell)chunks[i].scanned.min.y));
+				rect_extent_add(&extent, chunks[i].scanned.min.x, chunks[i].scanned.max.x,
+				                (funge_cell)(y + (funge_unsigned_cell)chunks[i].scanned.max.y));
+			}
+			if (chunks[i].scan.width > width)
+				width = chunks[i].scan.width;
+			y += (funge_unsigned_cell)chunks[i].scan.y;
+			chunks[i].scanning = false;
+		}
+		if (last->last_was_cr)
+			y++;
+		size->x = (last->x > width) ? last->x : width;
+		size->y = (funge_cell)y;
+		if (setup) {
+			if (extent.any) {
+				bounds.x = extent.min.x;
+				bounds.y = extent.min.y;
+				bounds.w = extent.max.x - extent.min.x;
+				bounds.h = extent.max.y - extent.min.y;
+			}
+			fungespace_static_setup(&bounds);
+		}
 	}
-#if defined(_POSIX_ADVISORY_INFO) && (_POSIX_ADVISORY_INFO > 0)
-	posix_madvise(addr, len, POSIX_MADV_SEQUENTIAL);
-#endif
-	*maddr = (unsigned char*)addr;
-	return fd;
-error:
-	if (addr != NULL) {
-		munmap(addr, len);
+
+	for (size_t i = 0; i < count; i++)
+		rect_begin(&chunks[i].written, 0, 0);
+	load_chunks(chunks, count);
+
+	for (size_t i = 0; i < count; i++) {
+		load_merge_tiles(&chunks[i]);
+		load_bounds(&chunks[i].written, initial);
 	}
-	if (fd != -1) {
-		close(fd);
+	for (size_t i = 0; i < count; i++) {
+		for (size_t j = 0; j < chunks[i].ndeferred; j++) {
+			const loadDeferred *run = &chunks[i].deferred[j];
+			rectState state;
+			rect_begin(&state, run->x, (funge_cell)run->n);
+			load_row(run->x, run->y, run->src, run->n, &state);
+			load_bounds(&state, initial);
+		}
+		free(chunks[i].deferred);
 	}
-	return -1;
+	load_touch_all();
+	return true;
 }
+#endif
 
 /**
- * Clean up a mapping created with do_mmap().
- * @param fd is the file descriptor to close.
- * @param addr is the address to the mmap()ed area.
- * @param length is the length of the mmap()ed area.
+ * Find the bounding rectangle of what fungespace_load_string() would load.
+ * Follows the same newline rules as it.
+ * @param program is the string to scan.
+ * @param length is the length of the string.
+ * @param bounds Out parameter, w and h are inclusive. Left as 0,0,0,0 if the
+ * program is only whitespace.
  */
-FUNGE_ATTR_FAST
-static inline void do_mmap_cleanup(int fd, unsigned char *addr, size_t length)
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void fungespace_scan_string(const unsigned char * restrict program,
+                                   size_t length, fungeRect * restrict bounds)
 {
-	if (FUNGE_LIKELY(addr != NULL)) {
-		munmap((char*)addr, length);
-	}
-	if (FUNGE_LIKELY(fd != -1)) {
-		close(fd);
+	loadScanner s = { program, program + length, 0, 0, 0, false };
+	const unsigned char *run;
+	size_t n;
+	bool found = false;
+	funge_cell minx = 0, miny = 0, maxx = 0, maxy = 0;
+
+	while ((n = load_next_run(&s, &run)) != 0) {
+		const unsigned char *first = load_skip_spaces(run, run + n);
+		if (first != run + n) {
+			funge_cell x0 = s.x + (funge_cell)(first - run);
+			funge_cell x1 = s.x + (funge_cell)(load_trim_spaces(first, run + n) - run) - 1;
+			if (FUNGE_UNLIKELY(!found)) {
+				minx = x0;
+				maxx = x1;
+				miny = s.y;
+				found = true;
+			} else {
+				if (x0 < minx) minx = x0;
+				if (x1 > maxx) maxx = x1;
+			}
+			// y never decreases.
+			maxy = s.y;
+		}
+		s.x += (funge_cell)n;
 	}
+	bounds->x = minx;
+	bounds->y = miny;
+	bounds->w = maxx - minx;
+	bounds->h = maxy - miny;
 }
 
-/// Macro for handling newlines.
-#define FUNGE_INITIAL_NEWLINE \
-	pos.x = 0; \
-	pos.y++;
-
 /**
  * Load a string into Funge-Space at 0,0. Used for initial loading.
  * Can handle null-bytes in the string without problems.
@@ -833,49 +4478,25 @@ static inline void do_mmap_cleanup(int fd, unsigned char *addr, size_t length)
  * @param length is the length of the string.
  */
 FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
-#ifndef FUNGE_EXTERNAL_LIBRARY
-static inline
-#endif
 void fungespace_load_string(const unsigned char * restrict program, size_t length)
 {
-	bool last_was_cr = false;
-	// Coord in Funge-Space.
-	funge_vector pos = {0, 0};
+	funge_vector size;
 
 	assert(program != NULL);
 
-	for (size_t i = 0; i < length; i++) {
-		switch (program[i]) {
-			case ' ':
-				if (last_was_cr) {
-					last_was_cr = false;
-					FUNGE_INITIAL_NEWLINE
-				}
-				pos.x++;
-				break;
-			case '\r':
-				if (last_was_cr) {
-					FUNGE_INITIAL_NEWLINE
-				}
-				last_was_cr = true;
-				break;
-			case '\n':
-				last_was_cr = false;
-				FUNGE_INITIAL_NEWLINE
-				break;
-			// Ignore form feed. Treat it as newline is treated in Unefunge.
-			case '\f':
-				break;
-			default:
-				if (last_was_cr) {
-					last_was_cr = false;
-					FUNGE_INITIAL_NEWLINE
-				}
-				fungespace_set_initial((funge_cell)program[i], &pos);
-				pos.x++;
-				break;
-		}
+#ifdef CFUN_PARALLEL_LOAD
+	if (load_parallel(program, length, vector_create_ref(0, 0), true, false, &size))
+		return;
+#endif
+	// Place the static array around the program, unless something has already
+	// been stored (then it is too late).
+	if (!cfun_static_space && ght_size(fspace.entries) == 0) {
+		fungeRect bounds;
+		fungespace_scan_string(program, length, &bounds);
+		fungespace_static_setup(&bounds);
 	}
+
+	load_text(program, length, vector_create_ref(0, 0), true, &size);
 }
 
 FUNGE_ATTR_FAST bool
@@ -903,13 +4524,101 @@ fungespace_load(const char * restrict filename)
 	return true;
 }
 
+/**
+ * Go through a file as fungespace_load_at_offset() does, collecting its
+ * runs for the cache.
+ * @param runs Where to put the runs, or NULL to only count them.
+ * @param bytes Where to put their bytes, or NULL to only count them.
+ * @param nruns Out parameter for the number of runs.
+ * @param nbytes Out parameter for the number of bytes in them.
+ */
+FUNGE_ATTR_FAST
+static void loadcache_collect(const unsigned char * restrict program, size_t length, bool binary,
+                              loadCacheRun * restrict runs, unsigned char * restrict bytes,
+                              size_t * restrict nruns, size_t * restrict nbytes)
+{
+	loadScanner s = { program, program + length, 0, 0, 0, false };
+	const unsigned char *run = program;
+	size_t n = binary ? length : load_next_run(&s, &run);
+
+	*nruns = *nbytes = 0;
+	while (n != 0) {
+		const unsigned char *first = load_skip_spaces(run, run + n);
+		if (first != run + n) {
+			size_t len = (size_t)(load_trim_spaces(first, run + n) - first);
+			if (runs) {
+				runs[*nruns].x = (funge_cell)((funge_unsigned_cell)s.x + (funge_unsigned_cell)(first - run));
+				runs[*nruns].y = s.y;
+				runs[*nruns].n = (funge_unsigned_cell)len;
+				runs[*nruns].start = *nbytes;
+				memcpy(bytes + *nbytes, first, len);
+			}
+			(*nruns)++;
+			*nbytes += len;
+		}
+		if (binary)
+			break;
+		s.x += (funge_cell)n;
+		n = load_next_run(&s, &run);
+	}
+}
+
+/**
+ * Store the runs of a file in its entry, which must be the most recently used
+ * one. Nothing is stored if it would take too much memory, or if the file
+ * changed recently.
+ * @param size Size pushed by i, for text files.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void loadcache_store(loadCacheEntry * restrict entry,
+                            const unsigned char * restrict program, size_t length,
+                            const funge_vector * restrict size)
+{
+	size_t nruns, nbytes, memory;
+
+	assert(entry == fspace_loadcache.entries);
+	if (length > LOADCACHE_MAX_MEMORY / 2 || entry->ctime > time(NULL) - LOADCACHE_MIN_AGE)
+		return;
+	loadcache_collect(program, length, entry->binary, NULL, NULL, &nruns, &nbytes);
+	memory = nruns * sizeof(loadCacheRun) + nbytes;
+	if (memory > LOADCACHE_MAX_MEMORY / 2)
+		return;
+	// This entry is small and first, so it stays.
+	loadcache_trim(LOADCACHE_MAX_ENTRIES, LOADCACHE_MAX_MEMORY - memory);
+	entry->runs = malloc(nruns * sizeof(loadCacheRun) + 1);
+	entry->bytes = malloc(nbytes + 1);
+	if (FUNGE_UNLIKELY(!entry->runs || !entry->bytes)) {
+		free(entry->runs);
+		free(entry->bytes);
+		entry->runs = NULL;
+		entry->bytes = NULL;
+		return;
+	}
+	loadcache_collect(program, length, entry->binary, entry->runs, entry->bytes, &nruns, &nbytes);
+	entry->nruns = nruns;
+	entry->size = *size;
+	entry->stored = true;
+	entry->memory += memory;
+	fspace_loadcache.memory += memory;
+}
 
-/// Macro for handling newlines.
-#define FUNGE_OFFSET_NEWLINE \
-	if (pos.x > size->x) \
-		size->x = pos.x; \
-	pos.x = 0; \
-	pos.y++;
+/**
+ * Load a file from its entry in the cache, like fungespace_load_at_offset().
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void loadcache_load(const loadCacheEntry * restrict entry,
+                           const funge_vector * restrict offset)
+{
+	for (size_t i = 0; i < entry->nruns; i++) {
+		const loadCacheRun *run = &entry->runs[i];
+		funge_cell x = (funge_cell)((funge_unsigned_cell)offset->x + (funge_unsigned_cell)run->x);
+		funge_cell y = (funge_cell)((funge_unsigned_cell)offset->y + (funge_unsigned_cell)run->y);
+		rectState state;
+		rect_begin(&state, x, (funge_cell)run->n);
+		load_row(x, y, entry->bytes + run->start, run->n, &state);
+		rect_end(&state);
+	}
+}
 
 FUNGE_ATTR_FAST bool
 fungespace_load_at_offset(const char         * restrict filename,
@@ -920,12 +4629,32 @@ fungespace_load_at_offset(const char         * restrict filename,
 	unsigned char *addr;
 	int fd;
 	size_t length;
-	funge_vector pos = {0, 0};
+	struct stat sb;
+	loadCacheEntry *entry = NULL;
+	bool loaded = false;
 
 	assert(filename != NULL);
 	assert(offset != NULL);
 	assert(size != NULL);
 
+	if (stat(filename, &sb) == 0 && sb.st_size > 0) {
+		entry = loadcache_find(filename, &sb, binary);
+		if (entry && entry->stored) {
+			if (binary) {
+				funge_cell endx = (funge_cell)((funge_unsigned_cell)offset->x + (funge_unsigned_cell)sb.st_size);
+				size->x = (endx > 0) ? endx : 0;
+				size->y = (offset->y > 0) ? offset->y : 0;
+			} else {
+				*size = entry->size;
+			}
+			fspace.stats.loadhits++;
+			loadcache_load(entry, offset);
+			return true;
+		}
+		if (!entry)
+			loadcache_add(filename, &sb, binary);
+	}
+
 	fd = do_mmap(filename, &addr, &length);
 	if (FUNGE_UNLIKELY(fd == -1))
 		return false;
@@ -940,60 +4669,156 @@ fungespace_load_at_offset(const char         * restrict filename,
 		return true;
 
 	if (binary) {
-		pos.x = offset->x;
-		pos.y = offset->y;
-		for (size_t i = 0; i < length; i++) {
-			if (addr[i] != ' ')
-				fungespace_set((funge_cell)addr[i], &pos);
-			pos.x++;
+		funge_cell endx = (funge_cell)((funge_unsigned_cell)offset->x + (funge_unsigned_cell)length);
+		if (endx > 0) size->x = endx;
+		if (offset->y > 0) size->y = offset->y;
+	}
+#ifdef CFUN_PARALLEL_LOAD
+	loaded = load_parallel(addr, length, offset, false, binary, size);
+#endif
+	if (!loaded && binary) {
+		rectState state;
+		rect_begin(&state, offset->x, (funge_cell)length);
+		load_row(offset->x, offset->y, addr, length, &state);
+		rect_end(&state);
+	} else if (!loaded) {
+		load_text(addr, length, offset, false, size);
+	}
+	// Loaded before, store it for the next time.
+	if (entry && (size_t)sb.st_size == length)
+		loadcache_store(entry, addr, length, size);
+	do_mmap_cleanup(fd, addr, length);
+	return true;
+}
+
+/*
+ * Saving reads a row at a time as bytes, in runs as for the rectangle
+ * operations. Plain runs of the compact static array are turned into bytes
+ * directly. Output is collected in a buffer written with write() when full.
+ */
+/// Size of the output buffer.
+#define SAVE_BUFFER_SIZE (1 << 20)
+
+/// Output buffer for fungespace_save_to_file().
+typedef struct saveBuffer {
+	int            fd;
+	size_t         used;
+	unsigned char  data[SAVE_BUFFER_SIZE];
+} saveBuffer;
+
+/**
+ * Write out what is in the buffer.
+ * @return False on errors.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static bool save_flush(saveBuffer * restrict buffer)
+{
+	size_t done = 0;
+
+	while (done < buffer->used) {
+		ssize_t n = write(buffer->fd, buffer->data + done, buffer->used - done);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
 		}
-	} else {
-		bool lastwascr = false;
-		for (size_t i = 0; i < length; i++) {
-			switch (addr[i]) {
-				// Ignore form feed. Treat it as newline is treated in Unefunge.
-				case '\f':
-					break;
-				case '\r':
-					if (lastwascr) {
-						// Blergh two \r after each other.
-						FUNGE_OFFSET_NEWLINE
-					}
-					lastwascr = true;
-					break;
-				case '\n':
-					FUNGE_OFFSET_NEWLINE
-					lastwascr = false;
-					break;
-				default:
-					if (lastwascr) {
-						lastwascr = false;
-						FUNGE_OFFSET_NEWLINE
-					}
-					if (addr[i] != ' ')
-						fungespace_set_offset((funge_cell)addr[i], &pos, offset);
-					pos.x++;
-					break;
-			}
+		done += (size_t)n;
+	}
+	buffer->used = 0;
+	return true;
+}
+
+/**
+ * Add n bytes to the buffer, or n copies of c if src is NULL.
+ * @return False on errors.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+static bool save_put(saveBuffer * restrict buffer, const unsigned char * restrict src,
+                     unsigned char c, uintmax_t n)
+{
+	while (n != 0) {
+		size_t k = SAVE_BUFFER_SIZE - buffer->used;
+		if (k == 0) {
+			if (!save_flush(buffer))
+				return false;
+			continue;
 		}
-		if (lastwascr) pos.y++;
+		if (k > n)
+			k = (size_t)n;
+		if (src) {
+			memcpy(buffer->data + buffer->used, src, k);
+			src += k;
+		} else {
+			memset(buffer->data + buffer->used, c, k);
+		}
+		buffer->used += k;
+		n -= k;
 	}
-	if (pos.x > size->x) size->x = pos.x;
-	if (pos.y > size->y) size->y = pos.y;
-	do_mmap_cleanup(fd, addr, length);
 	return true;
 }
 
+/**
+ * Read the n cells at x,y and to the right of it as bytes (the low byte of
+ * each cell).
+ * @param out Where to put the bytes.
+ * @return Number of cells up to and including the last one that isn't a
+ * space.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static funge_unsigned_cell save_read_row(funge_cell x, funge_cell y, funge_unsigned_cell n,
+                                         unsigned char * restrict out,
+                                         fungeSpaceCache * restrict readcache)
+{
+	funge_cell buf[RECT_CHUNK];
+	funge_unsigned_cell done = 0, end = 0;
+
+	while (done < n) {
+		funge_cell at = (funge_cell)((funge_unsigned_cell)x + done);
+		rectRunKind kind;
+		funge_unsigned_cell k = rect_run(at, y, n - done, false, &kind);
+#ifdef CFUN_COMPACT_CELLS
+		if (kind == RECT_STATIC) {
+			const fungeStaticCell *cells = rect_static_cell(at, y);
+			if (rect_static_plain(cells, k)) {
+				// Those are all byte values, so spaces can be found in the bytes.
+				const unsigned char encode = (unsigned char)FSPACE_ENCODE(0);
+				const unsigned char *last;
+				for (funge_unsigned_cell i = 0; i < k; i++)
+					out[done + i] = cells[i] ^ encode;
+				last = load_trim_spaces(out + done, out + done + k);
+				if (last != out + done)
+					end = (funge_unsigned_cell)(last - out);
+				done += k;
+				continue;
+			}
+		}
+#endif
+		if (k > RECT_CHUNK)
+			k = RECT_CHUNK;
+		rect_read_run(at, y, kind, k, buf, readcache);
+		for (funge_unsigned_cell i = 0; i < k; i++) {
+			funge_cell value = FSPACE_DECODE(buf[i]);
+			out[done + i] = (unsigned char)value;
+			if (value != ' ')
+				end = done + i + 1;
+		}
+		done += k;
+	}
+	return end;
+}
+
 FUNGE_ATTR_FAST bool
 fungespace_save_to_file(const char         * restrict filename,
                         const funge_vector * restrict offset,
                         const funge_vector * restrict size,
                         bool textfile)
 {
-	FILE * file;
-
-	funge_cell maxy = offset->y + size->y;
-	funge_cell maxx = offset->x + size->x;
+	fungeSpaceCache readcache = { {0, 0}, NULL, 0 };
+	saveBuffer *buffer;
+	unsigned char *row;
+	funge_unsigned_cell width = (funge_unsigned_cell)size->x;
+	uintmax_t newlines = 0;
+	bool ok = true;
 
 	assert(filename != NULL);
 	assert(offset != NULL);
@@ -1001,82 +4826,60 @@ fungespace_save_to_file(const char         * restrict filename,
 	assert(size->x > 0);
 	assert(size->y > 0);
 
-	file = fopen(filename, "wb");
-	if (!file)
+#if defined(USE64) && (SIZE_MAX < UINT64_MAX)
+	if (width > SIZE_MAX)
+		return false;
+#endif
+	row = malloc((size_t)width);
+	buffer = malloc(sizeof(saveBuffer));
+	if (!row || !buffer) {
+		free(row);
+		free(buffer);
+		return false;
+	}
+	buffer->used = 0;
+	buffer->fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+	if (buffer->fd == -1) {
+		free(row);
+		free(buffer);
 		return false;
+	}
 
 	if (!textfile) {
 		// Microoptimising! Remove this if it bothers you.
 		// However it also makes it possible to error out early.
 #if defined(_POSIX_ADVISORY_INFO) && (_POSIX_ADVISORY_INFO > 0)
-		if (posix_fallocate(fileno(file), 0, (off_t)(size->y * size->x)) != 0) {
-			goto error;
-		}
+		if (posix_fallocate(buffer->fd, 0, (off_t)(size->y * size->x)) != 0)
+			ok = false;
 #endif
-		for (funge_cell y = offset->y; y < maxy; y++) {
-			for (funge_cell x = offset->x; x < maxx; x++) {
-				funge_cell value = fungespace_get(vector_create_ref(x, y));
-				cf_putc_unlocked((int)value, file);
-			}
-			cf_putc_unlocked('\n', file);
-		}
-	// Text mode...
-	} else {
-		size_t index = 0;
-		// Extra size->y for adding a lot of \n...
-		unsigned char * restrict towrite = malloc((size_t)(size->x * size->y + size->y) * sizeof(unsigned char));
-		funge_cell * restrict string;
-
-		if (!towrite) {
-			goto error;
-		}
-		// Construct each line.
-		string = malloc((size_t)size->x * sizeof(funge_cell));
-		for (funge_cell y = offset->y; y < maxy; y++) {
-			ssize_t lastspace = (ssize_t)size->x;
-			if (!string) {
-				free(towrite);
-				goto error;
-			}
-			for (funge_cell x = offset->x; x < maxx; x++) {
-				string[x - offset->x] = fungespace_get(vector_create_ref(x, y));
-			}
-
-			do {
-				lastspace--;
-			} while ((lastspace >= 0) && (string[lastspace] == ' '));
+	}
 
-			for (ssize_t i = 0; i <= lastspace; i++) {
-				towrite[index + (size_t)i] = (unsigned char)string[i];
-			}
-			index += (size_t)(lastspace + 1);
-			towrite[index] = (funge_cell)'\n';
-			index++;
+	for (funge_unsigned_cell j = 0; ok && j < (funge_unsigned_cell)size->y; j++) {
+		funge_cell y = (funge_cell)((funge_unsigned_cell)offset->y + j);
+		funge_unsigned_cell end = save_read_row(offset->x, y, width, row, &readcache);
+		funge_unsigned_cell last = end;
+		if (!textfile) {
+			ok = save_put(buffer, row, 0, width) && save_put(buffer, NULL, '\n', 1);
+			continue;
 		}
-		free(string);
-		// Remove trailing newlines.
-		{
-			ssize_t lastnewline = (ssize_t)index;
-			do {
-				lastnewline--;
-			} while ((lastnewline >= 0) && (towrite[lastnewline] == '\n'));
-
-			if (lastnewline > 0) {
-				size_t retval = fwrite(towrite, sizeof(unsigned char), (size_t)(lastnewline + 1), file);
-				if (retval != (size_t)lastnewline + 1) {
-					free(towrite);
-					goto error;
-				}
-			}
+		// Text mode drops trailing spaces, and newlines (including cells
+		// with the value 10) at the end of the file. So newlines are only
+		// written once something else follows them.
+		while (last != 0 && row[last - 1] == '\n')
+			last--;
+		if (last != 0) {
+			ok = save_put(buffer, NULL, '\n', newlines) && save_put(buffer, row, 0, last);
+			newlines = 0;
 		}
-		free(towrite);
+		newlines += end - last + 1;
 	}
-	fclose(file);
-	return true;
-error:
-	if (file)
-		fclose(file);
-	return false;
+	if (ok)
+		ok = save_flush(buffer);
+	if (close(buffer->fd) != 0)
+		ok = false;
+	free(row);
+	free(buffer);
+	return ok;
 }
 
 
@@ -1127,13 +4930,11 @@ void fungespace_dump_sparse(void)
 		return;
 	fputs("Sparse Fungespace follows:\n", stderr);
 	fputs("(static\n", stderr);
-	for (funge_cell x = -FUNGESPACE_STATIC_OFFSET_X;
-	     x < FUNGESPACE_STATIC_X - FUNGESPACE_STATIC_OFFSET_X;
-	     x++)
-		for (funge_cell y = -FUNGESPACE_STATIC_OFFSET_Y;
-		     y < FUNGESPACE_STATIC_Y - FUNGESPACE_STATIC_OFFSET_Y;
-		     y++) {
-			funge_cell value = fungespace_get(vector_create_ref(x, y));
+	for (funge_unsigned_cell sx = 0; sx < cfun_static_x; sx++)
+		for (funge_unsigned_cell sy = 0; sy < cfun_static_y; sy++) {
+			funge_cell value = fungespace_static_read(sx, sy);
+			funge_cell x = (funge_cell)(sx - cfun_static_offset_x);
+			funge_cell y = (funge_cell)(sy - cfun_static_offset_y);
 			if (value != ' ')
 				fprintf(stderr, "  ((%"FUNGECELLPRI" %"FUNGECELLPRI") %"FUNGECELLPRI" \"%c\")\n", x, y, value, (char)value);
 		}
@@ -1143,10 +4944,20 @@ void fungespace_dump_sparse(void)
 	{
 		ght_fspace_iterator_t iterator;
 		const funge_vector *p_key;
-		funge_cell *p;
+		fungeSpaceTile **p;
 		for (p = ght_fspace_first(fspace.entries, &iterator, &p_key);
 		     p; p = ght_fspace_next(&iterator, &p_key)) {
-			fprintf(stderr, "  ((%"FUNGECELLPRI" %"FUNGECELLPRI") %"FUNGECELLPRI" \"%c\")\n", p_key->x, p_key->y, *p, (char)*p);
+			for (funge_cell ty = 0; ty < FUNGESPACE_TILE_SIZE; ty++)
+				for (funge_cell tx = 0; tx < FUNGESPACE_TILE_SIZE; tx++) {
+					funge_cell value = FSPACE_DECODE((*p)->cells[TILE_COORD(tx, ty)]);
+					// Values for escaped static cells were listed above.
+					if (FUNGESPACE_RANGE_CHECK((funge_unsigned_cell)(p_key->x + tx) + cfun_static_offset_x,
+					                           (funge_unsigned_cell)(p_key->y + ty) + cfun_static_offset_y))
+						continue;
+					if (value != ' ')
+						fprintf(stderr, "  ((%"FUNGECELLPRI" %"FUNGECELLPRI") %"FUNGECELLPRI" \"%c\")\n",
+						        p_key->x + tx, p_key->y + ty, value, (char)value);
+				}
 		}
 	}
 	fputs(")\n", stderr);
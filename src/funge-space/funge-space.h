@@ -30,12 +30,69 @@
 #include "../global.h"
 #include "../vector.h"
 #include "../rect.h"
+#include "../stack.h"
+#include <sys/types.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdbool.h>
 
 /// DO NOT CHANGE unless you are 100 sure of what you are doing!
 /// Yes I mean you!
 typedef funge_vector fungeSpaceHashKey;
+/// A fixed size block of cells, used for Funge-Space outside the static array.
+/// Opaque outside funge-space.c.
+typedef struct fungeSpaceTile fungeSpaceTile;
+
+/**
+ * Remembers which tile the last lookup outside the static array resolved to,
+ * so that the next access close to it can skip the hash table. Only valid as
+ * long as no tile has been allocated or freed since it was filled in.
+ */
+typedef struct fungeSpaceCache {
+	funge_vector     origin;     ///< Top left corner of the cached tile.
+	fungeSpaceTile * tile;       ///< The tile, or NULL if there is none (all spaces).
+	uint_fast64_t    generation; ///< Tile generation when filled in, 0 means empty cache.
+} fungeSpaceCache;
+
+/*
+ * With CFUN_ZERO_SPACE cells are stored XOR ' ', so a stored 0 is a space. Then
+ * zeroed memory (fresh pages from mmap(), calloc()) is already all spaces and
+ * doesn't need to be filled. Only use stored values through these macros.
+ */
+#ifdef CFUN_ZERO_SPACE
+/// Convert a cell value to how it is stored.
+#  define FSPACE_ENCODE(m_v) ((funge_cell)((m_v) ^ ' '))
+/// Convert a stored cell back to its value.
+#  define FSPACE_DECODE(m_v) ((funge_cell)((m_v) ^ ' '))
+#else
+#  define FSPACE_ENCODE(m_v) (m_v)
+#  define FSPACE_DECODE(m_v) (m_v)
+#endif
+
+#ifdef CFUN_COMPACT_CELLS
+/// A cell in the static array, FSPACE_ENCODE()d value truncated to a byte.
+typedef uint8_t fungeStaticCell;
+/// Marks a cell in the static array whose value is in a tile.
+#  define FSPACE_STATIC_ESCAPE 0xFF
+#else
+/// A cell in the static array, FSPACE_ENCODE()d value.
+typedef funge_cell fungeStaticCell;
+#endif
+
+/**
+ * Lets an IP moving in a straight line through the static array fetch
+ * instructions by moving a pointer, instead of looking up its position and
+ * checking if it needs to wrap every step. Only use it through
+ * fungespace_cursor_get() and fungespace_cursor_forward().
+ */
+typedef struct fungeSpaceCursor {
+	const fungeStaticCell * cell;       ///< Cell at position, NULL if not in the static array.
+	ptrdiff_t               stride;     ///< Distance in the array to the next cell along delta.
+	funge_unsigned_cell     steps;      ///< Steps along delta that stay in the array and bounds.
+	funge_vector            position;   ///< Position the cursor is at.
+	funge_vector            delta;      ///< Delta steps and stride are for.
+	uint_fast64_t           generation; ///< fungespace_cursor_generation when set up, 0 means none.
+} fungeSpaceCursor;
 
 /**
  * Create a Funge-space.
@@ -56,6 +113,16 @@ void fungespace_free(void);
  */
 FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
 funge_cell fungespace_get(const funge_vector * restrict position);
+/**
+ * Get a cell, using a lookup cache for positions outside the static array.
+ * Used by the main loop to fetch instructions, each IP has its own cache.
+ * @param position The place in Funge-Space to get the value for.
+ * @param cache The cache to use (and update).
+ * @return The value for that position.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+funge_cell fungespace_get_cached(const funge_vector * restrict position,
+                                 fungeSpaceCache * restrict cache);
 /**
  * Get a cell, with an offset. Mostly used to handle storage offset.
  * @param position The place in Funge-Space to get the value for.
@@ -83,6 +150,72 @@ FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
 void fungespace_set_offset(funge_cell value,
                            const funge_vector * restrict position,
                            const funge_vector * restrict offset);
+/**
+ * Copy an area of Funge-Space. The result is as if the whole area was read
+ * before anything was written, so the areas may overlap.
+ * @param area The area to copy, nothing is done if w or h is not positive.
+ * @param dest Where to copy the top left corner of the area to.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void fungespace_copy_rect(const fungeRect * restrict area,
+                          const funge_vector * restrict dest);
+/**
+ * Set all cells in an area to the same value.
+ * @param value The value to set.
+ * @param area The area to fill, nothing is done if w or h is not positive.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void fungespace_fill_rect(funge_cell value, const fungeRect * restrict area);
+/**
+ * Move an area of Funge-Space: copy it like fungespace_copy_rect(), then set
+ * the cells of the area that weren't copied over to spaces.
+ * @param area The area to move, nothing is done if w or h is not positive.
+ * @param dest Where to move the top left corner of the area to.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void fungespace_move_rect(const fungeRect * restrict area,
+                          const funge_vector * restrict dest);
+/**
+ * Push n cells, at start, start + delta, and so on, onto a stack. The cell
+ * at start ends up on top.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void fungespace_push_line(funge_stack * restrict stack,
+                          const funge_vector * restrict start,
+                          const funge_vector * restrict delta, size_t n);
+/**
+ * Pop n items off a stack into the cells at start, start + delta, and so on.
+ * The top item goes to start. Cells past the bottom of the stack get 0.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void fungespace_pop_line(funge_stack * restrict stack,
+                         const funge_vector * restrict start,
+                         const funge_vector * restrict delta, size_t n);
+/**
+ * Push the cells of an area onto a stack, so that the top left cell ends up
+ * on top, followed by the rest of the top row, then the next row, and so on.
+ * @param area The area, nothing is pushed if w or h is not positive.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void fungespace_push_rect(funge_stack * restrict stack,
+                          const fungeRect * restrict area);
+/**
+ * Pop items off a stack into the cells of an area, in the order
+ * fungespace_push_rect() pushes them. Cells past the bottom of the stack get 0.
+ * @param area The area, nothing is popped if w or h is not positive.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void fungespace_pop_rect(funge_stack * restrict stack,
+                         const fungeRect * restrict area);
+/**
+ * Push the 0 terminated string stored to the right of start as a 0"gnirts".
+ * @param maxlen How many cells to look for the 0 in.
+ * @return False (and nothing pushed) if there was no 0 in them.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+bool fungespace_push_string(funge_stack * restrict stack,
+                            const funge_vector * restrict start,
+                            funge_unsigned_cell maxlen);
 /**
  * Calculate the new position after adding a delta to a position, considering
  * any needed wrapping. Used for IP wrapping.
@@ -94,6 +227,159 @@ void fungespace_set_offset(funge_cell value,
 FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
 void fungespace_wrap(funge_vector * restrict position,
                      const funge_vector * restrict delta);
+/**
+ * Move past spaces: step along delta (wrapping) at least once, until a cell
+ * that isn't a space. Skips along the same row or column are cached.
+ * @param position Position to start from, will be modified in place.
+ * @param delta The delta to move along.
+ * @param cache Lookup cache to use for fetching cells.
+ * @return The value at the new position.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+funge_cell fungespace_skip_spaces(funge_vector * restrict position,
+                                  const funge_vector * restrict delta,
+                                  fungeSpaceCache * restrict cache);
+/**
+ * Move to the end of a ;; comment: step along delta (wrapping) at least once,
+ * until a ';'. Cached like fungespace_skip_spaces().
+ * @param position Position to start from, will be modified in place.
+ * @param delta The delta to move along.
+ * @param cache Lookup cache to use for fetching cells.
+ * @return The value at the new position, always ';'.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+funge_cell fungespace_skip_comment(funge_vector * restrict position,
+                                   const funge_vector * restrict delta,
+                                   fungeSpaceCache * restrict cache);
+
+/**
+ * Bumped when cursors may be invalid: when the static array is moved or the
+ * bounds shrink.
+ */
+extern uint_fast64_t fungespace_cursor_generation;
+/**
+ * Get the cell at position and set up cursor for moving from there along
+ * delta. Slow path of fungespace_cursor_get().
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+funge_cell fungespace_cursor_setup(fungeSpaceCursor * restrict cursor,
+                                   const funge_vector * restrict position,
+                                   const funge_vector * restrict delta,
+                                   fungeSpaceCache * restrict cache);
+
+/**
+ * Get a cell, like fungespace_get_cached(), using cursor when it is at
+ * position. Used by the main loop to fetch instructions.
+ * @param cursor The IP's cursor.
+ * @param position The place in Funge-Space to get the value for.
+ * @param delta The IP's delta, to set up the cursor with if needed.
+ * @param cache The IP's lookup cache.
+ * @return The value for that position.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static inline funge_cell fungespace_cursor_get(fungeSpaceCursor * restrict cursor,
+                                               const funge_vector * restrict position,
+                                               const funge_vector * restrict delta,
+                                               fungeSpaceCache * restrict cache)
+{
+	if (FUNGE_LIKELY(cursor->generation == fungespace_cursor_generation
+	                 && cursor->position.x == position->x
+	                 && cursor->position.y == position->y
+	                 && cursor->cell)) {
+		fungeStaticCell stored = *cursor->cell;
+#ifdef CFUN_COMPACT_CELLS
+		if (FUNGE_LIKELY(stored != FSPACE_STATIC_ESCAPE))
+#endif
+			return FSPACE_DECODE((funge_cell)stored);
+	}
+	return fungespace_cursor_setup(cursor, position, delta, cache);
+}
+
+/**
+ * Move position one step along delta, like ip_forward(). Just moves the
+ * cursor when it is set up for this position and delta and the step can't
+ * wrap.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void fungespace_cursor_forward(fungeSpaceCursor * restrict cursor,
+                                             funge_vector * restrict position,
+                                             const funge_vector * restrict delta)
+{
+	if (FUNGE_LIKELY(cursor->steps != 0
+	                 && cursor->generation == fungespace_cursor_generation
+	                 && cursor->position.x == position->x
+	                 && cursor->position.y == position->y
+	                 && cursor->delta.x == delta->x
+	                 && cursor->delta.y == delta->y)) {
+		cursor->steps--;
+		cursor->cell += cursor->stride;
+		position->x += delta->x;
+		position->y += delta->y;
+		cursor->position = *position;
+		return;
+	}
+	position->x += delta->x;
+	position->y += delta->y;
+	fungespace_wrap(position, delta);
+}
+
+/**
+ * Get the current write epoch. Epochs only grow, every change to a cell
+ * (through fungespace_set(), loading files, or anything else) gets a new one.
+ * Take it before reading cells that something is computed from, and check
+ * fungespace_changed_since() with it before using the result.
+ * @return The epoch of the last change to Funge-Space, 0 if none yet.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+uint_fast64_t fungespace_epoch(void);
+/**
+ * Check if any cell in an area may have changed since an epoch. Changes are
+ * tracked for 32x32 regions, so a change close to the area can also give
+ * true, but a change in it never gives false. Cells set to the value they
+ * already had with fungespace_set() don't count as changed.
+ * @param rect The area, w and h are the number of columns and rows.
+ * @param epoch Epoch from fungespace_epoch().
+ * @return True if something may have changed.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+bool fungespace_changed_since(const fungeRect * restrict rect, uint_fast64_t epoch);
+/**
+ * Watch a cell, so that changes to it are seen by
+ * fungespace_watched_changed_since(). Cells can't be unwatched.
+ * @param position The cell to watch.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void fungespace_watch(const funge_vector * restrict position);
+/**
+ * Get the epoch of the last change to a watched cell. Nothing watched has
+ * changed since an epoch that isn't older than this.
+ * @return The epoch, 0 if no watched cell has changed yet.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+uint_fast64_t fungespace_watched_epoch(void);
+/**
+ * Get the watched cells that changed since an epoch, from a log of the last
+ * few changes.
+ * @param epoch Epoch from fungespace_epoch(), taken before watching the cells.
+ * @param cells Where to store the cells, newest change first. A cell may be
+ * there more than once.
+ * @param max Number of cells that fit in cells.
+ * @return The number of cells stored, or -1 if more than max changed or
+ * they are no longer in the log (use fungespace_watched_changed_since()).
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+ssize_t fungespace_watched_changes(uint_fast64_t epoch, funge_vector * restrict cells, size_t max);
+/**
+ * Like fungespace_changed_since(), but only counting changes to watched
+ * cells. Cells far apart may share a watch, and loading files or copying
+ * areas counts as changing watched cells in the areas written.
+ * @param rect The area, w and h are the number of columns and rows.
+ * @param epoch Epoch from fungespace_epoch(), taken before watching the cells.
+ * @return True if a watched cell in the area may have changed.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+bool fungespace_watched_changed_since(const fungeRect * restrict rect, uint_fast64_t epoch);
+
 /**
  * Load a file into Funge-Space at 0,0. Optimised compared to
  * fungespace_load_at_offset(). Only used for loading initial file.
@@ -103,11 +389,10 @@ void fungespace_wrap(funge_vector * restrict position,
 FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
 bool fungespace_load(const char * restrict filename);
 
-#if defined(FUNGE_EXTERNAL_LIBRARY) || defined(CFUN_KLEE_TEST_PROGRAM)
 /**
- * Load a string into Funge-Space at 0,0. Optimised. This code is used
- * internally by cfunge itself but is not usually exposed. It is however needed
- * for IFFI (using cfunge as a library in C-INTERCAL).
+ * Load a string into Funge-Space at 0,0. Optimised. This is what
+ * fungespace_load() uses, it is also used by the image cache and for IFFI
+ * (using cfunge as a library in C-INTERCAL).
  * @param program Program to load.
  * @param length  Length of string, needed since code need to handle embedded
  * null bytes, thus strlen() won't work.
@@ -115,7 +400,6 @@ bool fungespace_load(const char * restrict filename);
 FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
 void fungespace_load_string(const unsigned char * restrict program,
                             size_t length);
-#endif
 
 /**
  * Load a file into Funge-Space at an offset. Used for the i instruction.
@@ -148,6 +432,91 @@ bool fungespace_save_to_file(const char         * restrict filename,
                              const funge_vector * restrict size,
                              bool textfile);
 
+/**
+ * Decremented by the main loop every tick, fungespace_adaptive_tick() is
+ * called when it reaches 0.
+ */
+extern uint_fast32_t fungespace_adaptive_countdown;
+/**
+ * Move the static array (only with -a) to where most accesses outside it
+ * happened recently, if that looks like it will help. Cells are moved between
+ * it and the tiles.
+ * Must only be called when nothing holds on to Funge-Space internals, which
+ * is between instructions.
+ */
+FUNGE_ATTR_FAST
+void fungespace_adaptive_tick(void);
+/**
+ * Print statistics about Funge-Space to stderr. Used for -P.
+ */
+void fungespace_print_stats(void);
+
+/**
+ * Called by fungespace_for_each_run() for each run of non-space cells.
+ * @param start Position of the first cell, the others follow to the right.
+ * @param cells Values of the cells.
+ * @param n Number of cells, at least 1.
+ * @param data The pointer given to fungespace_for_each_run().
+ * @return False to stop.
+ */
+typedef bool (*fungeSpaceRunFunc)(const funge_vector * restrict start,
+                                  const funge_cell * restrict cells,
+                                  size_t n, void * data);
+/**
+ * Call a function for all non-space cells, in runs of cells next to each
+ * other in a row, in no particular order. A long row of cells may be split
+ * into several runs. Funge-Space must not be changed meanwhile.
+ * @return False if func returned false.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR((nonnull(1)))
+bool fungespace_for_each_run(fungeSpaceRunFunc func, void * data);
+/**
+ * Start restoring Funge-Space from a checkpoint, instead of loading a
+ * program. Places the static array and sets the bounds to what they were
+ * (they may be larger than the cells restored).
+ * @param bounds Bounds as from fungespace_get_bounds_rect() when the
+ * checkpoint was written.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void fungespace_restore_begin(const fungeRect * restrict bounds);
+/**
+ * Store a run of cells, as passed to a fungeSpaceRunFunc, while restoring.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+void fungespace_restore_run(const funge_vector * restrict start,
+                            const funge_cell * restrict cells, size_t n);
+
+/**
+ * Identifies the build options that decide how Funge-Space is laid out in
+ * memory. Images can only be used by builds with the same layout.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_CONST FUNGE_ATTR_WARN_UNUSED
+uint32_t fungespace_image_layout(void);
+/**
+ * Write an image of Funge-Space: the static array as it is in memory, the
+ * tiles and the bounds. Meant to be called right after loading a program, to
+ * be mapped with fungespace_image_map() instead of loading it the next time.
+ * @param fd File to write to, should be empty.
+ * @param source_size Size of the program the image is for.
+ * @param source_hash Hash of the program the image is for.
+ * @return False (with errno set) if writing failed.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+bool fungespace_image_write(int fd, uint64_t source_size, uint64_t source_hash);
+/**
+ * Set up Funge-Space from an image, instead of loading a program. The static
+ * array is mapped privately from the file, so only the parts that are used
+ * are read, and the file must not be changed in place while it is mapped.
+ * Funge-Space must be empty.
+ * @param fd File to read from, may be closed afterwards.
+ * @param source_size Size of the program that was going to be loaded.
+ * @param source_hash Hash of the program that was going to be loaded.
+ * @return False if the image isn't for that program, was written by a build
+ * with another layout, or is broken. Funge-Space is still empty then.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+bool fungespace_image_map(int fd, uint64_t source_size, uint64_t source_hash);
+
 /**
  * Get the bounding rectangle for the part of Funge-Space that isn't empty.
  * @note It won't be too small, but it may be too big.
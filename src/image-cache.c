@@ -0,0 +1,365 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global.h"
+#include "image-cache.h"
+
+#include "diagnostic.h"
+#include "settings.h"
+#include "funge-space/funge-space.h"
+
+#include <errno.h>
+#include <inttypes.h> /* PRIx32, PRIx64 */
+#include <stdio.h>    /* rename, snprintf */
+#include <stdlib.h>   /* getenv, malloc, mkstemp, qsort, realloc */
+#include <string.h>   /* memcpy, strdup, strerror, strlen, strstr */
+
+#include <unistd.h>    /* close, unlink */
+#include <sys/types.h> /* fstat, mkdir, open */
+#include <sys/stat.h>  /* fstat, mkdir, open, stat */
+#include <sys/time.h>  /* utimes */
+#include <dirent.h>    /* opendir, readdir, closedir */
+#include <fcntl.h>     /* open */
+#include <sys/mman.h>  /* mmap, munmap, posix_madvise */
+
+/// Programs smaller than this are loaded as usual, parsing them is quick
+/// enough that hashing and writing images would not pay off.
+#define IMAGECACHE_MIN_SIZE (1024 * 1024)
+
+/*
+ * Every changed version of a program gets a new image, so the least recently
+ * used images are deleted to stay under the limits below. Using an image
+ * updates its modification time, which is what "recently used" goes by.
+ */
+/// Most disk space used by the images in the cache directory.
+#define IMAGECACHE_MAX_DISK ((uint64_t)512 << 20)
+/// Most images kept in the cache directory.
+#define IMAGECACHE_MAX_IMAGES 64
+
+/*
+ * Hashing the program is the only thing done with all of it when the image
+ * is used, so it has to be fast. This is the xxHash64 algorithm: four
+ * independent lanes of 64-bit words, which the CPU can work on in parallel.
+ * Byte order isn't normalised, images are only for the machine they were
+ * made on anyway.
+ */
+#define PRIME64_1 UINT64_C(0x9E3779B185EBCA87)
+#define PRIME64_2 UINT64_C(0xC2B2AE3D27D4EB4F)
+#define PRIME64_3 UINT64_C(0x165667B19E3779F9)
+#define PRIME64_4 UINT64_C(0x85EBCA77C2B2AE63)
+#define PRIME64_5 UINT64_C(0x27D4EB2F165667C5)
+
+FUNGE_ATTR_FAST FUNGE_ATTR_CONST
+static inline uint64_t rotl64(uint64_t x, unsigned int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_CONST
+static inline uint64_t hash_round(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME64_2;
+	return rotl64(acc, 31) * PRIME64_1;
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_CONST
+static inline uint64_t hash_merge(uint64_t acc, uint64_t lane)
+{
+	acc ^= hash_round(0, lane);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline uint64_t hash_read64(const unsigned char * restrict p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_PURE
+static uint64_t imagecache_hash(const unsigned char * restrict data, size_t length)
+{
+	const unsigned char *p = data;
+	const unsigned char *end = data + length;
+	uint64_t h;
+
+	if (length >= 32) {
+		uint64_t v1 = PRIME64_1 + PRIME64_2;
+		uint64_t v2 = PRIME64_2;
+		uint64_t v3 = 0;
+		uint64_t v4 = 0 - PRIME64_1;
+		do {
+			v1 = hash_round(v1, hash_read64(p));
+			v2 = hash_round(v2, hash_read64(p + 8));
+			v3 = hash_round(v3, hash_read64(p + 16));
+			v4 = hash_round(v4, hash_read64(p + 24));
+			p += 32;
+		} while ((size_t)(end - p) >= 32);
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h = hash_merge(h, v1);
+		h = hash_merge(h, v2);
+		h = hash_merge(h, v3);
+		h = hash_merge(h, v4);
+	} else {
+		h = PRIME64_5;
+	}
+	h += (uint64_t)length;
+	for (; (size_t)(end - p) >= 8; p += 8) {
+		h ^= hash_round(0, hash_read64(p));
+		h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+	}
+	for (; p < end; p++) {
+		h ^= *p * PRIME64_5;
+		h = rotl64(h, 11) * PRIME64_1;
+	}
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+/**
+ * Join a directory and a file name.
+ * @return Malloced path, exits if out of memory.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_MALLOC FUNGE_ATTR_WARN_UNUSED
+static char *imagecache_path(const char * restrict dir, const char * restrict name)
+{
+	size_t dirlen = strlen(dir);
+	size_t namelen = strlen(name);
+	char *path = malloc(dirlen + namelen + 2);
+	if (FUNGE_UNLIKELY(!path))
+		DIAG_OOM("Could not allocate image cache path");
+	memcpy(path, dir, dirlen);
+	path[dirlen] = '/';
+	memcpy(path + dirlen + 1, name, namelen + 1);
+	return path;
+}
+
+/**
+ * Find the cache directory and create it if needed: -I if given, otherwise
+ * cfunge under $XDG_CACHE_HOME, or under ~/.cache.
+ * @return Malloced path, or NULL if there is no cache directory.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_MALLOC FUNGE_ATTR_WARN_UNUSED
+static char *imagecache_dir(void)
+{
+	const char *base;
+	char *dir;
+
+	if (setting_image_cache_dir) {
+		dir = strdup(setting_image_cache_dir);
+		if (FUNGE_UNLIKELY(!dir))
+			DIAG_OOM("Could not allocate image cache path");
+	} else if ((base = getenv("XDG_CACHE_HOME")) && *base) {
+		// The base directory should already be there, but may not be.
+		mkdir(base, 0700);
+		dir = imagecache_path(base, "cfunge");
+	} else {
+		char *cache;
+		base = getenv("HOME");
+		if (!base || !*base)
+			return NULL;
+		cache = imagecache_path(base, ".cache");
+		mkdir(cache, 0700);
+		dir = imagecache_path(cache, "cfunge");
+		free(cache);
+	}
+	if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+		diag_warn_format("Could not create image cache directory \"%s\": %s", dir, strerror(errno));
+		free(dir);
+		return NULL;
+	}
+	return dir;
+}
+
+/// An image found in the cache directory.
+typedef struct imageCacheFile {
+	char    *path;
+	time_t   mtime;
+	uint64_t size;
+} imageCacheFile;
+
+/// Sort images by last use, oldest first.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_PURE
+static int imagecache_file_cmp(const void *a, const void *b)
+{
+	const imageCacheFile *fa = a;
+	const imageCacheFile *fb = b;
+	return (fa->mtime > fb->mtime) - (fa->mtime < fb->mtime);
+}
+
+/**
+ * Delete the least recently used images in dir until it is under the limits.
+ * Temporary files left by a cfunge that was killed while writing count as
+ * images too, so that they go away in time.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void imagecache_trim(const char * restrict dir)
+{
+	imageCacheFile *files = NULL;
+	size_t count = 0, allocated = 0;
+	uint64_t total = 0;
+	struct dirent *de;
+	DIR *d = opendir(dir);
+
+	if (!d)
+		return;
+	while ((de = readdir(d)) != NULL) {
+		struct stat sb;
+		char *path;
+
+		if (!strstr(de->d_name, ".img"))
+			continue;
+		path = imagecache_path(dir, de->d_name);
+		if (stat(path, &sb) != 0 || !S_ISREG(sb.st_mode)) {
+			free(path);
+			continue;
+		}
+		if (count == allocated) {
+			imageCacheFile *newfiles;
+			allocated = allocated ? allocated * 2 : 16;
+			newfiles = realloc(files, allocated * sizeof(imageCacheFile));
+			if (FUNGE_UNLIKELY(!newfiles))
+				DIAG_OOM("Could not allocate image cache file list");
+			files = newfiles;
+		}
+		files[count++] = (imageCacheFile) { path, sb.st_mtime, (uint64_t)sb.st_size };
+		total += (uint64_t)sb.st_size;
+	}
+	closedir(d);
+
+	if (count > IMAGECACHE_MAX_IMAGES || total > IMAGECACHE_MAX_DISK) {
+		size_t i = 0;
+		qsort(files, count, sizeof(imageCacheFile), imagecache_file_cmp);
+		for (; i < count && (count - i > IMAGECACHE_MAX_IMAGES || total > IMAGECACHE_MAX_DISK); i++) {
+			if (unlink(files[i].path) == 0 || errno == ENOENT)
+				total -= files[i].size;
+		}
+	}
+	for (size_t i = 0; i < count; i++)
+		free(files[i].path);
+	free(files);
+}
+
+/**
+ * Write an image of what was just loaded to path, through a temporary file
+ * so that nothing ever sees a partial image. Images larger than half the
+ * limit for the directory are not kept.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static void imagecache_store(const char * restrict dir, const char * restrict path,
+                             uint64_t size, uint64_t hash)
+{
+	size_t len = strlen(path);
+	char *tmp = malloc(len + sizeof(".XXXXXX"));
+	struct stat sb;
+	int fd;
+
+	if (FUNGE_UNLIKELY(!tmp))
+		DIAG_OOM("Could not allocate image cache path");
+	memcpy(tmp, path, len);
+	memcpy(tmp + len, ".XXXXXX", sizeof(".XXXXXX"));
+	fd = mkstemp(tmp);
+	if (fd == -1) {
+		diag_warn_format("Could not create image cache file \"%s\": %s", tmp, strerror(errno));
+		free(tmp);
+		return;
+	}
+	if (!fungespace_image_write(fd, size, hash)) {
+		diag_warn_format("Could not write image cache file \"%s\": %s", tmp, strerror(errno));
+		close(fd);
+		unlink(tmp);
+	} else if (fstat(fd, &sb) == 0 && (uint64_t)sb.st_size > IMAGECACHE_MAX_DISK / 2) {
+		close(fd);
+		unlink(tmp);
+	} else if (close(fd) != 0 || rename(tmp, path) != 0) {
+		diag_warn_format("Could not write image cache file \"%s\": %s", path, strerror(errno));
+		unlink(tmp);
+	} else {
+		imagecache_trim(dir);
+	}
+	free(tmp);
+}
+
+FUNGE_ATTR_FAST bool
+imagecache_load(const char * restrict filename)
+{
+	unsigned char *program;
+	struct stat sb;
+	char name[64];
+	char *dir, *path;
+	uint64_t hash;
+	int fd, imagefd;
+
+	if (setting_enable_sandbox || setting_static_width != 0
+	    || (setting_image_cache_dir && !*setting_image_cache_dir))
+		return fungespace_load(filename);
+
+	fd = open(filename, O_RDONLY);
+	if (FUNGE_UNLIKELY(fd == -1))
+		return false;
+	if (FUNGE_UNLIKELY(fstat(fd, &sb) == -1)) {
+		close(fd);
+		return false;
+	}
+	if ((uint64_t)sb.st_size < IMAGECACHE_MIN_SIZE || !(dir = imagecache_dir())) {
+		close(fd);
+		return fungespace_load(filename);
+	}
+	program = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (FUNGE_UNLIKELY(program == MAP_FAILED)) {
+		free(dir);
+		return fungespace_load(filename);
+	}
+#if defined(_POSIX_ADVISORY_INFO) && (_POSIX_ADVISORY_INFO > 0)
+	posix_madvise(program, (size_t)sb.st_size, POSIX_MADV_SEQUENTIAL);
+#endif
+	hash = imagecache_hash(program, (size_t)sb.st_size);
+	snprintf(name, sizeof(name), "%016" PRIx64 "-%08" PRIx32 ".img",
+	         hash, fungespace_image_layout());
+	path = imagecache_path(dir, name);
+
+	imagefd = open(path, O_RDONLY);
+	if (imagefd != -1) {
+		bool mapped = fungespace_image_map(imagefd, (uint64_t)sb.st_size, hash);
+		close(imagefd);
+		if (mapped) {
+			// Mark it as recently used, for imagecache_trim().
+			utimes(path, NULL);
+			munmap(program, (size_t)sb.st_size);
+			free(path);
+			free(dir);
+			return true;
+		}
+	}
+	// Not cached (or a broken image), load and cache it.
+	fungespace_load_string(program, (size_t)sb.st_size);
+	munmap(program, (size_t)sb.st_size);
+	imagecache_store(dir, path, (uint64_t)sb.st_size, hash);
+	free(path);
+	free(dir);
+	return true;
+}
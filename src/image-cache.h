@@ -0,0 +1,53 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Cache of Funge-Space images for large programs, so that they don't have to
+ * be parsed each time they are started.
+ *
+ * The image of a program is stored in the cache directory under the hash of
+ * the program text (and the Funge-Space layout of the build), so a changed
+ * program or a different build never picks up a stale image. Images are
+ * written to a temporary file and renamed into place, an image that is
+ * mapped by a running cfunge is never changed. The least recently used
+ * images are deleted when the directory gets too large.
+ */
+
+#ifndef FUNGE_HAD_SRC_IMAGE_CACHE_H
+#define FUNGE_HAD_SRC_IMAGE_CACHE_H
+
+#include "global.h"
+
+#include <stdbool.h>
+
+/**
+ * Load the initial program into Funge-Space, like fungespace_load(). Uses
+ * the cached image of it if there is one, otherwise loads the program and
+ * adds an image of it to the cache. Small programs and runs with -S or -w
+ * don't use the cache.
+ * @param filename Filename to load.
+ * @return True if successful, otherwise false (see errno).
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+bool imagecache_load(const char * restrict filename);
+
+#endif
@@ -60,23 +60,17 @@ static inline void print_trace(funge_cell iters, funge_cell kInstr)
 /// This moves IP to next instruction, with respect to ;, space and current delta.
 static inline funge_cell find_next_instr(instructionPointer * restrict ip, funge_cell kInstr)
 {
-	bool injump = false;
-	if (kInstr == ';')
-		injump = true;
+	bool injump = (kInstr == ';');
 	while (true) {
-		ip_forward(ip);
-		kInstr = fungespace_get(&ip->position);
-		if (kInstr == ';') {
-			injump = !injump;
+		if (injump) {
+			(void)fungespace_skip_comment(&ip->position, &ip->delta, &ip->fspaceCache);
+			injump = false;
 			continue;
-		} else if (kInstr == ' ') {
-			continue;
-		} else {
-			if (injump)
-				continue;
-			else
-				break;
 		}
+		kInstr = fungespace_skip_spaces(&ip->position, &ip->delta, &ip->fspaceCache);
+		if (kInstr != ';')
+			break;
+		injump = true;
 	}
 	return kInstr;
 }
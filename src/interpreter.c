@@ -22,14 +22,18 @@
 #include "global.h"
 #include "interpreter.h"
 
+#include "checkpoint.h"
 #include "diagnostic.h"
 #include "division.h"
 #include "funge-space/funge-space.h"
+#include "image-cache.h"
 #include "input.h"
 #include "ip.h"
 #include "prng.h"
 #include "settings.h"
+#include "snapshot.h"
 #include "stack.h"
+#include "trace-cache.h"
 #include "vector.h"
 
 #include "fingerprints/manager.h"
@@ -98,20 +102,45 @@ FUNGE_ATTR_FAST inline void if_north_south(instructionPointer * restrict ip)
 
 #ifdef CONCURRENT_FUNGE
 #  define return_from_execute_instruction(x) return (x)
-   /// Return with value if we are concurrent
-#  define return_if_con(x) return (x)
 #  define CON_RETTYPE bool
 #else
 #  define return_from_execute_instruction(x) return
 #  define CON_RETTYPE void
-#  define return_if_con(x) (x); return
 #endif
 
-/// Generate a case for use in execute_instruction() that pushes a number on
-/// the stack.
-#define PUSHVAL(x, y) \
-	case (x): \
-		stack_push(ip->stack, (funge_cell)y); \
+/*
+ * With CFUN_THREADED_DISPATCH, and a compiler that supports computed goto (a
+ * GCC extension), instructions are found through a table of 256 labels
+ * indexed by the opcode, instead of a check for fingerprint instructions
+ * followed by a switch. Either way the main loop is in the same function, so
+ * going on to the next instruction doesn't need a call.
+ */
+#if defined(CFUN_THREADED_DISPATCH) && defined(CFUNGE_COMP_GCC_COMPAT)
+#  define THREADED_DISPATCH
+#endif
+
+#ifdef THREADED_DISPATCH
+   /// Start the code for an instruction in execute_opcode().
+#  define OPCODE(m_name, m_char) op_##m_name
+   /// Start the code for unknown instructions in execute_opcode().
+#  define OPCODE_UNKNOWN op_unknown
+#else
+#  define OPCODE(m_name, m_char) case (m_char)
+#  define OPCODE_UNKNOWN default
+#endif
+
+#ifdef CONCURRENT_FUNGE
+   /// Finish an instruction in execute_opcode(), x is true if it took no tick.
+#  define instruction_done(x) retval = (x); break
+#else
+#  define instruction_done(x) break
+#endif
+
+/// Generate the code for an instruction in execute_opcode() that pushes a
+/// number on the stack.
+#define PUSHVAL(m_name, m_char, m_value) \
+	OPCODE(m_name, m_char): \
+		stack_push(ip->stack, (funge_cell)m_value); \
 		break;
 
 /// This function handles string mode.
@@ -156,431 +185,649 @@ static inline void handle_fprint(funge_cell opcode, instructionPointer * restric
 	}
 }
 
+/**
+ * Print the instruction about to be executed, if tracing is on.
+ * @param index Index of the IP, only printed for concurrent Funge.
+ */
+#ifndef DISABLE_TRACE
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void trace_instruction(const instructionPointer * restrict ip, ssize_t index, funge_cell opcode)
+{
+	if (FUNGE_LIKELY(setting_trace_level == 0))
+		return;
+	if (setting_trace_level > 3) {
+#  ifdef CONCURRENT_FUNGE
+		fprintf(stderr, "tix=%zd tid=%" FUNGECELLPRI " x=%" FUNGECELLPRI " y=%" FUNGECELLPRI ": %c (%" FUNGECELLPRI ")\n",
+		        index, ip->ID, ip->position.x, ip->position.y, (char)opcode, opcode);
+#  else
+		(void)index;
+		fprintf(stderr, "x=%" FUNGECELLPRI " y=%" FUNGECELLPRI ": %c (%" FUNGECELLPRI ")\n",
+		        ip->position.x, ip->position.y, (char)opcode, opcode);
+#  endif
+		if (setting_trace_level > 8)
+			stack_print_top(ip->stack);
+	} else if (setting_trace_level > 2) {
+		fprintf(stderr, "%c", (char)opcode);
+	}
+}
+#endif /* DISABLE_TRACE */
+
+/**
+ * Fetch the instruction at the position of an IP.
+ * @param index Index of the IP, for tracing.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline funge_cell fetch_instruction(instructionPointer * restrict ip, ssize_t index)
+{
+	funge_cell opcode = fungespace_cursor_get(&ip->fspaceCursor, &ip->position, &ip->delta, &ip->fspaceCache);
+#ifndef DISABLE_TRACE
+	trace_instruction(ip, index, opcode);
+#else
+	(void)index;
+#endif
+	return opcode;
+}
+
+/// Done between instructions, or for concurrent Funge between rounds of the
+/// IPs.
+FUNGE_ATTR_FAST
+static inline void interpreter_tick(void)
+{
+	if (FUNGE_UNLIKELY(--fungespace_adaptive_countdown == 0))
+		fungespace_adaptive_tick();
+	if (FUNGE_UNLIKELY(snapshot_requested))
 #ifdef CONCURRENT_FUNGE
-FUNGE_ATTR_FAST CON_RETTYPE execute_instruction(funge_cell opcode, instructionPointer * restrict ip, ssize_t * threadindex)
+		snapshot_take(IPList);
 #else
-FUNGE_ATTR_FAST CON_RETTYPE execute_instruction(funge_cell opcode, instructionPointer * restrict ip)
+		snapshot_take(IP);
 #endif
+}
+
+#ifdef CFUN_TRACE_CACHE
+/// Can the next instruction for ip come from the trace cache? Not when
+/// tracing, or when there are other IPs to run between instructions.
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_PURE
+static inline bool use_trace_cache(const instructionPointer * restrict ip)
 {
-	// First check if we are in string mode, and do special stuff then.
-	if (ip->mode == ipmSTRING) {
-		return_if_con(handle_string_mode(opcode, ip));
-	// Next: Is this a fingerprint opcode?
-	} else if ((opcode >= 'A') && (opcode <= 'Z')) {
-		handle_fprint(opcode, ip);
-	// OK a core instruction.
-	// Find what one and execute it.
-	} else {
-		switch (opcode) {
-			case ' ': {
-#ifdef AFL_FUZZ_TESTING
-				long iterations = 500;
+#  ifndef DISABLE_TRACE
+	if (setting_trace_level != 0)
+		return false;
+#  endif
+#  ifdef CONCURRENT_FUNGE
+	if (IPList->top != 0)
+		return false;
+#  endif
+	return ip->mode == ipmCODE;
+}
 #endif
-				do {
-					ip_forward(ip);
-#ifdef AFL_FUZZ_TESTING
-					if (!iterations--)
-						exit(123);
+
+#ifdef CONCURRENT_FUNGE
+#  ifdef LARGE_IPLIST
+#    define IPLIST_GET(m_index) (IPList->ips[m_index])
+#  else
+#    define IPLIST_GET(m_index) (&IPList->ips[m_index])
+#  endif
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+static inline void thread_forward(instructionPointer * restrict ip)
+{
+	assert(ip != NULL);
+
+	if (ip->needMove)
+		fungespace_cursor_forward(&ip->fspaceCursor, &ip->position, &ip->delta);
+	else
+		ip->needMove = true;
+}
 #endif
-				} while (fungespace_get(&ip->position) == ' ');
-				ip->needMove = false;
-				return_from_execute_instruction(true);
-			}
-			case 'z':
-				break;
-			case ';': {
-#ifdef AFL_FUZZ_TESTING
-				long iterations = 500;
+
+/**
+ * Execute an instruction, see execute_instruction().
+ *
+ * If chain is true this is the main loop instead: after the instruction it
+ * moves on and executes the next one (for the next IP in concurrent Funge),
+ * and never returns.
+ */
+#ifdef THREADED_DISPATCH
+// Computed goto is an extension, don't warn about it.
+#  pragma GCC diagnostic push
+#  pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+#ifdef CONCURRENT_FUNGE
+FUNGE_ATTR_FAST FUNGE_ATTR_NOINLINE
+static bool execute_opcode(funge_cell opcode, instructionPointer * ip, ssize_t * threadindex, bool chain)
+#else
+FUNGE_ATTR_FAST FUNGE_ATTR_NOINLINE
+static void execute_opcode(funge_cell opcode, instructionPointer * ip, bool chain)
+#endif
+{
+#ifdef THREADED_DISPATCH
+#  define OP_UNKNOWN8 &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown, \
+                      &&op_unknown, &&op_unknown, &&op_unknown, &&op_unknown
+#  define OP_FPRINT8 &&op_fprint, &&op_fprint, &&op_fprint, &&op_fprint, \
+                     &&op_fprint, &&op_fprint, &&op_fprint, &&op_fprint
+#  ifdef CONCURRENT_FUNGE
+#    define OP_SPLIT &&op_split
+#  else
+#    define OP_SPLIT &&op_unknown
+#  endif
+	static const void * const dispatch[256] = {
+		/* 0x00 */
+		OP_UNKNOWN8, OP_UNKNOWN8, OP_UNKNOWN8, OP_UNKNOWN8,
+		/* 0x20 */
+		&&op_space, &&op_not, &&op_string, &&op_trampoline, &&op_pop, &&op_rem, &&op_input_int, &&op_fetch,
+		&&op_load, &&op_unload, &&op_mul, &&op_add, &&op_output_char, &&op_sub, &&op_output_int, &&op_div,
+		&&op_push0, &&op_push1, &&op_push2, &&op_push3, &&op_push4, &&op_push5, &&op_push6, &&op_push7,
+		&&op_push8, &&op_push9, &&op_dup, &&op_jump_over, &&op_west, &&op_execute, &&op_east, &&op_away,
+		/* 0x40 */
+		&&op_stop, &&op_fprint, &&op_fprint, &&op_fprint, &&op_fprint, &&op_fprint, &&op_fprint, &&op_fprint,
+		OP_FPRINT8,
+		OP_FPRINT8,
+		&&op_fprint, &&op_fprint, &&op_fprint, &&op_turn_left, &&op_swap, &&op_turn_right, &&op_north, &&op_if_east_west,
+		/* 0x60 */
+		&&op_greater, &&op_push10, &&op_push11, &&op_push12, &&op_push13, &&op_push14, &&op_push15, &&op_get,
+		&&op_unknown, &&op_file_input, &&op_jump, &&op_iterate, &&op_unknown, &&op_unknown, &&op_clear, &&op_file_output,
+		&&op_put, &&op_quit, &&op_reflect, &&op_store, OP_SPLIT, &&op_under, &&op_south, &&op_compare,
+		&&op_absolute, &&op_sysinfo, &&op_nop, &&op_begin, &&op_if_north_south, &&op_end, &&op_input_char, &&op_unknown,
+		/* 0x80 */
+		OP_UNKNOWN8, OP_UNKNOWN8, OP_UNKNOWN8, OP_UNKNOWN8,
+		OP_UNKNOWN8, OP_UNKNOWN8, OP_UNKNOWN8, OP_UNKNOWN8,
+		OP_UNKNOWN8, OP_UNKNOWN8, OP_UNKNOWN8, OP_UNKNOWN8,
+		OP_UNKNOWN8, OP_UNKNOWN8, OP_UNKNOWN8, OP_UNKNOWN8
+	};
+#  undef OP_UNKNOWN8
+#  undef OP_FPRINT8
+#  undef OP_SPLIT
+#endif
+#ifdef CONCURRENT_FUNGE
+	bool retval;
 #endif
-				do {
-					ip_forward(ip);
 #ifdef AFL_FUZZ_TESTING
-					if (!iterations--)
-						exit(123);
+	long iterations = 1000;
+#  ifdef CONCURRENT_FUNGE
+	long thread_iterations = 1000;
+#  endif
 #endif
-				} while (fungespace_get(&ip->position) != ';');
-				return_from_execute_instruction(true);
-			}
-			case '^':
-				ip_go_north(ip);
-				break;
-			case '>':
-				ip_go_east(ip);
-				break;
-			case 'v':
-				ip_go_south(ip);
-				break;
-			case '<':
-				ip_go_west(ip);
-				break;
-			case 'j': {
-				// Currently need to do it like this or wrapping
-				// won't work for j.
-				funge_cell jumps = stack_pop(ip->stack);
-				ip_forward(ip);
-				if (jumps != 0) {
-					funge_vector tmp;
-					tmp.x = ip->delta.x;
-					tmp.y = ip->delta.y;
-					ip->delta.y *= jumps;
-					ip->delta.x *= jumps;
+
+	while (true) {
+#ifdef CONCURRENT_FUNGE
+		retval = false;
+#endif
+		// First check if we are in string mode, and do special stuff then.
+		if (ip->mode == ipmSTRING) {
+#ifdef CONCURRENT_FUNGE
+			retval = handle_string_mode(opcode, ip);
+#else
+			handle_string_mode(opcode, ip);
+#endif
+#ifndef THREADED_DISPATCH
+		// Next: Is this a fingerprint opcode?
+		} else if ((opcode >= 'A') && (opcode <= 'Z')) {
+			handle_fprint(opcode, ip);
+#endif
+		// OK a core instruction (or a fingerprint one with THREADED_DISPATCH).
+		// Find what one and execute it.
+		} else {
+#ifdef THREADED_DISPATCH
+			if (FUNGE_UNLIKELY((funge_unsigned_cell)opcode > 255))
+				goto op_unknown;
+			goto *dispatch[opcode];
+			do {
+#else
+			switch (opcode) {
+#endif
+				OPCODE(space, ' '):
+					(void)fungespace_skip_spaces(&ip->position, &ip->delta, &ip->fspaceCache);
+					ip->needMove = false;
+					instruction_done(true);
+				OPCODE(nop, 'z'):
+					break;
+				OPCODE(jump_over, ';'):
+					(void)fungespace_skip_comment(&ip->position, &ip->delta, &ip->fspaceCache);
+					instruction_done(true);
+				OPCODE(north, '^'):
+					ip_go_north(ip);
+					break;
+				OPCODE(east, '>'):
+					ip_go_east(ip);
+					break;
+				OPCODE(south, 'v'):
+					ip_go_south(ip);
+					break;
+				OPCODE(west, '<'):
+					ip_go_west(ip);
+					break;
+				OPCODE(jump, 'j'): {
+					// Currently need to do it like this or wrapping
+					// won't work for j.
+					funge_cell jumps = stack_pop(ip->stack);
 					ip_forward(ip);
-					ip->delta.x = tmp.x;
-					ip->delta.y = tmp.y;
+					if (jumps != 0) {
+						funge_vector tmp;
+						tmp.x = ip->delta.x;
+						tmp.y = ip->delta.y;
+						ip->delta.y *= jumps;
+						ip->delta.x *= jumps;
+						ip_forward(ip);
+						ip->delta.x = tmp.x;
+						ip->delta.y = tmp.y;
+					}
+					ip->needMove = false;
+					break;
 				}
-				ip->needMove = false;
-				break;
-			}
-			case '?': {
-				// May not be perfectly uniform.
-				// If this matters for you, contact me (with a patch).
-				funge_unsigned_cell rnd = prng_generate_unsigned(4);
-				switch (rnd) {
-					case 0: ip_go_north(ip); break;
-					case 1: ip_go_east(ip); break;
-					case 2: ip_go_south(ip); break;
-					case 3: ip_go_west(ip); break;
+				OPCODE(away, '?'): {
+					// May not be perfectly uniform.
+					// If this matters for you, contact me (with a patch).
+					funge_unsigned_cell rnd = prng_generate_unsigned(4);
+					switch (rnd) {
+						case 0: ip_go_north(ip); break;
+						case 1: ip_go_east(ip); break;
+						case 2: ip_go_south(ip); break;
+						case 3: ip_go_west(ip); break;
+					}
+					break;
 				}
-				break;
-			}
-			case 'r':
-				ip_reverse(ip);
-				break;
-			case '[':
-				ip_turn_left(ip);
-				break;
-			case ']':
-				ip_turn_right(ip);
-				break;
-			case 'x': {
-				funge_vector pos = stack_pop_vector(ip->stack);
+				OPCODE(reflect, 'r'):
+					ip_reverse(ip);
+					break;
+				OPCODE(turn_left, '['):
+					ip_turn_left(ip);
+					break;
+				OPCODE(turn_right, ']'):
+					ip_turn_right(ip);
+					break;
+				OPCODE(absolute, 'x'): {
+					funge_vector pos = stack_pop_vector(ip->stack);
 #ifdef AFL_FUZZ_TESTING
-				if (pos.x == 0 && pos.y == 0)
-					exit(123);
+					if (pos.x == 0 && pos.y == 0)
+						exit(123);
 #endif
-				ip->delta = pos;
-				break;
-			}
+					ip->delta = pos;
+					break;
+				}
 
-			PUSHVAL('0', 0)
-			PUSHVAL('1', 1)
-			PUSHVAL('2', 2)
-			PUSHVAL('3', 3)
-			PUSHVAL('4', 4)
-			PUSHVAL('5', 5)
-			PUSHVAL('6', 6)
-			PUSHVAL('7', 7)
-			PUSHVAL('8', 8)
-			PUSHVAL('9', 9)
-			PUSHVAL('a', 0xa)
-			PUSHVAL('b', 0xb)
-			PUSHVAL('c', 0xc)
-			PUSHVAL('d', 0xd)
-			PUSHVAL('e', 0xe)
-			PUSHVAL('f', 0xf)
-
-			case '"':
-				ip->mode = ipmSTRING;
-				ip->stringLastWasSpace = false;
-				break;
-			case ':':
-				stack_dup_top(ip->stack);
-				break;
-
-			case '#':
-				ip_forward(ip);
-				break;
-
-			case '_':
-				if_east_west(ip);
-				break;
-			case '|':
-				if_north_south(ip);
-				break;
-			case 'w': {
-				funge_cell a, b;
-				b = stack_pop(ip->stack);
-				a = stack_pop(ip->stack);
-				if (a < b)
-					ip_turn_left(ip);
-				else if (a > b)
-					ip_turn_right(ip);
-				break;
-			}
-			case 'k':
+				PUSHVAL(push0, '0', 0)
+				PUSHVAL(push1, '1', 1)
+				PUSHVAL(push2, '2', 2)
+				PUSHVAL(push3, '3', 3)
+				PUSHVAL(push4, '4', 4)
+				PUSHVAL(push5, '5', 5)
+				PUSHVAL(push6, '6', 6)
+				PUSHVAL(push7, '7', 7)
+				PUSHVAL(push8, '8', 8)
+				PUSHVAL(push9, '9', 9)
+				PUSHVAL(push10, 'a', 0xa)
+				PUSHVAL(push11, 'b', 0xb)
+				PUSHVAL(push12, 'c', 0xc)
+				PUSHVAL(push13, 'd', 0xd)
+				PUSHVAL(push14, 'e', 0xe)
+				PUSHVAL(push15, 'f', 0xf)
+
+				OPCODE(string, '"'):
+					ip->mode = ipmSTRING;
+					ip->stringLastWasSpace = false;
+					break;
+				OPCODE(dup, ':'):
+					stack_dup_top(ip->stack);
+					break;
+
+				OPCODE(trampoline, '#'):
+					ip_forward(ip);
+					break;
+
+				OPCODE(if_east_west, '_'):
+					if_east_west(ip);
+					break;
+				OPCODE(if_north_south, '|'):
+					if_north_south(ip);
+					break;
+				OPCODE(compare, 'w'): {
+					funge_cell a, b;
+					b = stack_pop(ip->stack);
+					a = stack_pop(ip->stack);
+					if (a < b)
+						ip_turn_left(ip);
+					else if (a > b)
+						ip_turn_right(ip);
+					break;
+				}
+				OPCODE(iterate, 'k'):
 #ifdef CONCURRENT_FUNGE
-				run_iterate(ip, &IPList, threadindex);
+					run_iterate(ip, &IPList, threadindex);
 #else
-				run_iterate(ip);
+					run_iterate(ip);
 #endif
-				break;
-
-			case '-': {
-				funge_cell a, b;
-				b = stack_pop(ip->stack);
-				a = stack_pop(ip->stack);
-				stack_push(ip->stack, a - b);
-				break;
-			}
-			case '+': {
-				funge_cell a, b;
-				b = stack_pop(ip->stack);
-				a = stack_pop(ip->stack);
-				stack_push(ip->stack, a + b);
-				break;
-			}
-			case '*': {
-				funge_cell a, b;
-				b = stack_pop(ip->stack);
-				a = stack_pop(ip->stack);
-				stack_push(ip->stack, a * b);
-				break;
-			}
-			case '/': {
-				funge_cell a, b;
-				b = stack_pop(ip->stack);
-				a = stack_pop(ip->stack);
-				stack_push(ip->stack, funge_division(a, b));
-				break;
-			}
-			case '%': {
-				funge_cell a, b;
-				b = stack_pop(ip->stack);
-				a = stack_pop(ip->stack);
-				stack_push(ip->stack, funge_modulo(a, b));
-				break;
-			}
-
-			case '!':
-				stack_push(ip->stack, !stack_pop(ip->stack));
-				break;
-			case '`': {
-				funge_cell a, b;
-				b = stack_pop(ip->stack);
-				a = stack_pop(ip->stack);
-				stack_push(ip->stack, a > b);
-				break;
-			}
-
-			case 'g': {
-				funge_vector pos;
-				funge_cell a;
-				pos = stack_pop_vector(ip->stack);
-				a = fungespace_get_offset(&pos, &ip->storageOffset);
-				stack_push(ip->stack, a);
-				break;
-			}
-			case 'p': {
-				funge_vector pos;
-				funge_cell a;
-				pos = stack_pop_vector(ip->stack);
-				a = stack_pop(ip->stack);
-				fungespace_set_offset(a, &pos, &ip->storageOffset);
-				break;
-			}
+					break;
+
+				OPCODE(sub, '-'): {
+					funge_cell a, b;
+					b = stack_pop(ip->stack);
+					a = stack_pop(ip->stack);
+					stack_push(ip->stack, a - b);
+					break;
+				}
+				OPCODE(add, '+'): {
+					funge_cell a, b;
+					b = stack_pop(ip->stack);
+					a = stack_pop(ip->stack);
+					stack_push(ip->stack, a + b);
+					break;
+				}
+				OPCODE(mul, '*'): {
+					funge_cell a, b;
+					b = stack_pop(ip->stack);
+					a = stack_pop(ip->stack);
+					stack_push(ip->stack, a * b);
+					break;
+				}
+				OPCODE(div, '/'): {
+					funge_cell a, b;
+					b = stack_pop(ip->stack);
+					a = stack_pop(ip->stack);
+					stack_push(ip->stack, funge_division(a, b));
+					break;
+				}
+				OPCODE(rem, '%'): {
+					funge_cell a, b;
+					b = stack_pop(ip->stack);
+					a = stack_pop(ip->stack);
+					stack_push(ip->stack, funge_modulo(a, b));
+					break;
+				}
 
-			case '\'':
-				ip_forward(ip);
-				stack_push(ip->stack, fungespace_get(&ip->position));
-				break;
-			case 's':
-				ip_forward_no_wrap(ip);
-				fungespace_set(stack_pop(ip->stack), &ip->position);
-				break;
-
-			case '$':
-				stack_discard(ip->stack, 1);
-				break;
-			case '\\':
-				stack_swap_top(ip->stack);
-				break;
-			case 'n':
-				stack_clear(ip->stack);
-				break;
-
-			case ',': {
-				funge_cell a = stack_pop(ip->stack);
-				// Reverse on failed output
-				if (FUNGE_UNLIKELY(cf_putchar_unlocked((int)a) != (unsigned char)a))
-					ip_reverse(ip);
-				break;
-			}
-			case '.':
-				// Reverse on failed output
-				if (FUNGE_UNLIKELY(printf("%" FUNGECELLPRI " ", stack_pop(ip->stack)) < 0))
-					ip_reverse(ip);
-				break;
+				OPCODE(not, '!'):
+					stack_push(ip->stack, !stack_pop(ip->stack));
+					break;
+				OPCODE(greater, '`'): {
+					funge_cell a, b;
+					b = stack_pop(ip->stack);
+					a = stack_pop(ip->stack);
+					stack_push(ip->stack, a > b);
+					break;
+				}
 
-			case '~': {
-				funge_cell a;
-				if (input_getchar(&a)) {
+				OPCODE(get, 'g'): {
+					funge_vector pos;
+					funge_cell a;
+					pos = stack_pop_vector(ip->stack);
+					a = fungespace_get_offset(&pos, &ip->storageOffset);
 					stack_push(ip->stack, a);
-				} else {
-					ip_reverse(ip);
+					break;
 				}
-				break;
-			}
-			case '&': {
-				funge_cell a = 0;
-				ret_getint gotint = rgi_noint;
-				while (gotint == rgi_noint)
-					gotint = input_getint(&a, 10);
-				if (gotint == rgi_success) {
-					stack_push(ip->stack, a);
-				} else {
-					ip_reverse(ip);
+				OPCODE(put, 'p'): {
+					funge_vector pos;
+					funge_cell a;
+					pos = stack_pop_vector(ip->stack);
+					a = stack_pop(ip->stack);
+					fungespace_set_offset(a, &pos, &ip->storageOffset);
+					break;
 				}
-				break;
-			}
 
-			case 'y':
-				run_sys_info(ip);
-				break;
-
-			case '{': {
-				funge_cell count;
-				funge_vector pos;
-				count = stack_pop(ip->stack);
-				ip_forward(ip);
-				pos.x = ip->position.x;
-				pos.y = ip->position.y;
-				ip_backward(ip);
-				if (!stackstack_begin(ip, count, &pos))
-					ip_reverse(ip);
-				break;
-			}
-			case '}':
-				if (ip->stackstack->current == 0) {
-					ip_reverse(ip);
-				} else {
-					funge_cell count;
-					count = stack_pop(ip->stack);
-					if (!stackstack_end(ip, count))
+				OPCODE(fetch, '\''):
+					ip_forward(ip);
+					stack_push(ip->stack, fungespace_get(&ip->position));
+					break;
+				OPCODE(store, 's'):
+					ip_forward_no_wrap(ip);
+					fungespace_set(stack_pop(ip->stack), &ip->position);
+					break;
+
+				OPCODE(pop, '$'):
+					stack_discard(ip->stack, 1);
+					break;
+				OPCODE(swap, '\\'):
+					stack_swap_top(ip->stack);
+					break;
+				OPCODE(clear, 'n'):
+					stack_clear(ip->stack);
+					break;
+
+				OPCODE(output_char, ','): {
+					funge_cell a = stack_pop(ip->stack);
+					// Reverse on failed output
+					if (FUNGE_UNLIKELY(cf_putchar_unlocked((int)a) != (unsigned char)a))
 						ip_reverse(ip);
+					break;
 				}
-				break;
-			case 'u':
-				if (ip->stackstack->current == 0) {
-					ip_reverse(ip);
-				} else {
+				OPCODE(output_int, '.'):
+					// Reverse on failed output
+					if (FUNGE_UNLIKELY(printf("%" FUNGECELLPRI " ", stack_pop(ip->stack)) < 0))
+						ip_reverse(ip);
+					break;
+
+				OPCODE(input_char, '~'): {
+					funge_cell a;
+					if (input_getchar(&a)) {
+						stack_push(ip->stack, a);
+					} else {
+						ip_reverse(ip);
+					}
+					break;
+				}
+				OPCODE(input_int, '&'): {
+					funge_cell a = 0;
+					ret_getint gotint = rgi_noint;
+					while (gotint == rgi_noint)
+						gotint = input_getint(&a, 10);
+					if (gotint == rgi_success) {
+						stack_push(ip->stack, a);
+					} else {
+						ip_reverse(ip);
+					}
+					break;
+				}
+
+				OPCODE(sysinfo, 'y'):
+					run_sys_info(ip);
+					break;
+
+				OPCODE(begin, '{'): {
 					funge_cell count;
+					funge_vector pos;
 					count = stack_pop(ip->stack);
-					stackstack_transfer(count,
-					                    ip->stackstack->stacks[ip->stackstack->current],
-					                    ip->stackstack->stacks[ip->stackstack->current - 1]);
+					ip_forward(ip);
+					pos.x = ip->position.x;
+					pos.y = ip->position.y;
+					ip_backward(ip);
+					if (!stackstack_begin(ip, count, &pos))
+						ip_reverse(ip);
+					break;
 				}
-				break;
-
-			case 'i':
-				run_file_input(ip);
-				break;
-			case 'o':
-				run_file_output(ip);
-				break;
-			case '=':
-				run_system_execute(ip);
-				break;
-
-			case '(':
-			case ')': {
-				// TODO: Handle Funge-109 style too.
-				funge_cell fpsize = stack_pop(ip->stack);
-				// Check for sanity (because we won't have any fingerprints
-				// outside such a range. This prevents long lockups here.
-#ifdef AFL_FUZZ_TESTING
-				if (fpsize > 500)
-					exit(123);
-#endif
-				if (fpsize < 1) {
-					ip_reverse(ip);
-				} else if (FUNGE_UNLIKELY(setting_disable_fingerprints)) {
-					stack_discard(ip->stack, (size_t)fpsize);
-					ip_reverse(ip);
-				} else {
-					funge_cell fprint = 0;
-					if (FUNGE_UNLIKELY((fpsize > 8) && setting_enable_warnings)) {
-						diag_warn_format("WARN: %c (x=%" FUNGECELLPRI " y=%"
-						                 FUNGECELLPRI "): count is very large(%" FUNGECELLPRI
-						                 "), probably a bug.\n", (char)opcode,
-						                 ip->position.x, ip->position.y, fpsize);
+				OPCODE(end, '}'):
+					if (ip->stackstack->current == 0) {
+						ip_reverse(ip);
+					} else {
+						funge_cell count;
+						count = stack_pop(ip->stack);
+						if (!stackstack_end(ip, count))
+							ip_reverse(ip);
 					}
-					while (fpsize--) {
-						fprint <<= 8;
-						fprint += stack_pop(ip->stack);
+					break;
+				OPCODE(under, 'u'):
+					if (ip->stackstack->current == 0) {
+						ip_reverse(ip);
+					} else {
+						funge_cell count;
+						count = stack_pop(ip->stack);
+						stackstack_transfer(count,
+						                    ip->stackstack->stacks[ip->stackstack->current],
+						                    ip->stackstack->stacks[ip->stackstack->current - 1]);
 					}
-					if (opcode == '(') {
-						if (!manager_load(ip, fprint))
-							ip_reverse(ip);
+					break;
+
+				OPCODE(file_input, 'i'):
+					run_file_input(ip);
+					break;
+				OPCODE(file_output, 'o'):
+					run_file_output(ip);
+					break;
+				OPCODE(execute, '='):
+					run_system_execute(ip);
+					break;
+
+				OPCODE(load, '('):
+				OPCODE(unload, ')'): {
+					// TODO: Handle Funge-109 style too.
+					funge_cell fpsize = stack_pop(ip->stack);
+					// Check for sanity (because we won't have any fingerprints
+					// outside such a range. This prevents long lockups here.
+#ifdef AFL_FUZZ_TESTING
+					if (fpsize > 500)
+						exit(123);
+#endif
+					if (fpsize < 1) {
+						ip_reverse(ip);
+					} else if (FUNGE_UNLIKELY(setting_disable_fingerprints)) {
+						stack_discard(ip->stack, (size_t)fpsize);
+						ip_reverse(ip);
 					} else {
-						if (!manager_unload(ip, fprint))
-							ip_reverse(ip);
+						funge_cell fprint = 0;
+						if (FUNGE_UNLIKELY((fpsize > 8) && setting_enable_warnings)) {
+							diag_warn_format("WARN: %c (x=%" FUNGECELLPRI " y=%"
+							                 FUNGECELLPRI "): count is very large(%" FUNGECELLPRI
+							                 "), probably a bug.\n", (char)opcode,
+							                 ip->position.x, ip->position.y, fpsize);
+						}
+						while (fpsize--) {
+							fprint <<= 8;
+							fprint += stack_pop(ip->stack);
+						}
+						if (opcode == '(') {
+							if (!manager_load(ip, fprint))
+								ip_reverse(ip);
+						} else {
+							if (!manager_unload(ip, fprint))
+								ip_reverse(ip);
+						}
 					}
+					break;
 				}
-				break;
-			}
 
 #ifdef CONCURRENT_FUNGE
-			case 't': {
-				ssize_t new_index = iplist_duplicate_ip(&IPList, *threadindex);
-				// Handle possible failure.
-				if (new_index != -1) {
-					*threadindex = new_index;
-				} else {
-					// Yeah this is the same as the child normally,
-					// the program should check that the parent still exists.
-					ip_reverse(ip);
+				OPCODE(split, 't'): {
+					ssize_t new_index = iplist_duplicate_ip(&IPList, *threadindex);
+					// Handle possible failure.
+					if (new_index != -1) {
+						*threadindex = new_index;
+					} else {
+						// Yeah this is the same as the child normally,
+						// the program should check that the parent still exists.
+						ip_reverse(ip);
+					}
+					break;
 				}
-				break;
-			}
 
 #endif /* CONCURRENT_FUNGE */
 
-			case '@':
+				OPCODE(stop, '@'):
 #ifdef CONCURRENT_FUNGE
-				if (IPList->top == 0) {
-					fflush(stdout);
-					exit(0);
-				} else {
-					*threadindex = iplist_terminate_ip(&IPList, *threadindex);
+					if (IPList->top == 0) {
+						fflush(stdout);
+						exit(0);
+					} else {
+						*threadindex = iplist_terminate_ip(&IPList, *threadindex);
 #  ifdef LARGE_IPLIST
-					IPList->ips[*threadindex]->needMove = false;
+						IPList->ips[*threadindex]->needMove = false;
 #  else
-					IPList->ips[*threadindex].needMove = false;
+						IPList->ips[*threadindex].needMove = false;
 #  endif
-				}
+					}
 #else
-				exit(0);
+					exit(0);
 #endif /* CONCURRENT_FUNGE */
-				break;
+					break;
 
-			case 'q':
-// We do the wrong thing here when fuzz testing to reduce false positives.
+				OPCODE(quit, 'q'):
+	// We do the wrong thing here when fuzz testing to reduce false positives.
 #ifdef FUZZ_TESTING
-				exit(0);
+					exit(0);
 #else
-				exit((int)stack_pop(ip->stack));
+					exit((int)stack_pop(ip->stack));
+#endif
+					break;
+
+#ifdef THREADED_DISPATCH
+				op_fprint:
+					handle_fprint(opcode, ip);
+					break;
 #endif
-				break;
 
-			default:
-				warn_unknown_instr(opcode, ip);
-				ip_reverse(ip);
+				OPCODE_UNKNOWN:
+					warn_unknown_instr(opcode, ip);
+					ip_reverse(ip);
+					break;
+#ifdef THREADED_DISPATCH
+			} while (false);
+#else
+			}
+#endif
 		}
+		if (!chain)
+			return_from_execute_instruction(retval);
+
+		// On to the next instruction.
+#ifdef CONCURRENT_FUNGE
+		thread_forward(IPLIST_GET(*threadindex));
+		if (!retval)
+			(*threadindex)--;
+		if (*threadindex < 0) {
+#  ifdef AFL_FUZZ_TESTING
+			// Give up after too many instructions
+			if (!iterations--)
+				exit(123);
+			thread_iterations = 1000;
+#  endif
+			interpreter_tick();
+			*threadindex = IPList->top;
+		}
+#  ifdef AFL_FUZZ_TESTING
+		if (!thread_iterations--)
+			exit(123);
+#  endif
+		ip = IPLIST_GET(*threadindex);
+#  ifdef CFUN_TRACE_CACHE
+		if (use_trace_cache(ip)) {
+			bool traced = tracecache_run(ip, &opcode);
+			// A loop of traces ending on a space never gets to the tick
+			// above, as spaces take no tick, so check for a snapshot here.
+			if (FUNGE_UNLIKELY(snapshot_requested))
+				snapshot_take(IPList);
+			if (traced)
+				continue;
+		}
+#  endif
+		opcode = fetch_instruction(ip, *threadindex);
+#else
+		if (ip->needMove)
+			fungespace_cursor_forward(&ip->fspaceCursor, &ip->position, &ip->delta);
+		else
+			ip->needMove = true;
+#  ifdef AFL_FUZZ_TESTING
+		// Give up after too many instructions
+		if (!iterations--)
+			exit(123);
+#  endif
+		interpreter_tick();
+#  ifdef CFUN_TRACE_CACHE
+		if (use_trace_cache(ip) && tracecache_run(ip, &opcode))
+			continue;
+#  endif
+		opcode = fetch_instruction(ip, 0);
+#endif
 	}
-	return_from_execute_instruction(false);
 }
-
+#ifdef THREADED_DISPATCH
+#  pragma GCC diagnostic pop
+#endif
 
 #ifdef CONCURRENT_FUNGE
-FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
-static inline void thread_forward(instructionPointer * restrict ip)
+FUNGE_ATTR_FAST CON_RETTYPE execute_instruction(funge_cell opcode, instructionPointer * restrict ip, ssize_t * threadindex)
 {
-	assert(ip != NULL);
-
-	if (ip->needMove)
-		ip_forward(ip);
-	else
-		ip->needMove = true;
+	return execute_opcode(opcode, ip, threadindex, false);
+}
+#else
+FUNGE_ATTR_FAST CON_RETTYPE execute_instruction(funge_cell opcode, instructionPointer * restrict ip)
+{
+	execute_opcode(opcode, ip, false);
 }
 #endif
 
@@ -588,106 +835,22 @@ static inline void thread_forward(instructionPointer * restrict ip)
 FUNGE_ATTR_NORET
 static inline void interpreter_main_loop(void)
 {
-#ifdef AFL_FUZZ_TESTING
-	long iterations = 1000;
-#endif
 #ifdef CONCURRENT_FUNGE
-	while (true) {
-		ssize_t i = IPList->top;
-#    ifdef AFL_FUZZ_TESTING
-		long thread_iterations = 1000;
-		// Give up after too many instructions
-		if (!iterations--)
-			exit(123);
-#    endif
-		while (i >= 0) {
-			bool retval;
-			funge_cell opcode;
-#    ifdef AFL_FUZZ_TESTING
-			if (!thread_iterations--)
-				exit(123);
-#    endif
-
-#    ifdef LARGE_IPLIST
-			opcode = fungespace_get(&IPList->ips[i]->position);
-#    else
-			opcode = fungespace_get(&IPList->ips[i].position);
-#    endif
-
-#    if !defined(DISABLE_TRACE) && defined(LARGE_IPLIST)
-			if (FUNGE_UNLIKELY(setting_trace_level != 0)) {
-				if (setting_trace_level > 8) {
-					fprintf(stderr, "tix=%zd tid=%" FUNGECELLPRI " x=%" FUNGECELLPRI " y=%" FUNGECELLPRI ": %c (%" FUNGECELLPRI ")\n",
-					        i, IPList->ips[i]->ID, IPList->ips[i]->position.x,
-					        IPList->ips[i]->position.y, (char)opcode, opcode);
-					stack_print_top(IPList->ips[i]->stack);
-				} else if (setting_trace_level > 3) {
-					fprintf(stderr, "tix=%zd tid=%" FUNGECELLPRI " x=%" FUNGECELLPRI " y=%" FUNGECELLPRI ": %c (%" FUNGECELLPRI ")\n",
-					        i, IPList->ips[i]->ID, IPList->ips[i]->position.x,
-					        IPList->ips[i]->position.y, (char)opcode, opcode);
-				} else if (setting_trace_level > 2)
-					fprintf(stderr, "%c", (char)opcode);
-			}
-#    elif !defined(DISABLE_TRACE) && !defined(LARGE_IPLIST)
-			if (FUNGE_UNLIKELY(setting_trace_level != 0)) {
-				if (setting_trace_level > 8) {
-					fprintf(stderr, "tix=%zd tid=%" FUNGECELLPRI " x=%" FUNGECELLPRI " y=%" FUNGECELLPRI ": %c (%" FUNGECELLPRI ")\n",
-					        i, IPList->ips[i].ID, IPList->ips[i].position.x,
-					        IPList->ips[i].position.y, (char)opcode, opcode);
-					stack_print_top(IPList->ips[i].stack);
-				} else if (setting_trace_level > 3) {
-					fprintf(stderr, "tix=%zd tid=%" FUNGECELLPRI " x=%" FUNGECELLPRI " y=%" FUNGECELLPRI ": %c (%" FUNGECELLPRI ")\n",
-					        i, IPList->ips[i].ID, IPList->ips[i].position.x,
-					        IPList->ips[i].position.y, (char)opcode, opcode);
-				} else if (setting_trace_level > 2)
-					fprintf(stderr, "%c", (char)opcode);
-			}
-#    endif /* DISABLE_TRACE */
-
-#    ifdef LARGE_IPLIST
-			retval = execute_instruction(opcode, IPList->ips[i], &i);
-			thread_forward(IPList->ips[i]);
-#    else
-			retval = execute_instruction(opcode, &IPList->ips[i], &i);
-			thread_forward(&IPList->ips[i]);
-#    endif
-			if (!retval)
-				i--;
-		}
-	}
-#else /* CONCURRENT_FUNGE */
-	while (true) {
-		funge_cell opcode;
-#    ifdef AFL_FUZZ_TESTING
-		// Give up after too many instructions
-		if (!iterations--)
-			exit(123);
-#    endif
-		opcode = fungespace_get(&IP->position);
-#    ifndef DISABLE_TRACE
-		if (FUNGE_UNLIKELY(setting_trace_level != 0)) {
-			if (setting_trace_level > 8) {
-				fprintf(stderr, "x=%" FUNGECELLPRI " y=%" FUNGECELLPRI ": %c (%" FUNGECELLPRI ")\n",
-				        IP->position.x, IP->position.y, (char)opcode, opcode);
-				stack_print_top(IP->stack);
-			} else if (setting_trace_level > 3) {
-				fprintf(stderr, "x=%" FUNGECELLPRI " y=%" FUNGECELLPRI ": %c (%" FUNGECELLPRI ")\n",
-				        IP->position.x, IP->position.y, (char)opcode, opcode);
-			} else if (setting_trace_level > 2)
-				fprintf(stderr, "%c", (char)opcode);
-		}
-#    endif /* DISABLE_TRACE */
+	ssize_t i;
 
-		execute_instruction(opcode, IP);
-		if (IP->needMove)
-			ip_forward(IP);
-		else
-			IP->needMove = true;
-	}
-#endif /* CONCURRENT_FUNGE */
+	interpreter_tick();
+	i = IPList->top;
+	// Runs until the program exits.
+	while (true)
+		(void)execute_opcode(fetch_instruction(IPLIST_GET(i), i), IPLIST_GET(i), &i, true);
+#else
+	interpreter_tick();
+	// Runs until the program exits.
+	while (true)
+		execute_opcode(fetch_instruction(IP, 0), IP, true);
+#endif
 }
 
-
 #ifndef NDEBUG
 // Used with debugging for freeing stuff at end of the program.
 // Not needed, but useful to check that free functions works,
@@ -700,6 +863,9 @@ static void debug_free(void)
 	ip_free(IP);
 # endif
 	sysinfo_cleanup();
+# ifdef CFUN_TRACE_CACHE
+	tracecache_free();
+# endif
 	fungespace_free();
 }
 #endif
@@ -737,24 +903,44 @@ void interpreter_run(const char *filename)
 #if !defined(NDEBUG) && !defined(CFUN_KLEE_TEST)
 	atexit(&debug_free);
 #endif
+	// Registered after debug_free() so it runs before it.
+	if (setting_fspace_stats) {
+#ifdef CFUN_TRACE_CACHE
+		atexit(&tracecache_print_stats);
+#endif
+		atexit(&fungespace_print_stats);
+	}
 	prng_init();
+	if (setting_restore_file) {
+		// Funge-Space, the IPs and the PRNG all come from the snapshot.
+#ifdef CONCURRENT_FUNGE
+		IPList = checkpoint_restore(setting_restore_file);
+		if (FUNGE_UNLIKELY(IPList == NULL))
+#else
+		IP = checkpoint_restore(setting_restore_file);
+		if (FUNGE_UNLIKELY(IP == NULL))
+#endif
+			diag_fatal_format("Failed to restore from \"%s\": %s", setting_restore_file, strerror(errno));
+	} else {
 #ifdef CFUN_KLEE_TEST_PROGRAM
-	klee_generate_program();
+		klee_generate_program();
 #else
-	if (FUNGE_UNLIKELY(!fungespace_load(filename))) {
-		diag_fatal_format("Failed to process file \"%s\": %s", filename, strerror(errno));
-	}
+		if (FUNGE_UNLIKELY(!imagecache_load(filename))) {
+			diag_fatal_format("Failed to process file \"%s\": %s", filename, strerror(errno));
+		}
 #endif
 #ifdef CONCURRENT_FUNGE
-	IPList = iplist_create();
-	if (FUNGE_UNLIKELY(IPList == NULL)) {
-		DIAG_FATAL_LOC("Couldn't create instruction pointer list!?");
-	}
+		IPList = iplist_create();
+		if (FUNGE_UNLIKELY(IPList == NULL)) {
+			DIAG_FATAL_LOC("Couldn't create instruction pointer list!?");
+		}
 #else
-	IP = ip_create();
-	if (FUNGE_UNLIKELY(IP == NULL)) {
-		DIAG_FATAL_LOC("Couldn't create instruction pointer!?");
-	}
+		IP = ip_create();
+		if (FUNGE_UNLIKELY(IP == NULL)) {
+			DIAG_FATAL_LOC("Couldn't create instruction pointer!?");
+		}
 #endif
+	}
+	snapshot_init();
 	interpreter_main_loop();
 }
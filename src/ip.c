@@ -57,6 +57,9 @@ static inline bool ip_create_in_place(instructionPointer *me)
 	me->delta.y              = 0;
 	me->storageOffset.x      = 0;
 	me->storageOffset.y      = 0;
+	me->fspaceCache.generation = 0;
+	me->fspaceCursor.generation = 0;
+	me->fspaceCursor.steps = 0;
 	me->mode                 = ipmCODE;
 	me->needMove             = true;
 	me->stringLastWasSpace   = false;
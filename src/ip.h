@@ -57,6 +57,8 @@ typedef struct s_instructionPointer {
 	funge_vector       position;           ///< Current position.
 	funge_vector       delta;              ///< Current delta.
 	funge_vector       storageOffset;      ///< The storage offset for current IP.
+	fungeSpaceCache    fspaceCache;        ///< Lookup cache for fetching instructions.
+	fungeSpaceCursor   fspaceCursor;       ///< Cursor for fetching instructions.
 	ipMode             mode;               ///< String or code mode.
 	// "Full" bool for very often checked flags.
 	bool               needMove;           ///< Should ip_forward be called at end of main loop. Is reset to true each time.
@@ -26,12 +26,13 @@
 #include "global.h"
 #include "main.h"
 
+#include <errno.h>  /* errno */
 #include <stdio.h>  /* fprintf, puts */
-#include <stdlib.h> /* exit */
+#include <stdlib.h> /* exit, strtoul */
 #include <signal.h> /* signal */
 #include <string.h> /* strncmp */
 #include <unistd.h> /* getopt */
-#include <limits.h> /* CHAR_BIT */
+#include <limits.h> /* CHAR_BIT, INT_MAX */
 
 #ifdef FUZZ_TESTING
 #include <sys/resource.h>
@@ -73,6 +74,30 @@ static void print_features(void)
 	     " - This binary does not use exact bounds in y.\n"
 #endif
 
+#ifdef CFUN_ZERO_SPACE
+	     " + Funge-Space is stored so zero means space (no fill at startup).\n"
+#else
+	     " - Funge-Space is filled with spaces at startup.\n"
+#endif
+
+#ifdef CFUN_COMPACT_CELLS
+	     " + The static Funge-Space array uses one byte per cell.\n"
+#else
+	     " - The static Funge-Space array uses full size cells.\n"
+#endif
+
+#ifdef CFUN_TILED_STATIC
+	     " + The static Funge-Space array is stored as 8x8 blocks.\n"
+#else
+	     " - The static Funge-Space array is stored row by row.\n"
+#endif
+
+#ifdef CFUN_OPEN_HASH
+	     " + Funge-Space hash tables use open addressing.\n"
+#else
+	     " - Funge-Space hash tables use chaining.\n"
+#endif
+
 #ifdef DEBUG
 	     " * This binary is a debug build.\n"
 #endif
@@ -115,17 +140,27 @@ static void print_help(void)
 {
 	puts("Usage: cfunge [OPTIONS] [FILE] [PROGRAM OPTIONS]\n"
 	     "A fast Befunge interpreter in C\n\n"
+	     " -a           Move the static Funge-Space array to where the program works.\n"
 	     " -b           Use fully buffered output (default is system default for stdout).\n"
+	     " -C seconds   Take a snapshot every so many seconds (needs -c).\n"
+	     " -c file      Write snapshots of the program to file on SIGUSR1.\n"
 	     " -E           Show non-fatal error messages, fatal ones are always shown.\n"
 	     " -F           Disable all fingerprints.\n"
 	     " -f           Show list of features and fingerprints supported in this binary.\n"
 	     " -h           Show this help and exit.\n"
+	     " -I dir       Cache images of large programs in dir, so they load faster the\n"
+	     "              next time (default: ~/.cache/cfunge, an empty dir turns it off).\n"
+	     " -P           Print Funge-Space statistics at exit.\n"
+	     " -r file      Restore the program from a snapshot written with -c, instead\n"
+	     "              of loading FILE (which is still what y reports).\n"
 	     " -S           Enable sandbox mode (see README for details).\n"
 	     " -s standard  Use the given standard (one of 93, 98 [default] and 109).\n"
 	     " -t level     Use given trace level. Default 0.\n"
 	     " -V           Show version and copyright info and exit.\n"
 	     " -v           Show version and build info and exit.\n"
-	     " -W           Show warnings."
+	     " -W           Show warnings.\n"
+	     " -w WxH       Size of the static Funge-Space array (default: picked from\n"
+	     "              the program). Larger is faster for big programs."
 #ifdef DISABLE_TRACE
 	     "\nNote that someone disabled trace in this binary, so -t will have no effect."
 #endif
@@ -152,6 +187,26 @@ static void print_build_info(void)
 #else
 	       "-exact-bounds "
 #endif
+#ifdef CFUN_ZERO_SPACE
+	       "+zero-space "
+#else
+	       "-zero-space "
+#endif
+#ifdef CFUN_COMPACT_CELLS
+	       "+compact-cells "
+#else
+	       "-compact-cells "
+#endif
+#ifdef CFUN_TILED_STATIC
+	       "+tiled-static "
+#else
+	       "-tiled-static "
+#endif
+#ifdef CFUN_OPEN_HASH
+	       "+open-hash "
+#else
+	       "-open-hash "
+#endif
 #ifdef HAVE_NCURSES
 	       "+ncurses "
 #else
@@ -218,6 +273,59 @@ static void print_version(void)
 	exit(EXIT_SUCCESS);
 }
 
+/// Largest width or height accepted by -w.
+#define STATIC_SIZE_MAX 65536
+
+/**
+ * Parse the argument to -w (WIDTHxHEIGHT).
+ */
+FUNGE_ATTR_NOINLINE FUNGE_ATTR_COLD FUNGE_ATTR_NONNULL
+static void parse_static_size(const char *optval)
+{
+	const char *arg = optval;
+	char *end;
+	unsigned long w, h;
+
+	errno = 0;
+	w = strtoul(arg, &end, 10);
+	if (end == arg || (*end != 'x' && *end != 'X'))
+		goto error;
+	arg = end + 1;
+	h = strtoul(arg, &end, 10);
+	if (end == arg || *end != '\0' || errno != 0)
+		goto error;
+	if (w == 0 || h == 0 || w > STATIC_SIZE_MAX || h > STATIC_SIZE_MAX)
+		goto error;
+	setting_static_width  = (funge_unsigned_cell)w;
+	setting_static_height = (funge_unsigned_cell)h;
+	return;
+error:
+	diag_fatal_format("%s is not valid for -w, expected WIDTHxHEIGHT (each 1 to %d).\n",
+	                  optval, STATIC_SIZE_MAX);
+}
+
+/**
+ * Parse the argument to -C (seconds between snapshots).
+ */
+FUNGE_ATTR_NOINLINE FUNGE_ATTR_COLD FUNGE_ATTR_NONNULL
+static void parse_snapshot_interval(const char *optval)
+{
+	char *end;
+	long seconds;
+
+	errno = 0;
+	seconds = strtol(optval, &end, 10);
+	if (end == optval || *end != '\0' || errno != 0)
+		goto error;
+	if (seconds <= 0 || seconds > INT_MAX)
+		goto error;
+	setting_snapshot_interval = (unsigned int)seconds;
+	return;
+error:
+	diag_fatal_format("%s is not valid for -C, expected a number of seconds (1 to %d).\n",
+	                  optval, INT_MAX);
+}
+
 int main(int argc, char *argv[])
 {
 	int opt;
@@ -233,11 +341,20 @@ int main(int argc, char *argv[])
 	// We detect socket issues in other ways.
 	signal(SIGPIPE, SIG_IGN);
 
-	while ((opt = getopt(argc, argv, "+bEFfhSs:t:VvW")) != -1) {
+	while ((opt = getopt(argc, argv, "+abC:c:EFfhI:Pr:Ss:t:VvWw:")) != -1) {
 		switch (opt) {
+			case 'a':
+				setting_adaptive_static = true;
+				break;
 			case 'b':
 				setvbuf(stdout, cfun_iobuf, _IOFBF, sizeof(cfun_iobuf));
 				break;
+			case 'C':
+				parse_snapshot_interval(optarg);
+				break;
+			case 'c':
+				setting_snapshot_file = optarg;
+				break;
 			case 'E':
 				setting_enable_errors = true;
 				break;
@@ -250,6 +367,15 @@ int main(int argc, char *argv[])
 			case 'h':
 				print_help();
 				break;
+			case 'I':
+				setting_image_cache_dir = optarg;
+				break;
+			case 'P':
+				setting_fspace_stats = true;
+				break;
+			case 'r':
+				setting_restore_file = optarg;
+				break;
 			case 'S':
 				setting_enable_sandbox = true;
 				break;
@@ -276,12 +402,17 @@ int main(int argc, char *argv[])
 			case 'W':
 				setting_enable_warnings = true;
 				break;
+			case 'w':
+				parse_static_size(optarg);
+				break;
 			default:
 				fprintf(stderr, "For help see: %s -h\n", argv[0]);
 				return EXIT_FAILURE;
 		}
 	}
-	if (FUNGE_UNLIKELY(optind >= argc)) {
+	if (FUNGE_UNLIKELY(setting_snapshot_interval != 0 && !setting_snapshot_file)) {
+		diag_fatal("-C needs a snapshot file given with -c.");
+	} else if (FUNGE_UNLIKELY(optind >= argc)) {
 		diag_fatal("No file provided.");
 	} else {
 		// Store argument count and a pointer to argv[optind] for later use
@@ -55,10 +55,23 @@ typedef unsigned char u_char;
 #  if !defined(HAVE_random) || !defined(HAVE_srandom)
 #    define random rand
 #    define srandom srand
+#  elif defined(HAVE_initstate) && defined(HAVE_setstate)
+#    define PRNG_SAVE_STATE
+#    include <stdint.h>
 #  endif
 
 #endif
 
+#ifdef PRNG_SAVE_STATE
+/// Size of the random() state, 128 bytes is what srandom() uses by default.
+#  define PRNG_STATE_SIZE 128
+/// The random() state, given to initstate() so it can be saved and restored.
+/// Of uint32_t to get the alignment random() wants.
+static uint32_t prng_state[PRNG_STATE_SIZE / sizeof(uint32_t)];
+/// srandom(), but using prng_state.
+#  define srandom(m_seed) initstate((m_seed), (char*)prng_state, sizeof(prng_state))
+#endif
+
 #ifndef HAVE_ARC4RANDOM
 static void setup_libc_random(void)
 {
@@ -141,3 +154,38 @@ funge_unsigned_cell prng_generate_unsigned(funge_unsigned_cell max_value)
 	return random() % max_value;
 #endif
 }
+
+FUNGE_ATTR_FAST
+size_t prng_get_state(const void ** state)
+{
+#ifdef PRNG_SAVE_STATE
+	// random() keeps where it is in the state outside of it, switching to
+	// the state it already uses stores that in it.
+	setstate((char*)prng_state);
+	*state = prng_state;
+	return sizeof(prng_state);
+#else
+	*state = NULL;
+	return 0;
+#endif
+}
+
+FUNGE_ATTR_FAST
+bool prng_set_state(const void * state, size_t size)
+{
+#ifdef PRNG_SAVE_STATE
+	uint32_t scratch[PRNG_STATE_SIZE / sizeof(uint32_t)];
+	if (size != sizeof(prng_state))
+		return false;
+	// Switching away from prng_state stores the current position into it,
+	// so switch to another state before overwriting it.
+	initstate(1, (char*)scratch, sizeof(scratch));
+	memcpy(prng_state, state, sizeof(prng_state));
+	setstate((char*)prng_state);
+	return true;
+#else
+	(void)state;
+	(void)size;
+	return false;
+#endif
+}
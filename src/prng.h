@@ -29,6 +29,9 @@
 
 #include "global.h"
 
+#include <stdbool.h>
+#include <stddef.h>
+
 /**
  * Initialize the PRNG (if it needs it)
  */
@@ -43,4 +46,22 @@ void prng_init(void);
 FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
 funge_unsigned_cell prng_generate_unsigned(funge_unsigned_cell max_value);
 
+/**
+ * Get the state of the PRNG, for checkpoints.
+ * @param state Out parameter for a pointer to the state, valid until the next
+ * call to any prng_* function.
+ * @return Size of the state, 0 if the PRNG in use can't be saved (then a
+ * restored program gets a new seed).
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+size_t prng_get_state(const void ** state);
+
+/**
+ * Set the state of the PRNG to one from prng_get_state().
+ * @return False if the state doesn't fit the PRNG in use, it is left as it
+ * was then.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL
+bool prng_set_state(const void * state, size_t size);
+
 #endif
@@ -30,5 +30,13 @@ standardVersion setting_current_standard = stdver98;
 uint_fast16_t setting_trace_level = 0;
 bool setting_enable_warnings = false;
 bool setting_enable_errors = false;
+funge_unsigned_cell setting_static_width = 0;
+funge_unsigned_cell setting_static_height = 0;
+bool setting_adaptive_static = false;
+bool setting_fspace_stats = false;
+const char * setting_snapshot_file = NULL;
+unsigned int setting_snapshot_interval = 0;
+const char * setting_restore_file = NULL;
+const char * setting_image_cache_dir = NULL;
 bool setting_disable_fingerprints = false;
 bool setting_enable_sandbox = false;
@@ -52,6 +52,27 @@ extern bool setting_enable_warnings;
 /// Fatal errors are always shown.
 extern bool setting_enable_errors;
 
+/// Width of the static Funge-Space array, 0 means pick it from the program.
+extern funge_unsigned_cell setting_static_width;
+/// Height of the static Funge-Space array, only used if the width is set.
+extern funge_unsigned_cell setting_static_height;
+
+/// Should the static Funge-Space array follow where the program works.
+extern bool setting_adaptive_static;
+/// Should Funge-Space statistics be printed at exit.
+extern bool setting_fspace_stats;
+
+/// File to write snapshots of the program to, NULL for none.
+extern const char * setting_snapshot_file;
+/// Seconds between snapshots, 0 means only on SIGUSR1.
+extern unsigned int setting_snapshot_interval;
+/// Snapshot to restore the program from instead of loading it, NULL for none.
+extern const char * setting_restore_file;
+
+/// Directory to cache images of large programs in, NULL for the default and
+/// an empty string to not cache them.
+extern const char * setting_image_cache_dir;
+
 /// Should fingerprints be enabled
 extern bool setting_disable_fingerprints;
 
@@ -0,0 +1,143 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global.h"
+#include "snapshot.h"
+
+#include "checkpoint.h"
+#include "diagnostic.h"
+#include "settings.h"
+
+#include <errno.h>
+#include <fcntl.h> /* open */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h> /* strerror, strlen */
+
+#include <unistd.h> /* _exit, close, dup2, fork, nice */
+#include <sys/time.h> /* setitimer */
+#include <sys/types.h> /* pid_t */
+#include <sys/wait.h> /* waitpid */
+
+volatile sig_atomic_t snapshot_requested = 0;
+
+/// The child writing the last snapshot, or 0 if none.
+static pid_t snapshot_child = 0;
+/// setting_snapshot_file with ".tmp" added, written to and then renamed so
+/// a crash while writing doesn't destroy the last good snapshot.
+static char *snapshot_tmpfile = NULL;
+
+static void snapshot_handler(int signum)
+{
+	(void)signum;
+	snapshot_requested = 1;
+}
+
+FUNGE_ATTR_FAST void snapshot_init(void)
+{
+	struct sigaction action;
+	size_t len;
+
+	if (!setting_snapshot_file)
+		return;
+	len = strlen(setting_snapshot_file);
+	snapshot_tmpfile = malloc(len + sizeof(".tmp"));
+	if (FUNGE_UNLIKELY(!snapshot_tmpfile))
+		DIAG_OOM("Could not allocate snapshot file name");
+	memcpy(snapshot_tmpfile, setting_snapshot_file, len);
+	memcpy(snapshot_tmpfile + len, ".tmp", sizeof(".tmp"));
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = &snapshot_handler;
+	sigemptyset(&action.sa_mask);
+	// Don't make blocking IO in the program fail with EINTR.
+	action.sa_flags = SA_RESTART;
+	if (sigaction(SIGUSR1, &action, NULL) != 0)
+		diag_fatal_format("Could not set up snapshots: %s", strerror(errno));
+
+	if (setting_snapshot_interval != 0) {
+		struct itimerval timer;
+		if (sigaction(SIGALRM, &action, NULL) != 0)
+			diag_fatal_format("Could not set up snapshots: %s", strerror(errno));
+		timer.it_interval.tv_sec = (time_t)setting_snapshot_interval;
+		timer.it_interval.tv_usec = 0;
+		timer.it_value = timer.it_interval;
+		if (setitimer(ITIMER_REAL, &timer, NULL) != 0)
+			diag_fatal_format("Could not set up snapshots: %s", strerror(errno));
+	}
+}
+
+#ifdef CONCURRENT_FUNGE
+FUNGE_ATTR_FAST void snapshot_take(const ipList * restrict ips)
+#else
+FUNGE_ATTR_FAST void snapshot_take(const instructionPointer * restrict ip)
+#endif
+{
+	pid_t pid;
+
+	snapshot_requested = 0;
+	if (snapshot_child != 0) {
+		pid_t done = waitpid(snapshot_child, NULL, WNOHANG);
+		if (done == 0)
+			return;
+		snapshot_child = 0;
+	}
+	pid = fork();
+	if (pid == -1) {
+		diag_error_format("Could not take snapshot: %s", strerror(errno));
+		return;
+	}
+	if (pid == 0) {
+		FILE *f;
+		bool ok;
+		int null;
+		// Stay out of the way of the program.
+		if (nice(10) == -1) {}
+		// Fingerprint loaders run by checkpoint_write() may write to the
+		// terminal (TERM does), that must not end up in the output.
+		null = open("/dev/null", O_WRONLY);
+		if (null != -1) {
+			dup2(null, STDOUT_FILENO);
+			close(null);
+		}
+		f = fopen(snapshot_tmpfile, "wb");
+		if (!f) {
+			diag_error_format("Could not write snapshot to %s: %s",
+			                  snapshot_tmpfile, strerror(errno));
+			_exit(EXIT_FAILURE);
+		}
+#ifdef CONCURRENT_FUNGE
+		ok = checkpoint_write(f, ips);
+#else
+		ok = checkpoint_write(f, ip);
+#endif
+		if (fclose(f) != 0)
+			ok = false;
+		if (!ok || rename(snapshot_tmpfile, setting_snapshot_file) != 0) {
+			diag_error_format("Could not write snapshot to %s: %s",
+			                  setting_snapshot_file, strerror(errno));
+			_exit(EXIT_FAILURE);
+		}
+		// Not exit(), that would run the atexit handlers of the program.
+		_exit(EXIT_SUCCESS);
+	}
+	snapshot_child = pid;
+}
@@ -0,0 +1,67 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Snapshots of a running program, for long running programs that should be
+ * possible to pick up again after a crash or reboot.
+ *
+ * A snapshot is taken by forking: the child gets a copy-on-write view of
+ * Funge-Space and the IPs as they were between two instructions, and writes
+ * it out with checkpoint_write() while the parent keeps running. The parent
+ * only pays for the fork() and for the pages it changes while the child is
+ * still writing.
+ */
+
+#ifndef FUNGE_HAD_SRC_SNAPSHOT_H
+#define FUNGE_HAD_SRC_SNAPSHOT_H
+
+#include "global.h"
+#include "ip.h"
+
+#include <signal.h>
+
+/// Set from the signal handlers, checked by the main loop between
+/// instructions.
+extern volatile sig_atomic_t snapshot_requested;
+
+/**
+ * Install the signal handlers, and start the timer if
+ * setting_snapshot_interval is set. Does nothing if setting_snapshot_file
+ * isn't set.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_COLD
+void snapshot_init(void);
+
+/**
+ * Take a snapshot in the background. Called by the main loop when
+ * snapshot_requested is set. If the previous snapshot is still being
+ * written this one is skipped.
+ */
+#ifdef CONCURRENT_FUNGE
+FUNGE_ATTR_FAST FUNGE_ATTR_COLD FUNGE_ATTR_NOINLINE FUNGE_ATTR_NONNULL
+void snapshot_take(const ipList * restrict ips);
+#else
+FUNGE_ATTR_FAST FUNGE_ATTR_COLD FUNGE_ATTR_NOINLINE FUNGE_ATTR_NONNULL
+void snapshot_take(const instructionPointer * restrict ip);
+#endif
+
+#endif
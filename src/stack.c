@@ -168,6 +168,20 @@ FUNGE_ATTR_FAST void stack_discard(funge_stack * restrict stack, size_t n)
 	}
 }
 
+FUNGE_ATTR_FAST funge_cell * stack_push_space(funge_stack * restrict stack, size_t n)
+{
+	funge_cell * items;
+	assert(stack != NULL);
+
+	// stack_prealloc_space() can't handle sizes this close to overflowing.
+	if (FUNGE_UNLIKELY(n > SIZE_MAX / sizeof(funge_cell) - stack->size - ALLOCSIZE_STACK))
+		stack_oom();
+	stack_prealloc_space(stack, n);
+	items = stack->entries + stack->top;
+	stack->top += n;
+	return items;
+}
+
 
 FUNGE_ATTR_FAST inline funge_cell stack_peek(const funge_stack * restrict stack)
 {
@@ -420,6 +434,28 @@ FUNGE_ATTR_FAST void stackstack_free(funge_stackstack * me)
 	free(me);
 }
 
+FUNGE_ATTR_FAST funge_stack * stackstack_push_stack(funge_stackstack ** me)
+{
+	funge_stackstack *stackStack = *me;
+	funge_stack      *stack;
+
+	stack = stack_create();
+	if (FUNGE_UNLIKELY(!stack))
+		return NULL;
+	if ((stackStack->size - 1) == stackStack->current) {
+		stackStack = realloc(stackStack, sizeof(funge_stackstack) + (stackStack->size + ALLOCSIZE_STACKSTACK) * sizeof(funge_stack*));
+		if (FUNGE_UNLIKELY(!stackStack)) {
+			stack_free(stack);
+			return NULL;
+		}
+		stackStack->size += ALLOCSIZE_STACKSTACK;
+		*me = stackStack;
+	}
+	stackStack->current++;
+	stackStack->stacks[stackStack->current] = stack;
+	return stack;
+}
+
 #ifdef CONCURRENT_FUNGE
 FUNGE_ATTR_FAST funge_stackstack * stackstack_duplicate(const funge_stackstack * restrict old)
 {
@@ -80,6 +80,13 @@ funge_cell stack_pop(funge_stack * restrict stack);
  */
 FUNGE_ATTR_NONNULL FUNGE_ATTR_FAST
 void stack_discard(funge_stack * restrict stack, size_t n);
+/**
+ * Make room for n items on top of the stack, for filling in directly.
+ * They must all be written before the stack is used again.
+ * @return Pointer to the lowest of the new items.
+ */
+FUNGE_ATTR_NONNULL FUNGE_ATTR_FAST FUNGE_ATTR_WARN_UNUSED
+funge_cell * stack_push_space(funge_stack * restrict stack, size_t n);
 /**
  * Stack peek.
  */
@@ -209,6 +216,15 @@ funge_stackstack * stackstack_create(void);
 FUNGE_ATTR_FAST
 void stackstack_free(funge_stackstack * me);
 
+/**
+ * Add a new empty stack on top of a stack-stack. Unlike stackstack_begin()
+ * nothing is done to the stack below. Used when restoring checkpoints.
+ * @param me Pointer to the stack-stack, it may be moved.
+ * @return The new stack, or NULL if out of memory (then nothing changed).
+ */
+FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED FUNGE_ATTR_FAST
+funge_stack * stackstack_push_stack(funge_stackstack ** me);
+
 #ifdef CONCURRENT_FUNGE
 /**
  * Deep copy a stack-stack, used for concurrency.
@@ -0,0 +1,676 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "global.h"
+#include "trace-cache.h"
+
+#ifdef CFUN_TRACE_CACHE
+
+#include "division.h"
+#include "settings.h"
+#include "stack.h"
+#include "funge-space/funge-space.h"
+
+#include <assert.h>
+#include <stdio.h>  /* fprintf, printf */
+#include <stdlib.h> /* free, malloc */
+#include <string.h> /* memcpy */
+
+/// Entries in the cache, must be a power of two.
+#define TRACECACHE_SIZE 4096
+/// Most cells a trace is decoded from.
+#define TRACE_MAX_STEPS 1024
+/// Most operations in a trace.
+#define TRACE_MAX_OPS 256
+/// Most times a trace changes direction.
+#define TRACE_MAX_SEGMENTS 32
+/// Traces passing fewer cells than this are run as usual instead.
+#define TRACE_MIN_LENGTH 3
+/// Changed cells to check against a trace before checking its whole area.
+#define TRACE_CHECK_CHANGES 8
+/// A trace that changes before being replayed this many times is code that
+/// keeps changing...
+#define TRACE_MIN_REPLAYS 4
+/// ...and is run as usual this many times before decoding it again.
+#define TRACE_COOLDOWN 256
+
+/// What an operation in a trace does.
+typedef enum traceOpcode {
+	top_push,
+	top_add,
+	top_sub,
+	top_mul,
+	top_div,
+	top_rem,
+	top_not,
+	top_greater,
+	top_dup,
+	top_pop,
+	top_swap,
+	top_clear,
+	top_get,
+	top_output_char,
+	top_output_int
+} traceOpcode;
+
+/// An operation in a trace.
+typedef struct traceOp {
+	funge_cell   value;  ///< Value pushed, or index in stops for output.
+	uint_fast8_t opcode; ///< A traceOpcode.
+} traceOp;
+
+/// Where the IP was at an operation that can reverse it (failed output).
+typedef struct traceStop {
+	funge_vector position;
+	funge_vector delta;
+} traceStop;
+
+/// The cells start, start + delta, and so on, that a trace was decoded from.
+typedef struct traceSegment {
+	funge_vector        start;
+	funge_vector        delta;
+	funge_unsigned_cell cells;
+} traceSegment;
+
+/// How a trace ends.
+typedef enum traceEnd {
+	teINSTRUCTION, ///< The IP is at endopcode, that should be run next.
+	teMOVEON,      ///< The instruction at end was the last one, move on from it.
+	teFETCH        ///< The IP is at end, fetch the instruction there as usual.
+} traceEnd;
+
+/// State of a cache entry.
+typedef enum traceState {
+	tsEMPTY,   ///< Nothing here.
+	tsSEEN,    ///< The IP has been at the key once, nothing decoded yet.
+	tsDECODED, ///< The trace is decoded, but may be invalid.
+	tsCOOLING  ///< The code kept changing, run it as usual for a while.
+} traceState;
+
+typedef struct traceEntry {
+	funge_vector   position;   ///< Key: where the trace starts.
+	funge_vector   delta;      ///< Key: delta when starting.
+	funge_vector   end;        ///< Where the IP is after the trace.
+	funge_vector   enddelta;   ///< Delta after the trace.
+	funge_cell     endopcode;  ///< The instruction at end, for teINSTRUCTION.
+	fungeRect      area;       ///< All cells the trace was decoded from are in this.
+	uint_fast64_t  epoch;      ///< Epoch the trace is known to be valid at.
+	uint_fast64_t  generation; ///< fungespace_cursor_generation when decoded.
+	uint_fast32_t  uses;       ///< Times replayed, halved when other keys want the entry.
+	traceOp      * ops;        ///< Allocated together with stops and segments.
+	traceStop    * stops;
+	traceSegment * segments;
+	uint_fast16_t  count;      ///< Number of ops.
+	uint_fast16_t  length;     ///< Number of cells passed.
+	uint_fast16_t  replays;    ///< Times replayed since decoded, up to TRACE_MIN_REPLAYS.
+	uint_fast16_t  cooldown;   ///< Visits left in tsCOOLING.
+	uint_fast8_t   nsegments;
+	uint_fast8_t   state;      ///< A traceState.
+	uint_fast8_t   endkind;    ///< A traceEnd.
+	ipMode         endmode;    ///< Mode after the trace.
+	/// True if the trace passes a string, so that endLastWasSpace is set.
+	bool           setsLastWasSpace;
+	bool           endLastWasSpace;
+	/// If the trace was decoded to stop before a cell that changed.
+	bool           avoided;
+} traceEntry;
+
+static struct {
+	traceEntry entries[TRACECACHE_SIZE];
+	struct {
+		uint_fast64_t decoded;  ///< Traces decoded.
+		uint_fast64_t replayed; ///< Traces replayed.
+		uint_fast64_t cells;    ///< Cells passed by replayed traces.
+	} stats;
+} tracecache;
+
+/**
+ * First of the two entries a key may be in.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_PURE
+static inline size_t trace_slot(const funge_vector * restrict position,
+                                const funge_vector * restrict delta)
+{
+	uint64_t h = (uint64_t)(funge_unsigned_cell)position->x * UINT64_C(0x9E3779B97F4A7C15)
+	             ^ (uint64_t)(funge_unsigned_cell)position->y * UINT64_C(0xC2B2AE3D27D4EB4F)
+	             ^ (uint64_t)(funge_unsigned_cell)delta->x * UINT64_C(0x165667B19E3779F9)
+	             ^ (uint64_t)(funge_unsigned_cell)delta->y * UINT64_C(0x27D4EB2F165667C5);
+	return (size_t)(h >> 32) & (TRACECACHE_SIZE - 2);
+}
+
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_PURE
+static inline bool trace_is_key(const traceEntry * restrict entry,
+                                const funge_vector * restrict position,
+                                const funge_vector * restrict delta)
+{
+	return entry->state != tsEMPTY
+	       && entry->position.x == position->x && entry->position.y == position->y
+	       && entry->delta.x == delta->x && entry->delta.y == delta->y;
+}
+
+/**
+ * Move position one step along delta, unless that would wrap.
+ * @param segments Segments so far, the last one is extended or a new one
+ * added for the new position.
+ * @param nsegments Number of segments, at most TRACE_MAX_SEGMENTS - 1.
+ * @return False if it would wrap, position is unchanged then.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static inline bool trace_step(funge_vector * restrict position,
+                              const funge_vector * restrict delta,
+                              traceSegment * restrict segments,
+                              size_t * restrict nsegments)
+{
+	funge_vector next = { position->x + delta->x, position->y + delta->y };
+	funge_vector wrapped = next;
+	traceSegment *last = &segments[*nsegments - 1];
+
+	fungespace_wrap(&wrapped, delta);
+	if (wrapped.x != next.x || wrapped.y != next.y)
+		return false;
+	*position = next;
+	if (last->delta.x == delta->x && last->delta.y == delta->y)
+		last->cells++;
+	else
+		segments[(*nsegments)++] = (traceSegment) { next, *delta, 1 };
+	return true;
+}
+
+/**
+ * Check if a segment has a cell.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_PURE FUNGE_ATTR_WARN_UNUSED
+static inline bool trace_segment_has(const traceSegment * restrict segment,
+                                     const funge_vector * restrict cell)
+{
+	// Differences too large to fit only give false matches, that are safe.
+	funge_unsigned_cell dx = (funge_unsigned_cell)cell->x - (funge_unsigned_cell)segment->start.x;
+	funge_unsigned_cell dy = (funge_unsigned_cell)cell->y - (funge_unsigned_cell)segment->start.y;
+	funge_cell k;
+
+	if ((funge_cell)dx == FUNGECELL_MIN || (funge_cell)dy == FUNGECELL_MIN)
+		return true;
+	// Steps along delta to get to the cell, if it is on the line at all.
+	if (segment->delta.x != 0)
+		k = (funge_cell)dx / segment->delta.x;
+	else if (segment->delta.y != 0)
+		k = (funge_cell)dy / segment->delta.y;
+	else
+		k = 0;
+	return k >= 0 && (funge_unsigned_cell)k < segment->cells
+	       && (funge_unsigned_cell)k * (funge_unsigned_cell)segment->delta.x == dx
+	       && (funge_unsigned_cell)k * (funge_unsigned_cell)segment->delta.y == dy;
+}
+
+/**
+ * Read a cell that the trace depends on: watch it and add it to the area.
+ * @param min Top left corner of the area so far.
+ * @param max Bottom right corner of the area so far.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static inline funge_cell trace_read(const funge_vector * restrict position,
+                                    funge_vector * restrict min,
+                                    funge_vector * restrict max)
+{
+	fungespace_watch(position);
+	if (position->x < min->x)
+		min->x = position->x;
+	if (position->x > max->x)
+		max->x = position->x;
+	if (position->y < min->y)
+		min->y = position->y;
+	if (position->y > max->y)
+		max->y = position->y;
+	return fungespace_get(position);
+}
+
+/**
+ * Check if position is the cell a trace should stop before.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_PURE
+static inline bool trace_avoids(const funge_vector * restrict avoid,
+                                const funge_vector * restrict position)
+{
+	return avoid && avoid->x == position->x && avoid->y == position->y;
+}
+
+/**
+ * Decode the trace for the key of entry, replacing what was there.
+ * @param avoid If not NULL, a cell that changed and probably will again. The
+ * trace stops before it, so that code after it can still be replayed.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NOINLINE
+static void trace_decode(traceEntry * restrict entry, const funge_vector * restrict avoid)
+{
+	static traceOp ops[TRACE_MAX_OPS];
+	static traceStop stops[TRACE_MAX_OPS];
+	static traceSegment segments[TRACE_MAX_SEGMENTS];
+	funge_vector position = entry->position;
+	funge_vector delta = entry->delta;
+	funge_vector min = position;
+	funge_vector max = position;
+	ipMode mode = ipmCODE;
+	bool lastWasSpace = false;
+	size_t count = 0;
+	size_t nstops = 0;
+	size_t steps = 0;
+	size_t nsegments = 1;
+
+	tracecache.stats.decoded++;
+	segments[0] = (traceSegment) { position, delta, 1 };
+	entry->epoch = fungespace_epoch();
+	entry->generation = fungespace_cursor_generation;
+	entry->setsLastWasSpace = false;
+	entry->endkind = teINSTRUCTION;
+	entry->avoided = (avoid != NULL);
+	entry->length = 0;
+
+	while (true) {
+		// Where the instruction at position starts, to end the trace before
+		// it if it can't be in the trace after all.
+		funge_vector at = position;
+		funge_vector atdelta = delta;
+		size_t atsegments = nsegments;
+		funge_unsigned_cell atcells = segments[nsegments - 1].cells;
+		funge_cell value;
+
+		if (steps >= TRACE_MAX_STEPS || count >= TRACE_MAX_OPS
+		    || nsegments >= TRACE_MAX_SEGMENTS) {
+			entry->endopcode = trace_read(&position, &min, &max);
+			break;
+		}
+		if (trace_avoids(avoid, &position)) {
+			// The step here added it to the segments, but it isn't read.
+			if (segments[nsegments - 1].cells > 1)
+				segments[nsegments - 1].cells--;
+			else if (nsegments > 1)
+				nsegments--;
+			entry->endkind = teFETCH;
+			break;
+		}
+		value = trace_read(&position, &min, &max);
+		if (mode == ipmSTRING) {
+			// Same as handle_string_mode() in interpreter.c.
+			if (value == '"') {
+				mode = ipmCODE;
+			} else if (value != ' ') {
+				lastWasSpace = false;
+				ops[count++] = (traceOp) { value, top_push };
+			} else if (!lastWasSpace || (setting_current_standard == stdver93)) {
+				lastWasSpace = true;
+				ops[count++] = (traceOp) { ' ', top_push };
+			}
+		} else {
+			switch (value) {
+				case ' ':
+				case 'z':
+					break;
+				case ';':
+					// The whole comment is one instruction.
+					do {
+						if (!trace_step(&position, &delta, segments, &nsegments) || ++steps >= TRACE_MAX_STEPS
+						    || trace_avoids(avoid, &position))
+							goto end_before;
+						value = trace_read(&position, &min, &max);
+					} while (value != ';');
+					break;
+				case '#':
+					if (!trace_step(&position, &delta, segments, &nsegments))
+						goto end_before;
+					steps++;
+					break;
+				case '\'':
+					if (!trace_step(&position, &delta, segments, &nsegments)
+					    || trace_avoids(avoid, &position))
+						goto end_before;
+					steps++;
+					ops[count++] = (traceOp) { trace_read(&position, &min, &max), top_push };
+					break;
+				case '"':
+					mode = ipmSTRING;
+					lastWasSpace = false;
+					entry->setsLastWasSpace = true;
+					break;
+
+				case '^': delta = (funge_vector) { 0, -1 }; break;
+				case '>': delta = (funge_vector) { 1, 0 }; break;
+				case 'v': delta = (funge_vector) { 0, 1 }; break;
+				case '<': delta = (funge_vector) { -1, 0 }; break;
+				case 'r': delta = (funge_vector) { -delta.x, -delta.y }; break;
+				case '[': delta = (funge_vector) { delta.y, -delta.x }; break;
+				case ']': delta = (funge_vector) { -delta.y, delta.x }; break;
+
+				case '0': case '1': case '2': case '3': case '4':
+				case '5': case '6': case '7': case '8': case '9':
+					ops[count++] = (traceOp) { value - '0', top_push };
+					break;
+				case 'a': case 'b': case 'c': case 'd': case 'e': case 'f':
+					ops[count++] = (traceOp) { value - 'a' + 0xa, top_push };
+					break;
+
+				case '+':  ops[count++] = (traceOp) { 0, top_add }; break;
+				case '-':  ops[count++] = (traceOp) { 0, top_sub }; break;
+				case '*':  ops[count++] = (traceOp) { 0, top_mul }; break;
+				case '/':  ops[count++] = (traceOp) { 0, top_div }; break;
+				case '%':  ops[count++] = (traceOp) { 0, top_rem }; break;
+				case '!':  ops[count++] = (traceOp) { 0, top_not }; break;
+				case '`':  ops[count++] = (traceOp) { 0, top_greater }; break;
+				case ':':  ops[count++] = (traceOp) { 0, top_dup }; break;
+				case '$':  ops[count++] = (traceOp) { 0, top_pop }; break;
+				case '\\': ops[count++] = (traceOp) { 0, top_swap }; break;
+				case 'n':  ops[count++] = (traceOp) { 0, top_clear }; break;
+				case 'g':  ops[count++] = (traceOp) { 0, top_get }; break;
+
+				case ',':
+				case '.':
+					stops[nstops] = (traceStop) { at, atdelta };
+					ops[count++] = (traceOp) { (funge_cell)nstops, (value == ',') ? top_output_char : top_output_int };
+					nstops++;
+					break;
+
+				default:
+					// Anything else ends the trace and is run as usual.
+					goto end_before;
+			}
+		}
+		entry->length++;
+		steps++;
+		if (!trace_step(&position, &delta, segments, &nsegments)) {
+			// The IP moves on from here as usual, wrapping.
+			entry->endkind = teMOVEON;
+			break;
+		}
+		continue;
+end_before:
+		// Ends at the instruction at "at", that is run as usual.
+		entry->endopcode = fungespace_get(&at);
+		position = at;
+		delta = atdelta;
+		nsegments = atsegments;
+		segments[nsegments - 1].cells = atcells;
+		break;
+	}
+
+	entry->end = position;
+	entry->enddelta = delta;
+	entry->endmode = mode;
+	entry->endLastWasSpace = lastWasSpace;
+	entry->area = (fungeRect) { min.x, min.y, max.x - min.x + 1, max.y - min.y + 1 };
+
+	free(entry->ops);
+	entry->count = (uint_fast16_t)count;
+	entry->nsegments = (uint_fast8_t)nsegments;
+	entry->replays = 0;
+	// One block for all of them.
+	entry->ops = malloc(count * sizeof(traceOp) + nstops * sizeof(traceStop)
+	                    + nsegments * sizeof(traceSegment));
+	if (FUNGE_UNLIKELY(!entry->ops)) {
+		// Nothing to replay then.
+		entry->stops = NULL;
+		entry->segments = NULL;
+		entry->count = 0;
+		entry->nsegments = 0;
+		entry->length = 0;
+	} else {
+		memcpy(entry->ops, ops, count * sizeof(traceOp));
+		entry->stops = (traceStop*)(entry->ops + count);
+		memcpy(entry->stops, stops, nstops * sizeof(traceStop));
+		entry->segments = (traceSegment*)(entry->stops + nstops);
+		memcpy(entry->segments, segments, nsegments * sizeof(traceSegment));
+	}
+	entry->state = tsDECODED;
+}
+
+/**
+ * Check that nothing the trace depends on has changed.
+ * @param changed Set to a cell of the trace that changed, if known.
+ * @param found Set to true if changed was set.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static inline bool trace_valid(traceEntry * restrict entry,
+                               funge_vector * restrict changed, bool * restrict found)
+{
+	funge_vector cells[TRACE_CHECK_CHANGES];
+	ssize_t nchanged;
+
+	// When the bounds shrink a trace may now have to wrap.
+	if (FUNGE_UNLIKELY(entry->generation != fungespace_cursor_generation))
+		return false;
+	if (FUNGE_LIKELY(entry->epoch >= fungespace_watched_epoch()))
+		return true;
+	// Other code close by changing doesn't matter, check the exact cells
+	// when there are few enough of them.
+	nchanged = fungespace_watched_changes(entry->epoch, cells, TRACE_CHECK_CHANGES);
+	if (nchanged < 0) {
+		if (fungespace_watched_changed_since(&entry->area, entry->epoch))
+			return false;
+	} else {
+		for (ssize_t i = 0; i < nchanged; i++)
+			for (size_t j = 0; j < entry->nsegments; j++)
+				if (trace_segment_has(&entry->segments[j], &cells[i])) {
+					*changed = cells[i];
+					*found = true;
+					return false;
+				}
+	}
+	entry->epoch = fungespace_epoch();
+	return true;
+}
+
+/**
+ * Find the entry for a key. If there isn't one, take one for it and mark it
+ * as seen.
+ * @return The entry, or NULL if it was just taken.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+static inline traceEntry *trace_lookup(const funge_vector * restrict position,
+                                       const funge_vector * restrict delta)
+{
+	traceEntry *first = &tracecache.entries[trace_slot(position, delta)];
+	traceEntry *second = first + 1;
+	traceEntry *entry;
+
+	if (FUNGE_LIKELY(trace_is_key(first, position, delta)))
+		return first;
+	if (trace_is_key(second, position, delta))
+		return second;
+	// Replace the one used least lately.
+	if (first->uses <= second->uses) {
+		entry = first;
+		second->uses /= 2;
+	} else {
+		entry = second;
+		first->uses /= 2;
+	}
+	entry->position = *position;
+	entry->delta = *delta;
+	entry->uses = 0;
+	entry->state = tsSEEN;
+	return NULL;
+}
+
+/**
+ * Stop replaying at a failed output: reverse and move on, as if the
+ * instruction was run as usual.
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_NOINLINE
+static void trace_stop(instructionPointer * restrict ip, const traceStop * restrict stop)
+{
+	ip->position = stop->position;
+	ip->delta = stop->delta;
+	ip_reverse(ip);
+	ip_forward(ip);
+}
+
+FUNGE_ATTR_FAST bool
+tracecache_run(instructionPointer * restrict ip, funge_cell * restrict opcode)
+{
+	traceEntry *entry = trace_lookup(&ip->position, &ip->delta);
+	funge_stack *stack = ip->stack;
+	funge_vector changed;
+	bool found = false;
+
+	// Only decode for places the IP comes back to.
+	if (!entry)
+		return false;
+	if (FUNGE_UNLIKELY(entry->state == tsCOOLING)) {
+		if (--entry->cooldown == 0)
+			entry->state = tsSEEN;
+		return false;
+	}
+	if (FUNGE_UNLIKELY(entry->state == tsSEEN)) {
+		trace_decode(entry, NULL);
+	} else if (FUNGE_UNLIKELY(!trace_valid(entry, &changed, &found))) {
+		// A cell that changed soon after decoding probably changes every
+		// time, stop before it. If that doesn't help either, decoding is
+		// slower than running the code as usual.
+		if (entry->replays < TRACE_MIN_REPLAYS && (entry->avoided || !found)) {
+			entry->state = tsCOOLING;
+			entry->cooldown = TRACE_COOLDOWN;
+			return false;
+		}
+		trace_decode(entry, (found && entry->replays < TRACE_MIN_REPLAYS) ? &changed : NULL);
+	}
+	if (entry->length < TRACE_MIN_LENGTH)
+		return false;
+	entry->uses++;
+	if (entry->replays < TRACE_MIN_REPLAYS)
+		entry->replays++;
+	tracecache.stats.replayed++;
+	tracecache.stats.cells += entry->length;
+
+	for (size_t i = 0; i < entry->count; i++) {
+		const traceOp *op = &entry->ops[i];
+		funge_cell a, b;
+		switch (op->opcode) {
+			case top_push:
+				stack_push(stack, op->value);
+				break;
+			case top_add:
+				b = stack_pop(stack);
+				a = stack_pop(stack);
+				stack_push(stack, a + b);
+				break;
+			case top_sub:
+				b = stack_pop(stack);
+				a = stack_pop(stack);
+				stack_push(stack, a - b);
+				break;
+			case top_mul:
+				b = stack_pop(stack);
+				a = stack_pop(stack);
+				stack_push(stack, a * b);
+				break;
+			case top_div:
+				b = stack_pop(stack);
+				a = stack_pop(stack);
+				stack_push(stack, funge_division(a, b));
+				break;
+			case top_rem:
+				b = stack_pop(stack);
+				a = stack_pop(stack);
+				stack_push(stack, funge_modulo(a, b));
+				break;
+			case top_not:
+				stack_push(stack, !stack_pop(stack));
+				break;
+			case top_greater:
+				b = stack_pop(stack);
+				a = stack_pop(stack);
+				stack_push(stack, a > b);
+				break;
+			case top_dup:
+				stack_dup_top(stack);
+				break;
+			case top_pop:
+				stack_discard(stack, 1);
+				break;
+			case top_swap:
+				stack_swap_top(stack);
+				break;
+			case top_clear:
+				stack_clear(stack);
+				break;
+			case top_get: {
+				funge_vector pos = stack_pop_vector(stack);
+				stack_push(stack, fungespace_get_offset(&pos, &ip->storageOffset));
+				break;
+			}
+			case top_output_char:
+				a = stack_pop(stack);
+				if (FUNGE_UNLIKELY(cf_putchar_unlocked((int)a) != (unsigned char)a)) {
+					trace_stop(ip, &entry->stops[op->value]);
+					return false;
+				}
+				break;
+			case top_output_int:
+				if (FUNGE_UNLIKELY(printf("%" FUNGECELLPRI " ", stack_pop(stack)) < 0)) {
+					trace_stop(ip, &entry->stops[op->value]);
+					return false;
+				}
+				break;
+		}
+	}
+
+	// Counts as that many ticks.
+	if (fungespace_adaptive_countdown > entry->length)
+		fungespace_adaptive_countdown -= entry->length;
+	else
+		fungespace_adaptive_countdown = 1;
+
+	ip->position = entry->end;
+	ip->delta = entry->enddelta;
+	ip->mode = entry->endmode;
+	if (entry->setsLastWasSpace)
+		ip->stringLastWasSpace = entry->endLastWasSpace;
+	if (entry->endkind == teINSTRUCTION) {
+		*opcode = entry->endopcode;
+		return true;
+	}
+	if (entry->endkind == teMOVEON)
+		ip_forward(ip);
+	return false;
+}
+
+void tracecache_print_stats(void)
+{
+	fprintf(stderr, "Trace cache statistics:\n");
+	fprintf(stderr, "  Traces decoded:     %" PRIuFAST64 "\n", tracecache.stats.decoded);
+	fprintf(stderr, "  Traces replayed:    %" PRIuFAST64 " (%" PRIuFAST64 " cells)\n",
+	        tracecache.stats.replayed, tracecache.stats.cells);
+}
+
+#ifndef NDEBUG
+void tracecache_free(void)
+{
+	for (size_t i = 0; i < TRACECACHE_SIZE; i++) {
+		free(tracecache.entries[i].ops);
+		tracecache.entries[i].ops = NULL;
+		tracecache.entries[i].stops = NULL;
+		tracecache.entries[i].segments = NULL;
+		tracecache.entries[i].nsegments = 0;
+		tracecache.entries[i].count = 0;
+		tracecache.entries[i].state = tsEMPTY;
+	}
+}
+#endif
+
+#endif /* CFUN_TRACE_CACHE */
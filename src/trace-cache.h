@@ -0,0 +1,72 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @file
+ * Cache of decoded traces: the instructions an IP runs from a cell in code
+ * mode, along a delta, until an instruction that the trace can't know the
+ * outcome of (a branch, anything changing Funge-Space, fingerprints and so
+ * on). Replaying a trace runs its stack and output instructions without
+ * fetching, dispatching or moving for each one.
+ *
+ * Traces never wrap, and the cells they were decoded from are watched (see
+ * fungespace_watch()), so a trace is decoded again after the code it came
+ * from changes.
+ */
+
+#ifndef FUNGE_HAD_SRC_TRACE_CACHE_H
+#define FUNGE_HAD_SRC_TRACE_CACHE_H
+
+#include "global.h"
+
+#include <stdbool.h>
+
+#include "ip.h"
+
+#ifdef CFUN_TRACE_CACHE
+/**
+ * Run the trace starting where ip is, if there is one. Traces are only
+ * decoded for places the IP comes to more than once.
+ * @param ip The IP, in code mode and about to fetch the instruction at its
+ * position. Moved to the end of the trace.
+ * @param opcode Set to the instruction at the new position of ip when true
+ * is returned.
+ * @return True if ip is at the instruction ending the trace, that should be
+ * executed next. False if the instruction at the position of ip should be
+ * fetched as usual (no trace, or the trace ended without one).
+ */
+FUNGE_ATTR_FAST FUNGE_ATTR_NONNULL FUNGE_ATTR_WARN_UNUSED
+bool tracecache_run(instructionPointer * restrict ip, funge_cell * restrict opcode);
+
+/**
+ * Print statistics for the trace cache to stderr, for -P.
+ */
+void tracecache_print_stats(void);
+
+#ifndef NDEBUG
+/**
+ * Free all traces.
+ */
+void tracecache_free(void);
+#endif
+#endif /* CFUN_TRACE_CACHE */
+
+#endif
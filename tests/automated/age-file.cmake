@@ -0,0 +1,28 @@
+# cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+# Copyright (C) 2017 Arvid Norlander <code AT vorpal DOT se>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at the proxy's option) any later version. Arvid Norlander is a
+# proxy who can decide which future versions of the GNU General Public
+# License can be used.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Copy SOURCE to DEST, then wait until the copy is old enough for i to keep
+# it in memory (LOADCACHE_MIN_AGE in funge-space.c, plus a second for file
+# times with whole seconds).
+#
+# Usage: cmake -DSOURCE=<file> -DDEST=<file> -P age-file.cmake
+execute_process(COMMAND ${CMAKE_COMMAND} -E copy ${SOURCE} ${DEST} RESULT_VARIABLE result)
+if (NOT result EQUAL 0)
+	message(FATAL_ERROR "Could not copy ${SOURCE} to ${DEST}")
+endif ()
+execute_process(COMMAND ${CMAKE_COMMAND} -E sleep 3)
@@ -0,0 +1,67 @@
+# cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+# Copyright (C) 2017 Arvid Norlander <code AT vorpal DOT se>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at the proxy's option) any later version. Arvid Norlander is a
+# proxy who can decide which future versions of the GNU General Public
+# License can be used.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Run the image-cache.b98 made by large-files.cmake without the image cache,
+# then twice with a new cache in WORK_DIR. The first of those stores the
+# image and the second maps it. All three must print the same, and if
+# EXPECTED is given that must be it.
+#
+# Usage: cmake -DCFUNGE=<cfunge> -DPROGRAM=<file> -DWORK_DIR=<dir>
+#              [-DEXPECTED=<file>] -P image-cache.cmake
+set(cache ${WORK_DIR}/cache)
+file(REMOVE_RECURSE ${cache})
+
+foreach (run 0 1 2)
+	if (run EQUAL 0)
+		set(dir "")
+		set(image "not used")
+	else ()
+		set(dir ${cache})
+		if (run EQUAL 1)
+			set(image "not used")
+		else ()
+			set(image "mapped")
+		endif ()
+	endif ()
+	execute_process(COMMAND ${CFUNGE} -P -I "${dir}" ${PROGRAM}
+	                WORKING_DIRECTORY ${WORK_DIR} TIMEOUT 30
+	                RESULT_VARIABLE result OUTPUT_VARIABLE output${run}
+	                ERROR_VARIABLE error)
+	if (NOT result EQUAL 0)
+		message(FATAL_ERROR "Run ${run} of ${PROGRAM} failed: ${result}\n${error}")
+	endif ()
+	if (NOT error MATCHES "Program image: +${image}\n")
+		message(FATAL_ERROR "Run ${run} of ${PROGRAM}, expected the image to be ${image}:\n${error}")
+	endif ()
+	if (run EQUAL 1)
+		file(GLOB images ${cache}/*.img)
+		if (NOT images)
+			message(FATAL_ERROR "No image was stored in ${cache}")
+		endif ()
+	endif ()
+	if (NOT output${run} STREQUAL output0)
+		message(FATAL_ERROR "Run ${run} of ${PROGRAM} printed:\n${output${run}}\nbut without the image cache it printed:\n${output0}")
+	endif ()
+endforeach ()
+
+if (EXPECTED)
+	file(READ ${EXPECTED} expected)
+	if (NOT output0 STREQUAL expected)
+		message(FATAL_ERROR "${PROGRAM} printed:\n${output0}\nexpected:\n${expected}")
+	endif ()
+endif ()
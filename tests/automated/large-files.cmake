@@ -0,0 +1,70 @@
+# cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+# Copyright (C) 2017 Arvid Norlander <code AT vorpal DOT se>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at the proxy's option) any later version. Arvid Norlander is a
+# proxy who can decide which future versions of the GNU General Public
+# License can be used.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Write the large files some tests need into WORK_DIR, they are too large to
+# keep in the source tree.
+#
+# image-cache.b98: image-cache.b98 from SOURCE_DIR, with 1200 rows of 1000
+# digits added under it, so it is large enough for the image cache.
+#
+# mixed.txt: over 4 MiB of text for i, large enough to be loaded by several
+# threads. Lines end in \n, \r\n and \r (so there are \r\r too), and there
+# are form feeds in lines and after a \r. Each group of lines has its number
+# in it, so rows that end up in the wrong place show. mixed-binary.txt is
+# what o writes back after a binary i of it, the same with a newline added.
+#
+# Usage: cmake -DSOURCE_DIR=<dir> -DWORK_DIR=<dir> -P large-files.cmake
+set(digits "")
+foreach (i RANGE 1 100)
+	string(APPEND digits "0123456789")
+endforeach ()
+set(rows "")
+foreach (i RANGE 1 100)
+	string(APPEND rows "${digits}\n")
+endforeach ()
+
+file(READ ${SOURCE_DIR}/image-cache.b98 header)
+file(WRITE ${WORK_DIR}/image-cache.b98 "${header}")
+foreach (i RANGE 1 12)
+	file(APPEND ${WORK_DIR}/image-cache.b98 "${rows}")
+endforeach ()
+
+string(SUBSTRING "${digits}" 0 100 line)
+set(spaces "")
+foreach (i RANGE 1 30)
+	string(APPEND spaces "          ")
+endforeach ()
+string(ASCII 12 ff)
+file(WRITE ${WORK_DIR}/mixed.txt "")
+file(WRITE ${WORK_DIR}/mixed-binary.txt "")
+foreach (block RANGE 0 69)
+	set(lines "")
+	foreach (i RANGE ${block}00 ${block}99)
+		string(APPEND lines
+			"${i}:${line}\r\n"
+			"  spaced   out  ${i}\r"
+			"\r"
+			"${line}${line}\n"
+			"form${ff}feed ${i}${ff}\r\n"
+			"cr then ff ${i}\r${ff}\n"
+			"${i}${spaces}x\n")
+	endforeach ()
+	file(APPEND ${WORK_DIR}/mixed.txt "${lines}")
+	file(APPEND ${WORK_DIR}/mixed-binary.txt "${lines}")
+endforeach ()
+file(APPEND ${WORK_DIR}/mixed-binary.txt "\n")
@@ -0,0 +1,64 @@
+# cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+# Copyright (C) 2017 Arvid Norlander <code AT vorpal DOT se>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at the proxy's option) any later version. Arvid Norlander is a
+# proxy who can decide which future versions of the GNU General Public
+# License can be used.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Run parallel-load.b98 in WORK_DIR, where large-files.cmake wrote the
+# mixed.txt it loads, with one and with four loader threads. Both runs must
+# print what is in parallel-load.expected and write the same files. The
+# binary copy must also be mixed-binary.txt, which is mixed.txt with the
+# newline o ends the row with.
+#
+# Usage: cmake -DCFUNGE=<cfunge> -DSOURCE_DIR=<dir> -DWORK_DIR=<dir>
+#              -P parallel-load.cmake
+file(READ ${SOURCE_DIR}/parallel-load.expected expected)
+
+foreach (threads 1 4)
+	file(REMOVE ${WORK_DIR}/out-text.txt ${WORK_DIR}/out-binary.txt)
+	execute_process(COMMAND ${CMAKE_COMMAND} -E env CFUNGE_LOAD_THREADS=${threads}
+	                        ${CFUNGE} ${SOURCE_DIR}/parallel-load.b98
+	                WORKING_DIRECTORY ${WORK_DIR} TIMEOUT 60
+	                RESULT_VARIABLE result OUTPUT_VARIABLE output
+	                ERROR_VARIABLE error)
+	if (NOT result EQUAL 0)
+		message(FATAL_ERROR "parallel-load.b98 with ${threads} threads failed: ${result}\n${error}")
+	endif ()
+	if (NOT output STREQUAL expected)
+		message(FATAL_ERROR "parallel-load.b98 with ${threads} threads printed:\n${output}\nexpected:\n${expected}")
+	endif ()
+	foreach (kind text binary)
+		if (NOT EXISTS ${WORK_DIR}/out-${kind}.txt)
+			message(FATAL_ERROR "parallel-load.b98 with ${threads} threads didn't write out-${kind}.txt")
+		endif ()
+		file(RENAME ${WORK_DIR}/out-${kind}.txt ${WORK_DIR}/${kind}-${threads}.txt)
+	endforeach ()
+endforeach ()
+
+foreach (kind text binary)
+	execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files
+	                        ${WORK_DIR}/${kind}-1.txt ${WORK_DIR}/${kind}-4.txt
+	                RESULT_VARIABLE result)
+	if (NOT result EQUAL 0)
+		message(FATAL_ERROR "${kind}-1.txt and ${kind}-4.txt in ${WORK_DIR} differ")
+	endif ()
+endforeach ()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files
+                        ${WORK_DIR}/binary-1.txt ${WORK_DIR}/mixed-binary.txt
+                RESULT_VARIABLE result)
+if (NOT result EQUAL 0)
+	message(FATAL_ERROR "binary-1.txt in ${WORK_DIR} isn't mixed.txt")
+endif ()
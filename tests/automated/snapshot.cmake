@@ -0,0 +1,103 @@
+# cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+# Copyright (C) 2017 Arvid Norlander <code AT vorpal DOT se>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at the proxy's option) any later version. Arvid Norlander is a
+# proxy who can decide which future versions of the GNU General Public
+# License can be used.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Take a snapshot of snapshot.b98 with -c and -C, restore it twice with -r
+# and check what the restored program prints (see the end of snapshot.b98).
+# Then check that restoring from truncated snapshots fails, that -C also
+# snapshots a loop run from the trace cache, and that bad -C uses are rejected.
+#
+# Usage: cmake -DCFUNGE=<cfunge> -DPYTHON=<python> -DSOURCE_DIR=<dir>
+#              -DWORK_DIR=<dir> -P snapshot.cmake
+set(program ${SOURCE_DIR}/snapshot.b98)
+set(snapshot ${WORK_DIR}/snapshot.ckpt)
+set(loop ${WORK_DIR}/loop.b98)
+set(loopsnapshot ${WORK_DIR}/loop.ckpt)
+file(REMOVE ${snapshot} ${WORK_DIR}/resume.txt ${loopsnapshot})
+
+# The program waits for resume.txt, so this only stops at the timeout.
+execute_process(COMMAND ${CFUNGE} -c ${snapshot} -C 1 ${program}
+                WORKING_DIRECTORY ${WORK_DIR} TIMEOUT 3 OUTPUT_QUIET)
+if (NOT EXISTS ${snapshot})
+	message(FATAL_ERROR "No snapshot was written to ${snapshot}")
+endif ()
+
+file(WRITE ${WORK_DIR}/resume.txt "resume\n")
+file(READ ${SOURCE_DIR}/snapshot.expected expected)
+foreach (run 1 2)
+	execute_process(COMMAND ${CFUNGE} -r ${snapshot} ${program}
+	                WORKING_DIRECTORY ${WORK_DIR} TIMEOUT 10
+	                RESULT_VARIABLE result OUTPUT_VARIABLE output${run})
+	if (NOT result EQUAL 0)
+		message(FATAL_ERROR "Restoring ${snapshot} failed: ${result}")
+	endif ()
+	# The first line is random, the rest must match.
+	string(FIND "${output${run}}" "\n" newline)
+	math(EXPR newline "${newline} + 1")
+	string(SUBSTRING "${output${run}}" ${newline} -1 rest)
+	if (NOT rest STREQUAL expected)
+		message(FATAL_ERROR "Restored program printed:\n${output${run}}\nexpected the random numbers and:\n${expected}")
+	endif ()
+endforeach ()
+# Both runs continue from the same PRNG state.
+if (NOT output1 STREQUAL output2)
+	message(FATAL_ERROR "Restoring twice gave different output:\n${output1}\n${output2}")
+endif ()
+
+foreach (quarter 1 2 3)
+	set(truncated ${WORK_DIR}/truncated.ckpt)
+	execute_process(COMMAND ${PYTHON} -c
+		"import sys; d = open(sys.argv[1], 'rb').read(); open(sys.argv[2], 'wb').write(d[:len(d) * ${quarter} // 4])"
+		${snapshot} ${truncated})
+	execute_process(COMMAND ${CFUNGE} -r ${truncated} ${program}
+	                WORKING_DIRECTORY ${WORK_DIR} TIMEOUT 10
+	                RESULT_VARIABLE result OUTPUT_QUIET ERROR_VARIABLE error)
+	if (result EQUAL 0 OR NOT error MATCHES "Failed to restore")
+		message(FATAL_ERROR "Restoring ${quarter}/4 of the snapshot gave ${result}:\n${error}")
+	endif ()
+endforeach ()
+
+# A loop that never leaves the trace cache (or the threaded dispatch loop
+# when that is off) must still get its snapshots, and they must restore.
+file(WRITE ${loop} "1+:$\n")
+execute_process(COMMAND ${CFUNGE} -c ${loopsnapshot} -C 1 ${loop}
+                WORKING_DIRECTORY ${WORK_DIR} TIMEOUT 3 OUTPUT_QUIET)
+if (NOT EXISTS ${loopsnapshot})
+	message(FATAL_ERROR "No snapshot was written to ${loopsnapshot}")
+endif ()
+execute_process(COMMAND ${CFUNGE} -r ${loopsnapshot} ${loop}
+                WORKING_DIRECTORY ${WORK_DIR} TIMEOUT 1
+                OUTPUT_QUIET ERROR_VARIABLE error)
+if (error MATCHES "Failed to restore")
+	message(FATAL_ERROR "Restoring ${loopsnapshot} failed:\n${error}")
+endif ()
+
+# -C needs -c, and a number of seconds.
+execute_process(COMMAND ${CFUNGE} -C 1 ${program}
+                WORKING_DIRECTORY ${WORK_DIR} TIMEOUT 10
+                RESULT_VARIABLE result OUTPUT_QUIET ERROR_VARIABLE error)
+if (result EQUAL 0 OR NOT error MATCHES "needs a snapshot file")
+	message(FATAL_ERROR "-C without -c gave ${result}:\n${error}")
+endif ()
+foreach (interval abc 0 -5 1x 99999999999999999999)
+	execute_process(COMMAND ${CFUNGE} -c ${snapshot} -C ${interval} ${program}
+	                WORKING_DIRECTORY ${WORK_DIR} TIMEOUT 10
+	                RESULT_VARIABLE result OUTPUT_QUIET ERROR_VARIABLE error)
+	if (result EQUAL 0 OR NOT error MATCHES "is not valid for -C")
+		message(FATAL_ERROR "-C ${interval} gave ${result}:\n${error}")
+	endif ()
+endforeach ()
@@ -63,6 +63,10 @@ def main():
                         nargs='?',
                         default=None,
                         help='Path to program filtering output.')
+    parser.add_argument('--cfunge-arg',
+                        action='append',
+                        default=[],
+                        help='Extra option to pass to cfunge (can be repeated)')
     parser.add_argument('--exit-code',
                         default=0,
                         type=int,
@@ -75,8 +79,8 @@ def main():
     output = b''
     try:
         output = subprocess.check_output([args.cfunge_path,
-                                          '-s', _SUFFIX_MAP[test_extension],
-                                          test],
+                                          '-s', _SUFFIX_MAP[test_extension]]
+                                         + args.cfunge_arg + [test],
                                          env={'TEST_ENV': 'test'})
     except subprocess.CalledProcessError as e:
         ret_code = e.returncode
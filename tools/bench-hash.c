@@ -0,0 +1,241 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmark for the Funge-Space hash tables. Built twice, as
+ * bench-hash-chained and bench-hash-open (with CFUN_OPEN_HASH), use
+ * "make bench-hash" to build and run both.
+ *
+ * The access patterns are modelled on funge-space.c: tile keys are the top
+ * left corners of 32x32 tiles, count keys are single rows or columns.
+ *
+ * Usage: bench-hash [number of keys] [rounds]
+ */
+
+#include "../lib/libghthash/ght_hash_table.h"
+#include "../src/diagnostic.h"
+#ifndef CFUN_OPEN_HASH
+#  define CFUNGE_MEMPOOL_HASHLIB
+#  include "../lib/mempool/cfunge_mempool.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+
+// Not used, only needed to link diagnostic.c.
+bool setting_enable_warnings = false;
+bool setting_enable_errors = true;
+
+/// Seconds since some point in the past.
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+/// xorshift64, good enough to pick keys.
+static uint64_t rng_state = UINT64_C(88172645463325252);
+static uint64_t rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+static void report(const char *name, double start, size_t ops)
+{
+	double t = now() - start;
+	printf("%-22s %8.2f ns/op\n", name, t * 1e9 / (double)ops);
+}
+
+/// Used to keep the compiler from optimising lookups away.
+static volatile uintptr_t sink;
+
+static void bench_tiles(size_t n, size_t rounds)
+{
+	ght_fspace_hash_table_t *table = ght_fspace_create(0x1000);
+	ght_fspace_iterator_t iterator;
+	const funge_vector *p_key;
+	funge_vector *keys = malloc(n * sizeof(funge_vector));
+	size_t side = 1;
+	uintptr_t acc = 0;
+	double start;
+
+	if (!table || !keys)
+		DIAG_OOM("Out of memory");
+	ght_fspace_set_rehash(table, true);
+	while (side * side < n)
+		side++;
+	// A square of tiles around 0,0, like a program spreading out.
+	for (size_t i = 0; i < n; i++) {
+		keys[i].x = ((funge_cell)(i % side) - (funge_cell)side / 2) * 32;
+		keys[i].y = ((funge_cell)(i / side) - (funge_cell)side / 2) * 32;
+	}
+
+	start = now();
+	for (size_t i = 0; i < n; i++)
+		if (ght_fspace_insert(table, (fungeSpaceTile *)(keys + i), keys + i) != 0)
+			DIAG_FATAL_LOC("Insert failed");
+	report("tile insert", start, n);
+
+	// Neighbouring tiles, like an IP walking across them.
+	start = now();
+	for (size_t r = 0; r < rounds; r++)
+		for (size_t i = 0; i < n; i++)
+			acc += (uintptr_t)(void *)*ght_fspace_get(table, keys + i);
+	report("tile get, sequential", start, n * rounds);
+
+	start = now();
+	for (size_t r = 0; r < rounds; r++)
+		for (size_t i = 0; i < n; i++)
+			acc += (uintptr_t)(void *)*ght_fspace_get(table, keys + rng() % n);
+	report("tile get, random", start, n * rounds);
+
+	// Empty space, only one tile in four exists there.
+	start = now();
+	for (size_t r = 0; r < rounds; r++)
+		for (size_t i = 0; i < n; i++) {
+			funge_vector key = { keys[i].x + (funge_cell)side * 32, keys[i].y + 16 * 32 };
+			fungeSpaceTile **tile = ght_fspace_get(table, &key);
+			acc += tile != NULL;
+		}
+	report("tile get, mostly miss", start, n * rounds);
+
+	start = now();
+	for (size_t r = 0; r < rounds; r++)
+		for (void *p = ght_fspace_first(table, &iterator, &p_key); p;
+		     p = ght_fspace_next(&iterator, &p_key))
+			acc += (uintptr_t)p_key->x;
+	report("tile iterate", start, n * rounds);
+
+	start = now();
+	for (size_t i = 0; i < n; i++) {
+		fungeSpaceTile *tile = ght_fspace_remove(table, keys + i);
+		acc += tile != NULL;
+	}
+	report("tile remove", start, n);
+
+	sink = acc;
+	ght_fspace_finalize(table);
+	free(keys);
+}
+
+#ifdef CFUN_EXACT_BOUNDS
+/// Same as FSPACE_COUNT_OP_OR_NEW in funge-space.c.
+static void count_op(ght_fspacecount_hash_table_t *table, funge_cell key, bool isset)
+{
+	funge_unsigned_cell *count = ght_fspacecount_get(table, &key);
+	if (count) {
+		if (isset)
+			(*count)++;
+		else
+			(*count)--;
+		if (*count == 0)
+			ght_fspacecount_remove(table, &key);
+	} else if (ght_fspacecount_insert(table, 1, &key) == -1) {
+		DIAG_FATAL_LOC("Insert failed");
+	}
+}
+
+static void bench_counts(size_t n, size_t rounds)
+{
+	ght_fspacecount_hash_table_t *table = ght_fspacecount_create(0x20000);
+	double start, worst;
+
+	if (!table)
+		DIAG_OOM("Out of memory");
+	ght_fspacecount_set_rehash(table, true);
+
+	// Put into a range of rows, then clear them again, so entries come and go.
+	start = now();
+	for (size_t r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < n; i++)
+			count_op(table, (funge_cell)(i + r * n / 4), true);
+		for (size_t i = 0; i < n; i++)
+			count_op(table, (funge_cell)(i + r * n / 4), false);
+	}
+	report("count set/clear", start, 2 * n * rounds);
+
+	// Many cells in a few hundred rows, the common case.
+	start = now();
+	for (size_t r = 0; r < rounds; r++)
+		for (size_t i = 0; i < n; i++)
+			count_op(table, (funge_cell)(rng() % 512) - 256, true);
+	report("count set, few keys", start, n * rounds);
+
+	sink = ght_size(table);
+	ght_fspacecount_finalize(table);
+
+	// Lots of new rows, the table has to grow a few times. Report the
+	// slowest single operation, that is where rehashing shows up.
+	table = ght_fspacecount_create(0x20000);
+	if (!table)
+		DIAG_OOM("Out of memory");
+	ght_fspacecount_set_rehash(table, true);
+	worst = 0;
+	for (size_t i = 0; i < 16 * n; i++) {
+		double t = now();
+		count_op(table, (funge_cell)i, true);
+		t = now() - t;
+		if (t > worst)
+			worst = t;
+	}
+	printf("%-22s %8.2f us\n", "count insert, worst", worst * 1e6);
+
+	sink = ght_size(table);
+	ght_fspacecount_finalize(table);
+}
+#endif
+
+int main(int argc, char *argv[])
+{
+	size_t n = 1 << 16, rounds = 20;
+
+	if (argc > 1)
+		n = strtoul(argv[1], NULL, 10);
+	if (argc > 2)
+		rounds = strtoul(argv[2], NULL, 10);
+	if (n == 0 || rounds == 0) {
+		fprintf(stderr, "Usage: %s [number of keys] [rounds]\n", argv[0]);
+		return 1;
+	}
+
+#ifdef CFUN_OPEN_HASH
+	puts("Open addressing hash tables:");
+#else
+	puts("Chained hash tables:");
+	if (!cf_mempool_fspace_setup())
+		DIAG_OOM("Out of memory");
+#  ifdef CFUN_EXACT_BOUNDS
+	if (!cf_mempool_fspacecount_setup())
+		DIAG_OOM("Out of memory");
+#  endif
+#endif
+
+	bench_tiles(n, rounds);
+#ifdef CFUN_EXACT_BOUNDS
+	bench_counts(n, rounds);
+#endif
+	return 0;
+}
@@ -0,0 +1,158 @@
+#!/usr/bin/python3
+"""Compare how fast cfunge binaries traverse Funge-Space in different directions.
+
+Meant for comparing builds with different static array layouts, for example:
+
+  cmake -DTILED_STATIC=OFF ... && make && cp cfunge /tmp/cfunge-rows
+  cmake -DTILED_STATIC=ON ... && make && cp cfunge /tmp/cfunge-tiled
+  tools/bench-layout.py /tmp/cfunge-rows /tmp/cfunge-tiled
+
+Two kinds of programs are generated:
+ * g-/p- programs read and write every cell of a SIZE x SIZE area with g and p,
+   walking it row by row, column by column or along diagonals.
+ * ip- programs make the IP itself walk long horizontal or vertical lines of
+   no-op instructions.
+"""
+
+import argparse
+import os
+import os.path
+import subprocess
+import sys
+import tempfile
+import time
+
+# Moving the IP is much cheaper than g and p, walk the area more times with it.
+IP_PASSES = 32
+
+
+def num(n):
+    """Befunge code pushing the non-negative number n"""
+    if n < 16:
+        return '0123456789abcdef'[n]
+    for d in range(15, 1, -1):
+        if n % d == 0 and n // d > 1:
+            return num(n // d) + num(d) + '*'
+    return num(n - 1) + '1+'
+
+
+# Turn i on top of the stack into x y of the cell to access. Data is at y >= 4,
+# below the program.
+_WALKS = {
+    'horizontal': ':N%\\N/N%4+',
+    'vertical': ':N/N%\\N%4+',
+    'diagonal': ':N%:02p\\N/+N%4+02g\\',
+}
+
+
+def gp_program(walk, size, passes):
+    """Program incrementing every cell of the area passes times with g and p"""
+    xy = _WALKS[walk].replace('N', num(size))
+    # The counter starts as the 0 popped from the empty stack, j goes back to
+    # the start of the line.
+    row0 = ':01p' + xy + 'g1+01g' + xy + 'p01g1+:' + num(passes * size * size) + '-!#@_'
+    # j ends up k + 2 cells after the current end (k being the length of the
+    # number to jump back). It moves one step and then jumps, that step must
+    # not wrap, hence the z after it.
+    k = 1
+    while len(num(len(row0) + k + 3)) > k:
+        k += 1
+    row0 += '0' + num(len(row0) + k + 3).rjust(k, 'z') + '-jz'
+    return row0 + '\n', passes * size * size
+
+
+def ip_program(walk, size, passes):
+    """Program making the IP snake through a size x size area of z instructions"""
+    # The counter code runs down from the top left, then the IP walks the
+    # area column by column (vertical) or row by row (horizontal), and goes
+    # back to the top along a column to the right of it.
+    top, height = 8, size - 1 if walk == 'horizontal' else size
+    count = num(max(1, passes * size * size // height // size))
+    c0 = len(count)
+    left = c0 + 1
+    width = size + 1
+    grid = [[' '] * (left + width) for _ in range(top + height)]
+    grid[0][0:c0 + 1] = list(count + 'v')
+    for y, c in enumerate('1-:!#@|', start=1):
+        grid[y][c0] = c
+    grid[top][c0] = '>'
+    for y in range(top, top + height):
+        grid[y][left:left + size] = ['z'] * size
+    if walk == 'vertical':
+        # size is even, so the last column is walked north.
+        for x in range(left, left + size, 2):
+            grid[top][x] = 'v'
+            grid[top + height - 1][x] = '>'
+            grid[top + height - 1][x + 1] = '^'
+            if x + 2 < left + size:
+                grid[top][x + 1] = '>'
+        back = left + size - 1
+    else:
+        # height is odd, so the last row is walked east.
+        for y in range(top, top + height - 1, 2):
+            grid[y][left + size - 1] = 'v'
+            grid[y + 1][left + size - 1] = '<'
+            grid[y + 1][left] = 'v'
+            grid[y + 2][left] = '>'
+        grid[top + height - 1][left + size] = '^'
+        back = left + size
+    for y in range(1, top + height - 1):
+        if grid[y][back] == ' ':
+            grid[y][back] = 'z'
+    grid[0][c0 + 1:back] = ['z'] * (back - c0 - 1)
+    grid[0][back] = '<'
+    turns = passes * size * size // height // size
+    return '\n'.join(''.join(row).rstrip() for row in grid) + '\n', max(1, turns) * height * size
+
+
+def run(cfunge, path, args):
+    """Run cfunge on path, return seconds taken"""
+    start = time.perf_counter()
+    subprocess.run([cfunge] + args + [path], check=True,
+                   stdout=subprocess.DEVNULL)
+    return time.perf_counter() - start
+
+
+def main():
+    """Main function"""
+    parser = argparse.ArgumentParser(description='Funge-Space traversal benchmark for cfunge')
+    parser.add_argument('cfunge_path', nargs='+',
+                        help='Path to cfunge binaries to compare')
+    parser.add_argument('-n', '--size', type=int, default=1024,
+                        help='Width and height of the area to walk, multiple of 64 (default: %(default)s)')
+    parser.add_argument('-p', '--passes', type=int, default=1,
+                        help='Number of times to walk the area with g and p, the IP walks '
+                             'it %d times as often (default: %%(default)s)' % IP_PASSES)
+    parser.add_argument('-r', '--repeat', type=int, default=3,
+                        help='Runs of each program, the fastest counts (default: %(default)s)')
+    args = parser.parse_args()
+    if args.size < 64 or args.size % 64:
+        parser.error('size must be a multiple of 64')
+
+    # The g/p area isn't part of the program, so the static array has to be
+    # made large enough to hold it (it starts 64 cells up and left of 0,0).
+    static = '%dx%d' % (args.size + 128, args.size + 128)
+    benchmarks = []
+    for walk in ('horizontal', 'vertical', 'diagonal'):
+        benchmarks.append(('gp-' + walk, gp_program(walk, args.size, args.passes), ['-w', static]))
+    for walk in ('horizontal', 'vertical'):
+        benchmarks.append(('ip-' + walk, ip_program(walk, args.size, args.passes * IP_PASSES), []))
+
+    with tempfile.TemporaryDirectory() as tmpdir:
+        print('%-14s' % 'benchmark' + ''.join(' %22s' % c[-22:]
+                                               for c in args.cfunge_path))
+        for name, (program, cells), extra in benchmarks:
+            path = os.path.join(tmpdir, name + '.b98')
+            with open(path, 'w') as f:
+                f.write(program)
+            line = '%-14s' % name
+            for cfunge in args.cfunge_path:
+                best = min(run(cfunge, path, extra) for _ in range(args.repeat))
+                line += ' %7.3f s %7.1f Mc/s' % (best, cells / best / 1e6)
+            print(line)
+            sys.stdout.flush()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
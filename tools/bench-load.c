@@ -0,0 +1,165 @@
+/* -*- mode: C; coding: utf-8; tab-width: 4; indent-tabs-mode: t; c-basic-offset: 4 -*-
+ *
+ * cfunge - A standard-conforming Befunge93/98/109 interpreter in C.
+ * Copyright (C) 2008-2013 Arvid Norlander <VorpalBlade AT users.noreply.github.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at the proxy's option) any later version. Arvid Norlander is a
+ * proxy who can decide which future versions of the GNU General Public
+ * License can be used.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Benchmark for loading programs into Funge-Space, reports MB/s for the
+ * initial load (fungespace_load_string()) and for loading a file on top of
+ * a program like the i instruction does (fungespace_load_at_offset()). Built
+ * as bench-loader, use "make bench-load" to build and run it.
+ *
+ * The test programs are rows of random instructions, with a given share of
+ * spaces between them, like large generated programs tend to be.
+ *
+ * Usage: bench-loader [width] [height] [rounds]
+ */
+
+#include "../src/global.h"
+#include "../src/funge-space/funge-space.h"
+#include "../src/diagnostic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/// Seconds since some point in the past.
+static double now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+/// xorshift64, good enough to pick characters.
+static uint64_t rng_state = UINT64_C(88172645463325252);
+static uint64_t rng(void)
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+/**
+ * Make a program of width x height cells, spaces percent of them spaces.
+ * Spaces come in runs of 1 to 8, as between the parts of generated code.
+ */
+static unsigned char *make_program(size_t width, size_t height,
+                                   unsigned int spaces, size_t *length)
+{
+	static const char code[] = "0123456789+-*/%!`><^v?_|\":\\$.,#gp&~@abcdef;jkxyz{}[]'";
+	unsigned char *program = malloc((width + 1) * height);
+	unsigned char *p = program;
+
+	if (!program)
+		DIAG_OOM("Out of memory");
+	for (size_t y = 0; y < height; y++) {
+		size_t x = 0;
+		while (x < width) {
+			if (rng() % 100 < spaces) {
+				size_t run = 1 + rng() % 8;
+				for (size_t i = 0; i < run && x < width; i++, x++)
+					*p++ = ' ';
+			} else {
+				*p++ = (unsigned char)code[rng() % (sizeof(code) - 1)];
+				x++;
+			}
+		}
+		*p++ = '\n';
+	}
+	*length = (size_t)(p - program);
+	return program;
+}
+
+static void report(const char *name, double start, size_t bytes, size_t rounds)
+{
+	double t = now() - start;
+	printf("%-28s %8.1f MB/s\n", name, (double)bytes * (double)rounds / t / 1e6);
+}
+
+static void bench(const char *name, size_t width, size_t height,
+                  unsigned int spaces, size_t rounds)
+{
+	char label[64];
+	char filename[] = "/tmp/bench-load.XXXXXX";
+	size_t length;
+	unsigned char *program = make_program(width, height, spaces, &length);
+	funge_vector offset = { 3, 5 }, size;
+	double start;
+	int fd;
+
+	snprintf(label, sizeof(label), "%s, initial load", name);
+	start = now();
+	for (size_t r = 0; r < rounds; r++) {
+		if (!fungespace_create())
+			DIAG_OOM("Out of memory");
+		fungespace_load_string(program, length);
+		fungespace_free();
+	}
+	report(label, start, length, rounds);
+
+	fd = mkstemp(filename);
+	if (fd == -1 || write(fd, program, length) != (ssize_t)length)
+		DIAG_FATAL_LOC("Could not write temporary file");
+	close(fd);
+	if (!fungespace_create())
+		DIAG_OOM("Out of memory");
+	fungespace_load_string(program, length);
+
+	snprintf(label, sizeof(label), "%s, i", name);
+	start = now();
+	for (size_t r = 0; r < rounds; r++)
+		if (!fungespace_load_at_offset(filename, &offset, &size, false))
+			DIAG_FATAL_LOC("Could not load temporary file");
+	report(label, start, length, rounds);
+
+	snprintf(label, sizeof(label), "%s, binary i", name);
+	start = now();
+	for (size_t r = 0; r < rounds; r++)
+		if (!fungespace_load_at_offset(filename, &offset, &size, true))
+			DIAG_FATAL_LOC("Could not load temporary file");
+	report(label, start, length, rounds);
+
+	fungespace_free();
+	unlink(filename);
+	free(program);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t width = 2000, height = 2000, rounds = 5;
+
+	if (argc > 1)
+		width = strtoul(argv[1], NULL, 10);
+	if (argc > 2)
+		height = strtoul(argv[2], NULL, 10);
+	if (argc > 3)
+		rounds = strtoul(argv[3], NULL, 10);
+	if (width == 0 || height == 0 || rounds == 0) {
+		fprintf(stderr, "Usage: %s [width] [height] [rounds]\n", argv[0]);
+		return 1;
+	}
+
+	bench("dense code", width, height, 10, rounds);
+	bench("sparse code", width, height, 60, rounds);
+	return 0;
+}